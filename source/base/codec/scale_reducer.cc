@@ -29,10 +29,12 @@ ScaleReducer::ScaleReducer() = default;
 
 ScaleReducer::~ScaleReducer() = default;
 
-const Frame* ScaleReducer::scaleFrame(const Frame* source_frame, const Size& target_size)
+const Frame* ScaleReducer::scaleFrame(const Frame* source_frame,
+                                      const Region& extra_region,
+                                      const Size& target_size)
 {
     DCHECK(source_frame);
-    DCHECK(!source_frame->constUpdatedRegion().isEmpty());
+    DCHECK(!source_frame->constUpdatedRegion().isEmpty() || !extra_region.isEmpty());
 
     const Size& source_size = source_frame->size();
 
@@ -78,31 +80,13 @@ const Frame* ScaleReducer::scaleFrame(const Frame* source_frame, const Size& tar
     }
     else
     {
-        Region* updated_region = target_frame_->updatedRegion();
-        updated_region->clear();
-
-        for (Region::Iterator it(source_frame->constUpdatedRegion());
-             !it.isAtEnd(); it.advance())
-        {
-            Rect target_rect = scaledRect(it.rect());
-            target_rect.intersectWith(target_frame_rect);
-
-            libyuv::ARGBScaleClip(source_frame->frameData(),
-                                  source_frame->stride(),
-                                  source_size.width(),
-                                  source_size.height(),
-                                  target_frame_->frameData(),
-                                  target_frame_->stride(),
-                                  target_size.width(),
-                                  target_size.height(),
-                                  target_rect.x(),
-                                  target_rect.y(),
-                                  target_rect.width(),
-                                  target_rect.height(),
-                                  libyuv::kFilterBox);
-
-            updated_region->addRect(target_rect);
-        }
+        target_frame_->updatedRegion()->clear();
+
+        for (Region::Iterator it(source_frame->constUpdatedRegion()); !it.isAtEnd(); it.advance())
+            scaleRect(source_frame, it.rect());
+
+        for (Region::Iterator it(extra_region); !it.isAtEnd(); it.advance())
+            scaleRect(source_frame, it.rect());
     }
 
     return target_frame_.get();
@@ -122,4 +106,26 @@ Rect ScaleReducer::scaledRect(const Rect& source_rect)
     return Rect::makeLTRB(left - 1, top - 1, right + 2, bottom + 2);
 }
 
+void ScaleReducer::scaleRect(const Frame* source_frame, const Rect& source_rect)
+{
+    Rect target_rect = scaledRect(source_rect);
+    target_rect.intersectWith(Rect::makeSize(target_size_));
+
+    libyuv::ARGBScaleClip(source_frame->frameData(),
+                          source_frame->stride(),
+                          source_size_.width(),
+                          source_size_.height(),
+                          target_frame_->frameData(),
+                          target_frame_->stride(),
+                          target_size_.width(),
+                          target_size_.height(),
+                          target_rect.x(),
+                          target_rect.y(),
+                          target_rect.width(),
+                          target_rect.height(),
+                          libyuv::kFilterBox);
+
+    target_frame_->updatedRegion()->addRect(target_rect);
+}
+
 } // namespace base
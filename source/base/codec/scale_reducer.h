@@ -21,6 +21,7 @@
 
 #include "base/macros_magic.h"
 #include "base/desktop/geometry.h"
+#include "base/desktop/region.h"
 
 #include <memory>
 
@@ -34,13 +35,18 @@ public:
     ScaleReducer();
     ~ScaleReducer();
 
-    const Frame* scaleFrame(const Frame* source_frame, const Size& target_size);
+    // Scales the updated region of |source_frame| and |extra_region|. If the frame is not scaled,
+    // then |source_frame| is returned and |extra_region| is not included into its updated region.
+    const Frame* scaleFrame(const Frame* source_frame,
+                            const Region& extra_region,
+                            const Size& target_size);
 
     double scaleFactorX() const { return scale_x_; }
     double scaleFactorY() const { return scale_y_; }
 
 private:
     Rect scaledRect(const Rect& source_rect);
+    void scaleRect(const Frame* source_frame, const Rect& source_rect);
 
     std::unique_ptr<Frame> target_frame_;
     Size source_size_;
@@ -32,14 +32,15 @@ void VideoEncoder::fillPacketInfo(const Frame* frame, proto::VideoPacket* packet
 {
     packet->set_encoding(encoding_);
 
-    if (last_size_ != frame->size())
-    {
-        last_size_ = frame->size();
-
-        proto::Rect* rect = packet->mutable_format()->mutable_video_rect();
-        rect->set_width(last_size_.width());
-        rect->set_height(last_size_.height());
-    }
+    if (last_size_ == frame->size() && !key_frame_requested_)
+        return;
+
+    last_size_ = frame->size();
+    key_frame_requested_ = false;
+
+    proto::Rect* rect = packet->mutable_format()->mutable_video_rect();
+    rect->set_width(last_size_.width());
+    rect->set_height(last_size_.height());
 }
 
 } // namespace base
@@ -20,6 +20,7 @@
 #define BASE__CODEC__VIDEO_ENCODER_H
 
 #include "base/desktop/geometry.h"
+#include "base/desktop/region.h"
 #include "proto/desktop.pb.h"
 
 namespace base {
@@ -32,16 +33,28 @@ public:
     explicit VideoEncoder(proto::VideoEncoding encoding);
     virtual ~VideoEncoder() = default;
 
-    virtual void encode(const Frame* frame, proto::VideoPacket* packet) = 0;
+    // Encodes the updated region of |frame| and |extra_region| (for example, the areas changed in
+    // the frames that were not encoded).
+    virtual void encode(const Frame* frame,
+                        const Region& extra_region,
+                        proto::VideoPacket* packet) = 0;
+
+    // Sets the bitrate in kbps that the encoded stream should not exceed. Encoders without rate
+    // control ignore it.
+    virtual void setTargetBitrate(uint32_t /* bitrate */) {}
 
     proto::VideoEncoding encoding() const { return encoding_; }
 
+    // The next packet contains the format of the video and is encoded as a key frame.
+    void requestKeyFrame() { key_frame_requested_ = true; }
+
 protected:
     void fillPacketInfo(const Frame* frame, proto::VideoPacket* packet);
 
 private:
     const proto::VideoEncoding encoding_;
     Size last_size_;
+    bool key_frame_requested_ = false;
 };
 
 } // namespace base
@@ -24,14 +24,47 @@
 #include <libyuv/convert.h>
 #include <libyuv/cpu_id.h>
 
+#include <algorithm>
+#include <limits>
 #include <thread>
 
 namespace base {
 
 namespace {
 
+// Duration of the first frame. Durations of the next frames are measured.
 const std::chrono::milliseconds kTargetFrameInterval{ 80 };
 
+// Limits of the measured frame duration. Frames are not encoded while the screen does not change.
+// Without the upper limit, the first frame after a pause would get the bits of the whole pause.
+const std::chrono::milliseconds kMinFrameInterval{ 5 };
+const std::chrono::milliseconds kMaxFrameInterval{ 200 };
+
+// The bitrate is used until the bandwidth is estimated.
+const uint32_t kDefaultTargetBitrate = 1000; // kbps
+
+// Changes of the target bitrate smaller than 1/20 do not reconfigure the codec.
+const uint32_t kBitrateChangeThreshold = 20;
+
+// Quantizer ranges for the number of kbps per megapixel of the video. With a low bitrate the
+// quantizer may be raised, so that the codec can meet the target bitrate. With a high bitrate the
+// upper limit is lowered, so that the quality is not sacrificed when the channel allows it.
+struct QuantizerRange
+{
+    uint32_t max_bitrate_per_megapixel;
+    unsigned int min_quantizer;
+    unsigned int max_quantizer;
+};
+
+const QuantizerRange kQuantizerRanges[] =
+{
+    { 300, 30, 56 },
+    { 800, 20, 40 },
+    { 2000, 20, 30 },
+    { 5000, 10, 24 },
+    { std::numeric_limits<uint32_t>::max(), 4, 20 }
+};
+
 // Defines the dimension of a macro block. This is used to compute the active map for the encoder.
 const int kMacroBlockSize = 16;
 
@@ -125,6 +158,24 @@ void createImage(const Size& size,
     *out_image_buffer = std::move(image_buffer);
 }
 
+void setRateControlParameters(vpx_codec_enc_cfg_t* config, uint32_t bitrate)
+{
+    const uint64_t pixels = std::max<uint64_t>(static_cast<uint64_t>(config->g_w) * config->g_h, 1);
+    const uint64_t bitrate_per_megapixel = static_cast<uint64_t>(bitrate) * 1000000 / pixels;
+
+    for (const auto& range : kQuantizerRanges)
+    {
+        if (bitrate_per_megapixel < range.max_bitrate_per_megapixel)
+        {
+            config->rc_min_quantizer = range.min_quantizer;
+            config->rc_max_quantizer = range.max_quantizer;
+            break;
+        }
+    }
+
+    config->rc_target_bitrate = bitrate;
+}
+
 int roundToTwosMultiple(int x)
 {
     return x & (~1);
@@ -155,22 +206,28 @@ std::unique_ptr<VideoEncoderVPX> VideoEncoderVPX::createVP9()
 }
 
 VideoEncoderVPX::VideoEncoderVPX(proto::VideoEncoding encoding)
-    : VideoEncoder(encoding)
+    : VideoEncoder(encoding),
+      target_bitrate_(kDefaultTargetBitrate)
 {
     memset(&config_, 0, sizeof(config_));
     memset(&active_map_, 0, sizeof(active_map_));
 }
 
-void VideoEncoderVPX::encode(const Frame* frame, proto::VideoPacket* packet)
+void VideoEncoderVPX::encode(const Frame* frame,
+                             const Region& extra_region,
+                             proto::VideoPacket* packet)
 {
     fillPacketInfo(frame, packet);
 
     bool is_key_frame = false;
+    vpx_enc_frame_flags_t flags = 0;
+    std::chrono::microseconds frame_duration = kTargetFrameInterval;
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
 
-    if (packet->has_format())
-    {
-        const Size& frame_size = frame->size();
+    const Size& frame_size = frame->size();
 
+    if (!codec_ || codec_size_ != frame_size)
+    {
         createImage(frame_size, &image_, &image_buffer_);
         createActiveMap(frame_size);
 
@@ -184,24 +241,44 @@ void VideoEncoderVPX::encode(const Frame* frame, proto::VideoPacket* packet)
             createVp9Codec(frame_size);
         }
 
+        codec_size_ = frame_size;
         is_key_frame = true;
+        pts_ = 0;
+    }
+    else
+    {
+        if (packet->has_format())
+        {
+            // The key frame is requested for the same size. The codec keeps its state and rate
+            // control, only the next frame is encoded as a key frame.
+            flags |= VPX_EFLAG_FORCE_KF;
+            is_key_frame = true;
+        }
+
+        frame_duration = std::clamp(
+            std::chrono::duration_cast<std::chrono::microseconds>(now - last_encode_time_),
+            std::chrono::microseconds(kMinFrameInterval),
+            std::chrono::microseconds(kMaxFrameInterval));
+        pts_ += frame_duration.count();
     }
 
+    last_encode_time_ = now;
+
     // Convert the updated capture data ready for encode.
     // Update active map based on updated region.
-    prepareImageAndActiveMap(is_key_frame, frame, packet);
+    prepareImageAndActiveMap(is_key_frame, frame, extra_region, packet);
 
     // Apply active map to the encoder.
     vpx_codec_err_t ret = vpx_codec_control(codec_.get(), VP8E_SET_ACTIVEMAP, &active_map_);
     DCHECK_EQ(ret, VPX_CODEC_OK);
 
-    // Do the actual encoding.
+    // Do the actual encoding. The duration of the frame is not known yet, the interval since the
+    // previous frame is used instead.
     ret = vpx_codec_encode(codec_.get(),
                            image_.get(),
-                           0, // pts
-                           static_cast<unsigned long>(
-                               std::chrono::microseconds(kTargetFrameInterval).count()),
-                           0, // flags
+                           pts_,
+                           static_cast<unsigned long>(frame_duration.count()),
+                           flags,
                            VPX_DL_REALTIME);
     DCHECK_EQ(ret, VPX_CODEC_OK);
 
@@ -222,6 +299,27 @@ void VideoEncoderVPX::encode(const Frame* frame, proto::VideoPacket* packet)
     }
 }
 
+void VideoEncoderVPX::setTargetBitrate(uint32_t bitrate)
+{
+    target_bitrate_ = bitrate;
+
+    // The bitrate is applied when the codec is created.
+    if (!codec_)
+        return;
+
+    const uint32_t current_bitrate = config_.rc_target_bitrate;
+    const uint32_t difference = (bitrate > current_bitrate) ?
+        bitrate - current_bitrate : current_bitrate - bitrate;
+
+    if (difference * kBitrateChangeThreshold < current_bitrate)
+        return;
+
+    setRateControlParameters(&config_, bitrate);
+
+    vpx_codec_err_t ret = vpx_codec_enc_config_set(codec_.get(), &config_);
+    DCHECK_EQ(ret, VPX_CODEC_OK);
+}
+
 void VideoEncoderVPX::createActiveMap(const Size& size)
 {
     active_map_.cols = (size.width() + kMacroBlockSize - 1) / kMacroBlockSize;
@@ -249,14 +347,9 @@ void VideoEncoderVPX::createVp8Codec(const Size& size)
     // explicitly select real time mode when doing encoding.
     config_.g_profile = 2;
 
-    // To enable remoting to be highly interactive and allow the target bitrate to be met, we relax
-    // the max quantizer. The quality will get topped-off in subsequent frames.
-    config_.rc_min_quantizer = 20;
-    config_.rc_max_quantizer = 30;
-
-    // In the absence of a good bandwidth estimator set the target bitrate to a
-    // conservative default.
-    config_.rc_target_bitrate = 1000;
+    // To enable remoting to be highly interactive and allow the target bitrate to be met, the
+    // quantizer range depends on the bitrate. The quality will get topped-off in subsequent frames.
+    setRateControlParameters(&config_, target_bitrate_);
 
     ret = vpx_codec_enc_init(codec_.get(), algo, &config_, 0);
     DCHECK_EQ(VPX_CODEC_OK, ret);
@@ -288,12 +381,7 @@ void VideoEncoderVPX::createVp9Codec(const Size& size)
 
     // Configure VP9 for I420 source frames.
     config_.g_profile = kVp9I420ProfileNumber;
-    config_.rc_min_quantizer = 20;
-    config_.rc_max_quantizer = 30;
-
-    // In the absence of a good bandwidth estimator set the target bitrate to a
-    // conservative default.
-    config_.rc_target_bitrate = 1000;
+    setRateControlParameters(&config_, target_bitrate_);
 
     ret = vpx_codec_enc_init(codec_.get(), algo, &config_, 0);
     DCHECK_EQ(VPX_CODEC_OK, ret);
@@ -316,8 +404,10 @@ void VideoEncoderVPX::createVp9Codec(const Size& size)
     DCHECK_EQ(VPX_CODEC_OK, ret);
 }
 
-void VideoEncoderVPX::prepareImageAndActiveMap(
-    bool is_key_frame, const Frame* frame, proto::VideoPacket* packet)
+void VideoEncoderVPX::prepareImageAndActiveMap(bool is_key_frame,
+                                               const Frame* frame,
+                                               const Region& extra_region,
+                                               proto::VideoPacket* packet)
 {
     Rect image_rect = Rect::makeWH(image_->w, image_->h);
     Region updated_region;
@@ -326,10 +416,8 @@ void VideoEncoderVPX::prepareImageAndActiveMap(
     {
         const int padding = ((encoding() == proto::VIDEO_ENCODING_VP9) ? 8 : 3);
 
-        for (Region::Iterator it(frame->constUpdatedRegion()); !it.isAtEnd(); it.advance())
+        auto add_padded_rect = [&](const Rect& rect)
         {
-            Rect rect = it.rect();
-
             // Pad each rectangle to avoid the block-artefact filters in libvpx from introducing
             // artefacts; VP9 includes up to 8px either side, and VP8 up to 3px, so unchanged
             // pixels up to that far out may still be affected by the changes in the updated
@@ -340,7 +428,13 @@ void VideoEncoderVPX::prepareImageAndActiveMap(
                 alignRect(Rect::makeLTRB(
                     rect.left() - padding, rect.top() - padding,
                     rect.right() + padding, rect.bottom() + padding)));
-        }
+        };
+
+        for (Region::Iterator it(frame->constUpdatedRegion()); !it.isAtEnd(); it.advance())
+            add_padded_rect(it.rect());
+
+        for (Region::Iterator it(extra_region); !it.isAtEnd(); it.advance())
+            add_padded_rect(it.rect());
 
         // Clip back to the screen dimensions, in case they're not macroblock aligned.
         // The conversion routines don't require even width & height, so this is safe even if the
@@ -29,6 +29,8 @@
 #include <vpx/vpx_encoder.h>
 #include <vpx/vp8cx.h>
 
+#include <chrono>
+
 namespace base {
 
 class VideoEncoderVPX : public VideoEncoder
@@ -39,7 +41,10 @@ public:
     static std::unique_ptr<VideoEncoderVPX> createVP8();
     static std::unique_ptr<VideoEncoderVPX> createVP9();
 
-    void encode(const Frame* frame, proto::VideoPacket* packet) override;
+    void encode(const Frame* frame,
+                const Region& extra_region,
+                proto::VideoPacket* packet) override;
+    void setTargetBitrate(uint32_t bitrate) override;
 
 private:
     explicit VideoEncoderVPX(proto::VideoEncoding encoding);
@@ -47,12 +52,24 @@ private:
     void createActiveMap(const Size& size);
     void createVp8Codec(const Size& size);
     void createVp9Codec(const Size& size);
-    void prepareImageAndActiveMap(bool is_key_frame, const Frame* frame, proto::VideoPacket* packet);
+    void prepareImageAndActiveMap(bool is_key_frame,
+                                  const Frame* frame,
+                                  const Region& extra_region,
+                                  proto::VideoPacket* packet);
     void addRectToActiveMap(const Rect& rect);
     void clearActiveMap();
 
     vpx_codec_enc_cfg_t config_;
     ScopedVpxCodec codec_;
+    Size codec_size_;
+
+    // Target bitrate in kbps.
+    uint32_t target_bitrate_;
+
+    // Timestamp of the last encoded frame in the time base of the codec. Rate control of the
+    // codec distributes the bitrate between frames according to their durations.
+    int64_t pts_ = 0;
+    std::chrono::steady_clock::time_point last_encode_time_;
 
     ByteArray active_map_buffer_;
     vpx_active_map_t active_map_;
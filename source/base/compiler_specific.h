@@ -40,4 +40,15 @@
 #define ALWAYS_INLINE inline
 #endif
 
+// Allows the function to use the instructions of the specified extensions (e.g. "avx2") regardless
+// of the compiler flags. The function must be called only if the processor supports them.
+// MSVC always allows the intrinsics. Clang requires the attribute also when it masquerades as MSVC.
+// Use like:
+//   TARGET_FEATURES("avx2") void DoStuff() { ... }
+#if defined(CC_GCC) || defined(__clang__)
+#define TARGET_FEATURES(features) __attribute__((target(features)))
+#else
+#define TARGET_FEATURES(features)
+#endif
+
 #endif // BASE__COMPILER_SPECIFIC_H
@@ -30,6 +30,32 @@
 
 namespace base {
 
+namespace {
+
+// Bits of XCR0 register for the state of XMM, YMM and ZMM registers.
+const uint64_t kXcr0SseAvxState = 0x06;
+const uint64_t kXcr0Avx512State = 0xE0;
+
+// Returns the state components that the operating system saves on context switch.
+uint64_t enabledStateComponents()
+{
+    // Bit 27 of register ECX set to 1 indicates that the operating system uses XSAVE and the XGETBV
+    // instruction is available.
+    if (CpuidUtil(0).eax() < 1 || !BitSet<uint32_t>(CpuidUtil(1).ecx()).test(27))
+        return 0;
+
+#if defined(CC_MSVC)
+    return _xgetbv(0);
+#else
+    uint32_t eax;
+    uint32_t edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+
+} // namespace
+
 CpuidUtil::CpuidUtil(int leaf, int subleaf)
 {
     get(leaf, subleaf);
@@ -79,6 +105,35 @@ bool CpuidUtil::hasAesNi()
     return BitSet<uint32_t>(CpuidUtil(1).ecx()).test(25);
 }
 
+// static
+bool CpuidUtil::hasAvx2()
+{
+    // Check if function 7 is supported.
+    if (CpuidUtil(0).eax() < 7)
+        return false;
+
+    if ((enabledStateComponents() & kXcr0SseAvxState) != kXcr0SseAvxState)
+        return false;
+
+    // Bit 5 of register EBX set to 1 indicates the support of AVX2 instructions.
+    return BitSet<uint32_t>(CpuidUtil(7).ebx()).test(5);
+}
+
+// static
+bool CpuidUtil::hasAvx512f()
+{
+    // Check if function 7 is supported.
+    if (CpuidUtil(0).eax() < 7)
+        return false;
+
+    const uint64_t kState = kXcr0SseAvxState | kXcr0Avx512State;
+    if ((enabledStateComponents() & kState) != kState)
+        return false;
+
+    // Bit 16 of register EBX set to 1 indicates the support of AVX-512 Foundation instructions.
+    return BitSet<uint32_t>(CpuidUtil(7).ebx()).test(16);
+}
+
 } // namespace base
 
 #endif // defined(ARCH_CPU_X86_FAMILY)
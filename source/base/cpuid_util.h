@@ -49,6 +49,11 @@ public:
 
     static bool hasAesNi();
 
+    // The instructions are available only if both the processor and the operating system support
+    // them (the operating system must save the extended registers on context switch).
+    static bool hasAvx2();
+    static bool hasAvx512f();
+
 private:
     uint32_t eax_ = 0;
     uint32_t ebx_ = 0;
@@ -18,11 +18,18 @@
 
 #include "base/desktop/differ.h"
 
+#include "base/cpuid_util.h"
 #include "base/logging.h"
+#include "base/desktop/diff_block_32bpp_avx2.h"
+#include "base/desktop/diff_block_32bpp_avx512.h"
 #include "base/desktop/diff_block_32bpp_sse2.h"
 #include "base/desktop/diff_block_32bpp_c.h"
+#include "base/task_runner.h"
+#include "base/threading/thread_pool.h"
 
+#include <algorithm>
 #include <cstring>
+#include <thread>
 #include <libyuv/cpu_id.h>
 
 namespace base {
@@ -33,6 +40,13 @@ const int kBlockSize = 16;
 const int kBytesPerPixel = 4;
 const int kBytesPerBlock = kBlockSize * kBytesPerPixel;
 
+// Smaller frames are processed in the calling thread. For them the time of waking up the worker
+// threads is comparable with the time of the comparison.
+const int kMinPixelsForBands = 2560 * 1440;
+
+// The comparison is limited by the memory bandwidth. More threads do not make it faster.
+const int kMaxBandCount = 4;
+
 // Check for diffs in upper-left portion of the block. The size of the portion to check is
 // specified by the |width| and |height| values.
 // Note that if we force the capturer to always return images whose width and height are multiples
@@ -55,17 +69,23 @@ uint8_t diffPartialBlock(const uint8_t* prev_image,
     return 0U;
 }
 
-
-
 } // namespace
 
 Differ::Differ(const Size& size)
+    : Differ(size, defaultBandCount(size))
+{
+    // Nothing
+}
+
+Differ::Differ(const Size& size, int band_count)
     : screen_rect_(Rect::makeSize(size)),
       bytes_per_row_(size.width() * kBytesPerPixel),
       diff_width_(((size.width() + kBlockSize - 1) / kBlockSize) + 1),
       diff_height_(((size.height() + kBlockSize - 1) / kBlockSize) + 1),
       full_blocks_x_(size.width() / kBlockSize),
-      full_blocks_y_(size.height() / kBlockSize)
+      full_blocks_y_(size.height() / kBlockSize),
+      bands_finished_(WaitableEvent::ResetPolicy::AUTOMATIC,
+                      WaitableEvent::InitialState::NOT_SIGNALED)
 {
     DLOG(LS_INFO) << "Screen size: " << size;
     DLOG(LS_INFO) << "Bytes per row: " << bytes_per_row_;
@@ -91,53 +111,137 @@ Differ::Differ(const Size& size)
 
     diff_full_block_func_ = diffFunction();
     CHECK(diff_full_block_func_);
+
+    // The last row of |diff_info_| is a boundary row.
+    const int block_rows = diff_height_ - 1;
+    band_count = std::clamp(band_count, 1, std::max(block_rows, 1));
+
+    for (int i = 0; i < band_count; ++i)
+    {
+        Band band;
+        band.first_row = block_rows * i / band_count;
+        band.last_row = block_rows * (i + 1) / band_count;
+
+        bands_.emplace_back(std::move(band));
+    }
+
+    DLOG(LS_INFO) << "Bands: " << band_count;
+
+    if (band_count > 1)
+    {
+        thread_pool_ = std::make_unique<ThreadPool>();
+        thread_pool_->start(band_count - 1);
+
+        for (int i = 1; i < band_count; ++i)
+            task_runners_.emplace_back(thread_pool_->taskRunner());
+    }
+}
+
+Differ::~Differ() = default;
+
+// static
+int Differ::defaultBandCount(const Size& size)
+{
+    if (size.width() * size.height() < kMinPixelsForBands)
+        return 1;
+
+    const int thread_count = static_cast<int>(std::thread::hardware_concurrency());
+    return std::clamp(thread_count, 1, kMaxBandCount);
 }
 
 // static
 Differ::DiffFullBlockFunc Differ::diffFunction()
 {
-    if (libyuv::TestCpuFlag(libyuv::kCpuHasSSE2))
-    {
 #if defined(ARCH_CPU_X86_FAMILY)
-        LOG(LS_INFO) << "SSE2 differ loaded";
+#if defined(USE_AVX512_DIFFER)
+    // The comparison of large frames is limited by the memory bandwidth, so AVX-512 gives no
+    // measurable gain over AVX2. On many processors it lowers the core clock and slows down the
+    // encoder running on the same cores. Therefore it is used only if enabled at build time.
+    if (CpuidUtil::hasAvx512f())
+    {
+        LOG(LS_INFO) << "AVX-512 differ loaded";
 
         if constexpr (kBlockSize == 16)
-            return diffFullBlock_32bpp_16x16_SSE2;
+            return diffFullBlock_32bpp_16x16_AVX512;
         else if constexpr (kBlockSize == 32)
-            return diffFullBlock_32bpp_32x32_SSE2;
-#endif // defined(ARCH_CPU_X86_FAMILY)
+            return diffFullBlock_32bpp_32x32_AVX512;
     }
-    else
+#endif // defined(USE_AVX512_DIFFER)
+
+    if (CpuidUtil::hasAvx2())
     {
-        LOG(LS_INFO) << "C differ loaded";
+        LOG(LS_INFO) << "AVX2 differ loaded";
 
         if constexpr (kBlockSize == 16)
-            return diffFullBlock_32bpp_16x16_C;
+            return diffFullBlock_32bpp_16x16_AVX2;
         else if constexpr (kBlockSize == 32)
-            return diffFullBlock_32bpp_32x32_C;
+            return diffFullBlock_32bpp_32x32_AVX2;
     }
 
+    if (libyuv::TestCpuFlag(libyuv::kCpuHasSSE2))
+    {
+        LOG(LS_INFO) << "SSE2 differ loaded";
+
+        if constexpr (kBlockSize == 16)
+            return diffFullBlock_32bpp_16x16_SSE2;
+        else if constexpr (kBlockSize == 32)
+            return diffFullBlock_32bpp_32x32_SSE2;
+    }
+#endif // defined(ARCH_CPU_X86_FAMILY)
+
+    LOG(LS_INFO) << "C differ loaded";
+
+    if constexpr (kBlockSize == 16)
+        return diffFullBlock_32bpp_16x16_C;
+    else if constexpr (kBlockSize == 32)
+        return diffFullBlock_32bpp_32x32_C;
+
     return nullptr;
 }
 
-// Identify all of the blocks that contain changed pixels.
-void Differ::markDirtyBlocks(const uint8_t* prev_image, const uint8_t* curr_image)
+void Differ::calcBand(const uint8_t* prev_image, const uint8_t* curr_image, Band* band)
+{
+    band->dirty_region.clear();
+
+    markDirtyBlocks(prev_image, curr_image, band->first_row, band->last_row);
+    mergeBlocks(band->first_row, band->last_row, &band->dirty_region);
+}
+
+// Identify all of the blocks in rows [first_row, last_row) that contain changed pixels.
+void Differ::markDirtyBlocks(const uint8_t* prev_image, const uint8_t* curr_image,
+                             int first_row, int last_row)
 {
-    const uint8_t* prev_block_row_start = prev_image;
-    const uint8_t* curr_block_row_start = curr_image;
+    const uint8_t* prev_block_row_start = prev_image + first_row * block_stride_y_;
+    const uint8_t* curr_block_row_start = curr_image + first_row * block_stride_y_;
 
     // Offset from the start of one diff_info row to the next.
     const int diff_stride = diff_width_;
 
-    uint8_t* is_diff_row_start = diff_info_.get();
+    uint8_t* is_diff_row_start = diff_info_.get() + first_row * diff_stride;
+
+    const int last_full_row = std::min(last_row, full_blocks_y_);
 
-    for (int y = 0; y < full_blocks_y_; ++y)
+    for (int y = first_row; y < last_full_row; ++y)
     {
         const uint8_t* prev_block = prev_block_row_start;
         const uint8_t* curr_block = curr_block_row_start;
 
         uint8_t* is_different = is_diff_row_start;
 
+        // Most block rows of a frame do not change. The rows of the images are packed, so a row of
+        // blocks is contiguous and can be compared at once. memcmp stops at the first difference,
+        // after which the changed blocks are located by the block kernel.
+        if (memcmp(prev_block_row_start, curr_block_row_start, block_stride_y_) == 0)
+        {
+            memset(is_different, 0, full_blocks_x_ + (partial_column_width_ != 0 ? 1 : 0));
+
+            prev_block_row_start += block_stride_y_;
+            curr_block_row_start += block_stride_y_;
+
+            is_diff_row_start += diff_stride;
+            continue;
+        }
+
         for (int x = 0; x < full_blocks_x_; ++x)
         {
             // Mark this block as being modified so that it gets incorporated into a dirty rect.
@@ -169,7 +273,7 @@ void Differ::markDirtyBlocks(const uint8_t* prev_image, const uint8_t* curr_imag
 
     // If the screen height is not a multiple of the block size, then this handles the last partial
     // row. This situation is far more common than the 'partial column' case.
-    if (partial_row_height_ != 0)
+    if (partial_row_height_ != 0 && last_row > full_blocks_y_)
     {
         const uint8_t* prev_block = prev_block_row_start;
         const uint8_t* curr_block = curr_block_row_start;
@@ -201,14 +305,15 @@ void Differ::markDirtyBlocks(const uint8_t* prev_image, const uint8_t* curr_imag
     }
 }
 
-// After the dirty blocks have been identified, this routine merges adjacent blocks into a region.
-// The goal is to minimize the region that covers the dirty blocks.
-void Differ::mergeBlocks(Region* dirty_region)
+// After the dirty blocks have been identified, this routine merges adjacent blocks in rows
+// [first_row, last_row) into a region. The goal is to minimize the region that covers the dirty
+// blocks.
+void Differ::mergeBlocks(int first_row, int last_row, Region* dirty_region)
 {
-    uint8_t* is_diff_row_start = diff_info_.get();
     const int diff_stride = diff_width_;
+    uint8_t* is_diff_row_start = diff_info_.get() + first_row * diff_stride;
 
-    for (int y = 0; y < diff_height_; ++y)
+    for (int y = first_row; y < last_row; ++y)
     {
         uint8_t* is_different = is_diff_row_start;
 
@@ -235,12 +340,15 @@ void Differ::mergeBlocks(Region* dirty_region)
                 }
 
                 // Group with blocks below. The entire width of blocks that we matched above much
-                // match for each row that we add.
+                // match for each row that we add. Rows of other bands are not touched.
                 uint8_t* bottom = is_different;
                 bool found_new_row;
 
                 do
                 {
+                    if (y + height >= last_row)
+                        break;
+
                     found_new_row = true;
                     bottom += diff_stride;
                     right = bottom;
@@ -290,12 +398,37 @@ void Differ::calcDirtyRegion(const uint8_t* prev_image,
 {
     dirty_region->clear();
 
-    // Identify all the blocks that contain changed pixels.
-    markDirtyBlocks(prev_image, curr_image);
+    if (bands_.size() == 1)
+    {
+        // Identify all the blocks that contain changed pixels.
+        markDirtyBlocks(prev_image, curr_image, bands_[0].first_row, bands_[0].last_row);
+
+        // Now that we've identified the blocks that have changed, merge adjacent blocks to
+        // minimize the number of rects that we return.
+        mergeBlocks(bands_[0].first_row, bands_[0].last_row, dirty_region);
+        return;
+    }
+
+    pending_bands_ = bands_.size() - 1;
+
+    for (size_t i = 1; i < bands_.size(); ++i)
+    {
+        task_runners_[i - 1]->postTask([this, prev_image, curr_image, i]()
+        {
+            calcBand(prev_image, curr_image, &bands_[i]);
+
+            if (--pending_bands_ == 0)
+                bands_finished_.signal();
+        });
+    }
+
+    calcBand(prev_image, curr_image, &bands_[0]);
+    bands_finished_.wait();
 
-    // Now that we've identified the blocks that have changed, merge adjacent blocks to minimize
-    // the number of rects that we return.
-    mergeBlocks(dirty_region);
+    // Blocks are merged only inside the bands. The union of the regions is the same as if the
+    // blocks were merged in the whole frame.
+    for (const auto& band : bands_)
+        dirty_region->addRegion(band.dirty_region);
 }
 
 } // namespace base
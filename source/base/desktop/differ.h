@@ -20,30 +20,58 @@
 #define BASE__DESKTOP__DIFFER_H
 
 #include "base/macros_magic.h"
+#include "base/waitable_event.h"
 #include "base/desktop/region.h"
 
+#include <atomic>
 #include <memory>
+#include <vector>
 
 namespace base {
 
+class TaskRunner;
+class ThreadPool;
+
 // Class to search for changed regions of the screen.
 class Differ
 {
 public:
+    // The number of bands is selected by the frame size. Small frames are processed in the calling
+    // thread.
     explicit Differ(const Size& size);
-    ~Differ() = default;
+
+    // The frame is divided into |band_count| horizontal bands, which are processed in parallel.
+    // If |band_count| is 1, the frame is processed in the calling thread.
+    Differ(const Size& size, int band_count);
+
+    ~Differ();
 
     void calcDirtyRegion(const uint8_t* prev_image,
                          const uint8_t* curr_image,
                          Region* changed_region);
 
+    int bandCount() const { return static_cast<int>(bands_.size()); }
+
+    // Returns the number of bands for frames of the size.
+    static int defaultBandCount(const Size& size);
+
 private:
     typedef uint8_t(*DiffFullBlockFunc)(const uint8_t*, const uint8_t*, int);
 
+    // Range of block rows [first_row, last_row) and the dirty region found in it.
+    struct Band
+    {
+        int first_row;
+        int last_row;
+        Region dirty_region;
+    };
+
     static DiffFullBlockFunc diffFunction();
 
-    void markDirtyBlocks(const uint8_t* prev_image, const uint8_t* curr_image);
-    void mergeBlocks(Region* dirty_region);
+    void calcBand(const uint8_t* prev_image, const uint8_t* curr_image, Band* band);
+    void markDirtyBlocks(const uint8_t* prev_image, const uint8_t* curr_image,
+                         int first_row, int last_row);
+    void mergeBlocks(int first_row, int last_row, Region* dirty_region);
 
     const Rect screen_rect_;
     const int bytes_per_row_;
@@ -59,6 +87,13 @@ private:
     std::unique_ptr<uint8_t[]> diff_info_;
     DiffFullBlockFunc diff_full_block_func_;
 
+    // The first band is processed in the calling thread, each of the others in its own thread.
+    std::vector<Band> bands_;
+    std::unique_ptr<ThreadPool> thread_pool_;
+    std::vector<std::shared_ptr<TaskRunner>> task_runners_;
+    std::atomic<size_t> pending_bands_ { 0 };
+    WaitableEvent bands_finished_;
+
     DISALLOW_COPY_AND_ASSIGN(Differ);
 };
 
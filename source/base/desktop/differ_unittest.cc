@@ -0,0 +1,277 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "base/desktop/differ.h"
+
+#include "base/cpuid_util.h"
+#include "base/desktop/diff_block_32bpp_avx2.h"
+#include "base/desktop/diff_block_32bpp_avx512.h"
+#include "base/desktop/diff_block_32bpp_c.h"
+#include "base/desktop/diff_block_32bpp_sse2.h"
+
+#include <gtest/gtest.h>
+#include <libyuv/cpu_id.h>
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace base {
+
+namespace {
+
+const int kBytesPerPixel = 4;
+const int kBlockSize = 16;
+
+class TestFrames
+{
+public:
+    explicit TestFrames(const Size& size)
+        : size_(size),
+          prev_(static_cast<size_t>(size.width()) * size.height() * kBytesPerPixel),
+          curr_(prev_.size())
+    {
+        std::mt19937 generator(size.width() * size.height());
+        for (auto& byte : prev_)
+            byte = static_cast<uint8_t>(generator());
+
+        curr_ = prev_;
+    }
+
+    // Changes one pixel in a |density| part of the blocks.
+    void change(double density, uint32_t seed)
+    {
+        curr_ = prev_;
+
+        std::mt19937 generator(seed);
+        std::bernoulli_distribution is_changed(density);
+
+        for (int block_y = 0; block_y < size_.height(); block_y += kBlockSize)
+        {
+            for (int block_x = 0; block_x < size_.width(); block_x += kBlockSize)
+            {
+                if (!is_changed(generator))
+                    continue;
+
+                const int x = std::min(block_x + static_cast<int>(generator() % kBlockSize),
+                                       size_.width() - 1);
+                const int y = std::min(block_y + static_cast<int>(generator() % kBlockSize),
+                                       size_.height() - 1);
+
+                curr_[(static_cast<size_t>(y) * size_.width() + x) * kBytesPerPixel] ^= 0xFF;
+            }
+        }
+    }
+
+    const uint8_t* prev() const { return prev_.data(); }
+    const uint8_t* curr() const { return curr_.data(); }
+
+private:
+    const Size size_;
+    std::vector<uint8_t> prev_;
+    std::vector<uint8_t> curr_;
+};
+
+const Size kTestSizes[] = { Size(1920, 1080), Size(1000, 707), Size(3840, 2160), Size(64, 16) };
+const double kTestDensities[] = { 0.0, 0.01, 0.1, 0.5, 1.0 };
+
+} // namespace
+
+TEST(differ_test, bands_give_same_region)
+{
+    for (const auto& size : kTestSizes)
+    {
+        TestFrames frames(size);
+        Differ serial_differ(size, 1);
+
+        for (int band_count = 2; band_count <= 4; ++band_count)
+        {
+            Differ parallel_differ(size, band_count);
+
+            for (double density : kTestDensities)
+            {
+                frames.change(density, band_count);
+
+                Region serial_region;
+                serial_differ.calcDirtyRegion(frames.prev(), frames.curr(), &serial_region);
+
+                Region parallel_region;
+                parallel_differ.calcDirtyRegion(frames.prev(), frames.curr(), &parallel_region);
+
+                EXPECT_TRUE(serial_region.equals(parallel_region))
+                    << "Size: " << size << ", bands: " << band_count << ", density: " << density;
+            }
+        }
+    }
+}
+
+TEST(differ_test, full_change)
+{
+    const Size size(1000, 707);
+
+    TestFrames frames(size);
+    frames.change(1.0, 1);
+
+    for (int band_count = 1; band_count <= 4; ++band_count)
+    {
+        Differ differ(size, band_count);
+
+        Region region;
+        differ.calcDirtyRegion(frames.prev(), frames.curr(), &region);
+
+        EXPECT_TRUE(region.equals(Region(Rect::makeSize(size)))) << "Bands: " << band_count;
+    }
+}
+
+TEST(differ_test, band_count_limits)
+{
+    EXPECT_EQ(Differ(Size(64, 16), 4).bandCount(), 1);
+    EXPECT_EQ(Differ(Size(64, 40), 4).bandCount(), 3);
+    EXPECT_EQ(Differ(Size(1280, 720)).bandCount(), 1);
+    EXPECT_EQ(Differ::defaultBandCount(Size(1920, 1080)), 1);
+    EXPECT_GE(Differ::defaultBandCount(Size(3840, 2160)), 1);
+}
+
+TEST(differ_test, DISABLED_benchmark)
+{
+    static const int kTimesToRun = 20;
+    static const Size kSizes[] = { Size(1920, 1080), Size(3840, 2160), Size(7680, 2160) };
+
+    for (const auto& size : kSizes)
+    {
+        TestFrames frames(size);
+
+        Differ serial_differ(size, 1);
+        Differ parallel_differ(size, std::max(Differ::defaultBandCount(Size(3840, 2160)), 2));
+
+        for (double density : kTestDensities)
+        {
+            frames.change(density, 1);
+
+            auto run = [&](Differ* differ)
+            {
+                Region region;
+
+                auto start_time = std::chrono::high_resolution_clock::now();
+                for (int i = 0; i < kTimesToRun; ++i)
+                    differ->calcDirtyRegion(frames.prev(), frames.curr(), &region);
+                auto duration = std::chrono::high_resolution_clock::now() - start_time;
+
+                return std::chrono::duration<double, std::micro>(duration).count() / kTimesToRun;
+            };
+
+            const double serial = run(&serial_differ);
+            const double parallel = run(&parallel_differ);
+
+            std::cout << "Size " << size << ", density " << density << ": "
+                      << static_cast<int64_t>(serial) << " us (1 band), "
+                      << static_cast<int64_t>(parallel) << " us ("
+                      << parallel_differ.bandCount() << " bands)" << std::endl;
+        }
+    }
+}
+
+TEST(differ_test, DISABLED_kernel_benchmark)
+{
+    using DiffFullBlockFunc = uint8_t(*)(const uint8_t*, const uint8_t*, int);
+
+    struct Kernel
+    {
+        const char* name;
+        bool is_supported;
+        DiffFullBlockFunc diff_16x16;
+        DiffFullBlockFunc diff_32x32;
+    };
+
+    const Kernel kKernels[] =
+    {
+        { "C", true, diffFullBlock_32bpp_16x16_C, diffFullBlock_32bpp_32x32_C },
+#if defined(ARCH_CPU_X86_FAMILY)
+        { "SSE2", libyuv::TestCpuFlag(libyuv::kCpuHasSSE2) != 0,
+          diffFullBlock_32bpp_16x16_SSE2, diffFullBlock_32bpp_32x32_SSE2 },
+        { "AVX2", CpuidUtil::hasAvx2(),
+          diffFullBlock_32bpp_16x16_AVX2, diffFullBlock_32bpp_32x32_AVX2 },
+        { "AVX-512", CpuidUtil::hasAvx512f(),
+          diffFullBlock_32bpp_16x16_AVX512, diffFullBlock_32bpp_32x32_AVX512 },
+#endif // defined(ARCH_CPU_X86_FAMILY)
+    };
+
+    // Unchanged blocks are the slowest case: all rows of the block are compared. The small frame
+    // fits in the cache, the large one shows the speed of the memory.
+    static const Size kSizes[] = { Size(256, 128), Size(3840, 2160) };
+    static const int kPixelsToRun = 3840 * 2160 * 20;
+
+    for (const auto& size : kSizes)
+    {
+        TestFrames frames(size);
+
+        const int bytes_per_row = size.width() * kBytesPerPixel;
+        const int times_to_run = kPixelsToRun / (size.width() * size.height());
+
+        auto run = [&](DiffFullBlockFunc diff_function, int block_size)
+        {
+            uint8_t result = 0;
+
+            auto start_time = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < times_to_run; ++i)
+            {
+                for (int y = 0; y + block_size <= size.height(); y += block_size)
+                {
+                    const size_t row_offset = static_cast<size_t>(y) * bytes_per_row;
+
+                    for (int x = 0; x + block_size <= size.width(); x += block_size)
+                    {
+                        const size_t offset = row_offset + static_cast<size_t>(x) * kBytesPerPixel;
+                        result |= diff_function(frames.prev() + offset, frames.curr() + offset,
+                                                bytes_per_row);
+                    }
+                }
+            }
+            auto duration = std::chrono::high_resolution_clock::now() - start_time;
+
+            EXPECT_EQ(result, 0);
+
+            // Microseconds per megapixel.
+            const double megapixels = static_cast<double>(size.width()) * size.height() / 1e6;
+            return std::chrono::duration<double, std::micro>(duration).count() /
+                (times_to_run * megapixels);
+        };
+
+        std::cout << "Unchanged " << size << " frame, us per megapixel:" << std::endl;
+        std::cout << std::setw(10) << "Kernel" << std::setw(10) << "16x16"
+                  << std::setw(10) << "32x32" << std::endl;
+
+        for (const auto& kernel : kKernels)
+        {
+            if (!kernel.is_supported)
+            {
+                std::cout << std::setw(10) << kernel.name << "  not supported" << std::endl;
+                continue;
+            }
+
+            std::cout << std::setw(10) << kernel.name
+                      << std::setw(10) << static_cast<int64_t>(run(kernel.diff_16x16, 16))
+                      << std::setw(10) << static_cast<int64_t>(run(kernel.diff_32x32, 32))
+                      << std::endl;
+        }
+    }
+}
+
+} // namespace base
@@ -67,6 +67,7 @@ Region::Region(const Region& other)
 
 Region::Region(Region&& other) noexcept
 {
+    miRegionInit(&x11reg_, NullBox, 0);
     *this = std::move(other);
 }
 
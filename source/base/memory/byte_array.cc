@@ -135,6 +135,19 @@ base::ByteArray serialize(const google::protobuf::MessageLite& message)
     return buffer;
 }
 
+void serialize(const google::protobuf::MessageLite& message, base::ByteArray* buffer)
+{
+    DCHECK(buffer);
+
+    const size_t size = message.ByteSizeLong();
+
+    buffer->resize(size);
+    if (!size)
+        return;
+
+    message.SerializeWithCachedSizesToArray(buffer->data());
+}
+
 int compare(const base::ByteArray& first, const base::ByteArray& second)
 {
     if (first.empty() && second.empty())
@@ -39,6 +39,9 @@ std::string toHex(const ByteArray& in);
 
 base::ByteArray serialize(const google::protobuf::MessageLite& message);
 
+// Serializes the message into |buffer|. The memory already allocated for |buffer| is reused.
+void serialize(const google::protobuf::MessageLite& message, base::ByteArray* buffer);
+
 template <class T>
 bool parse(const base::ByteArray& buffer, T* message)
 {
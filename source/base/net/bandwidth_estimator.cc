@@ -0,0 +1,136 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "base/net/bandwidth_estimator.h"
+
+#include <algorithm>
+
+namespace base {
+
+namespace {
+
+// The target bitrate is updated once per interval.
+const BandwidthEstimator::Milliseconds kMeasurementInterval{ 250 };
+
+// If messages wait in the queue longer, the channel does not deliver the current bitrate.
+const BandwidthEstimator::Milliseconds kHighQueueDelay{ 200 };
+
+// If messages wait in the queue less, the channel can deliver more.
+const BandwidthEstimator::Milliseconds kLowQueueDelay{ 50 };
+
+// The bitrate is decreased below the throughput, so that the queue is drained, and is increased
+// slowly (it doubles in about 2.5 seconds).
+const double kDecreaseFactor = 0.85;
+const double kIncreaseFactor = 1.07;
+
+} // namespace
+
+BandwidthEstimator::BandwidthEstimator() = default;
+
+BandwidthEstimator::~BandwidthEstimator() = default;
+
+void BandwidthEstimator::onMessageSent(size_t size, const TimePoint& now)
+{
+    if (interval_start_ == TimePoint())
+        interval_start_ = now;
+
+    queue_.push_back({ size, now });
+    queued_bytes_ += size;
+    sent_bytes_ += size;
+
+    updateTarget(now);
+}
+
+void BandwidthEstimator::onMessageWritten(size_t pending, const TimePoint& now)
+{
+    if (!queue_.empty())
+    {
+        const Message& message = queue_.front();
+
+        max_delay_ = std::max(max_delay_, std::chrono::duration_cast<Milliseconds>(
+            now - message.time));
+        written_bytes_ += message.size;
+        queued_bytes_ -= message.size;
+
+        queue_.pop_front();
+    }
+
+    // The messages written in one batch are reported with the same number of pending messages.
+    // When there are no pending messages, the queue must be empty.
+    if (!pending)
+    {
+        queue_.clear();
+        queued_bytes_ = 0;
+    }
+
+    updateTarget(now);
+}
+
+BandwidthEstimator::Milliseconds BandwidthEstimator::queueDrainTime() const
+{
+    // Bits divided by kilobits per second are milliseconds.
+    return Milliseconds(static_cast<uint64_t>(queued_bytes_) * 8 / target_bitrate_);
+}
+
+void BandwidthEstimator::updateTarget(const TimePoint& now)
+{
+    // A message that is still in the queue can wait longer than the written ones.
+    if (!queue_.empty())
+    {
+        max_delay_ = std::max(max_delay_, std::chrono::duration_cast<Milliseconds>(
+            now - queue_.front().time));
+    }
+
+    const Milliseconds elapsed = std::chrono::duration_cast<Milliseconds>(now - interval_start_);
+    if (elapsed < kMeasurementInterval)
+        return;
+
+    const uint64_t elapsed_ms = static_cast<uint64_t>(elapsed.count());
+
+    // Bits per millisecond are kilobits per second.
+    const uint64_t throughput = written_bytes_ * 8 / elapsed_ms;
+    const uint64_t send_rate = sent_bytes_ * 8 / elapsed_ms;
+
+    uint64_t target = target_bitrate_;
+
+    if (max_delay_ >= kHighQueueDelay)
+    {
+        // The channel delivers less than it was given. The bitrate is decreased to the measured
+        // throughput, but not more than by half per interval (nothing can be written when the
+        // queue stalls for a moment).
+        target = std::max(std::min(target, throughput), target / 2);
+        target = static_cast<uint64_t>(static_cast<double>(target) * kDecreaseFactor);
+    }
+    else if (max_delay_ <= kLowQueueDelay && send_rate * 2 >= target)
+    {
+        // The channel delivers everything without delay. The bitrate is increased only if the
+        // sender actually uses it, otherwise nothing is known about the capacity of the channel.
+        target = static_cast<uint64_t>(static_cast<double>(target) * kIncreaseFactor) + 1;
+    }
+
+    target_bitrate_ = static_cast<uint32_t>(
+        std::clamp(target, static_cast<uint64_t>(kMinBitrate), static_cast<uint64_t>(kMaxBitrate)));
+    queue_delay_ = max_delay_;
+
+    interval_start_ = now;
+    sent_bytes_ = 0;
+    written_bytes_ = 0;
+    max_delay_ = Milliseconds::zero();
+}
+
+} // namespace base
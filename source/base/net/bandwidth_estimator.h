@@ -0,0 +1,94 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef BASE__NET__BANDWIDTH_ESTIMATOR_H
+#define BASE__NET__BANDWIDTH_ESTIMATOR_H
+
+#include "base/macros_magic.h"
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+
+namespace base {
+
+// Estimates the bitrate that the channel can deliver without building a queue. The estimator
+// observes the messages added to the write queue of the channel and the moments when they are
+// written to the socket. If the messages wait in the queue, the target bitrate is decreased to the
+// measured throughput. If the queue is empty and the sender uses the target bitrate, the target
+// bitrate is slowly increased.
+class BandwidthEstimator
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using TimePoint = Clock::time_point;
+    using Milliseconds = std::chrono::milliseconds;
+
+    BandwidthEstimator();
+    ~BandwidthEstimator();
+
+    static constexpr uint32_t kDefaultBitrate = 1000; // kbps
+    static constexpr uint32_t kMinBitrate = 100; // kbps
+    static constexpr uint32_t kMaxBitrate = 50000; // kbps
+
+    // Must be called when a message of |size| bytes is added to the write queue.
+    void onMessageSent(size_t size, const TimePoint& now = Clock::now());
+
+    // Must be called when a message is written (see NetworkChannel::Listener::onMessageWritten).
+    // The messages are written in the order in which they were sent.
+    void onMessageWritten(size_t pending, const TimePoint& now = Clock::now());
+
+    // Bitrate in kbps that the sender should use.
+    uint32_t targetBitrate() const { return target_bitrate_; }
+
+    // Number of bytes that have been sent, but not written yet.
+    size_t queuedBytes() const { return queued_bytes_; }
+
+    // Time in which the queued bytes are written at the target bitrate.
+    Milliseconds queueDrainTime() const;
+
+    // The longest time that a message spent in the queue during the last measurement interval.
+    Milliseconds queueDelay() const { return queue_delay_; }
+
+private:
+    void updateTarget(const TimePoint& now);
+
+    struct Message
+    {
+        size_t size;
+        TimePoint time;
+    };
+
+    std::deque<Message> queue_;
+    size_t queued_bytes_ = 0;
+
+    // Statistics of the current measurement interval.
+    TimePoint interval_start_;
+    size_t sent_bytes_ = 0;
+    size_t written_bytes_ = 0;
+    Milliseconds max_delay_ { 0 };
+
+    Milliseconds queue_delay_ { 0 };
+    uint32_t target_bitrate_ = kDefaultBitrate;
+
+    DISALLOW_COPY_AND_ASSIGN(BandwidthEstimator);
+};
+
+} // namespace base
+
+#endif // BASE__NET__BANDWIDTH_ESTIMATOR_H
@@ -0,0 +1,170 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "base/net/bandwidth_estimator.h"
+
+#include <gtest/gtest.h>
+
+namespace base {
+
+namespace {
+
+using Milliseconds = BandwidthEstimator::Milliseconds;
+
+// Simulates a channel with the given capacity. Every |interval| the sender sends a message of
+// |message_size| bytes.
+class ChannelSimulator
+{
+public:
+    ChannelSimulator(uint32_t capacity_kbps, size_t message_size, const Milliseconds& interval)
+        : capacity_kbps_(capacity_kbps),
+          message_size_(message_size),
+          interval_(interval)
+    {
+        // Nothing
+    }
+
+    void run(BandwidthEstimator* estimator, const Milliseconds& duration)
+    {
+        for (Milliseconds end = time_ + duration; time_ < end; ++time_)
+        {
+            const BandwidthEstimator::TimePoint now = BandwidthEstimator::TimePoint() + time_;
+
+            if (time_ >= next_send_)
+            {
+                estimator->onMessageSent(message_size_, now);
+                ++queued_messages_;
+                next_send_ += interval_;
+            }
+
+            if (!queued_messages_)
+                continue;
+
+            // Bits per millisecond are kilobits per second.
+            written_bits_ += capacity_kbps_;
+
+            while (queued_messages_ && written_bits_ >= message_size_ * 8)
+            {
+                written_bits_ -= message_size_ * 8;
+                --queued_messages_;
+
+                estimator->onMessageWritten(queued_messages_, now);
+            }
+
+            if (!queued_messages_)
+                written_bits_ = 0;
+        }
+    }
+
+private:
+    const uint32_t capacity_kbps_;
+    const size_t message_size_;
+    const Milliseconds interval_;
+
+    Milliseconds time_ { 1 };
+    Milliseconds next_send_ { 1 };
+    size_t queued_messages_ = 0;
+    size_t written_bits_ = 0;
+};
+
+} // namespace
+
+TEST(BandwidthEstimator, Default)
+{
+    BandwidthEstimator estimator;
+
+    EXPECT_EQ(estimator.targetBitrate(), BandwidthEstimator::kDefaultBitrate);
+    EXPECT_EQ(estimator.queuedBytes(), 0u);
+    EXPECT_EQ(estimator.queueDelay(), Milliseconds::zero());
+}
+
+TEST(BandwidthEstimator, SlowChannel)
+{
+    BandwidthEstimator estimator;
+
+    // The sender uses 1600 kbps, the channel can deliver only 400 kbps.
+    ChannelSimulator simulator(400, 2000, Milliseconds(10));
+    simulator.run(&estimator, Milliseconds(2000));
+
+    EXPECT_LT(estimator.targetBitrate(), 400u);
+    EXPECT_GE(estimator.targetBitrate(), BandwidthEstimator::kMinBitrate);
+    EXPECT_GE(estimator.queueDelay(), Milliseconds(200));
+}
+
+TEST(BandwidthEstimator, FastChannel)
+{
+    BandwidthEstimator estimator;
+
+    // The sender uses 800 kbps, the channel can deliver 100 Mbps.
+    ChannelSimulator simulator(100000, 1000, Milliseconds(10));
+    simulator.run(&estimator, Milliseconds(5000));
+
+    EXPECT_GT(estimator.targetBitrate(), BandwidthEstimator::kDefaultBitrate);
+    EXPECT_LT(estimator.queueDelay(), Milliseconds(50));
+}
+
+TEST(BandwidthEstimator, IdleSender)
+{
+    BandwidthEstimator estimator;
+
+    // The sender uses 16 kbps. The capacity of the channel is unknown, the bitrate is not changed.
+    ChannelSimulator simulator(100000, 200, Milliseconds(100));
+    simulator.run(&estimator, Milliseconds(5000));
+
+    EXPECT_EQ(estimator.targetBitrate(), BandwidthEstimator::kDefaultBitrate);
+}
+
+TEST(BandwidthEstimator, Limits)
+{
+    BandwidthEstimator estimator;
+
+    ChannelSimulator slow_simulator(10, 5000, Milliseconds(10));
+    slow_simulator.run(&estimator, Milliseconds(10000));
+    EXPECT_EQ(estimator.targetBitrate(), BandwidthEstimator::kMinBitrate);
+
+    BandwidthEstimator other_estimator;
+
+    ChannelSimulator fast_simulator(1000000, 100000, Milliseconds(5));
+    fast_simulator.run(&other_estimator, Milliseconds(60000));
+    EXPECT_EQ(other_estimator.targetBitrate(), BandwidthEstimator::kMaxBitrate);
+}
+
+TEST(BandwidthEstimator, BatchedWrites)
+{
+    BandwidthEstimator estimator;
+    BandwidthEstimator::TimePoint now;
+
+    for (int i = 0; i < 4; ++i)
+        estimator.onMessageSent(1000, now);
+
+    EXPECT_EQ(estimator.queuedBytes(), 4000u);
+    EXPECT_EQ(estimator.queueDrainTime(), Milliseconds(32));
+
+    // The first two messages are written in one batch, two messages remain.
+    now += Milliseconds(10);
+    estimator.onMessageWritten(2, now);
+    estimator.onMessageWritten(2, now);
+    EXPECT_EQ(estimator.queuedBytes(), 2000u);
+
+    now += Milliseconds(10);
+    estimator.onMessageWritten(0, now);
+    EXPECT_EQ(estimator.queuedBytes(), 0u);
+    EXPECT_EQ(estimator.queueDrainTime(), Milliseconds::zero());
+}
+
+} // namespace base
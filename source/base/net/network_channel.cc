@@ -39,6 +39,11 @@ namespace base {
 namespace {
 
 static const size_t kMaxMessageSize = 16 * 1024 * 1024; // 16 MB
+static const size_t kDefaultMaxWriteBatchBytes = 256 * 1024; // 256 kB
+static const size_t kDefaultMaxWriteBatchMessages = 64;
+static const size_t kReadBufferSize = 16 * 1024; // 16 kB
+static const size_t kMaxPooledBuffers = 16;
+static const size_t kMaxPooledBufferCapacity = 256 * 1024; // 256 kB
 
 int calculateSpeed(int last_speed, const std::chrono::milliseconds& duration, int64_t bytes)
 {
@@ -69,7 +74,9 @@ NetworkChannel::NetworkChannel()
       socket_(io_context_),
       resolver_(std::make_unique<asio::ip::tcp::resolver>(io_context_)),
       encryptor_(std::make_unique<MessageEncryptorFake>()),
-      decryptor_(std::make_unique<MessageDecryptorFake>())
+      decryptor_(std::make_unique<MessageDecryptorFake>()),
+      max_write_batch_bytes_(kDefaultMaxWriteBatchBytes),
+      max_write_batch_messages_(kDefaultMaxWriteBatchMessages)
 {
     // Nothing
 }
@@ -80,7 +87,9 @@ NetworkChannel::NetworkChannel(asio::ip::tcp::socket&& socket)
       socket_(std::move(socket)),
       connected_(true),
       encryptor_(std::make_unique<MessageEncryptorFake>()),
-      decryptor_(std::make_unique<MessageDecryptorFake>())
+      decryptor_(std::make_unique<MessageDecryptorFake>()),
+      max_write_batch_bytes_(kDefaultMaxWriteBatchBytes),
+      max_write_batch_messages_(kDefaultMaxWriteBatchMessages)
 {
     DCHECK(socket_.is_open());
 }
@@ -180,11 +189,10 @@ void NetworkChannel::resume()
 
     switch (state_)
     {
-        // We already have an incomplete read operation.
-        case ReadState::READ_SIZE:
-        case ReadState::READ_USER_DATA:
-        case ReadState::READ_SERVICE_HEADER:
-        case ReadState::READ_SERVICE_DATA:
+        // We already have an incomplete read operation or messages are being processed now.
+        case ReadState::READ_SOME:
+        case ReadState::PROCESSING:
+        case ReadState::READ_LARGE_MESSAGE:
             return;
 
         default:
@@ -193,9 +201,15 @@ void NetworkChannel::resume()
 
     // If we have a message that was received before the pause command.
     if (state_ == ReadState::PENDING)
-        onMessageReceived();
+    {
+        state_ = ReadState::PROCESSING;
+
+        if (!onLargeMessageReceived())
+            return;
+    }
 
-    doReadSize();
+    // The buffer may contain messages that were received before the pause command.
+    processReadBuffer();
 }
 
 void NetworkChannel::send(ByteArray&& buffer)
@@ -203,6 +217,26 @@ void NetworkChannel::send(ByteArray&& buffer)
     addWriteTask(WriteTask::Type::USER_DATA, std::move(buffer));
 }
 
+void NetworkChannel::send(std::shared_ptr<const ByteArray> buffer)
+{
+    DCHECK(buffer);
+
+    // The buffer is referenced until it is copied to the write buffer.
+    write_queue_.emplace(WriteTask::Type::USER_DATA, std::move(buffer));
+
+    // If a write is in progress, the message will be sent after it is completed.
+    if (!write_in_progress_)
+        doWrite();
+}
+
+void NetworkChannel::send(const google::protobuf::MessageLite& message)
+{
+    ByteArray buffer = takePooledBuffer();
+    serialize(message, &buffer);
+
+    addWriteTask(WriteTask::Type::USER_DATA, std::move(buffer));
+}
+
 bool NetworkChannel::setNoDelay(bool enable)
 {
     asio::ip::tcp::no_delay option(enable);
@@ -308,6 +342,15 @@ bool NetworkChannel::setWriteBufferSize(size_t size)
     return true;
 }
 
+void NetworkChannel::setWriteBatchLimits(size_t max_bytes, size_t max_messages)
+{
+    DCHECK_GT(max_bytes, 0u);
+    DCHECK_GT(max_messages, 0u);
+
+    max_write_batch_bytes_ = max_bytes;
+    max_write_batch_messages_ = max_messages;
+}
+
 int NetworkChannel::speedRx()
 {
     TimePoint current_time = Clock::now();
@@ -446,45 +489,115 @@ void NetworkChannel::onErrorOccurred(const Location& location, ErrorCode error_c
 void NetworkChannel::onMessageWritten()
 {
     if (listener_)
-        listener_->onMessageWritten(write_queue_.size());
+        listener_->onMessageWritten(write_queue_.size() + write_batch_user_messages_);
 }
 
-void NetworkChannel::onMessageReceived()
+bool NetworkChannel::onMessageReceived(const uint8_t* data, size_t size)
 {
-    resizeBuffer(&decrypt_buffer_, decryptor_->decryptedDataSize(read_buffer_.size()));
+    resizeBuffer(&decrypt_buffer_, decryptor_->decryptedDataSize(size));
 
-    if (!decryptor_->decrypt(read_buffer_.data(), read_buffer_.size(), decrypt_buffer_.data()))
+    if (!decryptor_->decrypt(data, size, decrypt_buffer_.data()))
     {
         onErrorOccurred(FROM_HERE, ErrorCode::ACCESS_DENIED);
-        return;
+        return false;
     }
 
     if (listener_)
         listener_->onMessageReceived(decrypt_buffer_);
+
+    return true;
 }
 
-void NetworkChannel::addWriteTask(WriteTask::Type type, ByteArray&& data)
+bool NetworkChannel::onServiceMessageReceived(
+    const ServiceHeader& header, const uint8_t* data, size_t size)
+{
+    DCHECK_EQ(header.length, size);
+    DCHECK_LE(header.length, kMaxMessageSize);
+
+    if (header.type != KEEP_ALIVE)
+    {
+        onErrorOccurred(FROM_HERE, ErrorCode::INVALID_PROTOCOL);
+        return false;
+    }
+
+    if (header.flags & KEEP_ALIVE_PING)
+    {
+        // Send pong.
+        sendKeepAlive(KEEP_ALIVE_PONG, data, size);
+        return true;
+    }
+
+    if (header.length != keep_alive_counter_.size())
+    {
+        onErrorOccurred(FROM_HERE, ErrorCode::INVALID_PROTOCOL);
+        return false;
+    }
+
+    // Pong must contain the same data as ping.
+    if (memcmp(data, keep_alive_counter_.data(), keep_alive_counter_.size()) != 0)
+    {
+        onErrorOccurred(FROM_HERE, ErrorCode::INVALID_PROTOCOL);
+        return false;
+    }
+
+    round_trip_time_ = std::chrono::duration_cast<Milliseconds>(
+        Clock::now() - keep_alive_timestamp_);
+
+    DLOG(LS_INFO) << "Ping result: " << round_trip_time_.count() << " ms ("
+                  << keep_alive_counter_.size() << " bytes)";
+
+    // The user can disable keep alive. Restart the timer only if keep alive is enabled.
+    if (keep_alive_timer_)
+    {
+        DCHECK(!keep_alive_counter_.empty());
+
+        // Increase the counter of sent packets.
+        largeNumberIncrement(&keep_alive_counter_);
+
+        // Restart keep alive timer.
+        keep_alive_timer_->expires_after(keep_alive_interval_);
+        keep_alive_timer_->async_wait(
+            std::bind(&NetworkChannel::onKeepAliveInterval, this, std::placeholders::_1));
+    }
+
+    return true;
+}
+
+bool NetworkChannel::onLargeMessageReceived()
 {
-    const bool schedule_write = write_queue_.empty();
+    DCHECK_EQ(large_buffer_received_, large_buffer_.size());
+
+    if (large_message_is_service_)
+    {
+        return onServiceMessageReceived(
+            large_message_header_, large_buffer_.data(), large_buffer_.size());
+    }
+
+    return onMessageReceived(large_buffer_.data(), large_buffer_.size());
+}
 
+void NetworkChannel::addWriteTask(WriteTask::Type type, ByteArray&& data)
+{
     // Add the buffer to the queue for sending.
     write_queue_.emplace(type, std::move(data));
 
-    if (schedule_write)
+    // If a write is in progress, the message will be sent after it is completed.
+    if (!write_in_progress_)
         doWrite();
 }
 
-void NetworkChannel::doWrite()
+bool NetworkChannel::appendToWriteBuffer(const WriteTask& task)
 {
-    const WriteTask& task = write_queue_.front();
     const ByteArray& source_buffer = task.data();
 
     if (source_buffer.empty())
     {
         onErrorOccurred(FROM_HERE, ErrorCode::INVALID_PROTOCOL);
-        return;
+        return false;
     }
 
+    const size_t offset = write_buffer_.size();
+
     if (task.type() == WriteTask::Type::USER_DATA)
     {
         // Calculate the size of the encrypted message.
@@ -493,35 +606,104 @@ void NetworkChannel::doWrite()
         if (target_data_size > kMaxMessageSize)
         {
             onErrorOccurred(FROM_HERE, ErrorCode::INVALID_PROTOCOL);
-            return;
+            return false;
         }
 
         asio::const_buffer variable_size = variable_size_writer_.variableSize(target_data_size);
 
-        resizeBuffer(&write_buffer_, variable_size.size() + target_data_size);
+        write_buffer_.resize(offset + variable_size.size() + target_data_size);
 
         // Copy the size of the message to the buffer.
-        memcpy(write_buffer_.data(), variable_size.data(), variable_size.size());
+        memcpy(write_buffer_.data() + offset, variable_size.data(), variable_size.size());
 
         // Encrypt the message.
         if (!encryptor_->encrypt(source_buffer.data(),
                                  source_buffer.size(),
-                                 write_buffer_.data() + variable_size.size()))
+                                 write_buffer_.data() + offset + variable_size.size()))
         {
             onErrorOccurred(FROM_HERE, ErrorCode::ACCESS_DENIED);
-            return;
+            return false;
         }
     }
     else
     {
         DCHECK_EQ(task.type(), WriteTask::Type::SERVICE_DATA);
 
-        resizeBuffer(&write_buffer_, source_buffer.size());
+        write_buffer_.resize(offset + source_buffer.size());
 
         // Service data does not need encryption. Copy the source buffer.
-        memcpy(write_buffer_.data(), source_buffer.data(), source_buffer.size());
+        memcpy(write_buffer_.data() + offset, source_buffer.data(), source_buffer.size());
+    }
+
+    return true;
+}
+
+ByteArray NetworkChannel::takePooledBuffer()
+{
+    if (buffer_pool_.empty())
+        return ByteArray();
+
+    ByteArray buffer = std::move(buffer_pool_.back());
+    buffer_pool_.pop_back();
+    return buffer;
+}
+
+void NetworkChannel::releasePooledBuffer(ByteArray&& buffer)
+{
+    if (buffer_pool_.size() >= kMaxPooledBuffers)
+        return;
+
+    // Very large buffers are not kept so that a single large message does not hold memory.
+    if (!buffer.capacity() || buffer.capacity() > kMaxPooledBufferCapacity)
+        return;
+
+    buffer.clear();
+    buffer_pool_.emplace_back(std::move(buffer));
+}
+
+void NetworkChannel::doWrite()
+{
+    DCHECK(!write_in_progress_);
+
+    // The buffer keeps its capacity between writes, so in steady state there are no allocations.
+    write_buffer_.clear();
+    write_batch_user_messages_ = 0;
+
+    size_t batch_messages = 0;
+
+    // Encrypt as many queued messages as the limits allow into one buffer. The messages are
+    // encrypted strictly in the order in which they were queued.
+    while (batch_messages < max_write_batch_messages_)
+    {
+        if (write_queue_.empty() && !proxy_->reloadWriteQueue(&write_queue_))
+            break;
+
+        WriteTask& task = write_queue_.front();
+
+        // The first message is always added to the batch, even if it exceeds the limit.
+        if (batch_messages && write_buffer_.size() + task.data().size() > max_write_batch_bytes_)
+            break;
+
+        if (!appendToWriteBuffer(task))
+            return;
+
+        if (task.type() == WriteTask::Type::USER_DATA)
+            ++write_batch_user_messages_;
+
+        // The message is already copied to the write buffer. Its buffer can be reused.
+        releasePooledBuffer(task.takeData());
+
+        ++batch_messages;
+
+        // Delete the message from the queue. It is already in the write buffer.
+        write_queue_.pop();
     }
 
+    if (write_buffer_.empty())
+        return;
+
+    write_in_progress_ = true;
+
     // Send the buffer to the recipient.
     asio::async_write(socket_,
                       asio::buffer(write_buffer_.data(), write_buffer_.size()),
@@ -533,97 +715,63 @@ void NetworkChannel::doWrite()
 
 void NetworkChannel::onWrite(const std::error_code& error_code, size_t bytes_transferred)
 {
+    DCHECK(write_in_progress_);
+
+    write_in_progress_ = false;
+
     if (error_code)
     {
         onErrorOccurred(FROM_HERE, error_code);
         return;
     }
 
-    DCHECK(!write_queue_.empty());
-
     // Update TX statistics.
     addTxBytes(bytes_transferred);
 
-    WriteTask::Type task_type = write_queue_.front().type();
-
-    // Delete the sent message from the queue.
-    write_queue_.pop();
+    size_t written_messages = write_batch_user_messages_;
 
-    // If the queue is not empty, then we send the following message.
-    bool schedule_write = !write_queue_.empty() || proxy_->reloadWriteQueue(&write_queue_);
+    // Send the following messages (if any) before notifying the listener, so that the socket does
+    // not stay idle while the listener is processing notifications.
+    doWrite();
 
-    if (task_type == WriteTask::Type::USER_DATA)
+    // The listener is notified about each user message separately.
+    for (size_t i = 0; i < written_messages; ++i)
         onMessageWritten();
-
-    if (schedule_write)
-        doWrite();
 }
 
-void NetworkChannel::doReadSize()
+void NetworkChannel::doReadSome()
 {
-    state_ = ReadState::READ_SIZE;
-    asio::async_read(socket_,
-                     variable_size_reader_.buffer(),
-                     std::bind(&NetworkChannel::onReadSize,
-                               this,
-                               std::placeholders::_1,
-                               std::placeholders::_2));
-}
-
-void NetworkChannel::onReadSize(const std::error_code& error_code, size_t bytes_transferred)
-{
-    if (error_code)
-    {
-        onErrorOccurred(FROM_HERE, error_code);
-        return;
-    }
-
-    // Update RX statistics.
-    addRxBytes(bytes_transferred);
+    if (read_buffer_.empty())
+        read_buffer_.resize(kReadBufferSize);
 
-    std::optional<size_t> size = variable_size_reader_.messageSize();
-    if (size.has_value())
+    // Move the unprocessed data to the beginning of the buffer.
+    if (read_begin_ != 0)
     {
-        size_t message_size = *size;
-
-        if (message_size > kMaxMessageSize)
-        {
-            onErrorOccurred(FROM_HERE, ErrorCode::INVALID_PROTOCOL);
-            return;
-        }
+        const size_t unprocessed = read_end_ - read_begin_;
 
-        // If the message size is 0 (in other words, the first received byte is 0), then you need
-        // to start reading the service message.
-        if (!message_size)
-        {
-            doReadServiceHeader();
-            return;
-        }
+        if (unprocessed)
+            memmove(read_buffer_.data(), read_buffer_.data() + read_begin_, unprocessed);
 
-        doReadUserData(message_size);
+        read_begin_ = 0;
+        read_end_ = unprocessed;
     }
-    else
-    {
-        doReadSize();
-    }
-}
 
-void NetworkChannel::doReadUserData(size_t length)
-{
-    resizeBuffer(&read_buffer_, length);
+    DCHECK_LT(read_end_, read_buffer_.size());
 
-    state_ = ReadState::READ_USER_DATA;
-    asio::async_read(socket_,
-                     asio::buffer(read_buffer_.data(), read_buffer_.size()),
-                     std::bind(&NetworkChannel::onReadUserData,
-                               this,
-                               std::placeholders::_1,
-                               std::placeholders::_2));
+    state_ = ReadState::READ_SOME;
+    socket_.async_read_some(asio::buffer(read_buffer_.data() + read_end_,
+                                         read_buffer_.size() - read_end_),
+                            std::bind(&NetworkChannel::onReadSome,
+                                      this,
+                                      std::placeholders::_1,
+                                      std::placeholders::_2));
 }
 
-void NetworkChannel::onReadUserData(const std::error_code& error_code, size_t bytes_transferred)
+void NetworkChannel::onReadSome(const std::error_code& error_code, size_t bytes_transferred)
 {
-    DCHECK_EQ(state_, ReadState::READ_USER_DATA);
+    DCHECK_EQ(state_, ReadState::READ_SOME);
+
+    state_ = ReadState::IDLE;
 
     if (error_code)
     {
@@ -634,102 +782,137 @@ void NetworkChannel::onReadUserData(const std::error_code& error_code, size_t by
     // Update RX statistics.
     addRxBytes(bytes_transferred);
 
-    DCHECK_EQ(bytes_transferred, read_buffer_.size());
+    read_end_ += bytes_transferred;
+    DCHECK_LE(read_end_, read_buffer_.size());
 
+    // If the channel is paused, then the received data will be processed after calling resume().
     if (paused_)
-    {
-        state_ = ReadState::PENDING;
         return;
-    }
 
-    onMessageReceived();
+    processReadBuffer();
+}
 
-    if (paused_)
+void NetworkChannel::processReadBuffer()
+{
+    state_ = ReadState::PROCESSING;
+
+    // Process all complete messages in the buffer. The listener can pause the channel or an error
+    // can occur while processing the message.
+    while (connected_ && !paused_)
     {
-        state_ = ReadState::IDLE;
-        return;
-    }
+        const uint8_t* data = read_buffer_.data() + read_begin_;
+        const size_t available = read_end_ - read_begin_;
 
-    doReadSize();
-}
+        size_t header_size = 0;
 
-void NetworkChannel::doReadServiceHeader()
-{
-    resizeBuffer(&read_buffer_, sizeof(ServiceHeader));
+        std::optional<size_t> size = VariableSizeReader::messageSize(data, available, &header_size);
+        if (!size.has_value())
+            break;
 
-    state_ = ReadState::READ_SERVICE_HEADER;
-    asio::async_read(socket_,
-                     asio::buffer(read_buffer_.data(), read_buffer_.size()),
-                     std::bind(&NetworkChannel::onReadServiceHeader,
-                               this,
-                               std::placeholders::_1,
-                               std::placeholders::_2));
-}
+        size_t message_size = *size;
 
-void NetworkChannel::onReadServiceHeader(const std::error_code& error_code, size_t bytes_transferred)
-{
-    DCHECK_EQ(state_, ReadState::READ_SERVICE_HEADER);
-    DCHECK_EQ(read_buffer_.size(), sizeof(ServiceHeader));
+        if (message_size > kMaxMessageSize)
+        {
+            onErrorOccurred(FROM_HERE, ErrorCode::INVALID_PROTOCOL);
+            return;
+        }
 
-    if (error_code)
-    {
-        onErrorOccurred(FROM_HERE, error_code);
-        return;
-    }
+        // If the message size is 0 (in other words, the first received byte is 0), then this is
+        // a service message.
+        const bool is_service = !message_size;
+        ServiceHeader service_header;
 
-    DCHECK_EQ(bytes_transferred, read_buffer_.size());
+        if (is_service)
+        {
+            if (available < header_size + sizeof(ServiceHeader))
+                break;
 
-    // Update RX statistics.
-    addRxBytes(bytes_transferred);
+            memcpy(&service_header, data + header_size, sizeof(ServiceHeader));
 
-    ServiceHeader* header = reinterpret_cast<ServiceHeader*>(read_buffer_.data());
-    if (header->length > kMaxMessageSize)
-    {
-        onErrorOccurred(FROM_HERE, ErrorCode::INVALID_PROTOCOL);
-        return;
-    }
+            if (service_header.length > kMaxMessageSize)
+            {
+                onErrorOccurred(FROM_HERE, ErrorCode::INVALID_PROTOCOL);
+                return;
+            }
 
-    if (header->type == KEEP_ALIVE)
-    {
-        // Keep alive packet must always contain data.
-        if (!header->length)
+            // Keep alive packet must always contain data.
+            if (service_header.type != KEEP_ALIVE || !service_header.length)
+            {
+                onErrorOccurred(FROM_HERE, ErrorCode::INVALID_PROTOCOL);
+                return;
+            }
+
+            header_size += sizeof(ServiceHeader);
+            message_size = service_header.length;
+        }
+
+        if (available < header_size + message_size)
         {
-            onErrorOccurred(FROM_HERE, ErrorCode::INVALID_PROTOCOL);
+            // The message will fit in the buffer. Read the rest of the message.
+            if (header_size + message_size <= read_buffer_.size())
+                break;
+
+            // The message does not fit in the buffer. It is read separately.
+            large_message_is_service_ = is_service;
+            if (is_service)
+                large_message_header_ = service_header;
+
+            doReadLargeMessage(header_size, message_size);
             return;
         }
 
-        doReadServiceData(header->length);
+        read_begin_ += header_size + message_size;
+
+        bool result;
+
+        if (is_service)
+            result = onServiceMessageReceived(service_header, data + header_size, message_size);
+        else
+            result = onMessageReceived(data + header_size, message_size);
+
+        if (!result)
+            return;
     }
-    else
-    {
-        onErrorOccurred(FROM_HERE, ErrorCode::INVALID_PROTOCOL);
+
+    state_ = ReadState::IDLE;
+
+    if (!connected_ || paused_)
         return;
-    }
+
+    doReadSome();
 }
 
-void NetworkChannel::doReadServiceData(size_t length)
+void NetworkChannel::doReadLargeMessage(size_t header_size, size_t message_size)
 {
-    DCHECK_EQ(read_buffer_.size(), sizeof(ServiceHeader));
-    DCHECK_EQ(state_, ReadState::READ_SERVICE_HEADER);
-    DCHECK_GT(length, 0u);
+    const size_t available = read_end_ - read_begin_;
+
+    DCHECK_GT(header_size + message_size, available);
 
-    read_buffer_.resize(read_buffer_.size() + length);
+    // Copy the beginning of the message that is already received.
+    resizeBuffer(&large_buffer_, message_size);
+    large_buffer_received_ = available - header_size;
 
-    // Now we read the data after the header.
-    state_ = ReadState::READ_SERVICE_DATA;
+    memcpy(large_buffer_.data(),
+           read_buffer_.data() + read_begin_ + header_size,
+           large_buffer_received_);
+
+    // All data in the read buffer is processed.
+    read_begin_ = 0;
+    read_end_ = 0;
+
+    state_ = ReadState::READ_LARGE_MESSAGE;
     asio::async_read(socket_,
-                     asio::buffer(read_buffer_.data() + sizeof(ServiceHeader),
-                                  read_buffer_.size() - sizeof(ServiceHeader)),
-                     std::bind(&NetworkChannel::onReadServiceData,
+                     asio::buffer(large_buffer_.data() + large_buffer_received_,
+                                  large_buffer_.size() - large_buffer_received_),
+                     std::bind(&NetworkChannel::onReadLargeMessage,
                                this,
                                std::placeholders::_1,
                                std::placeholders::_2));
 }
 
-void NetworkChannel::onReadServiceData(const std::error_code& error_code, size_t bytes_transferred)
+void NetworkChannel::onReadLargeMessage(const std::error_code& error_code, size_t bytes_transferred)
 {
-    DCHECK_EQ(state_, ReadState::READ_SERVICE_DATA);
-    DCHECK_GT(read_buffer_.size(), sizeof(ServiceHeader));
+    DCHECK_EQ(state_, ReadState::READ_LARGE_MESSAGE);
 
     if (error_code)
     {
@@ -740,75 +923,21 @@ void NetworkChannel::onReadServiceData(const std::error_code& error_code, size_t
     // Update RX statistics.
     addRxBytes(bytes_transferred);
 
-    // Incoming buffer contains a service header.
-    ServiceHeader* header = reinterpret_cast<ServiceHeader*>(read_buffer_.data());
+    large_buffer_received_ += bytes_transferred;
+    DCHECK_EQ(large_buffer_received_, large_buffer_.size());
 
-    DCHECK_EQ(bytes_transferred, read_buffer_.size() - sizeof(ServiceHeader));
-    DCHECK_LE(header->length, kMaxMessageSize);
-
-    if (header->type == KEEP_ALIVE)
+    if (paused_)
     {
-        if (header->flags & KEEP_ALIVE_PING)
-        {
-            // Send pong.
-            sendKeepAlive(KEEP_ALIVE_PONG,
-                          read_buffer_.data() + sizeof(ServiceHeader),
-                          read_buffer_.size() - sizeof(ServiceHeader));
-        }
-        else
-        {
-            if (read_buffer_.size() < (sizeof(ServiceHeader) + header->length))
-            {
-                onErrorOccurred(FROM_HERE, ErrorCode::INVALID_PROTOCOL);
-                return;
-            }
-
-            if (header->length != keep_alive_counter_.size())
-            {
-                onErrorOccurred(FROM_HERE, ErrorCode::INVALID_PROTOCOL);
-                return;
-            }
-
-            // Pong must contain the same data as ping.
-            if (memcmp(read_buffer_.data() + sizeof(ServiceHeader),
-                       keep_alive_counter_.data(),
-                       keep_alive_counter_.size()) != 0)
-            {
-                onErrorOccurred(FROM_HERE, ErrorCode::INVALID_PROTOCOL);
-                return;
-            }
-
-            if (DCHECK_IS_ON())
-            {
-                Milliseconds ping_time = std::chrono::duration_cast<Milliseconds>(
-                    Clock::now() - keep_alive_timestamp_);
-
-                DLOG(LS_INFO) << "Ping result: " << ping_time.count() << " ms ("
-                              << keep_alive_counter_.size() << " bytes)";
-            }
-
-            // The user can disable keep alive. Restart the timer only if keep alive is enabled.
-            if (keep_alive_timer_)
-            {
-                DCHECK(!keep_alive_counter_.empty());
+        state_ = ReadState::PENDING;
+        return;
+    }
 
-                // Increase the counter of sent packets.
-                largeNumberIncrement(&keep_alive_counter_);
+    state_ = ReadState::PROCESSING;
 
-                // Restart keep alive timer.
-                keep_alive_timer_->expires_after(keep_alive_interval_);
-                keep_alive_timer_->async_wait(
-                    std::bind(&NetworkChannel::onKeepAliveInterval, this, std::placeholders::_1));
-            }
-        }
-    }
-    else
-    {
-        onErrorOccurred(FROM_HERE, ErrorCode::INVALID_PROTOCOL);
+    if (!onLargeMessageReceived())
         return;
-    }
 
-    doReadSize();
+    processReadBuffer();
 }
 
 void NetworkChannel::onKeepAliveInterval(const std::error_code& error_code)
@@ -21,13 +21,11 @@
 
 #include "base/memory/byte_array.h"
 #include "base/net/variable_size.h"
-#include "base/net/write_task.h"
+#include "base/net/write_queue.h"
 
 #include <asio/ip/tcp.hpp>
 #include <asio/high_resolution_timer.hpp>
 
-#include <queue>
-
 namespace base {
 
 class NetworkChannelProxy;
@@ -132,6 +130,16 @@ public:
     // to the queue to be sent.
     void send(ByteArray&& buffer);
 
+    // Sends a buffer shared with other channels without copying it. The buffer must not be changed
+    // until it is sent. Unlike send(ByteArray&&), the method can only be called from the channel
+    // thread.
+    void send(std::shared_ptr<const ByteArray> buffer);
+
+    // Serializes and sends a message. The message is serialized into a buffer from the channel
+    // pool, and the buffer is returned to the pool after the message is written. Unlike
+    // send(ByteArray&&), the method can only be called from the channel thread.
+    void send(const google::protobuf::MessageLite& message);
+
     // Disable or enable the algorithm of Nagle.
     bool setNoDelay(bool enable);
 
@@ -152,6 +160,16 @@ public:
     bool setReadBufferSize(size_t size);
     bool setWriteBufferSize(size_t size);
 
+    // Sets the limits for coalescing queued messages into a single socket write.
+    // |max_bytes| limits the total size of messages in one write (a single message
+    // larger than the limit is still sent as is). |max_messages| limits the number of messages in
+    // one write. If |max_messages| is 1, each message is sent with a separate write.
+    void setWriteBatchLimits(size_t max_bytes, size_t max_messages);
+
+    // Returns the round trip time measured by the last keep alive packet (see setOwnKeepAlive).
+    // Returns 0 if it has not been measured yet.
+    Milliseconds roundTripTime() const { return round_trip_time_; }
+
     int64_t totalRx() const { return total_rx_; }
     int64_t totalTx() const { return total_tx_; }
     int speedRx();
@@ -177,12 +195,11 @@ private:
 
     enum class ReadState
     {
-        IDLE,                // No reads are in progress right now.
-        READ_SIZE,           // Reading the message size.
-        READ_SERVICE_HEADER, // Reading the contents of the service header.
-        READ_SERVICE_DATA,   // Reading the contents of the service data.
-        READ_USER_DATA,      // Reading the contents of the user data.
-        PENDING              // There is a message about which we did not notify.
+        IDLE,               // No reads are in progress right now.
+        READ_SOME,          // Reading the next portion of data into the read buffer.
+        PROCESSING,         // Received messages are being processed.
+        READ_LARGE_MESSAGE, // Reading the contents of the message that does not fit in the buffer.
+        PENDING             // There is a message about which we did not notify.
     };
 
     enum ServiceMessageType
@@ -208,24 +225,25 @@ private:
     void onErrorOccurred(const Location& location, const std::error_code& error_code);
     void onErrorOccurred(const Location& location, ErrorCode error_code);
     void onMessageWritten();
-    void onMessageReceived();
+    bool onMessageReceived(const uint8_t* data, size_t size);
+    bool onServiceMessageReceived(const ServiceHeader& header, const uint8_t* data, size_t size);
+    bool onLargeMessageReceived();
 
     void addWriteTask(WriteTask::Type type, ByteArray&& data);
+    bool appendToWriteBuffer(const WriteTask& task);
+
+    ByteArray takePooledBuffer();
+    void releasePooledBuffer(ByteArray&& buffer);
 
     void doWrite();
     void onWrite(const std::error_code& error_code, size_t bytes_transferred);
 
-    void doReadSize();
-    void onReadSize(const std::error_code& error_code, size_t bytes_transferred);
+    void doReadSome();
+    void onReadSome(const std::error_code& error_code, size_t bytes_transferred);
+    void processReadBuffer();
 
-    void doReadUserData(size_t length);
-    void onReadUserData(const std::error_code& error_code, size_t bytes_transferred);
-
-    void doReadServiceHeader();
-    void onReadServiceHeader(const std::error_code& error_code, size_t bytes_transferred);
-
-    void doReadServiceData(size_t length);
-    void onReadServiceData(const std::error_code& error_code, size_t bytes_transferred);
+    void doReadLargeMessage(size_t header_size, size_t message_size);
+    void onReadLargeMessage(const std::error_code& error_code, size_t bytes_transferred);
 
     void onKeepAliveInterval(const std::error_code& error_code);
     void onKeepAliveTimeout(const std::error_code& error_code);
@@ -244,6 +262,7 @@ private:
     Seconds keep_alive_timeout_;
     ByteArray keep_alive_counter_;
     TimePoint keep_alive_timestamp_;
+    Milliseconds round_trip_time_ { 0 };
 
     Listener* listener_ = nullptr;
     bool connected_ = false;
@@ -252,13 +271,32 @@ private:
     std::unique_ptr<MessageEncryptor> encryptor_;
     std::unique_ptr<MessageDecryptor> decryptor_;
 
-    std::queue<WriteTask> write_queue_;
+    WriteQueue write_queue_;
     VariableSizeWriter variable_size_writer_;
     ByteArray write_buffer_;
+    bool write_in_progress_ = false;
+    size_t write_batch_user_messages_ = 0;
+    size_t max_write_batch_bytes_;
+    size_t max_write_batch_messages_;
+
+    // Buffers of already written messages. They are reused for new messages.
+    std::vector<ByteArray> buffer_pool_;
 
     ReadState state_ = ReadState::IDLE;
-    VariableSizeReader variable_size_reader_;
+
+    // Incoming data is read into |read_buffer_| in large portions. All complete messages in the
+    // buffer are processed in one pass. Bytes in the range [read_begin_, read_end_) are received,
+    // but not processed yet.
     ByteArray read_buffer_;
+    size_t read_begin_ = 0;
+    size_t read_end_ = 0;
+
+    // A message that does not fit in |read_buffer_| is read separately into |large_buffer_|.
+    ByteArray large_buffer_;
+    size_t large_buffer_received_ = 0;
+    bool large_message_is_service_ = false;
+    ServiceHeader large_message_header_;
+
     ByteArray decrypt_buffer_;
 
     int64_t total_tx_ = 0;
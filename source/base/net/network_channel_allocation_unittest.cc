@@ -0,0 +1,235 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+// The test replaces the global operator new to count heap allocations. The replacement affects the
+// whole executable, so the test is built into its own binary (aspia_base_allocation_tests).
+
+#include "base/net/network_channel.h"
+
+#include "base/message_loop/message_loop.h"
+#include "base/net/network_server.h"
+#include "proto/key_exchange.pb.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdlib>
+
+namespace base {
+
+namespace {
+
+std::atomic_bool g_count_allocations { false };
+std::atomic_int64_t g_allocation_count { 0 };
+
+} // namespace
+
+} // namespace base
+
+void* operator new(size_t size)
+{
+    if (base::g_count_allocations)
+        ++base::g_allocation_count;
+
+    void* memory = malloc(size ? size : 1);
+    if (!memory)
+        throw std::bad_alloc();
+
+    return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void* memory, size_t /* size */) noexcept
+{
+    free(memory);
+}
+
+namespace base {
+
+namespace {
+
+const char16_t kLoopbackAddress[] = u"127.0.0.1";
+
+// Counts heap allocations made by the code in its scope.
+class ScopedAllocationCounter
+{
+public:
+    ScopedAllocationCounter()
+    {
+        g_allocation_count = 0;
+        g_count_allocations = true;
+    }
+
+    ~ScopedAllocationCounter()
+    {
+        g_count_allocations = false;
+    }
+
+    int64_t count() const { return g_allocation_count; }
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(ScopedAllocationCounter);
+};
+
+class TestReceiver
+    : public NetworkServer::Delegate,
+      public NetworkChannel::Listener
+{
+public:
+    TestReceiver() = default;
+
+    size_t receivedCount() const { return received_count_; }
+
+    // NetworkServer::Delegate implementation.
+    void onNewConnection(std::unique_ptr<NetworkChannel> channel) override
+    {
+        channel_ = std::move(channel);
+        channel_->setListener(this);
+        channel_->resume();
+    }
+
+    // NetworkChannel::Listener implementation.
+    void onConnected() override
+    {
+        // Nothing
+    }
+
+    void onDisconnected(NetworkChannel::ErrorCode /* error_code */) override
+    {
+        MessageLoop::current()->taskRunner()->postQuit();
+    }
+
+    void onMessageReceived(const ByteArray& /* buffer */) override
+    {
+        ++received_count_;
+    }
+
+    void onMessageWritten(size_t /* pending */) override
+    {
+        // Nothing
+    }
+
+private:
+    size_t received_count_ = 0;
+    std::unique_ptr<NetworkChannel> channel_;
+
+    DISALLOW_COPY_AND_ASSIGN(TestReceiver);
+};
+
+// Sends the next message only after the previous one is written. The allocations are counted after
+// the warm up.
+class TestSender : public NetworkChannel::Listener
+{
+public:
+    TestSender(size_t warm_up_count, size_t message_count)
+        : channel_(std::make_unique<NetworkChannel>()),
+          warm_up_count_(warm_up_count),
+          message_count_(message_count)
+    {
+        channel_->setListener(this);
+        message_.set_public_key(std::string(200, 'a'));
+        message_.set_iv(std::string(12, 'b'));
+    }
+
+    NetworkChannel* channel() { return channel_.get(); }
+    int64_t allocationCount() const { return allocation_count_; }
+
+    // NetworkChannel::Listener implementation.
+    void onConnected() override
+    {
+        sendNext();
+    }
+
+    void onDisconnected(NetworkChannel::ErrorCode /* error_code */) override
+    {
+        MessageLoop::current()->taskRunner()->postQuit();
+    }
+
+    void onMessageReceived(const ByteArray& /* buffer */) override
+    {
+        // Nothing
+    }
+
+    void onMessageWritten(size_t /* pending */) override
+    {
+        ++written_count_;
+
+        if (written_count_ == warm_up_count_)
+            allocation_counter_ = std::make_unique<ScopedAllocationCounter>();
+
+        if (written_count_ == message_count_)
+        {
+            allocation_count_ = allocation_counter_->count();
+            allocation_counter_.reset();
+
+            MessageLoop::current()->taskRunner()->postQuit();
+            return;
+        }
+
+        sendNext();
+    }
+
+private:
+    void sendNext()
+    {
+        // All messages have the same size. Otherwise the buffers would grow with the messages.
+        message_.set_encryption(static_cast<uint32_t>(1 + written_count_ % 100));
+        channel_->send(message_);
+    }
+
+    std::unique_ptr<NetworkChannel> channel_;
+    proto::ClientHello message_;
+    const size_t warm_up_count_;
+    const size_t message_count_;
+    size_t written_count_ = 0;
+
+    std::unique_ptr<ScopedAllocationCounter> allocation_counter_;
+    int64_t allocation_count_ = -1;
+
+    DISALLOW_COPY_AND_ASSIGN(TestSender);
+};
+
+} // namespace
+
+TEST(network_channel_allocation_test, steady_state)
+{
+    static const size_t kWarmUpCount = 1000;
+    static const size_t kMessageCount = 21000;
+
+    MessageLoop message_loop(MessageLoop::Type::ASIO);
+
+    TestReceiver receiver;
+    NetworkServer server;
+    server.start(48220, &receiver);
+
+    TestSender sender(kWarmUpCount, kMessageCount);
+    sender.channel()->connect(kLoopbackAddress, 48220);
+
+    message_loop.run();
+
+    // Messages are serialized into pooled buffers and received into reused buffers, so sending
+    // and receiving do not allocate memory after the warm up.
+    EXPECT_EQ(sender.allocationCount(), 0);
+    EXPECT_GE(receiver.receivedCount(), kWarmUpCount);
+}
+
+} // namespace base
@@ -55,13 +55,17 @@ void NetworkChannelProxy::scheduleWrite()
     if (!channel_)
         return;
 
+    // If a write is in progress, the channel itself will reload the queue after it is completed.
+    if (channel_->write_in_progress_)
+        return;
+
     if (!reloadWriteQueue(&channel_->write_queue_))
         return;
 
     channel_->doWrite();
 }
 
-bool NetworkChannelProxy::reloadWriteQueue(std::queue<WriteTask>* work_queue)
+bool NetworkChannelProxy::reloadWriteQueue(WriteQueue* work_queue)
 {
     if (!work_queue->empty())
         return false;
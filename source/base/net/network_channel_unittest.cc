@@ -0,0 +1,436 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "base/net/network_channel.h"
+
+#include "base/message_loop/message_loop.h"
+#include "base/message_loop/message_pump_asio.h"
+#include "base/net/network_server.h"
+#include "base/net/variable_size.h"
+
+#include <asio/write.hpp>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <iostream>
+#include <random>
+
+namespace base {
+
+namespace {
+
+const char16_t kLoopbackAddress[] = u"127.0.0.1";
+
+class TestReceiver
+    : public NetworkServer::Delegate,
+      public NetworkChannel::Listener
+{
+public:
+    TestReceiver(size_t expected_count, bool store_messages)
+        : expected_count_(expected_count),
+          store_messages_(store_messages)
+    {
+        // Nothing
+    }
+
+    size_t receivedCount() const { return received_count_; }
+    const std::vector<ByteArray>& messages() const { return messages_; }
+
+    // NetworkServer::Delegate implementation.
+    void onNewConnection(std::unique_ptr<NetworkChannel> channel) override
+    {
+        channel_ = std::move(channel);
+        channel_->setListener(this);
+        channel_->resume();
+    }
+
+    // NetworkChannel::Listener implementation.
+    void onConnected() override
+    {
+        // Nothing
+    }
+
+    void onDisconnected(NetworkChannel::ErrorCode /* error_code */) override
+    {
+        MessageLoop::current()->taskRunner()->postQuit();
+    }
+
+    void onMessageReceived(const ByteArray& buffer) override
+    {
+        if (store_messages_)
+            messages_.emplace_back(buffer);
+
+        if (++received_count_ == expected_count_)
+            MessageLoop::current()->taskRunner()->postQuit();
+    }
+
+    void onMessageWritten(size_t /* pending */) override
+    {
+        // Nothing
+    }
+
+private:
+    const size_t expected_count_;
+    const bool store_messages_;
+    size_t received_count_ = 0;
+    std::vector<ByteArray> messages_;
+    std::unique_ptr<NetworkChannel> channel_;
+
+    DISALLOW_COPY_AND_ASSIGN(TestReceiver);
+};
+
+class TestSender : public NetworkChannel::Listener
+{
+public:
+    explicit TestSender(std::vector<ByteArray>&& messages)
+        : channel_(std::make_unique<NetworkChannel>()),
+          messages_(std::move(messages))
+    {
+        channel_->setListener(this);
+    }
+
+    NetworkChannel* channel() { return channel_.get(); }
+    size_t writtenCount() const { return written_count_; }
+
+    // NetworkChannel::Listener implementation.
+    void onConnected() override
+    {
+        // All messages are queued at once to emulate a burst of small messages.
+        for (auto& message : messages_)
+            channel_->send(std::move(message));
+    }
+
+    void onDisconnected(NetworkChannel::ErrorCode /* error_code */) override
+    {
+        MessageLoop::current()->taskRunner()->postQuit();
+    }
+
+    void onMessageReceived(const ByteArray& /* buffer */) override
+    {
+        // Nothing
+    }
+
+    void onMessageWritten(size_t /* pending */) override
+    {
+        ++written_count_;
+    }
+
+private:
+    std::unique_ptr<NetworkChannel> channel_;
+    std::vector<ByteArray> messages_;
+    size_t written_count_ = 0;
+
+    DISALLOW_COPY_AND_ASSIGN(TestSender);
+};
+
+// Sends the same buffer several times without copying it, as the host does for the clients that
+// share a video encoder.
+class SharedBufferSender : public NetworkChannel::Listener
+{
+public:
+    SharedBufferSender(std::shared_ptr<const ByteArray> buffer, size_t count)
+        : channel_(std::make_unique<NetworkChannel>()),
+          buffer_(std::move(buffer)),
+          count_(count)
+    {
+        channel_->setListener(this);
+    }
+
+    NetworkChannel* channel() { return channel_.get(); }
+
+    // NetworkChannel::Listener implementation.
+    void onConnected() override
+    {
+        for (size_t i = 0; i < count_; ++i)
+            channel_->send(buffer_);
+
+        // The channel keeps the buffer until it is written.
+        buffer_.reset();
+    }
+
+    void onDisconnected(NetworkChannel::ErrorCode /* error_code */) override
+    {
+        MessageLoop::current()->taskRunner()->postQuit();
+    }
+
+    void onMessageReceived(const ByteArray& /* buffer */) override
+    {
+        // Nothing
+    }
+
+    void onMessageWritten(size_t /* pending */) override
+    {
+        // Nothing
+    }
+
+private:
+    std::unique_ptr<NetworkChannel> channel_;
+    std::shared_ptr<const ByteArray> buffer_;
+    const size_t count_;
+
+    DISALLOW_COPY_AND_ASSIGN(SharedBufferSender);
+};
+
+ByteArray testMessage(size_t index, size_t size)
+{
+    ByteArray message(size);
+
+    for (size_t i = 0; i < size; ++i)
+        message[i] = static_cast<uint8_t>(index + i);
+
+    return message;
+}
+
+void appendMessage(const ByteArray& message, ByteArray* stream)
+{
+    VariableSizeWriter writer;
+    asio::const_buffer size = writer.variableSize(message.size());
+
+    const uint8_t* size_data = reinterpret_cast<const uint8_t*>(size.data());
+
+    stream->insert(stream->end(), size_data, size_data + size.size());
+    stream->insert(stream->end(), message.begin(), message.end());
+}
+
+void appendKeepAlivePing(uint32_t counter, ByteArray* stream)
+{
+    // Service message: zero size, then the header (type, flags, two reserved bytes, data length)
+    // and the data.
+    const uint8_t header[] = { 0, 1, 1, 0, 0 };
+    const uint32_t length = sizeof(counter);
+
+    const uint8_t* length_data = reinterpret_cast<const uint8_t*>(&length);
+    const uint8_t* counter_data = reinterpret_cast<const uint8_t*>(&counter);
+
+    stream->insert(stream->end(), std::begin(header), std::end(header));
+    stream->insert(stream->end(), length_data, length_data + sizeof(length));
+    stream->insert(stream->end(), counter_data, counter_data + sizeof(counter));
+}
+
+// Writes the stream to the socket in chunks of random size.
+class SplitWriter
+{
+public:
+    SplitWriter(asio::ip::tcp::socket* socket, const ByteArray& stream, size_t max_chunk_size)
+        : socket_(socket),
+          stream_(stream),
+          distribution_(1, max_chunk_size)
+    {
+        // Nothing
+    }
+
+    void start() { doWrite(); }
+
+private:
+    void doWrite()
+    {
+        if (pos_ >= stream_.size())
+            return;
+
+        size_t chunk_size = std::min(distribution_(engine_), stream_.size() - pos_);
+
+        asio::async_write(*socket_, asio::buffer(stream_.data() + pos_, chunk_size),
+            [this](const std::error_code& error_code, size_t bytes_transferred)
+        {
+            if (error_code)
+                return;
+
+            pos_ += bytes_transferred;
+            doWrite();
+        });
+    }
+
+    asio::ip::tcp::socket* socket_;
+    const ByteArray& stream_;
+    size_t pos_ = 0;
+    std::mt19937 engine_;
+    std::uniform_int_distribution<size_t> distribution_;
+
+    DISALLOW_COPY_AND_ASSIGN(SplitWriter);
+};
+
+double sendMessages(size_t message_count,
+                    size_t message_size,
+                    size_t max_batch_messages)
+{
+    MessageLoop message_loop(MessageLoop::Type::ASIO);
+
+    TestReceiver receiver(message_count, false);
+    NetworkServer server;
+    server.start(0, &receiver);
+
+    std::vector<ByteArray> messages;
+    messages.reserve(message_count);
+
+    for (size_t i = 0; i < message_count; ++i)
+        messages.emplace_back(testMessage(i, message_size));
+
+    TestSender sender(std::move(messages));
+    sender.channel()->setWriteBatchLimits(256 * 1024, max_batch_messages);
+    sender.channel()->connect(kLoopbackAddress, server.port());
+
+    auto start_time = std::chrono::high_resolution_clock::now();
+    message_loop.run();
+    auto duration = std::chrono::high_resolution_clock::now() - start_time;
+
+    EXPECT_EQ(receiver.receivedCount(), message_count);
+    EXPECT_EQ(sender.writtenCount(), message_count);
+
+    double seconds = std::chrono::duration<double>(duration).count();
+    return static_cast<double>(message_count) / seconds;
+}
+
+} // namespace
+
+TEST(network_channel_test, batched_write_order)
+{
+    static const size_t kMessageCount = 2000;
+
+    MessageLoop message_loop(MessageLoop::Type::ASIO);
+
+    TestReceiver receiver(kMessageCount, true);
+    NetworkServer server;
+    server.start(0, &receiver);
+
+    std::vector<ByteArray> messages;
+    for (size_t i = 0; i < kMessageCount; ++i)
+        messages.emplace_back(testMessage(i, (i * 37) % 20000 + 1));
+
+    std::vector<ByteArray> messages_copy(messages);
+    TestSender sender(std::move(messages_copy));
+    sender.channel()->setWriteBatchLimits(64 * 1024, 16);
+    sender.channel()->connect(kLoopbackAddress, server.port());
+
+    message_loop.run();
+
+    ASSERT_EQ(receiver.messages().size(), messages.size());
+
+    for (size_t i = 0; i < messages.size(); ++i)
+        EXPECT_EQ(receiver.messages()[i], messages[i]) << "Message index: " << i;
+
+    EXPECT_EQ(sender.writtenCount(), kMessageCount);
+}
+
+TEST(network_channel_test, shared_buffer)
+{
+    static const size_t kMessageCount = 100;
+
+    MessageLoop message_loop(MessageLoop::Type::ASIO);
+
+    TestReceiver receiver(kMessageCount, true);
+    NetworkServer server;
+    server.start(0, &receiver);
+
+    const ByteArray message = testMessage(1, 50000);
+    std::shared_ptr<const ByteArray> buffer = std::make_shared<ByteArray>(message);
+    std::weak_ptr<const ByteArray> weak_buffer = buffer;
+
+    SharedBufferSender sender(std::move(buffer), kMessageCount);
+    sender.channel()->setWriteBatchLimits(64 * 1024, 16);
+    sender.channel()->connect(kLoopbackAddress, server.port());
+
+    message_loop.run();
+
+    ASSERT_EQ(receiver.messages().size(), kMessageCount);
+
+    for (size_t i = 0; i < kMessageCount; ++i)
+        EXPECT_EQ(receiver.messages()[i], message) << "Message index: " << i;
+
+    // All copies of the message are written. The channel does not hold the buffer anymore.
+    EXPECT_TRUE(weak_buffer.expired());
+}
+
+TEST(network_channel_test, read_split_messages)
+{
+    static const size_t kMessageCount = 3000;
+    static const size_t kMaxChunkSizes[] = { 7, 100, 4096, 65536 };
+
+    std::vector<ByteArray> messages;
+    ByteArray stream;
+
+    for (size_t i = 0; i < kMessageCount; ++i)
+    {
+        // Small messages, messages of all size encodings and messages larger than the read buffer.
+        size_t message_size;
+        if (i % 500 == 0)
+            message_size = 100000 + i;
+        else if (i % 100 == 0)
+            message_size = 16384 + i;
+        else
+            message_size = (i * 13) % 300 + 1;
+
+        messages.emplace_back(testMessage(i, message_size));
+        appendMessage(messages.back(), &stream);
+
+        if (i % 10 == 0)
+            appendKeepAlivePing(static_cast<uint32_t>(i), &stream);
+    }
+
+    for (size_t max_chunk_size : kMaxChunkSizes)
+    {
+        MessageLoop message_loop(MessageLoop::Type::ASIO);
+
+        TestReceiver receiver(messages.size(), true);
+        NetworkServer server;
+        server.start(0, &receiver);
+
+        asio::ip::tcp::socket socket(message_loop.pumpAsio()->ioContext());
+        socket.connect(asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), server.port()));
+        socket.set_option(asio::ip::tcp::no_delay(true));
+
+        SplitWriter writer(&socket, stream, max_chunk_size);
+        writer.start();
+
+        auto start_time = std::chrono::high_resolution_clock::now();
+        message_loop.run();
+        auto duration = std::chrono::high_resolution_clock::now() - start_time;
+
+        ASSERT_EQ(receiver.messages().size(), messages.size())
+            << "Max chunk size: " << max_chunk_size;
+
+        for (size_t i = 0; i < messages.size(); ++i)
+        {
+            ASSERT_EQ(receiver.messages()[i], messages[i])
+                << "Message index: " << i << ", max chunk size: " << max_chunk_size;
+        }
+
+        double seconds = std::chrono::duration<double>(duration).count();
+        std::cout << "Max chunk size " << max_chunk_size << ": "
+                  << static_cast<int64_t>(static_cast<double>(stream.size()) / seconds / 1024.0)
+                  << " kB/s" << std::endl;
+    }
+}
+
+TEST(network_channel_test, DISABLED_batched_write_benchmark)
+{
+    static const size_t kMessageCount = 500000;
+    static const size_t kMessageSizes[] = { 16, 64, 256 };
+
+    for (size_t message_size : kMessageSizes)
+    {
+        double unbatched = sendMessages(kMessageCount, message_size, 1);
+        double batched = sendMessages(kMessageCount, message_size, 64);
+
+        std::cout << "Message size " << message_size << " bytes: "
+                  << static_cast<int64_t>(unbatched) << " msg/s (one write per message), "
+                  << static_cast<int64_t>(batched) << " msg/s (batched writes)" << std::endl;
+    }
+}
+
+} // namespace base
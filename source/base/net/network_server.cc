@@ -23,6 +23,9 @@
 #include "base/message_loop/message_pump_asio.h"
 #include "base/net/network_channel.h"
 #include "base/strings/unicode.h"
+#include "base/threading/thread.h"
+
+#include <atomic>
 
 namespace base {
 
@@ -32,6 +35,7 @@ public:
     explicit Impl(asio::io_context& io_context);
     ~Impl();
 
+    void addWorker(Thread* thread, Delegate* delegate);
     void start(uint16_t port, Delegate* delegate);
     void stop();
     uint16_t port() const;
@@ -39,12 +43,28 @@ public:
 private:
     void doAccept();
     void onAccept(const std::error_code& error_code, asio::ip::tcp::socket socket);
+    void onWorkerAccept(size_t worker_index,
+                        const std::error_code& error_code,
+                        asio::ip::tcp::socket socket);
+
+    struct Worker
+    {
+        asio::io_context* io_context;
+        std::shared_ptr<TaskRunner> task_runner;
+        Delegate* delegate;
+    };
 
     asio::io_context& io_context_;
     std::unique_ptr<asio::ip::tcp::acceptor> acceptor_;
     Delegate* delegate_ = nullptr;
     uint16_t port_ = 0;
 
+    std::vector<Worker> workers_;
+    size_t next_worker_ = 0;
+
+    // Read in the worker threads.
+    std::atomic_bool stopped_ = false;
+
     DISALLOW_COPY_AND_ASSIGN(Impl);
 };
 
@@ -59,21 +79,37 @@ NetworkServer::Impl::~Impl()
     DCHECK(!acceptor_);
 }
 
+void NetworkServer::Impl::addWorker(Thread* thread, Delegate* delegate)
+{
+    DCHECK(!acceptor_);
+    DCHECK(thread && thread->messageLoop() && delegate);
+
+    Worker worker;
+    worker.io_context = &thread->messageLoop()->pumpAsio()->ioContext();
+    worker.task_runner = thread->taskRunner();
+    worker.delegate = delegate;
+
+    workers_.emplace_back(std::move(worker));
+}
+
 void NetworkServer::Impl::start(uint16_t port, Delegate* delegate)
 {
     delegate_ = delegate;
-    port_ = port;
 
     DCHECK(delegate_);
 
     asio::ip::tcp::endpoint endpoint(asio::ip::tcp::v4(), port);
     acceptor_ = std::make_unique<asio::ip::tcp::acceptor>(io_context_, endpoint);
 
+    // If the port is 0, the system selects a free port.
+    port_ = acceptor_->local_endpoint().port();
+
     doAccept();
 }
 
 void NetworkServer::Impl::stop()
 {
+    stopped_ = true;
     delegate_ = nullptr;
     acceptor_.reset();
 }
@@ -85,8 +121,24 @@ uint16_t NetworkServer::Impl::port() const
 
 void NetworkServer::Impl::doAccept()
 {
-    acceptor_->async_accept(
-        std::bind(&Impl::onAccept, shared_from_this(), std::placeholders::_1, std::placeholders::_2));
+    if (workers_.empty())
+    {
+        acceptor_->async_accept(std::bind(
+            &Impl::onAccept, shared_from_this(), std::placeholders::_1, std::placeholders::_2));
+        return;
+    }
+
+    size_t worker_index = next_worker_;
+    next_worker_ = (next_worker_ + 1) % workers_.size();
+
+    // The socket is created in the I/O context of the worker thread, so that all further
+    // operations with it are performed in that thread.
+    acceptor_->async_accept(*workers_[worker_index].io_context,
+                            std::bind(&Impl::onWorkerAccept,
+                                      shared_from_this(),
+                                      worker_index,
+                                      std::placeholders::_1,
+                                      std::placeholders::_2));
 }
 
 void NetworkServer::Impl::onAccept(const std::error_code& error_code, asio::ip::tcp::socket socket)
@@ -112,6 +164,44 @@ void NetworkServer::Impl::onAccept(const std::error_code& error_code, asio::ip::
     doAccept();
 }
 
+void NetworkServer::Impl::onWorkerAccept(size_t worker_index,
+                                         const std::error_code& error_code,
+                                         asio::ip::tcp::socket socket)
+{
+    if (!delegate_)
+        return;
+
+    if (error_code)
+    {
+        LOG(LS_ERROR) << "Error while accepting connection: "
+                      << base::utf16FromLocal8Bit(error_code.message());
+    }
+    else
+    {
+        const Worker& worker = workers_[worker_index];
+
+        // The task must be copyable, but the socket is not.
+        std::shared_ptr<asio::ip::tcp::socket> socket_holder =
+            std::make_shared<asio::ip::tcp::socket>(std::move(socket));
+
+        worker.task_runner->postTask(
+            [self = shared_from_this(), delegate = worker.delegate, socket_holder]()
+        {
+            if (self->stopped_)
+                return;
+
+            std::unique_ptr<NetworkChannel> channel =
+                std::unique_ptr<NetworkChannel>(new NetworkChannel(std::move(*socket_holder)));
+
+            // Connection accepted.
+            delegate->onNewConnection(std::move(channel));
+        });
+    }
+
+    // Accept next connection.
+    doAccept();
+}
+
 NetworkServer::NetworkServer()
     : impl_(std::make_shared<Impl>(MessageLoop::current()->pumpAsio()->ioContext()))
 {
@@ -123,6 +213,11 @@ NetworkServer::~NetworkServer()
     impl_->stop();
 }
 
+void NetworkServer::addWorker(Thread* thread, Delegate* delegate)
+{
+    impl_->addWorker(thread, delegate);
+}
+
 void NetworkServer::start(uint16_t port, Delegate* delegate)
 {
     impl_->start(port, delegate);
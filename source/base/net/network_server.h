@@ -27,6 +27,7 @@
 namespace base {
 
 class NetworkChannel;
+class Thread;
 
 class NetworkServer
 {
@@ -42,8 +43,18 @@ public:
         virtual void onNewConnection(std::unique_ptr<NetworkChannel> channel) = 0;
     };
 
+    // Adds a thread to which accepted connections are distributed. Connections are distributed
+    // between the added threads in turn. The channel is created and |delegate| is notified in the
+    // thread that received the connection. The thread must use the ASIO message loop and must be
+    // running until the server is stopped. Must be called before start().
+    // If no threads are added, connections are handled in the thread of the server.
+    void addWorker(Thread* thread, Delegate* delegate);
+
+    // If |port| is 0, the server listens on a free port selected by the system.
     void start(uint16_t port, Delegate* delegate);
     void stop();
+
+    // Returns the port the server listens on.
     uint16_t port() const;
 
 private:
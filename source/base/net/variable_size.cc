@@ -22,45 +22,34 @@
 
 namespace base {
 
-VariableSizeReader::VariableSizeReader() = default;
-
-VariableSizeReader::~VariableSizeReader() = default;
-
-asio::mutable_buffer VariableSizeReader::buffer()
+// static
+std::optional<size_t> VariableSizeReader::messageSize(
+    const uint8_t* data, size_t size, size_t* length)
 {
-    DCHECK_LT(pos_, std::size(buffer_));
+    DCHECK(length);
 
-    return asio::mutable_buffer(&buffer_[pos_], sizeof(uint8_t));
-}
+    size_t result = 0;
 
-std::optional<size_t> VariableSizeReader::messageSize()
-{
-    DCHECK_LT(pos_, std::size(buffer_));
-
-    if (pos_ == 3 || !(buffer_[pos_] & 0x80))
+    for (size_t pos = 0; pos < size; ++pos)
     {
-        size_t result = buffer_[0] & 0x7F;
-
-        if (pos_ >= 1)
-            result += (buffer_[1] & 0x7F) << 7;
-
-        if (pos_ >= 2)
-            result += (buffer_[2] & 0x7F) << 14;
-
-        if (pos_ >= 3)
-            result += buffer_[3] << 21;
+        if (pos == 3)
+        {
+            // The fourth byte is the last and uses all 8 bits.
+            result += static_cast<size_t>(data[3]) << 21;
+            *length = 4;
+            return result;
+        }
 
-        memset(buffer_, 0, std::size(buffer_));
-        pos_ = 0;
+        result += static_cast<size_t>(data[pos] & 0x7F) << (pos * 7);
 
-        return result;
+        if (!(data[pos] & 0x80))
+        {
+            *length = pos + 1;
+            return result;
+        }
     }
-    else
-    {
-        ++pos_;
 
-        return std::nullopt;
-    }
+    return std::nullopt;
 }
 
 VariableSizeWriter::VariableSizeWriter() = default;
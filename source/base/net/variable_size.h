@@ -31,17 +31,13 @@ namespace base {
 class VariableSizeReader
 {
 public:
-    VariableSizeReader();
-    ~VariableSizeReader();
-
-    asio::mutable_buffer buffer();
-    std::optional<size_t> messageSize();
+    // Parses the message size at the beginning of |data|. If |size| is not enough to parse the
+    // message size, std::nullopt is returned. Otherwise |length| receives the number of bytes
+    // occupied by the message size.
+    static std::optional<size_t> messageSize(const uint8_t* data, size_t size, size_t* length);
 
 private:
-    uint8_t buffer_[4] = { 0 };
-    size_t pos_ = 0;
-
-    DISALLOW_COPY_AND_ASSIGN(VariableSizeReader);
+    DISALLOW_IMPLICIT_CONSTRUCTORS(VariableSizeReader);
 };
 
 class VariableSizeWriter
@@ -0,0 +1,88 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef BASE__NET__WRITE_QUEUE_H
+#define BASE__NET__WRITE_QUEUE_H
+
+#include "base/macros_magic.h"
+#include "base/net/write_task.h"
+
+#include <vector>
+
+namespace base {
+
+// FIFO queue of write tasks. Unlike std::queue, the queue keeps the allocated memory when it
+// becomes empty, so adding and removing tasks does not allocate memory in steady state.
+class WriteQueue
+{
+public:
+    WriteQueue() = default;
+    ~WriteQueue() = default;
+
+    bool empty() const { return front_ == tasks_.size(); }
+    size_t size() const { return tasks_.size() - front_; }
+
+    WriteTask& front() { return tasks_[front_]; }
+    const WriteTask& front() const { return tasks_[front_]; }
+
+    void emplace(WriteTask::Type type, ByteArray&& data)
+    {
+        tasks_.emplace_back(type, std::move(data));
+    }
+
+    void emplace(WriteTask::Type type, std::shared_ptr<const ByteArray> data)
+    {
+        tasks_.emplace_back(type, std::move(data));
+    }
+
+    void pop()
+    {
+        ++front_;
+
+        if (front_ == tasks_.size())
+        {
+            // The queue is empty. The capacity of the vector is kept.
+            tasks_.clear();
+            front_ = 0;
+        }
+        else if (front_ >= kMinCompactSize && front_ * 2 >= tasks_.size())
+        {
+            // Remove already processed tasks to prevent unbounded growth of the queue.
+            tasks_.erase(tasks_.begin(), tasks_.begin() + static_cast<ptrdiff_t>(front_));
+            front_ = 0;
+        }
+    }
+
+    void swap(WriteQueue& other)
+    {
+        tasks_.swap(other.tasks_);
+        std::swap(front_, other.front_);
+    }
+
+private:
+    static const size_t kMinCompactSize = 64;
+
+    std::vector<WriteTask> tasks_;
+    size_t front_ = 0;
+
+    DISALLOW_COPY_AND_ASSIGN(WriteQueue);
+};
+
+} // namespace base
+
+#endif // BASE__NET__WRITE_QUEUE_H
@@ -21,6 +21,8 @@
 
 #include "base/memory/byte_array.h"
 
+#include <memory>
+
 namespace base {
 
 class WriteTask
@@ -35,12 +37,30 @@ public:
         // Nothing
     }
 
+    // The buffer is shared with other tasks (e.g. the same message is sent to several channels)
+    // and must not be changed until the task is completed.
+    WriteTask(Type type, std::shared_ptr<const ByteArray> shared_data)
+        : type_(type),
+          shared_data_(std::move(shared_data))
+    {
+        // Nothing
+    }
+
     Type type() const { return type_; }
-    const ByteArray& data() const { return data_; }
+    const ByteArray& data() const { return shared_data_ ? *shared_data_ : data_; }
+
+    // Releases the data of the task. Returns the own buffer of the task to reuse its memory. The
+    // shared buffer is not returned.
+    ByteArray takeData()
+    {
+        shared_data_.reset();
+        return std::move(data_);
+    }
 
 private:
-    const Type type_;
-    const ByteArray data_;
+    Type type_;
+    ByteArray data_;
+    std::shared_ptr<const ByteArray> shared_data_;
 };
 
 } // namespace base
@@ -123,7 +123,7 @@ const char* Authenticator::errorToString(Authenticator::ErrorCode error_code)
 void Authenticator::sendMessage(const google::protobuf::MessageLite& message)
 {
     DCHECK(channel_);
-    channel_->send(base::serialize(message));
+    channel_->send(message);
 }
 
 void Authenticator::finish(const Location& location, ErrorCode error_code)
@@ -40,12 +40,18 @@ constexpr size_t kIvSize = 12;
 } // namespace
 
 ServerAuthenticator::ServerAuthenticator(std::shared_ptr<TaskRunner> task_runner)
-    : Authenticator(std::move(task_runner))
+    : Authenticator(task_runner),
+      task_runner_(std::move(task_runner)),
+      self_(std::make_shared<ServerAuthenticator*>(this)),
+      srp_(std::make_shared<SrpState>())
 {
-    // Nothing
+    DCHECK(task_runner_);
 }
 
-ServerAuthenticator::~ServerAuthenticator() = default;
+ServerAuthenticator::~ServerAuthenticator()
+{
+    *self_ = nullptr;
+}
 
 void ServerAuthenticator::setUserList(std::shared_ptr<UserListBase> user_list)
 {
@@ -115,6 +121,11 @@ bool ServerAuthenticator::setAnonymousAccess(
     return true;
 }
 
+void ServerAuthenticator::setWorkerTaskRunner(std::shared_ptr<TaskRunner> worker_task_runner)
+{
+    worker_task_runner_ = std::move(worker_task_runner);
+}
+
 bool ServerAuthenticator::onStarted()
 {
     internal_state_ = InternalState::READ_CLIENT_HELLO;
@@ -175,6 +186,14 @@ void ServerAuthenticator::onReceived(const ByteArray& buffer)
             onSessionResponse(buffer);
             break;
 
+        case InternalState::CALC_SERVER_KEY_EXCHANGE:
+        case InternalState::CALC_SESSION_KEY:
+        {
+            // The client must wait for our message before sending the next one.
+            finish(FROM_HERE, ErrorCode::PROTOCOL_ERROR);
+        }
+        break;
+
         default:
             NOTREACHED();
             break;
@@ -367,10 +386,12 @@ void ServerAuthenticator::onIdentify(const ByteArray& buffer)
 
     LOG(LS_INFO) << "Username: " << user_name_;
 
+    std::u16string user_name_utf16 = base::utf16FromUtf8(user_name_);
+    ByteArray seed_key;
+    bool calc_verifier = false;
+
     do
     {
-        std::u16string user_name_utf16 = base::utf16FromUtf8(user_name_);
-        ByteArray seed_key;
         User user;
 
         if (user_list_)
@@ -403,10 +424,10 @@ void ServerAuthenticator::onIdentify(const ByteArray& buffer)
             std::optional<SrpNgPair> Ng_pair = pairByGroup(user.group);
             if (Ng_pair.has_value())
             {
-                N_ = BigNum::fromStdString(Ng_pair->first);
-                g_ = BigNum::fromStdString(Ng_pair->second);
-                s_ = BigNum::fromByteArray(user.salt);
-                v_ = BigNum::fromByteArray(user.verifier);
+                srp_->N = BigNum::fromStdString(Ng_pair->first);
+                srp_->g = BigNum::fromStdString(Ng_pair->second);
+                srp_->s = BigNum::fromByteArray(user.salt);
+                srp_->v = BigNum::fromByteArray(user.verifier);
                 break;
             }
             else
@@ -421,17 +442,36 @@ void ServerAuthenticator::onIdentify(const ByteArray& buffer)
         hash.addData(seed_key);
         hash.addData(user_name_);
 
-        N_ = BigNum::fromStdString(kSrpNgPair_8192.first);
-        g_ = BigNum::fromStdString(kSrpNgPair_8192.second);
-        s_ = BigNum::fromByteArray(hash.result());
-        v_ = SrpMath::calc_v(user_name_utf16, seed_key, s_, N_, g_);
+        srp_->N = BigNum::fromStdString(kSrpNgPair_8192.first);
+        srp_->g = BigNum::fromStdString(kSrpNgPair_8192.second);
+        srp_->s = BigNum::fromByteArray(hash.result());
+        calc_verifier = true;
     }
     while (false);
 
-    b_ = BigNum::fromByteArray(Random::byteArray(128)); // 1024 bits.
-    B_ = SrpMath::calc_B(b_, N_, g_, v_);
+    srp_->b = BigNum::fromByteArray(Random::byteArray(128)); // 1024 bits.
+
+    internal_state_ = InternalState::CALC_SERVER_KEY_EXCHANGE;
+
+    postSrpTask([srp = srp_, user_name_utf16, seed_key, calc_verifier]()
+    {
+        if (calc_verifier)
+            srp->v = SrpMath::calc_v(user_name_utf16, seed_key, srp->s, srp->N, srp->g);
+
+        srp->B = SrpMath::calc_B(srp->b, srp->N, srp->g, srp->v);
+    },
+    std::bind(&ServerAuthenticator::onServerKeyCalculated, this));
+}
+
+void ServerAuthenticator::onServerKeyCalculated()
+{
+    // The authenticator could be finished by timeout or network error during the calculation.
+    if (state() != State::PENDING)
+        return;
+
+    DCHECK(internal_state_ == InternalState::CALC_SERVER_KEY_EXCHANGE);
 
-    if (!N_.isValid() || !g_.isValid() || !s_.isValid() || !B_.isValid())
+    if (!srp_->N.isValid() || !srp_->g.isValid() || !srp_->s.isValid() || !srp_->B.isValid())
     {
         finish(FROM_HERE, ErrorCode::PROTOCOL_ERROR);
         return;
@@ -443,10 +483,10 @@ void ServerAuthenticator::onIdentify(const ByteArray& buffer)
     std::unique_ptr<proto::SrpServerKeyExchange> server_key_exchange =
         std::make_unique<proto::SrpServerKeyExchange>();
 
-    server_key_exchange->set_number(N_.toStdString());
-    server_key_exchange->set_generator(g_.toStdString());
-    server_key_exchange->set_salt(s_.toStdString());
-    server_key_exchange->set_b(B_.toStdString());
+    server_key_exchange->set_number(srp_->N.toStdString());
+    server_key_exchange->set_generator(srp_->g.toStdString());
+    server_key_exchange->set_salt(srp_->s.toStdString());
+    server_key_exchange->set_b(srp_->B.toStdString());
     server_key_exchange->set_iv(toStdString(encrypt_iv_));
 
     LOG(LS_INFO) << "Sending: ServerKeyExchange";
@@ -465,16 +505,33 @@ void ServerAuthenticator::onClientKeyExchange(const ByteArray& buffer)
         return;
     }
 
-    A_ = BigNum::fromStdString(client_key_exchange->a());
+    srp_->A = BigNum::fromStdString(client_key_exchange->a());
     decrypt_iv_ = fromStdString(client_key_exchange->iv());
 
-    if (!A_.isValid() || decrypt_iv_.empty())
+    if (!srp_->A.isValid() || decrypt_iv_.empty())
     {
         finish(FROM_HERE, ErrorCode::PROTOCOL_ERROR);
         return;
     }
 
-    ByteArray srp_key = createSrpKey();
+    internal_state_ = InternalState::CALC_SESSION_KEY;
+
+    postSrpTask([srp = srp_]()
+    {
+        srp->key = createSrpKey(*srp);
+    },
+    std::bind(&ServerAuthenticator::onSrpKeyCalculated, this));
+}
+
+void ServerAuthenticator::onSrpKeyCalculated()
+{
+    // The authenticator could be finished by timeout or network error during the calculation.
+    if (state() != State::PENDING)
+        return;
+
+    DCHECK(internal_state_ == InternalState::CALC_SESSION_KEY);
+
+    ByteArray srp_key = std::move(srp_->key);
     if (srp_key.empty())
     {
         finish(FROM_HERE, ErrorCode::UNKNOWN_ERROR);
@@ -570,18 +627,46 @@ void ServerAuthenticator::onSessionResponse(const ByteArray& buffer)
     finish(FROM_HERE, ErrorCode::SUCCESS);
 }
 
-ByteArray ServerAuthenticator::createSrpKey()
+// static
+ByteArray ServerAuthenticator::createSrpKey(const SrpState& srp)
 {
-    if (!SrpMath::verify_A_mod_N(A_, N_))
+    if (!SrpMath::verify_A_mod_N(srp.A, srp.N))
     {
         LOG(LS_ERROR) << "SrpMath::verify_A_mod_N failed";
         return ByteArray();
     }
 
-    BigNum u = SrpMath::calc_u(A_, B_, N_);
-    BigNum server_key = SrpMath::calcServerKey(A_, v_, u, b_, N_);
+    BigNum u = SrpMath::calc_u(srp.A, srp.B, srp.N);
+    BigNum server_key = SrpMath::calcServerKey(srp.A, srp.v, u, srp.b, srp.N);
 
     return server_key.toByteArray();
 }
 
+void ServerAuthenticator::postSrpTask(TaskRunner::Callback task, TaskRunner::Callback reply)
+{
+    if (!worker_task_runner_)
+    {
+        task();
+        reply();
+        return;
+    }
+
+    worker_task_runner_->postTask([task = std::move(task),
+                                   reply = std::move(reply),
+                                   task_runner = task_runner_,
+                                   self = self_]()
+    {
+        task();
+
+        task_runner->postTask([reply, self]()
+        {
+            // The authenticator was destroyed while the task was running.
+            if (!*self)
+                return;
+
+            reply();
+        });
+    });
+}
+
 } // namespace base
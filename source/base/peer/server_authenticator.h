@@ -21,6 +21,7 @@
 
 #include "base/crypto/big_num.h"
 #include "base/crypto/key_pair.h"
+#include "base/task_runner.h"
 #include "base/net/network_channel.h"
 #include "base/peer/authenticator.h"
 
@@ -52,6 +53,11 @@ public:
     // By default, anonymous access is disabled.
     [[nodiscard]] bool setAnonymousAccess(AnonymousAccess anonymous_access, uint32_t session_types);
 
+    // Sets the task runner on which SRP calculations are performed. The calculations for large
+    // groups take a long time, so they should not block the authenticator thread.
+    // If the task runner is not set, the calculations are performed in the authenticator thread.
+    void setWorkerTaskRunner(std::shared_ptr<TaskRunner> worker_task_runner);
+
 protected:
     // Authenticator implementation.
     bool onStarted() override;
@@ -61,10 +67,37 @@ protected:
 private:
     void onClientHello(const ByteArray& buffer);
     void onIdentify(const ByteArray& buffer);
+    void onServerKeyCalculated();
     void onClientKeyExchange(const ByteArray& buffer);
+    void onSrpKeyCalculated();
     void doSessionChallenge();
     void onSessionResponse(const ByteArray& buffer);
-    [[nodiscard]] ByteArray createSrpKey();
+
+    // Numbers of the SRP exchange. They are shared with the tasks running in the worker thread
+    // and remain valid even if the authenticator is destroyed before the task is completed.
+    struct SrpState
+    {
+        BigNum N;
+        BigNum g;
+        BigNum v;
+        BigNum s;
+        BigNum b;
+        BigNum B;
+        BigNum A;
+        ByteArray key;
+    };
+
+    [[nodiscard]] static ByteArray createSrpKey(const SrpState& srp);
+
+    // Runs |task| on the worker task runner and then |reply| on the authenticator task runner.
+    // |reply| is not called if the authenticator is destroyed by this time.
+    void postSrpTask(TaskRunner::Callback task, TaskRunner::Callback reply);
+
+    std::shared_ptr<TaskRunner> task_runner_;
+    std::shared_ptr<TaskRunner> worker_task_runner_;
+
+    // Reset to nullptr in the destructor. Replies of the worker tasks check it before the call.
+    std::shared_ptr<ServerAuthenticator*> self_;
 
     std::shared_ptr<UserListBase> user_list_;
 
@@ -73,8 +106,10 @@ private:
         READ_CLIENT_HELLO,
         SEND_SERVER_HELLO,
         READ_IDENTIFY,
+        CALC_SERVER_KEY_EXCHANGE,
         SEND_SERVER_KEY_EXCHANGE,
         READ_CLIENT_KEY_EXCHANGE,
+        CALC_SESSION_KEY,
         SEND_SESSION_CHALLENGE,
         READ_SESSION_RESPONSE
     };
@@ -86,13 +121,7 @@ private:
     uint32_t session_types_ = 0;
 
     KeyPair key_pair_;
-    BigNum N_;
-    BigNum g_;
-    BigNum v_;
-    BigNum s_;
-    BigNum b_;
-    BigNum B_;
-    BigNum A_;
+    std::shared_ptr<SrpState> srp_;
 
     DISALLOW_COPY_AND_ASSIGN(ServerAuthenticator);
 };
@@ -19,17 +19,30 @@
 #include "base/peer/server_authenticator_manager.h"
 
 #include "base/logging.h"
+#include "base/sys_info.h"
 #include "base/task_runner.h"
 #include "base/peer/user_list_base.h"
 
+#include <algorithm>
+
 namespace base {
 
+namespace {
+
+// Maximum number of threads for SRP calculations.
+constexpr int kMaxWorkerThreads = 8;
+
+} // namespace
+
 ServerAuthenticatorManager::ServerAuthenticatorManager(
     std::shared_ptr<TaskRunner> task_runner, Delegate* delegate)
     : task_runner_(std::move(task_runner)),
       delegate_(delegate)
 {
     DCHECK(task_runner_ && delegate_);
+
+    worker_thread_count_ = static_cast<size_t>(
+        std::clamp(SysInfo::processorThreads(), 1, kMaxWorkerThreads));
 }
 
 ServerAuthenticatorManager::~ServerAuthenticatorManager() = default;
@@ -52,13 +65,26 @@ void ServerAuthenticatorManager::setAnonymousAccess(
     anonymous_session_types_ = session_types;
 }
 
+void ServerAuthenticatorManager::setWorkerThreadCount(size_t count)
+{
+    DCHECK(!worker_pool_.isRunning());
+    worker_thread_count_ = count;
+}
+
 void ServerAuthenticatorManager::addNewChannel(std::unique_ptr<NetworkChannel> channel)
 {
     DCHECK(channel);
 
+    if (worker_thread_count_ && !worker_pool_.isRunning())
+    {
+        LOG(LS_INFO) << "Authentication worker threads: " << worker_thread_count_;
+        worker_pool_.start(worker_thread_count_);
+    }
+
     std::unique_ptr<ServerAuthenticator> authenticator =
         std::make_unique<ServerAuthenticator>(task_runner_);
     authenticator->setUserList(user_list_);
+    authenticator->setWorkerTaskRunner(worker_pool_.taskRunner());
 
     if (!private_key_.empty())
     {
@@ -75,55 +101,53 @@ void ServerAuthenticatorManager::addNewChannel(std::unique_ptr<NetworkChannel> c
         }
     }
 
+    ServerAuthenticator* authenticator_ptr = authenticator.get();
+
     // Create a new authenticator for the connection and put it on the list.
-    pending_.emplace_back(std::move(authenticator));
+    pending_.emplace(authenticator_ptr, std::move(authenticator));
 
     // Start the authentication process.
-    pending_.back()->start(
-        std::move(channel), std::bind(&ServerAuthenticatorManager::onComplete, this));
+    authenticator_ptr->start(std::move(channel),
+        std::bind(&ServerAuthenticatorManager::onComplete, this, authenticator_ptr));
 }
 
-void ServerAuthenticatorManager::onComplete()
+void ServerAuthenticatorManager::onComplete(ServerAuthenticator* authenticator)
 {
-    for (auto it = pending_.begin(); it != pending_.end();)
+    auto it = pending_.find(authenticator);
+    if (it == pending_.end())
     {
-        ServerAuthenticator* current = it->get();
+        NOTREACHED();
+        return;
+    }
 
-        switch (current->state())
+    switch (authenticator->state())
+    {
+        case Authenticator::State::SUCCESS:
         {
-            case Authenticator::State::SUCCESS:
-            case Authenticator::State::FAILED:
-            {
-                if (current->state() == Authenticator::State::SUCCESS)
-                {
-                    SessionInfo session_info;
-
-                    session_info.channel       = current->takeChannel();
-                    session_info.version       = current->peerVersion();
-                    session_info.os_name       = current->peerOsName();
-                    session_info.computer_name = current->peerComputerName();
-                    session_info.user_name     = current->userName();
-                    session_info.session_type  = current->sessionType();
-
-                    delegate_->onNewSession(std::move(session_info));
-                }
-
-                // Authenticator not needed anymore.
-                task_runner_->deleteSoon(std::move(*it));
-                it = pending_.erase(it);
-            }
-            break;
+            SessionInfo session_info;
 
-            case Authenticator::State::PENDING:
-                // Authentication is not yet completed, skip.
-                ++it;
-                break;
+            session_info.channel       = authenticator->takeChannel();
+            session_info.version       = authenticator->peerVersion();
+            session_info.os_name       = authenticator->peerOsName();
+            session_info.computer_name = authenticator->peerComputerName();
+            session_info.user_name     = authenticator->userName();
+            session_info.session_type  = authenticator->sessionType();
 
-            default:
-                NOTREACHED();
-                return;
+            delegate_->onNewSession(std::move(session_info));
         }
+        break;
+
+        case Authenticator::State::FAILED:
+            break;
+
+        default:
+            NOTREACHED();
+            return;
     }
+
+    // Authenticator not needed anymore.
+    task_runner_->deleteSoon(std::move(it->second));
+    pending_.erase(it);
 }
 
 } // namespace base
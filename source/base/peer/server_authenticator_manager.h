@@ -20,6 +20,9 @@
 #define BASE__PEER__SERVER_AUTHENTICATOR_MANAGER_H
 
 #include "base/peer/server_authenticator.h"
+#include "base/threading/thread_pool.h"
+
+#include <unordered_map>
 
 namespace base {
 
@@ -63,17 +66,28 @@ public:
     void setAnonymousAccess(
         ServerAuthenticator::AnonymousAccess anonymous_access, uint32_t session_types);
 
+    // Sets the number of threads for SRP calculations. If |count| is 0, the calculations are
+    // performed in the thread of the manager. By default, one thread per processor thread is used
+    // (but no more than 8). The threads are started when the first channel is added, so an idle
+    // server has none. Must be called before the first channel is added.
+    void setWorkerThreadCount(size_t count);
+
     // Adds a channel to the authentication queue. After success completion, a session will be
     // created (in a stopped state) and method Delegate::onNewSession will be called.
     // If authentication fails, the channel will be automatically deleted.
     void addNewChannel(std::unique_ptr<NetworkChannel> channel);
 
 private:
-    void onComplete();
+    void onComplete(ServerAuthenticator* authenticator);
 
     std::shared_ptr<TaskRunner> task_runner_;
     std::shared_ptr<UserListBase> user_list_;
-    std::vector<std::unique_ptr<ServerAuthenticator>> pending_;
+
+    // Threads for SRP calculations. Must be destroyed after the authenticators.
+    ThreadPool worker_pool_;
+    size_t worker_thread_count_;
+
+    std::unordered_map<ServerAuthenticator*, std::unique_ptr<ServerAuthenticator>> pending_;
 
     ByteArray private_key_;
 
@@ -0,0 +1,72 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "base/threading/thread_pool.h"
+
+#include "base/logging.h"
+#include "base/threading/thread.h"
+
+namespace base {
+
+ThreadPool::ThreadPool() = default;
+
+ThreadPool::~ThreadPool()
+{
+    stop();
+}
+
+void ThreadPool::start(size_t thread_count)
+{
+    DCHECK(threads_.empty());
+
+    if (!thread_count)
+        thread_count = 1;
+
+    for (size_t i = 0; i < thread_count; ++i)
+    {
+        std::unique_ptr<Thread> thread = std::make_unique<Thread>();
+        thread->start(MessageLoop::Type::DEFAULT);
+        threads_.emplace_back(std::move(thread));
+    }
+
+    next_thread_ = 0;
+}
+
+void ThreadPool::stop()
+{
+    for (const auto& thread : threads_)
+        thread->stopSoon();
+
+    for (const auto& thread : threads_)
+        thread->stop();
+
+    threads_.clear();
+}
+
+std::shared_ptr<TaskRunner> ThreadPool::taskRunner()
+{
+    if (threads_.empty())
+        return nullptr;
+
+    Thread* thread = threads_[next_thread_].get();
+    next_thread_ = (next_thread_ + 1) % threads_.size();
+
+    return thread->taskRunner();
+}
+
+} // namespace base
@@ -0,0 +1,63 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef BASE__THREADING__THREAD_POOL_H
+#define BASE__THREADING__THREAD_POOL_H
+
+#include "base/macros_magic.h"
+
+#include <memory>
+#include <vector>
+
+namespace base {
+
+class TaskRunner;
+class Thread;
+
+// A fixed set of threads for tasks that must not block the calling thread (for example, heavy
+// cryptographic calculations). The class is not thread-safe and must be used from the thread in
+// which it was created.
+class ThreadPool
+{
+public:
+    ThreadPool();
+    ~ThreadPool();
+
+    // Starts |thread_count| threads. If |thread_count| is 0, then one thread is started.
+    void start(size_t thread_count);
+
+    // Stops all threads. Tasks that have not yet been started are discarded.
+    void stop();
+
+    bool isRunning() const { return !threads_.empty(); }
+    size_t threadCount() const { return threads_.size(); }
+
+    // Returns the task runner of one of the threads. Threads are selected in turn, so that the
+    // tasks are distributed evenly between them. Returns nullptr if the pool is not running.
+    std::shared_ptr<TaskRunner> taskRunner();
+
+private:
+    std::vector<std::unique_ptr<Thread>> threads_;
+    size_t next_thread_ = 0;
+
+    DISALLOW_COPY_AND_ASSIGN(ThreadPool);
+};
+
+} // namespace base
+
+#endif // BASE__THREADING__THREAD_POOL_H
@@ -0,0 +1,147 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "base/threading/thread_pool.h"
+
+#include "base/task_runner.h"
+#include "base/waitable_event.h"
+
+#include <atomic>
+#include <set>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+namespace base {
+
+namespace {
+
+const std::chrono::seconds kWaitTimeout{ 10 };
+
+std::thread::id threadIdOf(TaskRunner* task_runner)
+{
+    std::thread::id thread_id;
+    WaitableEvent event;
+
+    task_runner->postTask([&]()
+    {
+        thread_id = std::this_thread::get_id();
+        event.signal();
+    });
+
+    EXPECT_TRUE(event.wait(kWaitTimeout));
+    return thread_id;
+}
+
+} // namespace
+
+TEST(thread_pool_test, start_stop)
+{
+    ThreadPool pool;
+    EXPECT_FALSE(pool.isRunning());
+    EXPECT_EQ(pool.threadCount(), 0);
+
+    pool.start(3);
+    EXPECT_TRUE(pool.isRunning());
+    EXPECT_EQ(pool.threadCount(), 3);
+
+    pool.stop();
+    EXPECT_FALSE(pool.isRunning());
+    EXPECT_EQ(pool.threadCount(), 0);
+
+    // The pool can be started again after it was stopped.
+    pool.start(2);
+    EXPECT_TRUE(pool.isRunning());
+    EXPECT_EQ(pool.threadCount(), 2);
+}
+
+TEST(thread_pool_test, zero_threads)
+{
+    ThreadPool pool;
+    pool.start(0);
+
+    EXPECT_TRUE(pool.isRunning());
+    EXPECT_EQ(pool.threadCount(), 1);
+}
+
+TEST(thread_pool_test, round_robin)
+{
+    static const size_t kThreadCount = 4;
+
+    ThreadPool pool;
+    pool.start(kThreadCount);
+
+    std::vector<std::shared_ptr<TaskRunner>> task_runners;
+    for (size_t i = 0; i < kThreadCount * 2; ++i)
+    {
+        task_runners.emplace_back(pool.taskRunner());
+        ASSERT_TRUE(task_runners.back());
+    }
+
+    std::set<std::thread::id> thread_ids;
+
+    for (size_t i = 0; i < kThreadCount; ++i)
+    {
+        const std::thread::id thread_id = threadIdOf(task_runners[i].get());
+
+        EXPECT_NE(thread_id, std::this_thread::get_id());
+        thread_ids.insert(thread_id);
+
+        // After all threads were returned, the selection starts again from the first one.
+        EXPECT_EQ(threadIdOf(task_runners[i + kThreadCount].get()), thread_id);
+    }
+
+    EXPECT_EQ(thread_ids.size(), kThreadCount);
+}
+
+TEST(thread_pool_test, tasks_are_executed)
+{
+    static const int kTaskCount = 1000;
+
+    ThreadPool pool;
+    pool.start(4);
+
+    std::atomic_int executed = 0;
+    WaitableEvent finished;
+
+    for (int i = 0; i < kTaskCount; ++i)
+    {
+        pool.taskRunner()->postTask([&]()
+        {
+            if (++executed == kTaskCount)
+                finished.signal();
+        });
+    }
+
+    EXPECT_TRUE(finished.wait(kWaitTimeout));
+    EXPECT_EQ(executed, kTaskCount);
+}
+
+TEST(thread_pool_test, no_task_runner_when_stopped)
+{
+    ThreadPool pool;
+    EXPECT_EQ(pool.taskRunner(), nullptr);
+
+    pool.start(1);
+    EXPECT_NE(pool.taskRunner(), nullptr);
+
+    pool.stop();
+    EXPECT_EQ(pool.taskRunner(), nullptr);
+}
+
+} // namespace base
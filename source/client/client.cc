@@ -144,7 +144,7 @@ void Client::sendMessage(const google::protobuf::MessageLite& message)
         return;
     }
 
-    channel_->send(base::serialize(message));
+    channel_->send(message);
 }
 
 int64_t Client::totalRx() const
@@ -22,6 +22,7 @@
 #include "base/task_runner.h"
 #include "client/file_control_proxy.h"
 #include "client/file_manager_window_proxy.h"
+#include "common/file_packet.h"
 #include "common/file_task_factory.h"
 #include "common/file_task_consumer_proxy.h"
 #include "common/file_task_producer_proxy.h"
@@ -34,7 +35,9 @@ ClientFileTransfer::ClientFileTransfer(std::shared_ptr<base::TaskRunner> io_task
       task_consumer_proxy_(std::make_shared<common::FileTaskConsumerProxy>(this)),
       task_producer_proxy_(std::make_shared<common::FileTaskProducerProxy>(this)),
       local_worker_(std::make_unique<common::FileWorker>(io_task_runner)),
-      file_control_proxy_(std::make_shared<FileControlProxy>(io_task_runner, this))
+      file_control_proxy_(std::make_shared<FileControlProxy>(io_task_runner, this)),
+      packet_size_(common::kPreferredFilePacketSize),
+      packet_window_(common::kDefaultFilePacketWindow)
 {
     // Nothing
 }
@@ -55,6 +58,12 @@ void ClientFileTransfer::setFileManagerWindow(
     file_manager_window_proxy_ = std::move(file_manager_window_proxy);
 }
 
+void ClientFileTransfer::setPacketLimits(size_t packet_size, size_t packet_window)
+{
+    packet_size_ = packet_size;
+    packet_window_ = packet_window;
+}
+
 void ClientFileTransfer::onSessionStarted(const base::Version& /* peer_version */)
 {
     LOG(LS_INFO) << "File transfer session started";
@@ -84,14 +93,13 @@ void ClientFileTransfer::onMessageReceived(const base::ByteArray& buffer)
     }
     else if (!remote_task_queue_.empty())
     {
-        // Move the reply to the request and notify the sender.
-        remote_task_queue_.front()->setReply(std::move(reply));
-
-        // Remove the request from the queue.
+        // The host executes the requests in the order in which they were sent. The reply belongs
+        // to the oldest request.
+        std::shared_ptr<common::FileTask> task = std::move(remote_task_queue_.front());
         remote_task_queue_.pop();
 
-        // Execute the next request.
-        doNextRemoteTask();
+        // Move the reply to the request and notify the sender.
+        task->setReply(std::move(reply));
     }
     else
     {
@@ -141,26 +149,15 @@ void ClientFileTransfer::doTask(std::shared_ptr<common::FileTask> task)
     }
     else
     {
-        const bool schedule = remote_task_queue_.empty();
+        // Send a request to the remote computer without waiting for replies to previous requests.
+        // This allows file packets to be transferred without a pause for a round trip.
+        sendMessage(task->request());
 
-        // Add the request to the queue.
+        // Add the request to the queue of requests waiting for a reply.
         remote_task_queue_.emplace(std::move(task));
-
-        // If the request queue was empty, then run execution.
-        if (schedule)
-            doNextRemoteTask();
     }
 }
 
-void ClientFileTransfer::doNextRemoteTask()
-{
-    if (remote_task_queue_.empty())
-        return;
-
-    // Send a request to the remote computer.
-    sendMessage(remote_task_queue_.front()->request());
-}
-
 common::FileTaskFactory* ClientFileTransfer::taskFactory(common::FileTask::Target target)
 {
     common::FileTaskFactory* task_factory;
@@ -226,6 +223,7 @@ void ClientFileTransfer::transfer(std::shared_ptr<FileTransferWindowProxy> trans
 
     transfer_ = std::make_unique<FileTransfer>(
         local_worker_->taskRunner(), transfer_window_proxy, task_consumer_proxy_, transfer_type);
+    transfer_->setPacketLimits(packet_size_, packet_window_);
 
     transfer_->start(source_path, target_path, items, [this]()
     {
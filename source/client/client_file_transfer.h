@@ -52,6 +52,10 @@ public:
 
     void setFileManagerWindow(std::shared_ptr<FileManagerWindowProxy> file_manager_window_proxy);
 
+    // Sets the packet size and the packet window of file transfers (see
+    // FileTransfer::setPacketLimits). Must be called before the client is started.
+    void setPacketLimits(size_t packet_size, size_t packet_window);
+
     // FileTaskConsumer implementation.
     void doTask(std::shared_ptr<common::FileTask> task) override;
 
@@ -67,8 +71,6 @@ protected:
     void onTaskDone(std::shared_ptr<common::FileTask> task) override;
 
 private:
-    void doNextRemoteTask();
-
     common::FileTaskFactory* taskFactory(common::FileTask::Target target);
 
     // FileControl implementation.
@@ -100,6 +102,8 @@ private:
     std::shared_ptr<FileManagerWindowProxy> file_manager_window_proxy_;
     std::unique_ptr<FileRemover> remover_;
     std::unique_ptr<FileTransfer> transfer_;
+    size_t packet_size_;
+    size_t packet_window_;
 
     DISALLOW_COPY_AND_ASSIGN(ClientFileTransfer);
 };
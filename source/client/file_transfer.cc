@@ -27,6 +27,8 @@
 #include "common/file_task_producer_proxy.h"
 #include "common/file_packet.h"
 
+#include <algorithm>
+
 namespace client {
 
 namespace {
@@ -94,7 +96,9 @@ FileTransfer::FileTransfer(std::shared_ptr<base::TaskRunner> io_task_runner,
       task_consumer_proxy_(std::move(task_consumer_proxy)),
       task_producer_proxy_(std::make_shared<common::FileTaskProducerProxy>(this)),
       cancel_timer_(base::WaitableTimer::Type::SINGLE_SHOT, io_task_runner),
-      type_(type)
+      type_(type),
+      packet_size_(common::kPreferredFilePacketSize),
+      packet_window_(common::kDefaultFilePacketWindow)
 {
     // Nothing
 }
@@ -179,6 +183,13 @@ void FileTransfer::stop()
     }
 }
 
+void FileTransfer::setPacketLimits(size_t packet_size, size_t packet_window)
+{
+    packet_size_ =
+        std::clamp(packet_size, common::kMinFilePacketSize, common::kMaxFilePacketSize);
+    packet_window_ = std::clamp(packet_window, size_t(1), common::kMaxFilePacketWindow);
+}
+
 void FileTransfer::setActionForErrorType(Error::Type error_type, Error::Action action)
 {
     actions_.insert_or_assign(error_type, action);
@@ -250,13 +261,39 @@ void FileTransfer::targetReply(const proto::FileRequest& request, const proto::F
             return;
         }
 
-        task_consumer_proxy_->doTask(
-            task_factory_source_->packetRequest(proto::FilePacketRequest::NO_FLAGS));
+        // The target reports the compression it supports. Old versions do not support it.
+        compression_ = reply.compression();
+
+        // The parameters of the transfer are passed to the source with the first packet request.
+        // Old versions of the source ignore them and transfer the whole file.
+        first_packet_request_ = std::make_unique<proto::FilePacketRequest>();
+        first_packet_request_->set_flags(proto::FilePacketRequest::NO_FLAGS);
+        first_packet_request_->set_compression(compression_);
+        first_packet_request_->set_offset(reply.resume_offset());
+        first_packet_request_->set_offset_checksum(reply.resume_checksum());
+
+        if (reply.has_signature())
+            first_packet_request_->mutable_signature()->CopyFrom(reply.signature());
+
+        // The number of packets is not known until the first packet with the file size is
+        // received.
+        packets_to_request_ = 1;
+        requestPackets();
     }
     else if (request.has_packet())
     {
+        if (stale_target_replies_)
+        {
+            --stale_target_replies_;
+            return;
+        }
+
+        DCHECK(target_pending_);
+        --target_pending_;
+
         if (reply.error_code() != proto::FILE_ERROR_SUCCESS)
         {
+            discardPackets();
             onError(Error::Type::WRITE_FILE, reply.error_code(), frontTask().targetPath());
             return;
         }
@@ -264,16 +301,16 @@ void FileTransfer::targetReply(const proto::FileRequest& request, const proto::F
         const int64_t full_task_size = frontTask().size();
         if (full_task_size && total_size_)
         {
-            int64_t packet_size = common::kMaxFilePacketSize;
-
-            task_transfered_size_ += packet_size;
+            // The data of the packet can be compressed. All packets except the last one have the
+            // same size.
+            int64_t packet_size = 0;
+            if (!request.packet().data().empty() || request.packet().delta_size())
+                packet_size = static_cast<int64_t>(packet_size_in_transfer_);
 
-            if (task_transfered_size_ > full_task_size)
-            {
-                packet_size = task_transfered_size_ - full_task_size;
-                task_transfered_size_ = full_task_size;
-            }
+            if (task_transfered_size_ + packet_size > full_task_size)
+                packet_size = full_task_size - task_transfered_size_;
 
+            task_transfered_size_ += packet_size;
             total_transfered_size_ += packet_size;
 
             const int task_percentage =
@@ -292,15 +329,12 @@ void FileTransfer::targetReply(const proto::FileRequest& request, const proto::F
 
         if (request.packet().flags() & proto::FilePacket::LAST_PACKET)
         {
+            DCHECK(!source_pending_ && !target_pending_);
             doNextTask();
             return;
         }
 
-        uint32_t flags = proto::FilePacketRequest::NO_FLAGS;
-        if (is_canceled_)
-            flags = proto::FilePacketRequest::CANCEL;
-
-        task_consumer_proxy_->doTask(task_factory_source_->packetRequest(flags));
+        requestPackets();
     }
     else
     {
@@ -323,18 +357,64 @@ void FileTransfer::sourceReply(const proto::FileRequest& request, const proto::F
             return;
         }
 
-        task_consumer_proxy_->doTask(
-            task_factory_target_->upload(front_task.targetPath(), front_task.overwrite()));
+        // The target continues an interrupted transfer of the file. If the file is overwritten,
+        // only the changed parts of the file are transferred.
+        task_consumer_proxy_->doTask(task_factory_target_->upload(
+            front_task.targetPath(), front_task.overwrite(), true, front_task.overwrite()));
     }
     else if (request.has_packet_request())
     {
+        if (stale_source_replies_)
+        {
+            --stale_source_replies_;
+            return;
+        }
+
+        DCHECK(source_pending_);
+        --source_pending_;
+
         if (reply.error_code() != proto::FILE_ERROR_SUCCESS)
         {
+            discardPackets();
             onError(Error::Type::READ_FILE, reply.error_code(), frontTask().sourcePath());
             return;
         }
 
-        task_consumer_proxy_->doTask(task_factory_target_->packet(reply.packet()));
+        const proto::FilePacket& packet = reply.packet();
+
+        if (packet.flags() & proto::FilePacket::FIRST_PACKET)
+        {
+            // Old versions do not send the packet size and always use the default size.
+            uint64_t packet_size = packet.packet_size();
+            if (!packet_size)
+                packet_size = common::kDefaultFilePacketSize;
+
+            packet_size_in_transfer_ = static_cast<size_t>(packet_size);
+
+            // The part of the file before the offset was transferred earlier.
+            const uint64_t offset = std::min(packet.offset(), packet.file_size());
+            const uint64_t left_size = packet.file_size() - offset;
+
+            if (offset && frontTask().size())
+            {
+                const int64_t skipped_size =
+                    std::min(static_cast<int64_t>(offset), frontTask().size());
+
+                task_transfered_size_ += skipped_size;
+                total_transfered_size_ += skipped_size;
+            }
+
+            uint64_t packet_count =
+                std::max((left_size + packet_size - 1) / packet_size, uint64_t(1));
+
+            // The first packet has already been requested.
+            packets_to_request_ = static_cast<size_t>(packet_count - 1);
+        }
+
+        ++target_pending_;
+        task_consumer_proxy_->doTask(task_factory_target_->packet(packet));
+
+        requestPackets();
     }
     else
     {
@@ -381,6 +461,14 @@ void FileTransfer::doFrontTask(bool overwrite)
     task_percentage_ = 0;
     task_transfered_size_ = 0;
 
+    packets_to_request_ = 0;
+    source_pending_ = 0;
+    target_pending_ = 0;
+    cancel_sent_ = false;
+    compression_ = proto::FILE_COMPRESSION_NONE;
+    packet_size_in_transfer_ = 0;
+    first_packet_request_.reset();
+
     Task& front_task = frontTask();
     front_task.setOverwrite(overwrite);
 
@@ -394,7 +482,7 @@ void FileTransfer::doFrontTask(bool overwrite)
     else
     {
         task_consumer_proxy_->doTask(
-            task_factory_source_->download(front_task.sourcePath()));
+            task_factory_source_->download(front_task.sourcePath(), packet_size_));
     }
 }
 
@@ -424,6 +512,52 @@ void FileTransfer::doNextTask()
     doFrontTask(false);
 }
 
+void FileTransfer::requestPackets()
+{
+    if (is_canceled_)
+    {
+        // After the cancel request the source closes the file and does not accept packet requests.
+        // The request is sent when the packets in flight are written.
+        if (!cancel_sent_ && !source_pending_ && !target_pending_)
+        {
+            cancel_sent_ = true;
+            ++source_pending_;
+
+            task_consumer_proxy_->doTask(
+                task_factory_source_->packetRequest(proto::FilePacketRequest::CANCEL));
+        }
+        return;
+    }
+
+    while (packets_to_request_ && source_pending_ + target_pending_ < packet_window_)
+    {
+        --packets_to_request_;
+        ++source_pending_;
+
+        if (first_packet_request_)
+        {
+            task_consumer_proxy_->doTask(
+                task_factory_source_->packetRequest(std::move(first_packet_request_)));
+            continue;
+        }
+
+        task_consumer_proxy_->doTask(
+            task_factory_source_->packetRequest(proto::FilePacketRequest::NO_FLAGS, compression_));
+    }
+}
+
+void FileTransfer::discardPackets()
+{
+    // The source and the target execute the requests in order, so the replies to the packets in
+    // flight come before the replies to new requests.
+    stale_source_replies_ += source_pending_;
+    stale_target_replies_ += target_pending_;
+
+    packets_to_request_ = 0;
+    source_pending_ = 0;
+    target_pending_ = 0;
+}
+
 void FileTransfer::onError(Error::Type type, proto::FileError code, const std::string& path)
 {
     auto default_action = actions_.find(type);
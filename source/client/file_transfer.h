@@ -167,6 +167,11 @@ public:
                const FinishCallback& finish_callback);
     void stop();
 
+    // Sets the size of file packets requested from the source and the number of packets that can
+    // be requested without waiting for the previous packets to be written to the target.
+    // Must be called before start().
+    void setPacketLimits(size_t packet_size, size_t packet_window);
+
     void setAction(Error::Type error_type, Error::Action action);
 
 protected:
@@ -179,6 +184,8 @@ private:
     void sourceReply(const proto::FileRequest& request, const proto::FileReply& reply);
     void doFrontTask(bool overwrite);
     void doNextTask();
+    void requestPackets();
+    void discardPackets();
     void onError(Error::Type type, proto::FileError code, const std::string& path = std::string());
     void setActionForErrorType(Error::Type error_type, Error::Action action);
     void onFinished();
@@ -210,6 +217,28 @@ private:
 
     bool is_canceled_ = false;
 
+    // Packets of the current file are requested from the source before the previous packets are
+    // written to the target, so that the transfer does not wait for a round trip for each packet.
+    size_t packet_size_;
+    size_t packet_window_;
+    size_t packets_to_request_ = 0; // Packets that have not been requested yet.
+    size_t source_pending_ = 0; // Packets requested from the source.
+    size_t target_pending_ = 0; // Packets sent to the target.
+    bool cancel_sent_ = false;
+
+    // Size of the packets of the current file reported by the source.
+    size_t packet_size_in_transfer_ = 0;
+
+    // Compression of the packets supported by the target of the current file.
+    proto::FileCompression compression_ = proto::FILE_COMPRESSION_NONE;
+
+    // Request of the first packet with the offset and the signature reported by the target.
+    std::unique_ptr<proto::FilePacketRequest> first_packet_request_;
+
+    // After an error the replies to the packets in flight are ignored.
+    size_t stale_source_replies_ = 0;
+    size_t stale_target_replies_ = 0;
+
     DISALLOW_COPY_AND_ASSIGN(FileTransfer);
 };
 
@@ -0,0 +1,200 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "client/file_transfer.h"
+
+#include "base/message_loop/message_loop.h"
+#include "client/file_transfer_window.h"
+#include "client/file_transfer_window_proxy.h"
+#include "common/file_packet.h"
+#include "common/file_task_consumer_proxy.h"
+
+#include <algorithm>
+
+#include <gtest/gtest.h>
+
+namespace client {
+
+namespace {
+
+const size_t kPacketSize = 32 * 1024;
+const size_t kPacketCount = 10;
+const int64_t kFileSize = kPacketSize * kPacketCount;
+
+class TestTransferWindow : public FileTransferWindow
+{
+public:
+    TestTransferWindow() = default;
+    ~TestTransferWindow() override = default;
+
+    // FileTransferWindow implementation.
+    void start(std::shared_ptr<FileTransferProxy> /* transfer_proxy */) override {}
+    void stop() override {}
+    void setCurrentItem(const std::string& /* source_path */,
+                        const std::string& /* target_path */) override {}
+    void setCurrentProgress(int /* total */, int /* current */) override {}
+    void errorOccurred(const FileTransfer::Error& /* error */) override {}
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(TestTransferWindow);
+};
+
+// Keeps the requests of the source and the target until the test replies to them.
+class TestTaskConsumer : public common::FileTaskConsumer
+{
+public:
+    TestTaskConsumer() = default;
+    ~TestTaskConsumer() override = default;
+
+    bool isEmpty() const { return tasks_.empty(); }
+    size_t count() const { return tasks_.size(); }
+
+    std::shared_ptr<common::FileTask> takeTask()
+    {
+        std::shared_ptr<common::FileTask> task = std::move(tasks_.front());
+        tasks_.pop_front();
+        return task;
+    }
+
+    // common::FileTaskConsumer implementation.
+    void doTask(std::shared_ptr<common::FileTask> task) override
+    {
+        tasks_.emplace_back(std::move(task));
+    }
+
+private:
+    std::deque<std::shared_ptr<common::FileTask>> tasks_;
+
+    DISALLOW_COPY_AND_ASSIGN(TestTaskConsumer);
+};
+
+void replySuccess(std::shared_ptr<common::FileTask> task)
+{
+    std::unique_ptr<proto::FileReply> reply = std::make_unique<proto::FileReply>();
+    reply->set_error_code(proto::FILE_ERROR_SUCCESS);
+    task->setReply(std::move(reply));
+}
+
+void replyPacket(std::shared_ptr<common::FileTask> task, size_t packet_index)
+{
+    std::unique_ptr<proto::FileReply> reply = std::make_unique<proto::FileReply>();
+    reply->set_error_code(proto::FILE_ERROR_SUCCESS);
+
+    proto::FilePacket* packet = reply->mutable_packet();
+    packet->set_flags(proto::FilePacket::NO_FLAGS);
+    packet->set_data(std::string(kPacketSize, static_cast<char>(packet_index)));
+
+    if (packet_index == 0)
+    {
+        packet->set_flags(packet->flags() | proto::FilePacket::FIRST_PACKET);
+        packet->set_file_size(kFileSize);
+        packet->set_packet_size(kPacketSize);
+    }
+
+    if (packet_index == kPacketCount - 1)
+        packet->set_flags(packet->flags() | proto::FilePacket::LAST_PACKET);
+
+    task->setReply(std::move(reply));
+}
+
+// Downloads a file and returns the maximum number of packets that were requested from the source
+// and not yet written to the target.
+size_t maxPacketsInFlight(size_t packet_window)
+{
+    base::MessageLoop message_loop;
+    std::shared_ptr<base::TaskRunner> task_runner = message_loop.taskRunner();
+
+    TestTransferWindow window;
+    std::shared_ptr<FileTransferWindowProxy> window_proxy =
+        std::make_shared<FileTransferWindowProxy>(task_runner, &window);
+
+    TestTaskConsumer consumer;
+    std::shared_ptr<common::FileTaskConsumerProxy> consumer_proxy =
+        std::make_shared<common::FileTaskConsumerProxy>(&consumer);
+
+    std::unique_ptr<FileTransfer> transfer = std::make_unique<FileTransfer>(
+        task_runner, window_proxy, consumer_proxy, FileTransfer::Type::DOWNLOADER);
+    transfer->setPacketLimits(kPacketSize, packet_window);
+
+    bool finished = false;
+
+    transfer->start("/source", "/target", { FileTransfer::Item("file", kFileSize, false) },
+                    [&finished]() { finished = true; });
+
+    // The packet size is passed to the source with the download request.
+    std::shared_ptr<common::FileTask> task = consumer.takeTask();
+    EXPECT_TRUE(task->request().has_download_request());
+    EXPECT_EQ(task->request().download_request().packet_size(), kPacketSize);
+    replySuccess(std::move(task));
+
+    task = consumer.takeTask();
+    EXPECT_TRUE(task->request().has_upload_request());
+    replySuccess(std::move(task));
+
+    // The number of packets is not known until the first packet is received.
+    EXPECT_EQ(consumer.count(), 1);
+
+    size_t max_in_flight = 0;
+    size_t received_count = 0;
+    size_t written_count = 0;
+
+    // The source and the target reply in the order of the requests.
+    while (!consumer.isEmpty())
+    {
+        max_in_flight = std::max(max_in_flight, consumer.count());
+
+        task = consumer.takeTask();
+
+        if (task->request().has_packet_request())
+        {
+            replyPacket(std::move(task), received_count++);
+        }
+        else
+        {
+            EXPECT_TRUE(task->request().has_packet());
+            ++written_count;
+            replySuccess(std::move(task));
+        }
+    }
+
+    EXPECT_EQ(received_count, kPacketCount);
+    EXPECT_EQ(written_count, kPacketCount);
+    EXPECT_TRUE(finished);
+
+    transfer.reset();
+    consumer_proxy->dettach();
+    window_proxy->dettach();
+
+    return max_in_flight;
+}
+
+} // namespace
+
+TEST(file_transfer_test, packet_window)
+{
+    EXPECT_EQ(maxPacketsInFlight(4), 4);
+    EXPECT_EQ(maxPacketsInFlight(common::kDefaultFilePacketWindow), kPacketCount);
+}
+
+TEST(file_transfer_test, packet_window_clamped)
+{
+    // Packets are transferred one by one.
+    EXPECT_EQ(maxPacketsInFlight(0), 1);
+}
+
+} // namespace client
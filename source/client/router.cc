@@ -60,7 +60,7 @@ void Router::refreshSessionList()
 
     proto::AdminToRouter message;
     message.mutable_session_list_request()->set_dummy(1);
-    channel_->send(base::serialize(message));
+    channel_->send(message);
 }
 
 void Router::stopSession(int64_t session_id)
@@ -73,7 +73,7 @@ void Router::stopSession(int64_t session_id)
     request->set_type(proto::SESSION_REQUEST_DISCONNECT);
     request->set_session_id(session_id);
 
-    channel_->send(base::serialize(message));
+    channel_->send(message);
 }
 
 void Router::refreshUserList()
@@ -82,7 +82,7 @@ void Router::refreshUserList()
 
     proto::AdminToRouter message;
     message.mutable_user_list_request()->set_dummy(1);
-    channel_->send(base::serialize(message));
+    channel_->send(message);
 }
 
 void Router::addUser(const proto::User& user)
@@ -96,7 +96,7 @@ void Router::addUser(const proto::User& user)
     request->set_type(proto::USER_REQUEST_ADD);
     request->mutable_user()->CopyFrom(user);
 
-    channel_->send(base::serialize(message));
+    channel_->send(message);
 }
 
 void Router::modifyUser(const proto::User& user)
@@ -110,7 +110,7 @@ void Router::modifyUser(const proto::User& user)
     request->set_type(proto::USER_REQUEST_MODIFY);
     request->mutable_user()->CopyFrom(user);
 
-    channel_->send(base::serialize(message));
+    channel_->send(message);
 }
 
 void Router::deleteUser(int64_t entry_id)
@@ -123,7 +123,7 @@ void Router::deleteUser(int64_t entry_id)
     request->set_type(proto::USER_REQUEST_DELETE);
     request->mutable_user()->set_entry_id(entry_id);
 
-    channel_->send(base::serialize(message));
+    channel_->send(message);
 }
 
 void Router::onConnected()
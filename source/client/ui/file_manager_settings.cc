@@ -18,12 +18,16 @@
 
 #include "client/ui/file_manager_settings.h"
 
+#include "common/file_packet.h"
+
 namespace client {
 
 namespace {
 
 const QString kWindowGeometryParam = QStringLiteral("FileManager/WindowGeometry");
 const QString kWindowStateParam = QStringLiteral("FileManager/WindowState");
+const QString kPacketSizeParam = QStringLiteral("FileManager/PacketSize");
+const QString kPacketWindowParam = QStringLiteral("FileManager/PacketWindow");
 
 } // namespace
 
@@ -56,4 +60,16 @@ void FileManagerSettings::setWindowState(const QByteArray& state)
     settings_.setValue(kWindowStateParam, state);
 }
 
+size_t FileManagerSettings::packetSize() const
+{
+    return settings_.value(kPacketSizeParam,
+                           static_cast<uint>(common::kPreferredFilePacketSize)).toUInt();
+}
+
+size_t FileManagerSettings::packetWindow() const
+{
+    return settings_.value(kPacketWindowParam,
+                           static_cast<uint>(common::kDefaultFilePacketWindow)).toUInt();
+}
+
 } // namespace client
@@ -37,6 +37,11 @@ public:
     QByteArray windowState() const;
     void setWindowState(const QByteArray& state);
 
+    // Size of file packets and the number of packets requested without waiting for the previous
+    // ones to be written. The values are not changed from the UI.
+    size_t packetSize() const;
+    size_t packetWindow() const;
+
 private:
     QSettings settings_;
 
@@ -67,6 +67,9 @@ std::unique_ptr<Client> QtFileManagerWindow::createClient()
 
     client->setFileManagerWindow(file_manager_window_proxy_);
 
+    FileManagerSettings settings;
+    client->setPacketLimits(settings.packetSize(), settings.packetWindow());
+
     return client;
 }
 
@@ -0,0 +1,375 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "common/file_delta.h"
+
+#include "base/logging.h"
+#include "common/platform_file.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace common {
+
+namespace {
+
+// Smaller files are always transferred completely.
+const uint64_t kMinSignatureFileSize = 64 * 1024; // 64 kB
+
+// The block size is about the square root of the file size, as in rsync. The number of blocks is
+// limited, so that the signature fits in one message.
+const size_t kMinBlockSize = 2 * 1024; // 2 kB
+const size_t kMaxBlockSize = 8 * 1024 * 1024; // 8 MB
+const uint64_t kMaxBlockCount = 128 * 1024;
+
+// Only a part of the strong checksum is sent. Candidates are selected by the rolling checksum
+// first, so 64 bits are enough.
+const size_t kStrongChecksumSize = 8;
+
+const base::GenericHash::Type kStrongChecksumType = base::GenericHash::BLAKE2s256;
+
+const size_t kMaxOffsetChecksumSize = 64 * 1024; // 64 kB
+
+const size_t kHashBlockSize = 1024 * 1024; // 1 MB
+
+const uint32_t kNoBlock = 0xFFFFFFFF;
+const size_t kFilterBits = 1 << 16;
+
+size_t filterIndex(uint32_t checksum)
+{
+    return (checksum ^ (checksum >> 16)) & (kFilterBits - 1);
+}
+
+bool readFully(PlatformFile* file, uint8_t* data, size_t size)
+{
+    while (size)
+    {
+        int64_t result = file->read(data, size);
+        if (result <= 0)
+            return false;
+
+        data += result;
+        size -= static_cast<size_t>(result);
+    }
+
+    return true;
+}
+
+} // namespace
+
+void RollingChecksum::reset(const uint8_t* data, size_t size)
+{
+    a_ = 0;
+    b_ = 0;
+    size_ = static_cast<uint32_t>(size);
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        a_ += data[i];
+        b_ += a_;
+    }
+}
+
+void RollingChecksum::roll(uint8_t removed, uint8_t added)
+{
+    a_ += added - removed;
+    b_ += a_ - size_ * removed;
+}
+
+// static
+bool FileDeltaUtil::buildSignature(PlatformFile* file, uint64_t file_size,
+                                   proto::FileSignature* signature)
+{
+    DCHECK(file);
+    DCHECK(signature);
+
+    if (file_size < kMinSignatureFileSize)
+        return false;
+
+    uint64_t block_size = static_cast<uint64_t>(std::sqrt(static_cast<double>(file_size)));
+    block_size = std::max(block_size, (file_size + kMaxBlockCount - 1) / kMaxBlockCount);
+
+    // Round up to a multiple of the minimum size.
+    block_size = (block_size + kMinBlockSize - 1) / kMinBlockSize * kMinBlockSize;
+    if (block_size > kMaxBlockSize)
+        return false;
+
+    const uint64_t block_count = (file_size + block_size - 1) / block_size;
+
+    signature->set_block_size(static_cast<uint32_t>(block_size));
+    signature->set_file_size(file_size);
+    signature->mutable_weak_checksum()->Reserve(static_cast<int>(block_count));
+    signature->mutable_strong_checksum()->reserve(block_count * kStrongChecksumSize);
+
+    std::vector<uint8_t> buffer(static_cast<size_t>(block_size));
+    base::GenericHash hash(kStrongChecksumType);
+    RollingChecksum checksum;
+
+    uint64_t left_size = file_size;
+    while (left_size)
+    {
+        const size_t size = static_cast<size_t>(std::min(left_size, block_size));
+
+        if (!readFully(file, buffer.data(), size))
+        {
+            LOG(LS_WARNING) << "Unable to read file";
+            return false;
+        }
+
+        checksum.reset(buffer.data(), size);
+        signature->add_weak_checksum(checksum.value());
+
+        hash.reset();
+        hash.addData(buffer.data(), size);
+
+        base::ByteArray strong_checksum = hash.result();
+        signature->mutable_strong_checksum()->append(
+            reinterpret_cast<const char*>(strong_checksum.data()), kStrongChecksumSize);
+
+        left_size -= size;
+    }
+
+    return true;
+}
+
+// static
+bool FileDeltaUtil::offsetChecksum(PlatformFile* file, uint64_t offset, std::string* checksum)
+{
+    DCHECK(file);
+    DCHECK(checksum);
+
+    const size_t size = static_cast<size_t>(
+        std::min(offset, static_cast<uint64_t>(kMaxOffsetChecksumSize)));
+
+    if (!file->seek(static_cast<int64_t>(offset - size)))
+        return false;
+
+    std::vector<uint8_t> buffer(size);
+    if (!readFully(file, buffer.data(), size))
+        return false;
+
+    *checksum = base::toStdString(
+        base::GenericHash::hash(kStrongChecksumType, buffer.data(), size));
+    return true;
+}
+
+// static
+bool FileDeltaUtil::hashFile(PlatformFile* file, uint64_t size, base::GenericHash* hash)
+{
+    DCHECK(file);
+    DCHECK(hash);
+
+    std::vector<uint8_t> buffer(static_cast<size_t>(
+        std::min(size, static_cast<uint64_t>(kHashBlockSize))));
+
+    while (size)
+    {
+        const size_t block_size = static_cast<size_t>(
+            std::min(size, static_cast<uint64_t>(buffer.size())));
+
+        if (!readFully(file, buffer.data(), block_size))
+            return false;
+
+        hash->addData(buffer.data(), block_size);
+        size -= block_size;
+    }
+
+    return true;
+}
+
+FileDeltaEncoder::FileDeltaEncoder(const proto::FileSignature& signature,
+                                   size_t block_size,
+                                   size_t block_count)
+    : block_size_(block_size),
+      strong_checksums_(signature.strong_checksum()),
+      next_block_(block_count, kNoBlock),
+      filter_(kFilterBits / 8),
+      hash_(kStrongChecksumType)
+{
+    blocks_.reserve(block_count);
+
+    // The blocks are added in reverse order, so the lists are sorted by the offset.
+    for (size_t i = block_count; i-- > 0;)
+    {
+        const uint32_t weak_checksum = signature.weak_checksum(static_cast<int>(i));
+
+        auto result = blocks_.try_emplace(weak_checksum, static_cast<uint32_t>(i));
+        if (!result.second)
+        {
+            next_block_[i] = result.first->second;
+            result.first->second = static_cast<uint32_t>(i);
+        }
+
+        const size_t index = filterIndex(weak_checksum);
+        filter_[index >> 3] |= static_cast<uint8_t>(1 << (index & 7));
+    }
+}
+
+FileDeltaEncoder::~FileDeltaEncoder() = default;
+
+// static
+std::unique_ptr<FileDeltaEncoder> FileDeltaEncoder::create(const proto::FileSignature& signature)
+{
+    const uint64_t block_size = signature.block_size();
+    if (block_size < kMinBlockSize || block_size > kMaxBlockSize)
+    {
+        LOG(LS_WARNING) << "Invalid block size: " << block_size;
+        return nullptr;
+    }
+
+    const uint64_t block_count = (signature.file_size() + block_size - 1) / block_size;
+    if (!block_count || block_count > kMaxBlockCount ||
+        static_cast<uint64_t>(signature.weak_checksum_size()) != block_count ||
+        signature.strong_checksum().size() != block_count * kStrongChecksumSize)
+    {
+        LOG(LS_WARNING) << "Invalid file signature";
+        return nullptr;
+    }
+
+    // Only complete blocks are searched. The last block is usually incomplete.
+    const size_t full_block_count = static_cast<size_t>(signature.file_size() / block_size);
+
+    return std::unique_ptr<FileDeltaEncoder>(new FileDeltaEncoder(
+        signature, static_cast<size_t>(block_size), full_block_count));
+}
+
+void FileDeltaEncoder::encode(const uint8_t* data, size_t available, size_t size,
+                              proto::FilePacket* packet)
+{
+    DCHECK_LE(size, available);
+
+    std::string* literals = packet->mutable_data();
+    size_t literal_begin = 0;
+    size_t pos = 0;
+
+    auto add_copy = [&](uint64_t offset, size_t copy_size)
+    {
+        const size_t literal_size = pos - literal_begin;
+        literals->append(reinterpret_cast<const char*>(data + literal_begin), literal_size);
+
+        const int count = packet->delta_size();
+        proto::FileDelta* last = count ? packet->mutable_delta(count - 1) : nullptr;
+
+        if (last && !literal_size && last->copy_offset() + last->copy_size() == offset)
+        {
+            // Consecutive blocks are copied with one part.
+            last->set_copy_size(last->copy_size() + static_cast<uint32_t>(copy_size));
+        }
+        else
+        {
+            proto::FileDelta* delta = packet->add_delta();
+            delta->set_literal_size(static_cast<uint32_t>(literal_size));
+            delta->set_copy_offset(offset);
+            delta->set_copy_size(static_cast<uint32_t>(copy_size));
+        }
+
+        pos += copy_size;
+        literal_begin = pos;
+    };
+
+    while (pos < size)
+    {
+        if (copy_left_)
+        {
+            const size_t copy_size = std::min(copy_left_, size - pos);
+            const uint64_t copy_offset = copy_offset_;
+
+            copy_offset_ += copy_size;
+            copy_left_ -= copy_size;
+
+            add_copy(copy_offset, copy_size);
+            continue;
+        }
+
+        // The rest of the file is shorter than a block.
+        if (available - pos < block_size_)
+            break;
+
+        if (!checksum_valid_)
+        {
+            checksum_.reset(data + pos, block_size_);
+            checksum_valid_ = true;
+        }
+
+        uint64_t offset;
+        if (findBlock(data + pos, &offset))
+        {
+            checksum_valid_ = false;
+            copy_offset_ = offset;
+            copy_left_ = block_size_;
+            continue;
+        }
+
+        if (pos + block_size_ < available)
+            checksum_.roll(data[pos], data[pos + block_size_]);
+        else
+            checksum_valid_ = false;
+
+        ++pos;
+    }
+
+    literals->append(reinterpret_cast<const char*>(data + literal_begin), size - literal_begin);
+}
+
+bool FileDeltaEncoder::findBlock(const uint8_t* data, uint64_t* offset)
+{
+    const uint32_t weak_checksum = checksum_.value();
+
+    const size_t index = filterIndex(weak_checksum);
+    if (!(filter_[index >> 3] & (1 << (index & 7))))
+        return false;
+
+    auto result = blocks_.find(weak_checksum);
+    if (result == blocks_.end())
+        return false;
+
+    hash_.reset();
+    hash_.addData(data, block_size_);
+    const base::ByteArray strong_checksum = hash_.result();
+
+    bool found = false;
+
+    for (uint32_t block = result->second; block != kNoBlock; block = next_block_[block])
+    {
+        if (memcmp(strong_checksums_.data() + block * kStrongChecksumSize,
+                   strong_checksum.data(), kStrongChecksumSize) != 0)
+        {
+            continue;
+        }
+
+        const uint64_t block_offset = static_cast<uint64_t>(block) * block_size_;
+
+        // The block following the previous one is preferred, so that the parts can be merged.
+        if (block_offset == copy_offset_)
+        {
+            *offset = block_offset;
+            return true;
+        }
+
+        if (!found)
+        {
+            *offset = block_offset;
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+} // namespace common
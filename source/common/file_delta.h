@@ -0,0 +1,119 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef COMMON__FILE_DELTA_H
+#define COMMON__FILE_DELTA_H
+
+#include "base/macros_magic.h"
+#include "base/crypto/generic_hash.h"
+#include "proto/file_transfer.pb.h"
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace common {
+
+class PlatformFile;
+
+// Rolling checksum of rsync. When the window is moved by one byte, the checksum is updated without
+// reading the whole window.
+class RollingChecksum
+{
+public:
+    RollingChecksum() = default;
+
+    void reset(const uint8_t* data, size_t size);
+    void roll(uint8_t removed, uint8_t added);
+
+    uint32_t value() const { return (b_ << 16) | (a_ & 0xFFFF); }
+
+private:
+    uint32_t a_ = 0;
+    uint32_t b_ = 0;
+    uint32_t size_ = 0;
+};
+
+class FileDeltaUtil
+{
+public:
+    // Builds the signature of the file of size |file_size| from the current position. Returns
+    // false if the file cannot be read or is not worth transferring with delta.
+    static bool buildSignature(PlatformFile* file, uint64_t file_size,
+                               proto::FileSignature* signature);
+
+    // Calculates the checksum of the data preceding |offset|. It is used to check that the
+    // partially transferred file matches the source. The position of the file is left at |offset|.
+    static bool offsetChecksum(PlatformFile* file, uint64_t offset, std::string* checksum);
+
+    // If the target builds the file from its partial file or from its existing file, the source
+    // sends the hash of the whole file. The target checks it before the file replaces the old one.
+    static const base::GenericHash::Type kFileHashType = base::GenericHash::BLAKE2b512;
+
+    // Adds |size| bytes of the file from the current position to |hash|.
+    static bool hashFile(PlatformFile* file, uint64_t size, base::GenericHash* hash);
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(FileDeltaUtil);
+};
+
+// Finds the blocks of the signature in the file of the source. The found blocks are not
+// transferred, the target copies them from its existing file.
+class FileDeltaEncoder
+{
+public:
+    ~FileDeltaEncoder();
+
+    // Returns nullptr if the signature is not valid.
+    static std::unique_ptr<FileDeltaEncoder> create(const proto::FileSignature& signature);
+
+    size_t blockSize() const { return block_size_; }
+
+    // Encodes the first |size| bytes of |data| into |packet|. |data| contains the file from the
+    // current position. |available| is the number of bytes accessible in |data|, it must be at
+    // least |size| + blockSize() or the rest of the file.
+    void encode(const uint8_t* data, size_t available, size_t size, proto::FilePacket* packet);
+
+private:
+    FileDeltaEncoder(const proto::FileSignature& signature, size_t block_size, size_t block_count);
+
+    bool findBlock(const uint8_t* data, uint64_t* offset);
+
+    const size_t block_size_;
+    const std::string strong_checksums_;
+
+    // Blocks with the same rolling checksum are linked in a list. Before the lookup in the map the
+    // checksum is checked in a bitmap, most positions of the source do not match any block.
+    std::unordered_map<uint32_t, uint32_t> blocks_;
+    std::vector<uint32_t> next_block_;
+    std::vector<uint8_t> filter_;
+
+    base::GenericHash hash_;
+    RollingChecksum checksum_;
+    bool checksum_valid_ = false;
+
+    // A found block can continue in the next packet.
+    uint64_t copy_offset_ = 0;
+    size_t copy_left_ = 0;
+
+    DISALLOW_COPY_AND_ASSIGN(FileDeltaEncoder);
+};
+
+} // namespace common
+
+#endif // COMMON__FILE_DELTA_H
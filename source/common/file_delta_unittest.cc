@@ -0,0 +1,247 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "common/file_delta.h"
+
+#include "common/platform_file.h"
+
+#include <random>
+
+#include <gtest/gtest.h>
+
+namespace common {
+
+namespace {
+
+const size_t kPacketSize = 64 * 1024;
+
+std::vector<uint8_t> randomData(size_t size, uint32_t seed)
+{
+    std::mt19937 engine(seed);
+    std::vector<uint8_t> data(size);
+
+    for (auto& byte : data)
+        byte = static_cast<uint8_t>(engine());
+
+    return data;
+}
+
+class FileDeltaTest : public testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        file_path_ = std::filesystem::temp_directory_path() / "aspia_file_delta_test";
+    }
+
+    void TearDown() override
+    {
+        std::error_code ignored_error;
+        std::filesystem::remove(file_path_, ignored_error);
+    }
+
+    proto::FileSignature signature(const std::vector<uint8_t>& data)
+    {
+        std::unique_ptr<PlatformFile> file = PlatformFile::create(file_path_);
+        EXPECT_TRUE(file);
+        EXPECT_TRUE(file->write(data.data(), data.size()));
+        file.reset();
+
+        file = PlatformFile::openForReading(file_path_);
+        EXPECT_TRUE(file);
+
+        proto::FileSignature signature;
+        EXPECT_TRUE(FileDeltaUtil::buildSignature(file.get(), data.size(), &signature));
+        return signature;
+    }
+
+    std::filesystem::path file_path_;
+};
+
+// Encodes |source| with the signature of |base| and applies the packets to |base|. Returns the
+// number of bytes that are transferred as is.
+size_t encodeAndApply(const std::vector<uint8_t>& base,
+                      const std::vector<uint8_t>& source,
+                      FileDeltaEncoder* encoder,
+                      std::vector<uint8_t>* target)
+{
+    size_t literal_size = 0;
+
+    for (size_t pos = 0; pos < source.size(); pos += kPacketSize)
+    {
+        const size_t size = std::min(kPacketSize, source.size() - pos);
+
+        proto::FilePacket packet;
+        encoder->encode(source.data() + pos, source.size() - pos, size, &packet);
+
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(packet.data().data());
+        size_t data_size = packet.data().size();
+        size_t packet_size = data_size;
+
+        for (const auto& delta : packet.delta())
+        {
+            target->insert(target->end(), data, data + delta.literal_size());
+            data += delta.literal_size();
+            data_size -= delta.literal_size();
+
+            EXPECT_LE(delta.copy_offset() + delta.copy_size(), base.size());
+
+            const uint8_t* copy = base.data() + delta.copy_offset();
+            target->insert(target->end(), copy, copy + delta.copy_size());
+            packet_size += delta.copy_size();
+        }
+
+        target->insert(target->end(), data, data + data_size);
+        literal_size += packet.data().size();
+
+        EXPECT_EQ(packet_size, size);
+    }
+
+    return literal_size;
+}
+
+} // namespace
+
+TEST(rolling_checksum_test, roll)
+{
+    const size_t kWindowSize = 2048;
+    std::vector<uint8_t> data = randomData(kWindowSize * 4, 1);
+
+    RollingChecksum rolling;
+    rolling.reset(data.data(), kWindowSize);
+
+    for (size_t pos = 0; pos + kWindowSize < data.size(); ++pos)
+    {
+        RollingChecksum expected;
+        expected.reset(data.data() + pos, kWindowSize);
+        ASSERT_EQ(rolling.value(), expected.value()) << "pos: " << pos;
+
+        rolling.roll(data[pos], data[pos + kWindowSize]);
+    }
+}
+
+TEST(rolling_checksum_test, different_data)
+{
+    std::vector<uint8_t> data = randomData(4096, 2);
+
+    RollingChecksum first;
+    first.reset(data.data(), data.size());
+
+    ++data[data.size() / 2];
+
+    RollingChecksum second;
+    second.reset(data.data(), data.size());
+
+    EXPECT_NE(first.value(), second.value());
+}
+
+TEST_F(FileDeltaTest, small_file_has_no_signature)
+{
+    std::vector<uint8_t> data = randomData(1024, 3);
+
+    std::unique_ptr<PlatformFile> file = PlatformFile::create(file_path_);
+    ASSERT_TRUE(file);
+    ASSERT_TRUE(file->write(data.data(), data.size()));
+    file.reset();
+
+    file = PlatformFile::openForReading(file_path_);
+    ASSERT_TRUE(file);
+
+    proto::FileSignature signature;
+    EXPECT_FALSE(FileDeltaUtil::buildSignature(file.get(), data.size(), &signature));
+}
+
+TEST_F(FileDeltaTest, invalid_signature)
+{
+    proto::FileSignature valid = signature(randomData(256 * 1024, 4));
+    EXPECT_TRUE(FileDeltaEncoder::create(valid));
+
+    proto::FileSignature invalid = valid;
+    invalid.set_block_size(1);
+    EXPECT_FALSE(FileDeltaEncoder::create(invalid));
+
+    invalid = valid;
+    invalid.mutable_weak_checksum()->RemoveLast();
+    EXPECT_FALSE(FileDeltaEncoder::create(invalid));
+
+    invalid = valid;
+    invalid.mutable_strong_checksum()->pop_back();
+    EXPECT_FALSE(FileDeltaEncoder::create(invalid));
+
+    invalid = valid;
+    invalid.set_file_size(valid.file_size() * 4);
+    EXPECT_FALSE(FileDeltaEncoder::create(invalid));
+}
+
+TEST_F(FileDeltaTest, same_file)
+{
+    std::vector<uint8_t> base = randomData(512 * 1024, 5);
+
+    std::unique_ptr<FileDeltaEncoder> encoder = FileDeltaEncoder::create(signature(base));
+    ASSERT_TRUE(encoder);
+
+    std::vector<uint8_t> target;
+    size_t literal_size = encodeAndApply(base, base, encoder.get(), &target);
+
+    EXPECT_EQ(target, base);
+
+    // Only the incomplete last block is transferred.
+    EXPECT_LT(literal_size, encoder->blockSize());
+}
+
+TEST_F(FileDeltaTest, changed_file)
+{
+    std::vector<uint8_t> base = randomData(1024 * 1024, 6);
+    std::vector<uint8_t> source = base;
+
+    // Change a byte, insert data and remove data at different places.
+    source[100 * 1024] ^= 0xFF;
+
+    std::vector<uint8_t> inserted = randomData(1000, 7);
+    source.insert(source.begin() + 400 * 1024, inserted.begin(), inserted.end());
+
+    source.erase(source.begin() + 700 * 1024, source.begin() + 701 * 1024);
+
+    std::unique_ptr<FileDeltaEncoder> encoder = FileDeltaEncoder::create(signature(base));
+    ASSERT_TRUE(encoder);
+
+    std::vector<uint8_t> target;
+    size_t literal_size = encodeAndApply(base, source, encoder.get(), &target);
+
+    EXPECT_EQ(target, source);
+
+    // Each change costs at most a few blocks.
+    EXPECT_LT(literal_size, encoder->blockSize() * 8);
+}
+
+TEST_F(FileDeltaTest, different_file)
+{
+    std::vector<uint8_t> base = randomData(256 * 1024, 8);
+    std::vector<uint8_t> source = randomData(256 * 1024, 9);
+
+    std::unique_ptr<FileDeltaEncoder> encoder = FileDeltaEncoder::create(signature(base));
+    ASSERT_TRUE(encoder);
+
+    std::vector<uint8_t> target;
+    size_t literal_size = encodeAndApply(base, source, encoder.get(), &target);
+
+    EXPECT_EQ(target, source);
+    EXPECT_EQ(literal_size, source.size());
+}
+
+} // namespace common
@@ -19,70 +19,187 @@
 #include "common/file_depacketizer.h"
 
 #include "base/logging.h"
+#include "common/file_delta.h"
+#include "common/file_packet.h"
+#include "common/platform_file.h"
+
+#include <algorithm>
 
 namespace common {
 
-FileDepacketizer::FileDepacketizer(const std::filesystem::path& file_path,
-                                   std::ofstream&& file_stream)
-    : file_path_(file_path),
-      file_stream_(std::move(file_stream))
+namespace {
+
+const size_t kWriteBlockSize = 1024 * 1024; // 1 MB
+
+// Suffix of the file that is written until the transfer is completed.
+const char kPartialFileSuffix[] = ".aspia-partial";
+
+} // namespace
+
+FileDepacketizer::FileDepacketizer(const std::filesystem::path& file_path)
+    : file_path_(file_path)
 {
-    // Nothing
+    write_buffer_.reserve(kWriteBlockSize);
 }
 
 FileDepacketizer::~FileDepacketizer()
 {
     // If the file is opened, it was not completely written.
-    if (file_stream_.is_open())
+    if (file_)
     {
-        file_stream_.close();
+        if (keep_partial_ && !canceled_)
+        {
+            // The transfer was interrupted. The written part is kept to continue the transfer
+            // later.
+            flush();
+            file_.reset();
+            return;
+        }
+
+        file_.reset();
 
         // The transfer of files was canceled. Delete the file.
         std::error_code ignored_error;
-        std::filesystem::remove(file_path_, ignored_error);
+        std::filesystem::remove(partial_path_.empty() ? file_path_ : partial_path_, ignored_error);
     }
 }
 
 // static
 std::unique_ptr<FileDepacketizer> FileDepacketizer::create(
-    const std::filesystem::path& file_path, bool overwrite)
+    const std::filesystem::path& file_path, bool /* overwrite */, bool resume, bool delta)
+{
+    std::unique_ptr<FileDepacketizer> depacketizer(new FileDepacketizer(file_path));
+
+    if (!resume && !delta)
+    {
+        // An existing file is always truncated. The caller checks whether the file exists if it
+        // must not be overwritten.
+        depacketizer->file_ = PlatformFile::create(file_path);
+        if (!depacketizer->file_)
+            return nullptr;
+
+        return depacketizer;
+    }
+
+    depacketizer->partial_path_ = file_path;
+    depacketizer->partial_path_ += kPartialFileSuffix;
+    depacketizer->keep_partial_ = resume;
+
+    if (resume)
+        depacketizer->openPartialFile();
+
+    if (!depacketizer->file_)
+    {
+        depacketizer->file_ = PlatformFile::create(depacketizer->partial_path_);
+        if (!depacketizer->file_)
+            return nullptr;
+    }
+
+    if (delta)
+        depacketizer->openBaseFile();
+
+    return depacketizer;
+}
+
+void FileDepacketizer::openPartialFile()
 {
-    std::ofstream::openmode mode = std::ofstream::binary;
+    std::error_code ignored_error;
+    if (!std::filesystem::is_regular_file(partial_path_, ignored_error))
+        return;
 
-    if (overwrite)
-        mode |= std::ofstream::trunc;
+    std::unique_ptr<PlatformFile> file = PlatformFile::openForReading(partial_path_);
+    if (!file)
+        return;
 
-    std::ofstream file_stream;
+    int64_t file_size = file->size();
+    if (file_size <= 0)
+        return;
 
-    file_stream.open(file_path, mode);
-    if (!file_stream.is_open())
-        return nullptr;
+    if (!FileDeltaUtil::offsetChecksum(
+            file.get(), static_cast<uint64_t>(file_size), &resume_checksum_))
+    {
+        return;
+    }
+
+    file_ = PlatformFile::openForAppending(partial_path_);
+    if (!file_)
+        return;
+
+    resume_offset_ = static_cast<uint64_t>(file_size);
+    LOG(LS_INFO) << "Partial file found (size: " << resume_offset_ << ")";
+}
+
+void FileDepacketizer::openBaseFile()
+{
+    std::error_code ignored_error;
+    if (!std::filesystem::is_regular_file(file_path_, ignored_error))
+        return;
+
+    std::unique_ptr<PlatformFile> file = PlatformFile::openForReading(file_path_);
+    if (!file)
+        return;
+
+    int64_t file_size = file->size();
+    if (file_size <= 0)
+        return;
+
+    if (!FileDeltaUtil::buildSignature(file.get(), static_cast<uint64_t>(file_size), &signature_))
+    {
+        signature_.Clear();
+        return;
+    }
 
-    return std::unique_ptr<FileDepacketizer>(
-        new FileDepacketizer(file_path, std::move(file_stream)));
+    base_file_ = std::move(file);
+    base_size_ = static_cast<uint64_t>(file_size);
+    base_pos_ = base_size_;
 }
 
 bool FileDepacketizer::writeNextPacket(const proto::FilePacket& packet)
 {
-    DCHECK(file_stream_.is_open());
+    DCHECK(file_);
+
+    // The first packet must have the full file size.
+    if ((packet.flags() & proto::FilePacket::FIRST_PACKET) && !startFile(packet))
+        return false;
+
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(packet.data().data());
+    size_t packet_size = packet.data().size();
 
-    const size_t packet_size = packet.data().size();
-    if (!packet_size)
+    if (packet_size && packet.compression() != proto::FILE_COMPRESSION_NONE)
+    {
+        if (packet.compression() != proto::FILE_COMPRESSION_ZSTD)
+        {
+            LOG(LS_WARNING) << "Unsupported compression: " << packet.compression();
+            return false;
+        }
+
+        if (!decompress(packet.data()))
+            return false;
+
+        data = decompress_buffer_.data();
+        packet_size = decompress_buffer_.size();
+    }
+
+    if (!packet_size && !packet.delta_size())
     {
         if (packet.flags() & proto::FilePacket::LAST_PACKET)
         {
             if (packet.flags() & proto::FilePacket::FIRST_PACKET)
             {
-                // Zero-length file received.
-                file_size_ = 0;
-                file_stream_.close();
-            }
-            else
-            {
-                // If an empty data packet with the last packet flag set is received, the transfer
-                // is canceled.
+                // Zero-length file received or the whole file was received in the previous
+                // transfer.
+                if (left_size_)
+                {
+                    LOG(LS_WARNING) << "Wrong packet size";
+                    return false;
+                }
+
+                return finishFile(packet.file_hash());
             }
 
+            // If an empty data packet with the last packet flag set is received, the transfer is
+            // canceled.
+            canceled_ = true;
             return true;
         }
 
@@ -90,29 +207,278 @@ bool FileDepacketizer::writeNextPacket(const proto::FilePacket& packet)
         return false;
     }
 
-    // The first packet must have the full file size.
-    if (packet.flags() & proto::FilePacket::FIRST_PACKET)
+    // Check the parts copied from the existing file before writing anything.
+    uint64_t total_size = packet_size;
+    size_t literal_size = 0;
+
+    for (const auto& delta : packet.delta())
     {
-        file_size_ = packet.file_size();
-        left_size_ = file_size_;
+        literal_size += delta.literal_size();
+
+        if (!base_file_ || literal_size > packet_size || delta.copy_offset() > base_size_ ||
+            delta.copy_size() > base_size_ - delta.copy_offset())
+        {
+            LOG(LS_WARNING) << "Invalid delta";
+            return false;
+        }
+
+        total_size += delta.copy_size();
     }
 
-    file_stream_.seekp(static_cast<std::streamoff>(file_size_ - left_size_));
-    file_stream_.write(packet.data().data(), packet_size);
-    if (file_stream_.fail())
+    if (total_size > left_size_)
     {
-        LOG(LS_WARNING) << "Unable to write file";
+        LOG(LS_WARNING) << "Packet exceeds the file size";
         return false;
     }
 
-    left_size_ -= packet_size;
+    for (const auto& delta : packet.delta())
+    {
+        if (!writeData(data, delta.literal_size()))
+            return false;
+
+        data += delta.literal_size();
+        packet_size -= delta.literal_size();
+
+        if (!copyData(delta.copy_offset(), delta.copy_size()))
+            return false;
+    }
+
+    if (!writeData(data, packet_size))
+        return false;
+
+    left_size_ -= total_size;
 
     if (packet.flags() & proto::FilePacket::LAST_PACKET)
     {
-        file_size_ = 0;
-        file_stream_.close();
+        if (left_size_)
+        {
+            LOG(LS_WARNING) << "Wrong file size";
+            return false;
+        }
+
+        return finishFile(packet.file_hash());
+    }
+
+    return true;
+}
+
+bool FileDepacketizer::startFile(const proto::FilePacket& packet)
+{
+    const uint64_t offset = packet.offset();
+
+    if (offset > packet.file_size())
+    {
+        LOG(LS_WARNING) << "Invalid offset: " << offset;
+        return false;
+    }
+
+    if (offset != resume_offset_)
+    {
+        if (offset)
+        {
+            LOG(LS_WARNING) << "Unexpected offset: " << offset << " (" << resume_offset_ << ")";
+            return false;
+        }
+
+        // The source does not continue the transfer. The partial file is written from the
+        // beginning.
+        file_.reset();
+        file_ = PlatformFile::create(partial_path_);
+        if (!file_)
+            return false;
+    }
+
+    if (!partial_path_.empty() && (offset || base_file_))
+    {
+        file_hash_ = std::make_unique<base::GenericHash>(FileDeltaUtil::kFileHashType);
+
+        if (offset)
+        {
+            // The partial file is opened for appending without sharing. It is reopened to read
+            // the part that was written in the previous transfer.
+            file_.reset();
+
+            std::unique_ptr<PlatformFile> file = PlatformFile::openForReading(partial_path_);
+            if (!file || !FileDeltaUtil::hashFile(file.get(), offset, file_hash_.get()))
+            {
+                LOG(LS_WARNING) << "Unable to read partial file";
+                return false;
+            }
+
+            file.reset();
+
+            file_ = PlatformFile::openForAppending(partial_path_);
+            if (!file_)
+                return false;
+        }
+    }
+
+    file_size_ = packet.file_size();
+    left_size_ = file_size_ - offset;
+    return true;
+}
+
+bool FileDepacketizer::finishFile(const std::string& file_hash)
+{
+    if (!flush())
+        return false;
+
+    file_size_ = 0;
+    file_.reset();
+    base_file_.reset();
+
+    // Old versions do not send the hash.
+    if (file_hash_ && !file_hash.empty() &&
+        base::toStdString(file_hash_->result()) != file_hash)
+    {
+        // The part written in the previous transfer or the existing file does not match the
+        // source. The partial file is removed, so the next transfer starts from the beginning.
+        LOG(LS_WARNING) << "File does not match the source";
+
+        std::error_code ignored_error;
+        std::filesystem::remove(partial_path_, ignored_error);
+        return false;
+    }
+
+    if (!partial_path_.empty())
+    {
+        // The existing file is replaced only when the new one is completely written.
+        std::error_code error_code;
+        std::filesystem::rename(partial_path_, file_path_, error_code);
+        if (error_code)
+        {
+            LOG(LS_WARNING) << "Unable to rename file: " << error_code.message();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool FileDepacketizer::writeData(const uint8_t* data, size_t size)
+{
+    if (file_hash_)
+        file_hash_->addData(data, size);
+
+    if (write_buffer_.empty() && size >= kWriteBlockSize)
+    {
+        // Large packets are written without copying.
+        if (!file_->write(data, size))
+        {
+            LOG(LS_WARNING) << "Unable to write file";
+            return false;
+        }
+
+        return true;
+    }
+
+    write_buffer_.insert(write_buffer_.end(), data, data + size);
+
+    if (write_buffer_.size() >= kWriteBlockSize)
+        return flush();
+
+    return true;
+}
+
+bool FileDepacketizer::copyData(uint64_t offset, size_t size)
+{
+    if (base_pos_ != offset && !base_file_->seek(static_cast<int64_t>(offset)))
+        return false;
+
+    base_pos_ = offset;
+
+    // The size of the part is set by the source, so it is copied through the buffer in blocks.
+    while (size)
+    {
+        if (write_buffer_.size() >= kWriteBlockSize && !flush())
+            return false;
+
+        const size_t buffer_size = write_buffer_.size();
+        const size_t read_size = std::min(size, kWriteBlockSize - buffer_size);
+
+        write_buffer_.resize(buffer_size + read_size);
+
+        int64_t result = base_file_->read(write_buffer_.data() + buffer_size, read_size);
+        if (result <= 0)
+        {
+            // The existing file was changed after the signature was built.
+            LOG(LS_WARNING) << "Unable to read existing file";
+            write_buffer_.resize(buffer_size);
+            return false;
+        }
+
+        write_buffer_.resize(buffer_size + static_cast<size_t>(result));
+
+        if (file_hash_)
+            file_hash_->addData(write_buffer_.data() + buffer_size, static_cast<size_t>(result));
+
+        base_pos_ += static_cast<uint64_t>(result);
+        size -= static_cast<size_t>(result);
+    }
+
+    if (write_buffer_.size() >= kWriteBlockSize)
+        return flush();
+
+    return true;
+}
+
+bool FileDepacketizer::decompress(const std::string& data)
+{
+    if (!decompress_stream_)
+        decompress_stream_.reset(ZSTD_createDStream());
+
+    size_t ret = ZSTD_initDStream(decompress_stream_.get());
+    if (ZSTD_isError(ret))
+    {
+        LOG(LS_ERROR) << "ZSTD_initDStream failed: " << ZSTD_getErrorName(ret);
+        return false;
+    }
+
+    // The packet cannot be larger than the maximum packet size before compression.
+    decompress_buffer_.resize(kMaxFilePacketSize);
+
+    ZSTD_inBuffer input = { data.data(), data.size(), 0 };
+    ZSTD_outBuffer output = { decompress_buffer_.data(), decompress_buffer_.size(), 0 };
+
+    do
+    {
+        ret = ZSTD_decompressStream(decompress_stream_.get(), &output, &input);
+        if (ZSTD_isError(ret))
+        {
+            LOG(LS_ERROR) << "ZSTD_decompressStream failed: " << ZSTD_getErrorName(ret);
+            return false;
+        }
+
+        if (ret && output.pos == output.size)
+        {
+            LOG(LS_ERROR) << "Decompressed packet is too large";
+            return false;
+        }
+    }
+    while (ret && input.pos < input.size);
+
+    if (ret)
+    {
+        LOG(LS_ERROR) << "Incomplete compressed packet";
+        return false;
+    }
+
+    decompress_buffer_.resize(output.pos);
+    return true;
+}
+
+bool FileDepacketizer::flush()
+{
+    if (write_buffer_.empty())
+        return true;
+
+    if (!file_->write(write_buffer_.data(), write_buffer_.size()))
+    {
+        LOG(LS_WARNING) << "Unable to write file";
+        return false;
     }
 
+    write_buffer_.clear();
     return true;
 }
 
@@ -20,30 +20,79 @@
 #define COMMON__FILE_DEPACKETIZER_H
 
 #include "base/macros_magic.h"
+#include "base/codec/scoped_zstd_stream.h"
+#include "base/crypto/generic_hash.h"
+#include "base/memory/byte_array.h"
 #include "proto/file_transfer.pb.h"
 
 #include <filesystem>
-#include <fstream>
 #include <memory>
 
 namespace common {
 
+class PlatformFile;
+
 class FileDepacketizer
 {
 public:
     ~FileDepacketizer();
 
+    // Creates an instance of the class.
+    // If |resume| is true, the file is written to a partial file that is kept if the transfer is
+    // interrupted. If the partial file already exists, the transfer is continued from its end.
+    // If |delta| is true and the file exists, the signature of the existing file is built. The
+    // source can transfer only the parts that differ, the rest is copied from the existing file.
+    // In both cases the partial file replaces the file when the transfer is completed.
     static std::unique_ptr<FileDepacketizer> create(const std::filesystem::path& file_path,
-                                                    bool overwrite);
+                                                    bool overwrite,
+                                                    bool resume = false,
+                                                    bool delta = false);
+
+    // Parameters of the transfer for the source (see proto::FilePacketRequest).
+    uint64_t resumeOffset() const { return resume_offset_; }
+    const std::string& resumeChecksum() const { return resume_checksum_; }
+    bool hasSignature() const { return base_file_ != nullptr; }
+    const proto::FileSignature& signature() const { return signature_; }
 
-    // Reads the packet and writes its contents to a file.
+    // Reads the packet and writes its contents to a file. Small packets are collected in a buffer
+    // and written in large blocks, so an error of writing can be reported for a later packet.
     bool writeNextPacket(const proto::FilePacket& packet);
 
 private:
-    FileDepacketizer(const std::filesystem::path& file_path, std::ofstream&& file_stream);
+    explicit FileDepacketizer(const std::filesystem::path& file_path);
+
+    void openPartialFile();
+    void openBaseFile();
+
+    bool startFile(const proto::FilePacket& packet);
+    bool finishFile(const std::string& file_hash);
+    bool writeData(const uint8_t* data, size_t size);
+    bool copyData(uint64_t offset, size_t size);
+    bool flush();
+    bool decompress(const std::string& data);
 
     std::filesystem::path file_path_;
-    std::ofstream file_stream_;
+    std::filesystem::path partial_path_; // Empty if the file is written directly.
+    std::unique_ptr<PlatformFile> file_;
+    base::ByteArray write_buffer_;
+
+    bool keep_partial_ = false;
+    bool canceled_ = false;
+    uint64_t resume_offset_ = 0;
+    std::string resume_checksum_;
+
+    // Existing file of the target for the delta transfer.
+    std::unique_ptr<PlatformFile> base_file_;
+    proto::FileSignature signature_;
+    uint64_t base_size_ = 0;
+    uint64_t base_pos_ = 0;
+
+    // Hash of the data written to the partial file. It is compared with the hash of the source
+    // if the file is built from the partial file or from the existing file.
+    std::unique_ptr<base::GenericHash> file_hash_;
+
+    base::ScopedZstdDStream decompress_stream_;
+    base::ByteArray decompress_buffer_;
 
     uint64_t file_size_ = 0;
     uint64_t left_size_ = 0;
@@ -0,0 +1,244 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "common/file_depacketizer.h"
+
+#include "common/file_packetizer.h"
+#include "common/platform_file.h"
+
+#include <random>
+
+#include <gtest/gtest.h>
+
+namespace common {
+
+namespace {
+
+const size_t kFileSize = 3 * 1024 * 1024 + 123;
+
+std::vector<uint8_t> randomData(size_t size, uint32_t seed)
+{
+    std::mt19937 engine(seed);
+    std::vector<uint8_t> data(size);
+
+    for (auto& byte : data)
+        byte = static_cast<uint8_t>(engine());
+
+    return data;
+}
+
+void writeFile(const std::filesystem::path& path, const std::vector<uint8_t>& data)
+{
+    std::unique_ptr<PlatformFile> file = PlatformFile::create(path);
+    ASSERT_TRUE(file);
+    ASSERT_TRUE(file->write(data.data(), data.size()));
+}
+
+std::vector<uint8_t> readFile(const std::filesystem::path& path)
+{
+    std::unique_ptr<PlatformFile> file = PlatformFile::openForReading(path);
+    if (!file)
+        return {};
+
+    std::vector<uint8_t> data(static_cast<size_t>(file->size()));
+    size_t pos = 0;
+
+    while (pos < data.size())
+    {
+        int64_t result = file->read(data.data() + pos, data.size() - pos);
+        if (result <= 0)
+            return {};
+
+        pos += static_cast<size_t>(result);
+    }
+
+    return data;
+}
+
+class FileDepacketizerTest : public testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        std::filesystem::path temp_dir = std::filesystem::temp_directory_path();
+
+        source_path_ = temp_dir / "aspia_depacketizer_test_source";
+        target_path_ = temp_dir / "aspia_depacketizer_test_target";
+        partial_path_ = temp_dir / "aspia_depacketizer_test_target.aspia-partial";
+    }
+
+    void TearDown() override
+    {
+        std::error_code ignored_error;
+        std::filesystem::remove(source_path_, ignored_error);
+        std::filesystem::remove(target_path_, ignored_error);
+        std::filesystem::remove(partial_path_, ignored_error);
+    }
+
+    // Transfers the source file to |depacketizer| with the parameters requested by it.
+    bool transfer(FileDepacketizer* depacketizer)
+    {
+        std::unique_ptr<FilePacketizer> packetizer =
+            FilePacketizer::create(source_path_, 256 * 1024);
+        if (!packetizer)
+            return false;
+
+        proto::FilePacketRequest request;
+        request.set_compression(proto::FILE_COMPRESSION_ZSTD);
+        request.set_offset(depacketizer->resumeOffset());
+        request.set_offset_checksum(depacketizer->resumeChecksum());
+
+        if (depacketizer->hasSignature())
+            request.mutable_signature()->CopyFrom(depacketizer->signature());
+
+        while (true)
+        {
+            std::unique_ptr<proto::FilePacket> packet = packetizer->readNextPacket(request);
+            if (!packet || !depacketizer->writeNextPacket(*packet))
+                return false;
+
+            if (packet->flags() & proto::FilePacket::LAST_PACKET)
+                return true;
+
+            request.Clear();
+            request.set_compression(proto::FILE_COMPRESSION_ZSTD);
+        }
+    }
+
+    std::filesystem::path source_path_;
+    std::filesystem::path target_path_;
+    std::filesystem::path partial_path_;
+};
+
+} // namespace
+
+TEST_F(FileDepacketizerTest, delta)
+{
+    std::vector<uint8_t> target = randomData(kFileSize, 1);
+    std::vector<uint8_t> source = target;
+    source[kFileSize / 2] ^= 0xFF;
+
+    writeFile(source_path_, source);
+    writeFile(target_path_, target);
+
+    std::unique_ptr<FileDepacketizer> depacketizer =
+        FileDepacketizer::create(target_path_, true, false, true);
+    ASSERT_TRUE(depacketizer);
+    EXPECT_TRUE(depacketizer->hasSignature());
+
+    EXPECT_TRUE(transfer(depacketizer.get()));
+    depacketizer.reset();
+
+    EXPECT_EQ(readFile(target_path_), source);
+    EXPECT_FALSE(std::filesystem::exists(partial_path_));
+}
+
+TEST_F(FileDepacketizerTest, resume)
+{
+    std::vector<uint8_t> source = randomData(kFileSize, 2);
+
+    writeFile(source_path_, source);
+    writeFile(partial_path_, std::vector<uint8_t>(source.begin(), source.begin() + kFileSize / 2));
+
+    std::unique_ptr<FileDepacketizer> depacketizer =
+        FileDepacketizer::create(target_path_, true, true, false);
+    ASSERT_TRUE(depacketizer);
+    EXPECT_EQ(depacketizer->resumeOffset(), kFileSize / 2);
+
+    EXPECT_TRUE(transfer(depacketizer.get()));
+    depacketizer.reset();
+
+    EXPECT_EQ(readFile(target_path_), source);
+    EXPECT_FALSE(std::filesystem::exists(partial_path_));
+}
+
+TEST_F(FileDepacketizerTest, resume_changed_source)
+{
+    std::vector<uint8_t> source = randomData(kFileSize, 3);
+    std::vector<uint8_t> partial(source.begin(), source.begin() + kFileSize / 2);
+
+    // The change is before the data covered by the checksum of the offset.
+    partial[1000] ^= 0xFF;
+
+    writeFile(source_path_, source);
+    writeFile(partial_path_, partial);
+
+    std::unique_ptr<FileDepacketizer> depacketizer =
+        FileDepacketizer::create(target_path_, true, true, false);
+    ASSERT_TRUE(depacketizer);
+    EXPECT_EQ(depacketizer->resumeOffset(), kFileSize / 2);
+
+    // The hash of the whole file does not match. The file is not renamed and the partial file is
+    // removed, so the next transfer starts from the beginning.
+    EXPECT_FALSE(transfer(depacketizer.get()));
+    depacketizer.reset();
+
+    EXPECT_FALSE(std::filesystem::exists(target_path_));
+    EXPECT_FALSE(std::filesystem::exists(partial_path_));
+}
+
+TEST_F(FileDepacketizerTest, large_copy)
+{
+    std::vector<uint8_t> target = randomData(kFileSize, 4);
+    writeFile(target_path_, target);
+
+    std::unique_ptr<FileDepacketizer> depacketizer =
+        FileDepacketizer::create(target_path_, true, false, true);
+    ASSERT_TRUE(depacketizer);
+    ASSERT_TRUE(depacketizer->hasSignature());
+
+    // One part copies the whole existing file. It is larger than any packet.
+    proto::FilePacket packet;
+    packet.set_flags(proto::FilePacket::FIRST_PACKET | proto::FilePacket::LAST_PACKET);
+    packet.set_file_size(kFileSize);
+
+    proto::FileDelta* delta = packet.add_delta();
+    delta->set_copy_offset(0);
+    delta->set_copy_size(kFileSize);
+
+    EXPECT_TRUE(depacketizer->writeNextPacket(packet));
+    depacketizer.reset();
+
+    EXPECT_EQ(readFile(target_path_), target);
+}
+
+TEST_F(FileDepacketizerTest, copy_out_of_file)
+{
+    std::vector<uint8_t> target = randomData(kFileSize, 5);
+    writeFile(target_path_, target);
+
+    std::unique_ptr<FileDepacketizer> depacketizer =
+        FileDepacketizer::create(target_path_, true, false, true);
+    ASSERT_TRUE(depacketizer);
+
+    proto::FilePacket packet;
+    packet.set_flags(proto::FilePacket::FIRST_PACKET);
+    packet.set_file_size(0xFFFFFFFF);
+
+    proto::FileDelta* delta = packet.add_delta();
+    delta->set_copy_offset(0);
+    delta->set_copy_size(0xFFFFFFFF);
+
+    EXPECT_FALSE(depacketizer->writeNextPacket(packet));
+    depacketizer.reset();
+
+    // The existing file is not changed.
+    EXPECT_EQ(readFile(target_path_), target);
+}
+
+} // namespace common
@@ -22,8 +22,18 @@
 namespace common {
 
 // When transferring a file is divided into parts and each part is transmitted separately.
-// This parameter specifies the size of the part.
-static const size_t kMaxFilePacketSize = 16 * 1024; // 16 kB
+// The size of the part is requested by the receiving side. Old versions always use the default
+// size.
+static const size_t kDefaultFilePacketSize = 16 * 1024; // 16 kB
+static const size_t kMinFilePacketSize = 4 * 1024; // 4 kB
+static const size_t kMaxFilePacketSize = 1024 * 1024; // 1 MB
+
+// Number of packets that can be requested without waiting for the previous packets to be written.
+static const size_t kDefaultFilePacketWindow = 16;
+static const size_t kMaxFilePacketWindow = 64;
+
+// Size of file packets requested by new versions.
+static const size_t kPreferredFilePacketSize = 64 * 1024; // 64 kB
 
 } // namespace common
 
@@ -19,12 +19,32 @@
 #include "common/file_packetizer.h"
 
 #include "base/logging.h"
+#include "common/file_delta.h"
 #include "common/file_packet.h"
+#include "common/platform_file.h"
+
+#include <algorithm>
+#include <cstring>
 
 namespace common {
 
 namespace {
 
+// Size of the blocks in which the file is read.
+const size_t kReadBlockSize = 1024 * 1024; // 1 MB
+
+// The compression ratio can be in the range of 1 to 22. File packets are compressed on the fly,
+// so the fastest level is used.
+constexpr int kCompressionRatio = 1;
+
+// Packets smaller than this size are not compressed.
+const size_t kMinCompressionSize = 512;
+
+// The packet is sent compressed if it is at least 1/8 smaller.
+const size_t kMinCompressionGainShift = 3;
+
+const size_t kMaxSkipInterval = 64;
+
 char* outputBuffer(proto::FilePacket* packet, size_t size)
 {
     packet->mutable_data()->resize(size);
@@ -33,30 +53,44 @@ char* outputBuffer(proto::FilePacket* packet, size_t size)
 
 } // namespace
 
-FilePacketizer::FilePacketizer(std::ifstream&& file_stream)
-    : file_stream_(std::move(file_stream))
+FilePacketizer::FilePacketizer(std::unique_ptr<PlatformFile> file,
+                               uint64_t file_size,
+                               size_t packet_size)
+    : file_(std::move(file)),
+      packet_size_(packet_size),
+      file_size_(file_size),
+      left_size_(file_size),
+      unread_size_(file_size)
 {
-    file_stream_.seekg(0, file_stream_.end);
-    file_size_ = static_cast<uint64_t>(file_stream_.tellg());
-    file_stream_.seekg(0);
-    left_size_ = file_size_;
+    // Nothing
 }
 
-std::unique_ptr<FilePacketizer> FilePacketizer::create(const std::filesystem::path& file_path)
+FilePacketizer::~FilePacketizer() = default;
+
+std::unique_ptr<FilePacketizer> FilePacketizer::create(const std::filesystem::path& file_path,
+                                                       size_t packet_size)
 {
-    std::ifstream file_stream;
+    std::unique_ptr<PlatformFile> file = PlatformFile::openForReading(file_path);
+    if (!file)
+        return nullptr;
 
-    file_stream.open(file_path, std::ifstream::binary);
-    if (!file_stream.is_open())
+    int64_t file_size = file->size();
+    if (file_size < 0)
         return nullptr;
 
-    return std::unique_ptr<FilePacketizer>(new FilePacketizer(std::move(file_stream)));
+    if (!packet_size)
+        packet_size = kDefaultFilePacketSize;
+
+    packet_size = std::clamp(packet_size, kMinFilePacketSize, kMaxFilePacketSize);
+
+    return std::unique_ptr<FilePacketizer>(
+        new FilePacketizer(std::move(file), static_cast<uint64_t>(file_size), packet_size));
 }
 
 std::unique_ptr<proto::FilePacket> FilePacketizer::readNextPacket(
     const proto::FilePacketRequest& request)
 {
-    DCHECK(file_stream_.is_open());
+    DCHECK(file_);
 
     // Create a new file packet.
     std::unique_ptr<proto::FilePacket> packet = std::make_unique<proto::FilePacket>();
@@ -67,42 +101,274 @@ std::unique_ptr<proto::FilePacket> FilePacketizer::readNextPacket(
         return packet;
     }
 
-    size_t packet_buffer_size = kMaxFilePacketSize;
+    const bool first_packet = first_packet_;
+    if (first_packet_)
+    {
+        first_packet_ = false;
 
-    if (left_size_ < kMaxFilePacketSize)
-        packet_buffer_size = static_cast<size_t>(left_size_);
+        if (!startTransfer(request))
+        {
+            LOG(LS_WARNING) << "Unable to start transfer";
+            return nullptr;
+        }
+    }
 
-    char* packet_buffer = outputBuffer(packet.get(), packet_buffer_size);
+    size_t packet_buffer_size = packet_size_;
 
-    // Moving to a new position in file.
-    file_stream_.seekg(static_cast<std::streamoff>(file_size_ - left_size_));
+    if (left_size_ < packet_size_)
+        packet_buffer_size = static_cast<size_t>(left_size_);
 
-    file_stream_.read(packet_buffer, packet_buffer_size);
-    if (file_stream_.fail())
+    if (delta_encoder_)
     {
-        LOG(LS_WARNING) << "Unable to read file";
-        return nullptr;
+        if (!readDelta(packet_buffer_size, packet.get()))
+        {
+            LOG(LS_WARNING) << "Unable to read file";
+            return nullptr;
+        }
+    }
+    else
+    {
+        char* packet_buffer = outputBuffer(packet.get(), packet_buffer_size);
+
+        if (!readData(packet_buffer, packet_buffer_size))
+        {
+            LOG(LS_WARNING) << "Unable to read file";
+            return nullptr;
+        }
+
+        if (file_hash_)
+            file_hash_->addData(packet_buffer, packet_buffer_size);
     }
 
-    if (left_size_ == file_size_)
+    if (first_packet)
     {
         packet->set_flags(packet->flags() | proto::FilePacket::FIRST_PACKET);
 
-        // Set file path and size in first packet.
+        // Set file size, packet size and offset in first packet.
         packet->set_file_size(file_size_);
+        packet->set_packet_size(static_cast<uint32_t>(packet_size_));
+        packet->set_offset(offset_);
     }
 
+    if (request.compression() == proto::FILE_COMPRESSION_ZSTD)
+        compressPacket(packet.get());
+
     left_size_ -= packet_buffer_size;
 
     if (!left_size_)
     {
         file_size_ = 0;
-        file_stream_.close();
+        file_.reset();
 
         packet->set_flags(packet->flags() | proto::FilePacket::LAST_PACKET);
+
+        if (file_hash_)
+            packet->set_file_hash(base::toStdString(file_hash_->result()));
     }
 
     return packet;
 }
 
+bool FilePacketizer::startTransfer(const proto::FilePacketRequest& request)
+{
+    const uint64_t offset = request.offset();
+
+    if (offset && offset <= file_size_)
+    {
+        // The target has a part of the file. If the part does not match the file, it is
+        // transferred from the beginning.
+        std::string checksum;
+        if (FileDeltaUtil::offsetChecksum(file_.get(), offset, &checksum) &&
+            checksum == request.offset_checksum())
+        {
+            offset_ = offset;
+        }
+        else if (!file_->seek(0))
+        {
+            return false;
+        }
+    }
+
+    left_size_ = file_size_ - offset_;
+    unread_size_ = left_size_;
+
+    if (request.has_signature() && left_size_)
+        delta_encoder_ = FileDeltaEncoder::create(request.signature());
+
+    if (offset_ || delta_encoder_)
+    {
+        // The checksum of the offset covers only the data before it and the existing file of the
+        // target can change after its signature was built. The target checks the whole file.
+        file_hash_ = std::make_unique<base::GenericHash>(FileDeltaUtil::kFileHashType);
+
+        if (offset_ && (!file_->seek(0) ||
+                        !FileDeltaUtil::hashFile(file_.get(), offset_, file_hash_.get())))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool FilePacketizer::readDelta(size_t size, proto::FilePacket* packet)
+{
+    // Blocks that start in this packet can end in the next one.
+    const uint64_t required_size = std::min(
+        static_cast<uint64_t>(size + delta_encoder_->blockSize()),
+        read_buffer_.size() - read_pos_ + unread_size_);
+
+    if (read_buffer_.size() - read_pos_ < required_size)
+    {
+        // Move the rest of the buffer to the beginning and read the next block.
+        read_buffer_.erase(read_buffer_.begin(), read_buffer_.begin() + read_pos_);
+        read_pos_ = 0;
+
+        size_t read_size = static_cast<size_t>(required_size) - read_buffer_.size();
+        read_size = static_cast<size_t>(
+            std::min(static_cast<uint64_t>(std::max(read_size, kReadBlockSize)), unread_size_));
+
+        size_t buffer_size = read_buffer_.size();
+        read_buffer_.resize(buffer_size + read_size);
+
+        while (read_size)
+        {
+            int64_t result = file_->read(read_buffer_.data() + buffer_size, read_size);
+            if (result <= 0)
+            {
+                // The file was truncated after it was opened or an error occurred.
+                read_buffer_.clear();
+                return false;
+            }
+
+            unread_size_ -= static_cast<uint64_t>(result);
+            buffer_size += static_cast<size_t>(result);
+            read_size -= static_cast<size_t>(result);
+        }
+    }
+
+    if (file_hash_)
+        file_hash_->addData(read_buffer_.data() + read_pos_, size);
+
+    delta_encoder_->encode(read_buffer_.data() + read_pos_,
+                           read_buffer_.size() - read_pos_,
+                           size,
+                           packet);
+    read_pos_ += size;
+    return true;
+}
+
+void FilePacketizer::compressPacket(proto::FilePacket* packet)
+{
+    const std::string& data = packet->data();
+    if (data.size() < kMinCompressionSize)
+        return;
+
+    if (skip_packets_)
+    {
+        --skip_packets_;
+        return;
+    }
+
+    if (!compress_stream_)
+        compress_stream_.reset(ZSTD_createCStream());
+
+    size_t ret = ZSTD_initCStream(compress_stream_.get(), kCompressionRatio);
+    if (ZSTD_isError(ret))
+    {
+        LOG(LS_ERROR) << "ZSTD_initCStream failed: " << ZSTD_getErrorName(ret);
+        return;
+    }
+
+    // Compression makes sense only if the result is noticeably smaller.
+    const size_t max_output_size = data.size() - (data.size() >> kMinCompressionGainShift);
+    compress_buffer_.resize(max_output_size);
+
+    ZSTD_inBuffer input = { data.data(), data.size(), 0 };
+    ZSTD_outBuffer output = { compress_buffer_.data(), compress_buffer_.size(), 0 };
+
+    bool compressed = false;
+
+    while (output.pos < output.size)
+    {
+        if (input.pos < input.size)
+            ret = ZSTD_compressStream(compress_stream_.get(), &output, &input);
+        else
+            ret = ZSTD_endStream(compress_stream_.get(), &output);
+
+        if (ZSTD_isError(ret))
+        {
+            LOG(LS_ERROR) << "ZSTD compression failed: " << ZSTD_getErrorName(ret);
+            return;
+        }
+
+        if (input.pos == input.size && !ret)
+        {
+            compressed = true;
+            break;
+        }
+    }
+
+    if (!compressed)
+    {
+        // The output buffer is full: the data does not compress well.
+        skip_interval_ = std::clamp(skip_interval_ * 2, size_t(1), kMaxSkipInterval);
+        skip_packets_ = skip_interval_;
+        return;
+    }
+
+    skip_interval_ = 0;
+
+    compress_buffer_.resize(output.pos);
+    packet->mutable_data()->swap(compress_buffer_);
+    packet->set_compression(proto::FILE_COMPRESSION_ZSTD);
+}
+
+bool FilePacketizer::readData(char* data, size_t size)
+{
+    while (size)
+    {
+        if (read_pos_ == read_buffer_.size())
+        {
+            // Large parts are read directly into the packet.
+            if (size >= kReadBlockSize)
+            {
+                int64_t result = file_->read(data, size);
+                if (result <= 0)
+                    return false;
+
+                unread_size_ -= static_cast<uint64_t>(result);
+                data += result;
+                size -= static_cast<size_t>(result);
+                continue;
+            }
+
+            read_buffer_.resize(static_cast<size_t>(
+                std::min(unread_size_, static_cast<uint64_t>(kReadBlockSize))));
+            read_pos_ = 0;
+
+            int64_t result = file_->read(read_buffer_.data(), read_buffer_.size());
+            if (result <= 0)
+            {
+                // The file was truncated after it was opened or an error occurred.
+                read_buffer_.clear();
+                return false;
+            }
+
+            read_buffer_.resize(static_cast<size_t>(result));
+            unread_size_ -= static_cast<uint64_t>(result);
+        }
+
+        size_t copy_size = std::min(size, read_buffer_.size() - read_pos_);
+
+        memcpy(data, read_buffer_.data() + read_pos_, copy_size);
+        read_pos_ += copy_size;
+
+        data += copy_size;
+        size -= copy_size;
+    }
+
+    return true;
+}
+
 } // namespace common
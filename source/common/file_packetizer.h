@@ -20,34 +20,74 @@
 #define COMMON__FILE_PACKETIZER_H
 
 #include "base/macros_magic.h"
+#include "base/codec/scoped_zstd_stream.h"
+#include "base/crypto/generic_hash.h"
+#include "base/memory/byte_array.h"
 #include "proto/file_transfer.pb.h"
 
 #include <filesystem>
-#include <fstream>
 #include <memory>
 
 namespace common {
 
+class FileDeltaEncoder;
+class PlatformFile;
+
 class FilePacketizer
 {
 public:
-    ~FilePacketizer() = default;
+    ~FilePacketizer();
 
     // Creates an instance of the class.
     // Parameter |file_path| contains the full path to the file.
+    // Parameter |packet_size| contains the requested size of packets. If 0, the default size is
+    // used. The size is limited to the range [kMinFilePacketSize, kMaxFilePacketSize].
     // If the specified file can not be opened for reading, then returns nullptr.
-    static std::unique_ptr<FilePacketizer> create(const std::filesystem::path& file_path);
+    static std::unique_ptr<FilePacketizer> create(const std::filesystem::path& file_path,
+                                                  size_t packet_size = 0);
 
-    // Creates a packet for transferring.
+    // Creates a packet for transferring. If the request allows, the packet data is compressed.
+    // The first request can contain the offset from which the target continues the transfer and
+    // the signature of the existing file of the target.
     std::unique_ptr<proto::FilePacket> readNextPacket(const proto::FilePacketRequest& request);
 
 private:
-    explicit FilePacketizer(std::ifstream&& file_stream);
+    FilePacketizer(std::unique_ptr<PlatformFile> file, uint64_t file_size, size_t packet_size);
+
+    bool startTransfer(const proto::FilePacketRequest& request);
+    bool readData(char* data, size_t size);
+    bool readDelta(size_t size, proto::FilePacket* packet);
+    void compressPacket(proto::FilePacket* packet);
 
-    std::ifstream file_stream_;
+    std::unique_ptr<PlatformFile> file_;
+    const size_t packet_size_;
+
+    // The file is read sequentially in large blocks. Packets are copied from the block or encoded
+    // from it if the target has an existing file.
+    base::ByteArray read_buffer_;
+    size_t read_pos_ = 0;
 
     uint64_t file_size_ = 0;
     uint64_t left_size_ = 0;
+    uint64_t offset_ = 0;
+    bool first_packet_ = true;
+
+    // Size of the data that has not been read from the file yet.
+    uint64_t unread_size_ = 0;
+
+    std::unique_ptr<FileDeltaEncoder> delta_encoder_;
+
+    // Hash of the whole file. Created only if the target uses its own data for the file.
+    std::unique_ptr<base::GenericHash> file_hash_;
+
+    base::ScopedZstdCStream compress_stream_;
+    std::string compress_buffer_;
+
+    // Already compressed files are not worth compressing. If a packet does not compress well,
+    // the following packets are sent as is. Compression is tried again after |skip_packets_|
+    // packets, the interval doubles after each failure.
+    size_t skip_packets_ = 0;
+    size_t skip_interval_ = 0;
 
     DISALLOW_COPY_AND_ASSIGN(FilePacketizer);
 };
@@ -74,28 +74,49 @@ std::shared_ptr<FileTask> FileTaskFactory::remove(const std::string& path)
     return makeTask(std::move(request));
 }
 
-std::shared_ptr<FileTask> FileTaskFactory::download(const std::string& file_path)
+std::shared_ptr<FileTask> FileTaskFactory::download(const std::string& file_path,
+                                                    size_t packet_size)
 {
     auto request = std::make_unique<proto::FileRequest>();
-    request->mutable_download_request()->set_path(file_path);
+
+    proto::DownloadRequest* download_request = request->mutable_download_request();
+    download_request->set_path(file_path);
+    download_request->set_packet_size(static_cast<uint32_t>(packet_size));
+
     return makeTask(std::move(request));
 }
 
-std::shared_ptr<FileTask> FileTaskFactory::upload(const std::string& file_path, bool overwrite)
+std::shared_ptr<FileTask> FileTaskFactory::upload(const std::string& file_path, bool overwrite,
+                                                  bool resume, bool delta)
 {
     auto request = std::make_unique<proto::FileRequest>();
 
     proto::UploadRequest* upload_request = request->mutable_upload_request();
     upload_request->set_path(file_path);
     upload_request->set_overwrite(overwrite);
+    upload_request->set_resume(resume);
+    upload_request->set_delta(delta);
+
+    return makeTask(std::move(request));
+}
+
+std::shared_ptr<FileTask> FileTaskFactory::packetRequest(uint32_t flags,
+                                                         proto::FileCompression compression)
+{
+    auto request = std::make_unique<proto::FileRequest>();
+
+    proto::FilePacketRequest* packet_request = request->mutable_packet_request();
+    packet_request->set_flags(flags);
+    packet_request->set_compression(compression);
 
     return makeTask(std::move(request));
 }
 
-std::shared_ptr<FileTask> FileTaskFactory::packetRequest(uint32_t flags)
+std::shared_ptr<FileTask> FileTaskFactory::packetRequest(
+    std::unique_ptr<proto::FilePacketRequest> packet_request)
 {
     auto request = std::make_unique<proto::FileRequest>();
-    request->mutable_packet_request()->set_flags(flags);
+    request->set_allocated_packet_request(packet_request.release());
     return makeTask(std::move(request));
 }
 
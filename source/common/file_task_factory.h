@@ -20,13 +20,10 @@
 #define CLIENT__FILE_TASK_FACTORY_H
 
 #include "common/file_task.h"
+#include "proto/file_transfer.pb.h"
 
 #include <string>
 
-namespace proto {
-class FilePacket;
-} // namespace proto
-
 namespace common {
 
 class FileTaskFactory
@@ -42,9 +39,13 @@ public:
     std::shared_ptr<FileTask> createDirectory(const std::string& path);
     std::shared_ptr<FileTask> rename(const std::string& old_name, const std::string& new_name);
     std::shared_ptr<FileTask> remove(const std::string& path);
-    std::shared_ptr<FileTask> download(const std::string& file_path);
-    std::shared_ptr<FileTask> upload(const std::string& file_path, bool overwrite);
-    std::shared_ptr<FileTask> packetRequest(uint32_t flags);
+    std::shared_ptr<FileTask> download(const std::string& file_path, size_t packet_size = 0);
+    std::shared_ptr<FileTask> upload(const std::string& file_path, bool overwrite,
+                                     bool resume = false, bool delta = false);
+    std::shared_ptr<FileTask> packetRequest(
+        uint32_t flags, proto::FileCompression compression = proto::FILE_COMPRESSION_NONE);
+    std::shared_ptr<FileTask> packetRequest(
+        std::unique_ptr<proto::FilePacketRequest> packet_request);
     std::shared_ptr<FileTask> packet(const proto::FilePacket& packet);
     std::shared_ptr<FileTask> packet(std::unique_ptr<proto::FilePacket> packet);
 
@@ -373,7 +373,8 @@ std::unique_ptr<proto::FileReply> FileWorker::Impl::doDownloadRequest(
 {
     std::unique_ptr<proto::FileReply> reply = std::make_unique<proto::FileReply>();
 
-    packetizer_ = FilePacketizer::create(std::filesystem::u8path(request.path()));
+    packetizer_ = FilePacketizer::create(
+        std::filesystem::u8path(request.path()), request.packet_size());
     if (!packetizer_)
         reply->set_error_code(proto::FILE_ERROR_FILE_OPEN_ERROR);
     else
@@ -401,7 +402,8 @@ std::unique_ptr<proto::FileReply> FileWorker::Impl::doUploadRequest(
             }
         }
 
-        depacketizer_ = FileDepacketizer::create(file_path, request.overwrite());
+        depacketizer_ = FileDepacketizer::create(
+            file_path, request.overwrite(), request.resume(), request.delta());
         if (!depacketizer_)
         {
             reply->set_error_code(proto::FILE_ERROR_FILE_CREATE_ERROR);
@@ -409,6 +411,16 @@ std::unique_ptr<proto::FileReply> FileWorker::Impl::doUploadRequest(
         }
 
         reply->set_error_code(proto::FILE_ERROR_SUCCESS);
+        reply->set_compression(proto::FILE_COMPRESSION_ZSTD);
+
+        if (depacketizer_->resumeOffset())
+        {
+            reply->set_resume_offset(depacketizer_->resumeOffset());
+            reply->set_resume_checksum(depacketizer_->resumeChecksum());
+        }
+
+        if (depacketizer_->hasSignature())
+            reply->mutable_signature()->CopyFrom(depacketizer_->signature());
     }
     while (false);
 
@@ -0,0 +1,82 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef COMMON__PLATFORM_FILE_H
+#define COMMON__PLATFORM_FILE_H
+
+#include "base/macros_magic.h"
+#include "build/build_config.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+
+#if defined(OS_WIN)
+#include "base/win/scoped_object.h"
+#endif // defined(OS_WIN)
+
+namespace common {
+
+// A file opened with the native API of the OS. Unlike the standard streams it does not have its
+// own buffering: data is read and written directly with system calls, so the caller should use
+// large blocks. The files are opened for sequential access.
+class PlatformFile
+{
+public:
+    ~PlatformFile();
+
+    // Opens an existing file for reading. Returns nullptr if the file cannot be opened.
+    static std::unique_ptr<PlatformFile> openForReading(const std::filesystem::path& file_path);
+
+    // Creates a new file or truncates an existing one. Returns nullptr if the file cannot be
+    // created.
+    static std::unique_ptr<PlatformFile> create(const std::filesystem::path& file_path);
+
+    // Opens an existing file for writing at the end of the file. Returns nullptr if the file
+    // cannot be opened.
+    static std::unique_ptr<PlatformFile> openForAppending(const std::filesystem::path& file_path);
+
+    // Returns the size of the file or -1 if an error occurred.
+    int64_t size() const;
+
+    // Reads up to |size| bytes from the current position. Returns the number of bytes read, 0 at
+    // the end of the file or -1 if an error occurred.
+    int64_t read(void* data, size_t size);
+
+    // Sets the current position to |offset| bytes from the beginning of the file. Returns false if
+    // an error occurred.
+    bool seek(int64_t offset);
+
+    // Writes all |size| bytes at the current position. Returns false if an error occurred.
+    bool write(const void* data, size_t size);
+
+private:
+#if defined(OS_WIN)
+    explicit PlatformFile(base::win::ScopedHandle&& handle);
+    base::win::ScopedHandle handle_;
+#elif defined(OS_POSIX)
+    explicit PlatformFile(int fd);
+    int fd_;
+#endif
+
+    DISALLOW_COPY_AND_ASSIGN(PlatformFile);
+};
+
+} // namespace common
+
+#endif // COMMON__PLATFORM_FILE_H
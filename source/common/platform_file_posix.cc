@@ -0,0 +1,184 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "common/platform_file.h"
+
+#include "base/logging.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace common {
+
+namespace {
+
+// Limits the size of one system call. Some systems do not allow larger reads and writes.
+const size_t kMaxChunkSize = 1024 * 1024 * 1024; // 1 GB
+
+} // namespace
+
+PlatformFile::PlatformFile(int fd)
+    : fd_(fd)
+{
+    DCHECK_NE(fd_, -1);
+}
+
+PlatformFile::~PlatformFile()
+{
+    if (close(fd_) != 0)
+        PLOG(LS_WARNING) << "close failed";
+}
+
+// static
+std::unique_ptr<PlatformFile> PlatformFile::openForReading(const std::filesystem::path& file_path)
+{
+    int fd;
+
+    do
+    {
+        fd = open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    while (fd == -1 && errno == EINTR);
+
+    if (fd == -1)
+    {
+        PLOG(LS_WARNING) << "open failed";
+        return nullptr;
+    }
+
+#if defined(OS_LINUX)
+    // The file is read from the beginning to the end. Let the kernel read ahead more aggressively.
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#elif defined(OS_MAC)
+    fcntl(fd, F_RDAHEAD, 1);
+#endif
+
+    return std::unique_ptr<PlatformFile>(new PlatformFile(fd));
+}
+
+// static
+std::unique_ptr<PlatformFile> PlatformFile::create(const std::filesystem::path& file_path)
+{
+    int fd;
+
+    do
+    {
+        fd = open(file_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    }
+    while (fd == -1 && errno == EINTR);
+
+    if (fd == -1)
+    {
+        PLOG(LS_WARNING) << "open failed";
+        return nullptr;
+    }
+
+    return std::unique_ptr<PlatformFile>(new PlatformFile(fd));
+}
+
+// static
+std::unique_ptr<PlatformFile> PlatformFile::openForAppending(
+    const std::filesystem::path& file_path)
+{
+    int fd;
+
+    do
+    {
+        fd = open(file_path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+    }
+    while (fd == -1 && errno == EINTR);
+
+    if (fd == -1)
+    {
+        PLOG(LS_WARNING) << "open failed";
+        return nullptr;
+    }
+
+    return std::unique_ptr<PlatformFile>(new PlatformFile(fd));
+}
+
+int64_t PlatformFile::size() const
+{
+    struct stat file_info;
+
+    if (fstat(fd_, &file_info) != 0)
+    {
+        PLOG(LS_WARNING) << "fstat failed";
+        return -1;
+    }
+
+    return static_cast<int64_t>(file_info.st_size);
+}
+
+int64_t PlatformFile::read(void* data, size_t size)
+{
+    ssize_t result;
+
+    do
+    {
+        result = ::read(fd_, data, std::min(size, kMaxChunkSize));
+    }
+    while (result == -1 && errno == EINTR);
+
+    if (result == -1)
+    {
+        PLOG(LS_WARNING) << "read failed";
+        return -1;
+    }
+
+    return static_cast<int64_t>(result);
+}
+
+bool PlatformFile::seek(int64_t offset)
+{
+    if (lseek(fd_, static_cast<off_t>(offset), SEEK_SET) == -1)
+    {
+        PLOG(LS_WARNING) << "lseek failed";
+        return false;
+    }
+
+    return true;
+}
+
+bool PlatformFile::write(const void* data, size_t size)
+{
+    const uint8_t* current = reinterpret_cast<const uint8_t*>(data);
+
+    while (size)
+    {
+        ssize_t result = ::write(fd_, current, std::min(size, kMaxChunkSize));
+        if (result == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            PLOG(LS_WARNING) << "write failed";
+            return false;
+        }
+
+        current += result;
+        size -= static_cast<size_t>(result);
+    }
+
+    return true;
+}
+
+} // namespace common
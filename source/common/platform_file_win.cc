@@ -0,0 +1,182 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "common/platform_file.h"
+
+#include "base/logging.h"
+
+#include <algorithm>
+
+namespace common {
+
+namespace {
+
+// ReadFile and WriteFile take the size as DWORD.
+const DWORD kMaxChunkSize = 1024 * 1024 * 1024; // 1 GB
+
+// Files that other processes hold open (e.g. log files that are still being written) must be
+// readable too.
+const DWORD kReadShareMode = FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE;
+
+} // namespace
+
+PlatformFile::PlatformFile(base::win::ScopedHandle&& handle)
+    : handle_(std::move(handle))
+{
+    DCHECK(handle_.isValid());
+}
+
+PlatformFile::~PlatformFile() = default;
+
+// static
+std::unique_ptr<PlatformFile> PlatformFile::openForReading(const std::filesystem::path& file_path)
+{
+    base::win::ScopedHandle handle(CreateFileW(file_path.c_str(),
+                                               GENERIC_READ,
+                                               kReadShareMode,
+                                               nullptr,
+                                               OPEN_EXISTING,
+                                               FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                                               nullptr));
+    if (!handle.isValid())
+    {
+        PLOG(LS_WARNING) << "CreateFileW failed";
+        return nullptr;
+    }
+
+    return std::unique_ptr<PlatformFile>(new PlatformFile(std::move(handle)));
+}
+
+// static
+std::unique_ptr<PlatformFile> PlatformFile::create(const std::filesystem::path& file_path)
+{
+    base::win::ScopedHandle handle(CreateFileW(file_path.c_str(),
+                                               GENERIC_WRITE,
+                                               0,
+                                               nullptr,
+                                               CREATE_ALWAYS,
+                                               FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                                               nullptr));
+    if (!handle.isValid())
+    {
+        PLOG(LS_WARNING) << "CreateFileW failed";
+        return nullptr;
+    }
+
+    return std::unique_ptr<PlatformFile>(new PlatformFile(std::move(handle)));
+}
+
+// static
+std::unique_ptr<PlatformFile> PlatformFile::openForAppending(
+    const std::filesystem::path& file_path)
+{
+    base::win::ScopedHandle handle(CreateFileW(file_path.c_str(),
+                                               GENERIC_WRITE,
+                                               0,
+                                               nullptr,
+                                               OPEN_EXISTING,
+                                               FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                                               nullptr));
+    if (!handle.isValid())
+    {
+        PLOG(LS_WARNING) << "CreateFileW failed";
+        return nullptr;
+    }
+
+    LARGE_INTEGER distance;
+    distance.QuadPart = 0;
+
+    if (!SetFilePointerEx(handle.get(), distance, nullptr, FILE_END))
+    {
+        PLOG(LS_WARNING) << "SetFilePointerEx failed";
+        return nullptr;
+    }
+
+    return std::unique_ptr<PlatformFile>(new PlatformFile(std::move(handle)));
+}
+
+int64_t PlatformFile::size() const
+{
+    LARGE_INTEGER file_size;
+
+    if (!GetFileSizeEx(handle_.get(), &file_size))
+    {
+        PLOG(LS_WARNING) << "GetFileSizeEx failed";
+        return -1;
+    }
+
+    return file_size.QuadPart;
+}
+
+int64_t PlatformFile::read(void* data, size_t size)
+{
+    DWORD read_bytes = 0;
+
+    if (!ReadFile(handle_.get(),
+                  data,
+                  static_cast<DWORD>(std::min(size, static_cast<size_t>(kMaxChunkSize))),
+                  &read_bytes,
+                  nullptr))
+    {
+        PLOG(LS_WARNING) << "ReadFile failed";
+        return -1;
+    }
+
+    return static_cast<int64_t>(read_bytes);
+}
+
+bool PlatformFile::seek(int64_t offset)
+{
+    LARGE_INTEGER distance;
+    distance.QuadPart = offset;
+
+    if (!SetFilePointerEx(handle_.get(), distance, nullptr, FILE_BEGIN))
+    {
+        PLOG(LS_WARNING) << "SetFilePointerEx failed";
+        return false;
+    }
+
+    return true;
+}
+
+bool PlatformFile::write(const void* data, size_t size)
+{
+    const uint8_t* current = reinterpret_cast<const uint8_t*>(data);
+
+    while (size)
+    {
+        DWORD written_bytes = 0;
+
+        if (!WriteFile(handle_.get(),
+                       current,
+                       static_cast<DWORD>(std::min(size, static_cast<size_t>(kMaxChunkSize))),
+                       &written_bytes,
+                       nullptr))
+        {
+            PLOG(LS_WARNING) << "WriteFile failed";
+            return false;
+        }
+
+        current += written_bytes;
+        size -= written_bytes;
+    }
+
+    return true;
+}
+
+} // namespace common
@@ -19,6 +19,7 @@
 #include "host/client_session.h"
 
 #include "base/logging.h"
+#include "base/net/bandwidth_estimator.h"
 #include "base/net/network_channel_proxy.h"
 #include "host/client_session_desktop.h"
 #include "host/client_session_file_transfer.h"
@@ -126,11 +127,27 @@ std::shared_ptr<base::NetworkChannelProxy> ClientSession::channelProxy()
     return channel_->channelProxy();
 }
 
-void ClientSession::sendMessage(base::ByteArray&& buffer)
+void ClientSession::sendMessage(const google::protobuf::MessageLite& message)
 {
+    if (bandwidth_estimator_)
+        bandwidth_estimator_->onMessageSent(message.ByteSizeLong());
+
+    channel_->send(message);
+}
+
+void ClientSession::sendMessage(std::shared_ptr<const base::ByteArray> buffer)
+{
+    if (bandwidth_estimator_)
+        bandwidth_estimator_->onMessageSent(buffer->size());
+
     channel_->send(std::move(buffer));
 }
 
+void ClientSession::setBandwidthEstimator(base::BandwidthEstimator* bandwidth_estimator)
+{
+    bandwidth_estimator_ = bandwidth_estimator;
+}
+
 void ClientSession::onConnected()
 {
     NOTREACHED();
@@ -25,6 +25,7 @@
 #include "proto/common.pb.h"
 
 namespace base {
+class BandwidthEstimator;
 class NetworkChannelProxy;
 } // namespace base
 
@@ -44,6 +45,9 @@ public:
 
         virtual void onClientSessionConfigured() = 0;
         virtual void onClientSessionFinished() = 0;
+
+        // The desktop client dropped frames and can receive them again.
+        virtual void onClientSessionVideoResumed(ClientSession* client_session) = 0;
     };
 
     enum class State
@@ -84,7 +88,15 @@ protected:
     virtual void onStarted() = 0;
 
     std::shared_ptr<base::NetworkChannelProxy> channelProxy();
-    void sendMessage(base::ByteArray&& buffer);
+    void sendMessage(const google::protobuf::MessageLite& message);
+
+    // Sends an already serialized message shared with other sessions. The buffer is not copied
+    // and must not be changed until it is sent.
+    void sendMessage(std::shared_ptr<const base::ByteArray> buffer);
+
+    // Sets the estimator that is notified about all sent messages. The session must notify it
+    // about the written messages in onMessageWritten().
+    void setBandwidthEstimator(base::BandwidthEstimator* bandwidth_estimator);
 
     // base::NetworkChannel::Listener implementation.
     void onConnected() override;
@@ -102,6 +114,7 @@ private:
     std::string computer_name_;
 
     std::unique_ptr<base::NetworkChannel> channel_;
+    base::BandwidthEstimator* bandwidth_estimator_ = nullptr;
 };
 
 } // namespace host
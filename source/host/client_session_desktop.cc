@@ -22,10 +22,8 @@
 #include "base/power_controller.h"
 #include "base/codec/audio_encoder_opus.h"
 #include "base/codec/cursor_encoder.h"
-#include "base/codec/scale_reducer.h"
-#include "base/codec/video_encoder_vpx.h"
 #include "base/desktop/frame.h"
-#include "base/desktop/screen_capturer.h"
+#include "base/net/bandwidth_estimator.h"
 #include "common/desktop_session_constants.h"
 #include "host/desktop_session_proxy.h"
 #include "host/system_info.h"
@@ -34,13 +32,27 @@
 
 namespace host {
 
+namespace {
+
+// If the queued messages are delivered longer, new frames are not sent to the client. They would
+// only increase the latency.
+const std::chrono::milliseconds kMaxQueueDrainTime{ 100 };
+
+// Frames are sent again only when the queue is delivered much faster. Otherwise a client on a
+// slow channel would switch between dropping and sending the frames all the time, and would get
+// a key frame each time it continues the stream of a shared encoder.
+const std::chrono::milliseconds kResumeQueueDrainTime{ kMaxQueueDrainTime / 2 };
+
+} // namespace
+
 ClientSessionDesktop::ClientSessionDesktop(
     proto::SessionType session_type, std::unique_ptr<base::NetworkChannel> channel)
     : ClientSession(session_type, std::move(channel)),
+      bandwidth_estimator_(std::make_unique<base::BandwidthEstimator>()),
       incoming_message_(std::make_unique<proto::ClientToHost>()),
       outgoing_message_(std::make_unique<proto::HostToClient>())
 {
-    // Nothing
+    setBandwidthEstimator(bandwidth_estimator_.get());
 }
 
 ClientSessionDesktop::~ClientSessionDesktop() = default;
@@ -52,6 +64,12 @@ void ClientSessionDesktop::setDesktopSessionProxy(
     DCHECK(desktop_session_proxy_);
 }
 
+void ClientSessionDesktop::setVideoEncoderPool(std::shared_ptr<VideoEncoderPool> video_encoder_pool)
+{
+    video_encoder_pool_ = std::move(video_encoder_pool);
+    DCHECK(video_encoder_pool_);
+}
+
 void ClientSessionDesktop::onMessageReceived(const base::ByteArray& buffer)
 {
     incoming_message_->Clear();
@@ -67,15 +85,15 @@ void ClientSessionDesktop::onMessageReceived(const base::ByteArray& buffer)
         if (sessionType() != proto::SESSION_TYPE_DESKTOP_MANAGE)
             return;
 
-        if (!scale_reducer_)
+        if (!video_encoder_)
             return;
 
         const proto::MouseEvent& mouse_event = incoming_message_->mouse_event();
 
         int pos_x = static_cast<int>(
-            static_cast<double>(mouse_event.x() * 100) / scale_reducer_->scaleFactorX());
+            static_cast<double>(mouse_event.x() * 100) / video_encoder_->scaleFactorX());
         int pos_y = static_cast<int>(
-            static_cast<double>(mouse_event.y() * 100) / scale_reducer_->scaleFactorY());
+            static_cast<double>(mouse_event.y() * 100) / video_encoder_->scaleFactorY());
 
         proto::MouseEvent out_mouse_event;
         out_mouse_event.set_mask(mouse_event.mask());
@@ -109,9 +127,17 @@ void ClientSessionDesktop::onMessageReceived(const base::ByteArray& buffer)
     }
 }
 
-void ClientSessionDesktop::onMessageWritten(size_t /* pending */)
+void ClientSessionDesktop::onMessageWritten(size_t pending)
 {
-    // Nothing
+    bandwidth_estimator_->onMessageWritten(pending);
+
+    if (frames_skipped_ && queueDrainTime() <= kResumeQueueDrainTime)
+    {
+        // The client can receive frames again. The changes of the dropped frames are sent with the
+        // last captured frame even if the screen does not change anymore.
+        frames_skipped_ = false;
+        delegate_->onClientSessionVideoResumed(this);
+    }
 }
 
 void ClientSessionDesktop::onStarted()
@@ -143,14 +169,12 @@ void ClientSessionDesktop::onStarted()
     LOG(LS_INFO) << "Supported audio encodings: " << request->audio_encodings();
 
     // Send the request.
-    sendMessage(base::serialize(*outgoing_message_));
+    sendMessage(*outgoing_message_);
 }
 
 void ClientSessionDesktop::encodeScreen(const base::Frame* frame, const base::MouseCursor* cursor)
 {
-    outgoing_message_->Clear();
-
-    if (frame && video_encoder_ && scale_reducer_)
+    if (frame && video_encoding_ != proto::VIDEO_ENCODING_UNKNOWN && video_encoder_pool_)
     {
         if (source_size_ != frame->size())
         {
@@ -172,48 +196,50 @@ void ClientSessionDesktop::encodeScreen(const base::Frame* frame, const base::Mo
         if (current_size.isEmpty())
             current_size = source_size_;
 
-        const base::Frame* scaled_frame = scale_reducer_->scaleFrame(frame, current_size);
-        if (!scaled_frame)
+        if (!video_encoder_ || video_encoder_->size() != current_size)
         {
-            LOG(LS_ERROR) << "No scaled frame";
-            return;
+            // Other clients can already receive the stream of the encoder. The client can decode
+            // it only from a key frame.
+            video_encoder_ = video_encoder_pool_->encoder(video_encoding_, current_size);
+            if (video_encoder_)
+                video_encoder_->requestKeyFrame();
         }
 
-        proto::VideoPacket* packet = outgoing_message_->mutable_video_packet();
-
-        // Encode the frame into a video packet.
-        video_encoder_->encode(scaled_frame, packet);
-
-        if (packet->has_format())
+        if (video_encoder_)
         {
-            proto::VideoPacketFormat* format = packet->mutable_format();
-
-            // In video packets that contain the format, we pass the screen capture type.
-            format->set_capturer_type(frame->capturerType());
-
-            // Real screen size.
-            proto::Size* screen_size = format->mutable_screen_size();
-            screen_size->set_width(frame->size().width());
-            screen_size->set_height(frame->size().height());
-
-            LOG(LS_INFO) << "Video packet has format";
-            LOG(LS_INFO) << "Capturer type: " << base::ScreenCapturer::typeToString(
-                static_cast<base::ScreenCapturer::Type>(frame->capturerType()));
-            LOG(LS_INFO) << "Screen size: " << screen_size->width() << "x"
-                         << screen_size->height();
-            LOG(LS_INFO) << "Video size: " << format->video_rect().width() << "x"
-                         << format->video_rect().height();
+            if (frames_skipped_ || queueDrainTime() > kMaxQueueDrainTime)
+            {
+                // The frame is dropped. The changes are sent when the queue is delivered.
+                video_encoder_->skipFrame(frame);
+                frames_skipped_ = true;
+            }
+            else
+            {
+                if (!video_encoder_->canContinue(video_packet_number_))
+                {
+                    // Other clients of the encoder received packets while the frames were dropped
+                    // for this client. The client can continue the stream only from a key frame.
+                    video_encoder_->requestKeyFrame();
+                }
+
+                std::shared_ptr<const base::ByteArray> buffer =
+                    video_encoder_->encode(frame, bandwidth_estimator_->targetBitrate());
+                if (buffer)
+                {
+                    video_packet_number_ = video_encoder_->packetNumber();
+                    sendMessage(std::move(buffer));
+                }
+            }
         }
     }
 
     if (cursor && cursor_encoder_)
     {
-        if (!cursor_encoder_->encode(*cursor, outgoing_message_->mutable_cursor_shape()))
-            outgoing_message_->clear_cursor_shape();
-    }
+        outgoing_message_->Clear();
 
-    if (outgoing_message_->has_video_packet() || outgoing_message_->has_cursor_shape())
-        sendMessage(base::serialize(*outgoing_message_));
+        if (cursor_encoder_->encode(*cursor, outgoing_message_->mutable_cursor_shape()))
+            sendMessage(*outgoing_message_);
+    }
 }
 
 void ClientSessionDesktop::encodeAudio(const proto::AudioPacket& audio_packet)
@@ -226,7 +252,12 @@ void ClientSessionDesktop::encodeAudio(const proto::AudioPacket& audio_packet)
     if (!audio_encoder_->encode(audio_packet, outgoing_message_->mutable_audio_packet()))
         return;
 
-    sendMessage(base::serialize(*outgoing_message_));
+    sendMessage(*outgoing_message_);
+}
+
+std::chrono::milliseconds ClientSessionDesktop::queueDrainTime() const
+{
+    return bandwidth_estimator_->queueDrainTime();
 }
 
 void ClientSessionDesktop::setScreenList(const proto::ScreenList& list)
@@ -237,7 +268,7 @@ void ClientSessionDesktop::setScreenList(const proto::ScreenList& list)
     extension->set_name(common::kSelectScreenExtension);
     extension->set_data(list.SerializeAsString());
 
-    sendMessage(base::serialize(*outgoing_message_));
+    sendMessage(*outgoing_message_);
 }
 
 void ClientSessionDesktop::injectClipboardEvent(const proto::ClipboardEvent& event)
@@ -247,7 +278,7 @@ void ClientSessionDesktop::injectClipboardEvent(const proto::ClipboardEvent& eve
         outgoing_message_->Clear();
 
         outgoing_message_->mutable_clipboard_event()->CopyFrom(event);
-        sendMessage(base::serialize(*outgoing_message_));
+        sendMessage(*outgoing_message_);
     }
 }
 
@@ -353,7 +384,7 @@ void ClientSessionDesktop::readExtension(const proto::DesktopExtension& extensio
         desktop_extension->set_name(common::kSystemInfoExtension);
         desktop_extension->set_data(system_info.SerializeAsString());
 
-        sendMessage(base::serialize(*outgoing_message_));
+        sendMessage(*outgoing_message_);
     }
     else
     {
@@ -363,14 +394,16 @@ void ClientSessionDesktop::readExtension(const proto::DesktopExtension& extensio
 
 void ClientSessionDesktop::readConfig(const proto::DesktopConfig& config)
 {
+    // The encoder is selected for the next frame. A new key frame is sent to the client even if
+    // the encoding has not changed.
+    video_encoder_.reset();
+    video_encoding_ = proto::VIDEO_ENCODING_UNKNOWN;
+
     switch (config.video_encoding())
     {
         case proto::VIDEO_ENCODING_VP8:
-            video_encoder_ = base::VideoEncoderVPX::createVP8();
-            break;
-
         case proto::VIDEO_ENCODING_VP9:
-            video_encoder_ = base::VideoEncoderVPX::createVP9();
+            video_encoding_ = config.video_encoding();
             break;
 
         default:
@@ -381,7 +414,7 @@ void ClientSessionDesktop::readConfig(const proto::DesktopConfig& config)
         break;
     }
 
-    if (!video_encoder_)
+    if (video_encoding_ == proto::VIDEO_ENCODING_UNKNOWN)
     {
         LOG(LS_ERROR) << "Video encoder not initialized!";
         return;
@@ -405,8 +438,6 @@ void ClientSessionDesktop::readConfig(const proto::DesktopConfig& config)
     if (config.flags() & proto::ENABLE_CURSOR_SHAPE)
         cursor_encoder_ = std::make_unique<base::CursorEncoder>();
 
-    scale_reducer_ = std::make_unique<base::ScaleReducer>();
-
     desktop_session_config_.disable_font_smoothing =
         (config.flags() & proto::DISABLE_FONT_SMOOTHING);
     desktop_session_config_.disable_effects =
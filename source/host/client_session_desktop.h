@@ -23,14 +23,14 @@
 #include "base/desktop/geometry.h"
 #include "host/client_session.h"
 #include "host/desktop_session.h"
+#include "host/video_encoder_pool.h"
 
 namespace base {
 class AudioEncoder;
+class BandwidthEstimator;
 class CursorEncoder;
 class Frame;
 class MouseCursor;
-class ScaleReducer;
-class VideoEncoder;
 } // namespace base
 
 namespace host {
@@ -45,6 +45,7 @@ public:
     ~ClientSessionDesktop();
 
     void setDesktopSessionProxy(std::shared_ptr<DesktopSessionProxy> desktop_session_proxy);
+    void setVideoEncoderPool(std::shared_ptr<VideoEncoderPool> video_encoder_pool);
 
     void encodeScreen(const base::Frame* frame, const base::MouseCursor* cursor);
     void encodeAudio(const proto::AudioPacket& audio_packet);
@@ -52,6 +53,10 @@ public:
     void injectClipboardEvent(const proto::ClipboardEvent& event);
 
     const DesktopSession::Config& desktopSessionConfig() const { return desktop_session_config_; }
+    const VideoEncoderPool::Encoder* videoEncoder() const { return video_encoder_.get(); }
+
+    // Time in which the messages queued for the client are delivered at the estimated bandwidth.
+    std::chrono::milliseconds queueDrainTime() const;
 
 protected:
     // net::Listener implementation.
@@ -66,8 +71,23 @@ private:
     void readConfig(const proto::DesktopConfig& config);
 
     std::shared_ptr<DesktopSessionProxy> desktop_session_proxy_;
-    std::unique_ptr<base::ScaleReducer> scale_reducer_;
-    std::unique_ptr<base::VideoEncoder> video_encoder_;
+
+    // The encoder is shared with other clients that receive the same encoding and size.
+    std::shared_ptr<VideoEncoderPool> video_encoder_pool_;
+    std::shared_ptr<VideoEncoderPool::Encoder> video_encoder_;
+    proto::VideoEncoding video_encoding_ = proto::VIDEO_ENCODING_UNKNOWN;
+
+    // Number of the last video packet sent to the client.
+    uint64_t video_packet_number_ = 0;
+
+    // Frames are dropped for the client until its queue is delivered. Then the changes are sent
+    // with the last captured frame, because the screen may not change anymore.
+    bool frames_skipped_ = false;
+
+    // Measures how fast the channel delivers the messages. The bitrate of the video is adjusted to
+    // the estimated bandwidth.
+    std::unique_ptr<base::BandwidthEstimator> bandwidth_estimator_;
+
     std::unique_ptr<base::CursorEncoder> cursor_encoder_;
     std::unique_ptr<base::AudioEncoder> audio_encoder_;
     DesktopSession::Config desktop_session_config_;
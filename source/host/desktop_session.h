@@ -21,6 +21,8 @@
 
 #include "proto/desktop_internal.pb.h"
 
+#include <chrono>
+
 namespace base {
 class Frame;
 class MouseCursor;
@@ -72,6 +74,14 @@ public:
     virtual void selectScreen(const proto::Screen& screen) = 0;
     virtual void captureScreen() = 0;
 
+    // Returns the last captured frame or nullptr if no frame has been captured yet. The frame is
+    // valid until the next frame is captured or the session is stopped.
+    virtual const base::Frame* lastFrame() const = 0;
+
+    // Sets the interval between screen captures. It is increased when the clients cannot receive
+    // the frames as fast as they are captured.
+    virtual void setCaptureInterval(const std::chrono::milliseconds& interval) = 0;
+
     virtual void injectKeyEvent(const proto::KeyEvent& event) = 0;
     virtual void injectMouseEvent(const proto::MouseEvent& event) = 0;
     virtual void injectClipboardEvent(const proto::ClipboardEvent& event) = 0;
@@ -42,6 +42,8 @@ public:
     void stop();
     void generateFrame();
 
+    const base::Frame* frame() const { return frame_.get(); }
+
 private:
 
     Delegate* delegate_ = nullptr;
@@ -167,6 +169,16 @@ void DesktopSessionFake::captureScreen()
     frame_generator_->generateFrame();
 }
 
+const base::Frame* DesktopSessionFake::lastFrame() const
+{
+    return frame_generator_->frame();
+}
+
+void DesktopSessionFake::setCaptureInterval(const std::chrono::milliseconds& /* interval */)
+{
+    // Nothing
+}
+
 void DesktopSessionFake::injectKeyEvent(const proto::KeyEvent& /* event */)
 {
     // Nothing
@@ -41,6 +41,8 @@ public:
     void configure(const Config& config) override;
     void selectScreen(const proto::Screen& screen) override;
     void captureScreen() override;
+    const base::Frame* lastFrame() const override;
+    void setCaptureInterval(const std::chrono::milliseconds& interval) override;
     void injectKeyEvent(const proto::KeyEvent& event) override;
     void injectMouseEvent(const proto::MouseEvent& event) override;
     void injectClipboardEvent(const proto::ClipboardEvent& event) override;
@@ -25,6 +25,13 @@
 
 namespace host {
 
+namespace {
+
+// The interval is used until the clients report that they cannot keep up with it.
+const std::chrono::milliseconds kDefaultCaptureInterval{ 40 };
+
+} // namespace
+
 class DesktopSessionIpc::SharedBuffer : public base::SharedMemoryBase
 {
 public:
@@ -70,6 +77,7 @@ private:
 
 DesktopSessionIpc::DesktopSessionIpc(std::unique_ptr<base::IpcChannel> channel, Delegate* delegate)
     : channel_(std::move(channel)),
+      capture_interval_(kDefaultCaptureInterval),
       outgoing_message_(std::make_unique<proto::internal::ServiceToDesktop>()),
       incoming_message_(std::make_unique<proto::internal::DesktopToService>()),
       delegate_(delegate)
@@ -143,6 +151,16 @@ void DesktopSessionIpc::captureScreen()
     }
 }
 
+const base::Frame* DesktopSessionIpc::lastFrame() const
+{
+    return last_frame_.get();
+}
+
+void DesktopSessionIpc::setCaptureInterval(const std::chrono::milliseconds& interval)
+{
+    capture_interval_ = interval;
+}
+
 void DesktopSessionIpc::injectKeyEvent(const proto::KeyEvent& event)
 {
     outgoing_message_->Clear();
@@ -277,7 +295,8 @@ void DesktopSessionIpc::onScreenCaptured(const proto::internal::ScreenCaptured&
     delegate_->onScreenCaptured(frame, mouse_cursor);
 
     outgoing_message_->Clear();
-    outgoing_message_->mutable_next_screen_capture()->set_update_interval(40);
+    outgoing_message_->mutable_next_screen_capture()->set_update_interval(
+        static_cast<uint32_t>(capture_interval_.count()));
     channel_->send(base::serialize(*outgoing_message_));
 }
 
@@ -39,6 +39,8 @@ public:
     void configure(const Config& config) override;
     void selectScreen(const proto::Screen& screen) override;
     void captureScreen() override;
+    const base::Frame* lastFrame() const override;
+    void setCaptureInterval(const std::chrono::milliseconds& interval) override;
     void injectKeyEvent(const proto::KeyEvent& event) override;
     void injectMouseEvent(const proto::MouseEvent& event) override;
     void injectClipboardEvent(const proto::ClipboardEvent& event) override;
@@ -63,6 +65,7 @@ private:
     std::unique_ptr<base::Frame> last_frame_;
     std::unique_ptr<base::MouseCursor> last_mouse_cursor_;
     std::unique_ptr<proto::ScreenList> last_screen_list_;
+    std::chrono::milliseconds capture_interval_;
 
     std::unique_ptr<proto::internal::ServiceToDesktop> outgoing_message_;
     std::unique_ptr<proto::internal::DesktopToService> incoming_message_;
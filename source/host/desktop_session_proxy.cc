@@ -53,6 +53,20 @@ void DesktopSessionProxy::captureScreen()
         desktop_session_->captureScreen();
 }
 
+const base::Frame* DesktopSessionProxy::lastFrame() const
+{
+    if (!desktop_session_)
+        return nullptr;
+
+    return desktop_session_->lastFrame();
+}
+
+void DesktopSessionProxy::setCaptureInterval(const std::chrono::milliseconds& interval)
+{
+    if (desktop_session_)
+        desktop_session_->setCaptureInterval(interval);
+}
+
 void DesktopSessionProxy::injectKeyEvent(const proto::KeyEvent& event)
 {
     if (desktop_session_)
@@ -36,6 +36,8 @@ public:
     void configure(const DesktopSession::Config& config);
     void selectScreen(const proto::Screen& screen);
     void captureScreen();
+    const base::Frame* lastFrame() const;
+    void setCaptureInterval(const std::chrono::milliseconds& interval);
     void injectKeyEvent(const proto::KeyEvent& event);
     void injectMouseEvent(const proto::MouseEvent& event);
     void injectClipboardEvent(const proto::ClipboardEvent& event);
@@ -33,6 +33,10 @@ namespace {
 const wchar_t kFirewallRuleName[] = L"Aspia Host Service";
 const wchar_t kFirewallRuleDecription[] = L"Allow incoming TCP connections";
 
+// The host authenticates only a few clients at a time. One thread keeps the SRP calculations out of
+// the network thread.
+const size_t kAuthenticationThreads = 1;
+
 } // namespace
 
 Server::Server(std::shared_ptr<base::TaskRunner> task_runner)
@@ -86,6 +90,7 @@ void Server::start()
         std::bind(&Server::updateConfiguration, this, std::placeholders::_1, std::placeholders::_2));
 
     authenticator_manager_ = std::make_unique<base::ServerAuthenticatorManager>(task_runner_, this);
+    authenticator_manager_->setWorkerThreadCount(kAuthenticationThreads);
 
     user_session_manager_ = std::make_unique<UserSessionManager>(task_runner_);
     user_session_manager_->start(this);
@@ -30,15 +30,27 @@
 #include "host/client_session_desktop.h"
 #include "host/desktop_session_proxy.h"
 
+#include <algorithm>
+
 namespace host {
 
+namespace {
+
+// Limits of the interval between screen captures. The interval is increased when all clients
+// have queued more data than they can receive in the minimum interval.
+const std::chrono::milliseconds kMinCaptureInterval{ 40 };
+const std::chrono::milliseconds kMaxCaptureInterval{ 1000 };
+
+} // namespace
+
 UserSession::UserSession(std::shared_ptr<base::TaskRunner> task_runner,
                          base::SessionId session_id,
                          std::unique_ptr<base::IpcChannel> channel)
     : task_runner_(task_runner),
       channel_(std::move(channel)),
       attach_timer_(base::WaitableTimer::Type::SINGLE_SHOT, task_runner),
-      session_id_(session_id)
+      session_id_(session_id),
+      video_encoder_pool_(std::make_shared<VideoEncoderPool>())
 {
     DCHECK(task_runner_);
 
@@ -172,6 +184,7 @@ void UserSession::addNewSession(std::unique_ptr<ClientSession> client_session)
                 static_cast<ClientSessionDesktop*>(client_session_ptr);
 
             desktop_client_session->setDesktopSessionProxy(desktop_session_proxy_);
+            desktop_client_session->setVideoEncoderPool(video_encoder_pool_);
             desktop_session_proxy_->control(proto::internal::Control::ENABLE);
         }
         break;
@@ -341,8 +354,24 @@ void UserSession::onDesktopSessionStopped()
 
 void UserSession::onScreenCaptured(const base::Frame* frame, const base::MouseCursor* cursor)
 {
+    // Clients with the same encoding and size get the frame encoded once.
+    video_encoder_pool_->nextFrame();
+
+    std::chrono::milliseconds capture_interval =
+        desktop_clients_.empty() ? kMinCaptureInterval : kMaxCaptureInterval;
+
     for (const auto& client : desktop_clients_)
-        static_cast<ClientSessionDesktop*>(client.get())->encodeScreen(frame, cursor);
+    {
+        ClientSessionDesktop* desktop_client = static_cast<ClientSessionDesktop*>(client.get());
+
+        desktop_client->encodeScreen(frame, cursor);
+
+        // The next frame is captured when at least one client can receive it.
+        capture_interval = std::min(capture_interval, desktop_client->queueDrainTime());
+    }
+
+    desktop_session_proxy_->setCaptureInterval(
+        std::clamp(capture_interval, kMinCaptureInterval, kMaxCaptureInterval));
 }
 
 void UserSession::onAudioCaptured(const proto::AudioPacket& audio_packet)
@@ -449,6 +478,34 @@ void UserSession::onClientSessionFinished()
     }
 }
 
+void UserSession::onClientSessionVideoResumed(ClientSession* client_session)
+{
+    const base::Frame* frame = desktop_session_proxy_->lastFrame();
+    if (!frame)
+        return;
+
+    ClientSessionDesktop* resumed_client = static_cast<ClientSessionDesktop*>(client_session);
+
+    // The last frame is delivered as a new one. The resumed client encodes it first, so that a key
+    // frame it needs is encoded once for all clients of its encoder.
+    video_encoder_pool_->nextFrame();
+    resumed_client->encodeScreen(frame, nullptr);
+
+    const VideoEncoderPool::Encoder* encoder = resumed_client->videoEncoder();
+    if (!encoder)
+        return;
+
+    // The other clients of the encoder must receive the packet to continue the stream. The clients
+    // of other encoders do not need the frame.
+    for (const auto& client : desktop_clients_)
+    {
+        ClientSessionDesktop* desktop_client = static_cast<ClientSessionDesktop*>(client.get());
+
+        if (desktop_client != resumed_client && desktop_client->videoEncoder() == encoder)
+            desktop_client->encodeScreen(frame, nullptr);
+    }
+}
+
 void UserSession::onSessionDettached(const base::Location& location)
 {
     if (state_ == State::DETTACHED)
@@ -31,6 +31,8 @@
 
 namespace host {
 
+class VideoEncoderPool;
+
 class UserSession
     : public base::IpcChannel::Listener,
       public DesktopSession::Delegate,
@@ -97,6 +99,7 @@ protected:
     // ClientSession::Delegate implementation.
     void onClientSessionConfigured() override;
     void onClientSessionFinished() override;
+    void onClientSessionVideoResumed(ClientSession* client_session) override;
 
 private:
     void onSessionDettached(const base::Location& location);
@@ -119,6 +122,9 @@ private:
     base::HostId host_id_ = base::kInvalidHostId;
     std::string password_;
 
+    // Shared by the desktop clients.
+    std::shared_ptr<VideoEncoderPool> video_encoder_pool_;
+
     using ClientSessionPtr = std::unique_ptr<ClientSession>;
     using ClientSessionList = std::vector<ClientSessionPtr>;
 
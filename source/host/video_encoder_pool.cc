@@ -0,0 +1,216 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "host/video_encoder_pool.h"
+
+#include "base/logging.h"
+#include "base/codec/scale_reducer.h"
+#include "base/codec/video_encoder_vpx.h"
+#include "base/desktop/frame.h"
+#include "base/desktop/screen_capturer.h"
+
+#include <algorithm>
+
+namespace host {
+
+VideoEncoderPool::VideoEncoderPool() = default;
+
+VideoEncoderPool::~VideoEncoderPool() = default;
+
+std::shared_ptr<VideoEncoderPool::Encoder> VideoEncoderPool::encoder(
+    proto::VideoEncoding encoding, const base::Size& size)
+{
+    auto it = encoders_.begin();
+
+    while (it != encoders_.end())
+    {
+        std::shared_ptr<Encoder> encoder = it->lock();
+        if (!encoder)
+        {
+            // No client uses the encoder anymore.
+            it = encoders_.erase(it);
+            continue;
+        }
+
+        if (encoder->encoding() == encoding && encoder->size() == size)
+            return encoder;
+
+        ++it;
+    }
+
+    std::unique_ptr<base::VideoEncoder> video_encoder;
+
+    switch (encoding)
+    {
+        case proto::VIDEO_ENCODING_VP8:
+            video_encoder = base::VideoEncoderVPX::createVP8();
+            break;
+
+        case proto::VIDEO_ENCODING_VP9:
+            video_encoder = base::VideoEncoderVPX::createVP9();
+            break;
+
+        default:
+            LOG(LS_WARNING) << "Unsupported video encoding: " << encoding;
+            return nullptr;
+    }
+
+    if (!video_encoder)
+        return nullptr;
+
+    LOG(LS_INFO) << "Video encoder created (encoding: " << encoding << ", size: "
+                 << size.width() << "x" << size.height() << ")";
+
+    std::shared_ptr<Encoder> encoder(
+        new Encoder(this, encoding, size, std::move(video_encoder)));
+    encoders_.emplace_back(encoder);
+    return encoder;
+}
+
+VideoEncoderPool::Encoder::Encoder(const VideoEncoderPool* pool,
+                                   proto::VideoEncoding encoding,
+                                   const base::Size& size,
+                                   std::unique_ptr<base::VideoEncoder> video_encoder)
+    : pool_(pool),
+      encoding_(encoding),
+      size_(size),
+      scale_reducer_(std::make_unique<base::ScaleReducer>()),
+      video_encoder_(std::move(video_encoder))
+{
+    DCHECK(pool_);
+    DCHECK(video_encoder_);
+}
+
+VideoEncoderPool::Encoder::~Encoder() = default;
+
+double VideoEncoderPool::Encoder::scaleFactorX() const
+{
+    return scale_reducer_->scaleFactorX();
+}
+
+double VideoEncoderPool::Encoder::scaleFactorY() const
+{
+    return scale_reducer_->scaleFactorY();
+}
+
+std::shared_ptr<const base::ByteArray> VideoEncoderPool::Encoder::encode(
+    const base::Frame* frame, uint32_t target_bitrate)
+{
+    DCHECK(frame);
+
+    const bool is_next_frame = frame_number_ != pool_->frame_number_;
+
+    // A client that starts receiving the stream after the frame was encoded for other clients
+    // needs a key frame. In this case the frame is encoded again.
+    if (!is_next_frame && !key_frame_requested_)
+    {
+        target_bitrate_ = std::min(target_bitrate_, target_bitrate);
+        return encoded_ ? buffer_ : nullptr;
+    }
+
+    // The bitrates of the other clients are known only after they received the previous frame.
+    // The stream must not exceed the bitrate of the slowest of them.
+    const uint32_t bitrate = std::min(target_bitrate_, target_bitrate);
+    target_bitrate_ = is_next_frame ? target_bitrate : bitrate;
+
+    video_encoder_->setTargetBitrate(bitrate);
+
+    frame_number_ = pool_->frame_number_;
+    encoded_ = false;
+
+    if (key_frame_requested_)
+    {
+        video_encoder_->requestKeyFrame();
+        key_frame_requested_ = false;
+    }
+
+    // The areas changed in the skipped frames are not encoded yet. The frame is shared with other
+    // encoders, so the areas are passed along with it instead of being added to its region.
+    skipped_region_.intersectWith(base::Rect::makeSize(frame->size()));
+
+    const base::Frame* scaled_frame = scale_reducer_->scaleFrame(frame, skipped_region_, size_);
+    if (!scaled_frame)
+    {
+        LOG(LS_ERROR) << "No scaled frame";
+        return nullptr;
+    }
+
+    message_.Clear();
+
+    proto::VideoPacket* packet = message_.mutable_video_packet();
+
+    // Encode the frame into a video packet. The scaled frame already includes the skipped areas.
+    video_encoder_->encode(
+        scaled_frame, scaled_frame == frame ? skipped_region_ : base::Region(), packet);
+    skipped_region_.clear();
+
+    if (packet->has_format())
+    {
+        proto::VideoPacketFormat* format = packet->mutable_format();
+
+        // In video packets that contain the format, we pass the screen capture type.
+        format->set_capturer_type(frame->capturerType());
+
+        // Real screen size.
+        proto::Size* screen_size = format->mutable_screen_size();
+        screen_size->set_width(frame->size().width());
+        screen_size->set_height(frame->size().height());
+
+        LOG(LS_INFO) << "Video packet has format";
+        LOG(LS_INFO) << "Capturer type: " << base::ScreenCapturer::typeToString(
+            static_cast<base::ScreenCapturer::Type>(frame->capturerType()));
+        LOG(LS_INFO) << "Screen size: " << screen_size->width() << "x"
+                     << screen_size->height();
+        LOG(LS_INFO) << "Video size: " << format->video_rect().width() << "x"
+                     << format->video_rect().height();
+    }
+
+    // Channels that have not sent the previous packet yet still hold its buffer.
+    if (!buffer_ || buffer_.use_count() > 1)
+        buffer_ = std::make_shared<base::ByteArray>();
+
+    base::serialize(message_, buffer_.get());
+    encoded_ = true;
+    key_frame_ = packet->has_format();
+    ++packet_number_;
+
+    return buffer_;
+}
+
+bool VideoEncoderPool::Encoder::canContinue(uint64_t packet_number) const
+{
+    // The frame is already encoded for other clients. The client gets the same packet.
+    if (frame_number_ == pool_->frame_number_ && encoded_)
+        return key_frame_ || packet_number_ == packet_number + 1;
+
+    // The next packet follows the last one.
+    return packet_number_ == packet_number;
+}
+
+void VideoEncoderPool::Encoder::skipFrame(const base::Frame* frame)
+{
+    DCHECK(frame);
+
+    // The frame is already encoded for other clients.
+    if (frame_number_ == pool_->frame_number_)
+        return;
+
+    skipped_region_.addRegion(frame->constUpdatedRegion());
+}
+
+} // namespace host
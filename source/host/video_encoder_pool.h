@@ -0,0 +1,138 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef HOST__VIDEO_ENCODER_POOL_H
+#define HOST__VIDEO_ENCODER_POOL_H
+
+#include "base/macros_magic.h"
+#include "base/desktop/geometry.h"
+#include "base/desktop/region.h"
+#include "base/memory/byte_array.h"
+#include "proto/desktop.pb.h"
+
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace base {
+class Frame;
+class ScaleReducer;
+class VideoEncoder;
+} // namespace base
+
+namespace host {
+
+// Clients that receive the desktop with the same encoding and size share one encoder. Each captured
+// frame is scaled, encoded and serialized once for all of them.
+class VideoEncoderPool
+{
+public:
+    VideoEncoderPool();
+    ~VideoEncoderPool();
+
+    class Encoder
+    {
+    public:
+        ~Encoder();
+
+        proto::VideoEncoding encoding() const { return encoding_; }
+        const base::Size& size() const { return size_; }
+
+        double scaleFactorX() const;
+        double scaleFactorY() const;
+
+        // The next packet contains the format of the video and is encoded as a key frame. It is
+        // requested when a client starts receiving the stream of the encoder.
+        void requestKeyFrame() { key_frame_requested_ = true; }
+
+        // Returns the serialized message with the video packet of the current frame. The frame is
+        // encoded only by the first call for it and all clients send the same buffer. Returns
+        // nullptr if the frame cannot be encoded.
+        // |target_bitrate| is the bitrate in kbps that the channel of the calling client can
+        // deliver. The frame is encoded with the lowest bitrate of the clients of the encoder.
+        std::shared_ptr<const base::ByteArray> encode(
+            const base::Frame* frame, uint32_t target_bitrate);
+
+        // Must be called by a client that does not send the frame (e.g. its channel is
+        // congested). If no client encodes the frame, its updated region is encoded with the next
+        // one.
+        void skipFrame(const base::Frame* frame);
+
+        // Number of the packet returned by the last call of encode(). Packets are numbered
+        // sequentially. A client that has not received all packets can continue the stream only
+        // from a key frame.
+        uint64_t packetNumber() const { return packet_number_; }
+        bool isKeyFrame() const { return key_frame_; }
+
+        // Returns true if a client whose last received packet is |packet_number| can decode the
+        // packet of the current frame. Otherwise the client must request a key frame before the
+        // frame is encoded. If the frame is already encoded for other clients, the key frame
+        // breaks their stream too.
+        bool canContinue(uint64_t packet_number) const;
+
+    private:
+        friend class VideoEncoderPool;
+
+        Encoder(const VideoEncoderPool* pool,
+                proto::VideoEncoding encoding,
+                const base::Size& size,
+                std::unique_ptr<base::VideoEncoder> video_encoder);
+
+        const VideoEncoderPool* pool_;
+        const proto::VideoEncoding encoding_;
+        const base::Size size_;
+
+        std::unique_ptr<base::ScaleReducer> scale_reducer_;
+        std::unique_ptr<base::VideoEncoder> video_encoder_;
+        bool key_frame_requested_ = false;
+
+        // The lowest target bitrate of the clients that received the last encoded frame.
+        uint32_t target_bitrate_ = std::numeric_limits<uint32_t>::max();
+
+        // The last encoded frame.
+        uint64_t frame_number_ = 0;
+        proto::HostToClient message_;
+        // The buffer is reused for the next frame if no channel holds it anymore.
+        std::shared_ptr<base::ByteArray> buffer_;
+        bool encoded_ = false;
+        uint64_t packet_number_ = 0;
+        bool key_frame_ = false;
+
+        // Updated region of the frames that no client encoded.
+        base::Region skipped_region_;
+
+        DISALLOW_COPY_AND_ASSIGN(Encoder);
+    };
+
+    // Returns the encoder for the encoding and the size. If no client uses such an encoder, a new
+    // one is created. Returns nullptr if the encoding is not supported.
+    std::shared_ptr<Encoder> encoder(proto::VideoEncoding encoding, const base::Size& size);
+
+    // Must be called for each captured frame before the clients encode it.
+    void nextFrame() { ++frame_number_; }
+
+private:
+    uint64_t frame_number_ = 1;
+    std::vector<std::weak_ptr<Encoder>> encoders_;
+
+    DISALLOW_COPY_AND_ASSIGN(VideoEncoderPool);
+};
+
+} // namespace host
+
+#endif // HOST__VIDEO_ENCODER_POOL_H
@@ -0,0 +1,80 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "relay/buffer_pool.h"
+
+#include "base/logging.h"
+
+namespace relay {
+
+namespace {
+
+// Maximum total size of buffers that are cached in the pool. Buffers that do not fit are freed.
+const size_t kMaxCachedBytes = 8 * 1024 * 1024; // 8 MB
+
+} // namespace
+
+BufferPool::BufferPool()
+    : free_lists_(sizeClass(kMaxBufferSize) + 1)
+{
+    // Nothing
+}
+
+BufferPool::~BufferPool() = default;
+
+BufferPool::Buffer BufferPool::take(size_t size)
+{
+    std::vector<Buffer>& free_list = free_lists_[sizeClass(size)];
+    if (free_list.empty())
+        return std::make_unique<uint8_t[]>(size);
+
+    Buffer buffer = std::move(free_list.back());
+    free_list.pop_back();
+
+    cached_bytes_ -= size;
+    return buffer;
+}
+
+void BufferPool::release(size_t size, Buffer buffer)
+{
+    if (!buffer)
+        return;
+
+    if (cached_bytes_ + size > kMaxCachedBytes)
+        return;
+
+    free_lists_[sizeClass(size)].emplace_back(std::move(buffer));
+    cached_bytes_ += size;
+}
+
+// static
+size_t BufferPool::sizeClass(size_t size)
+{
+    DCHECK_GE(size, kMinBufferSize);
+    DCHECK_LE(size, kMaxBufferSize);
+    DCHECK_EQ(size & (size - 1), 0u);
+
+    size_t result = 0;
+
+    while ((kMinBufferSize << result) < size)
+        ++result;
+
+    return result;
+}
+
+} // namespace relay
@@ -0,0 +1,64 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef RELAY__BUFFER_POOL_H
+#define RELAY__BUFFER_POOL_H
+
+#include "base/macros_magic.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace relay {
+
+// Pool of data buffers for sessions. The buffer sizes are powers of two in the range from
+// kMinBufferSize to kMaxBufferSize. Released buffers are cached and reused for new requests.
+// The class is not thread safe. Each session shard has its own pool.
+class BufferPool
+{
+public:
+    BufferPool();
+    ~BufferPool();
+
+    static constexpr size_t kMinBufferSize = 4 * 1024; // 4 kB
+    static constexpr size_t kMaxBufferSize = 256 * 1024; // 256 kB
+
+    using Buffer = std::unique_ptr<uint8_t[]>;
+
+    // Returns a buffer of |size| bytes. |size| must be a power of two in the allowed range.
+    Buffer take(size_t size);
+
+    // Returns a buffer of |size| bytes to the pool.
+    void release(size_t size, Buffer buffer);
+
+    // Returns the total size of cached buffers.
+    size_t cachedBytes() const { return cached_bytes_; }
+
+private:
+    static size_t sizeClass(size_t size);
+
+    std::vector<std::vector<Buffer>> free_lists_;
+    size_t cached_bytes_ = 0;
+
+    DISALLOW_COPY_AND_ASSIGN(BufferPool);
+};
+
+} // namespace relay
+
+#endif // RELAY__BUFFER_POOL_H
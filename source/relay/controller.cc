@@ -64,7 +64,9 @@ private:
 Controller::Controller(std::shared_ptr<base::TaskRunner> task_runner)
     : task_runner_(task_runner),
       reconnect_timer_(base::WaitableTimer::Type::SINGLE_SHOT, task_runner),
-      shared_pool_(std::make_unique<SharedPool>(this))
+      statistics_timer_(base::WaitableTimer::Type::REPEATED, task_runner),
+      shared_pool_(std::make_unique<SharedPool>(this)),
+      key_factory_(std::make_unique<KeyFactory>(task_runner, this))
 {
     Settings settings;
 
@@ -82,11 +84,27 @@ Controller::Controller(std::shared_ptr<base::TaskRunner> task_runner)
     peer_port_ = settings.peerPort();
     peer_idle_timeout_ = settings.peerIdleTimeout();
     max_peer_count_ = settings.maxPeerCount();
+    session_options_.kernel_forwarding = settings.isKernelForwardingEnabled();
+    session_options_.send_buffer_size = settings.peerSendBufferSize();
+    session_options_.receive_buffer_size = settings.peerReceiveBufferSize();
+    session_options_.rate_limit = settings.sessionRateLimit();
+    relay_rate_limit_ = settings.relayRateLimit();
+    worker_thread_count_ = settings.workerThreadCount();
+    statistics_interval_ = settings.statisticsInterval();
+    statistics_session_count_ = settings.statisticsSessionCount();
 
     LOG(LS_INFO) << "Peer address: " << peer_address_;
     LOG(LS_INFO) << "Peer port: " << peer_port_;
     LOG(LS_INFO) << "Peer idle timeout: " << peer_idle_timeout_.count();
     LOG(LS_INFO) << "Max peer count: " << max_peer_count_;
+    LOG(LS_INFO) << "Kernel forwarding: " << session_options_.kernel_forwarding;
+    LOG(LS_INFO) << "Peer send buffer size: " << session_options_.send_buffer_size;
+    LOG(LS_INFO) << "Peer receive buffer size: " << session_options_.receive_buffer_size;
+    LOG(LS_INFO) << "Session rate limit: " << session_options_.rate_limit;
+    LOG(LS_INFO) << "Relay rate limit: " << relay_rate_limit_;
+    LOG(LS_INFO) << "Worker thread count: " << worker_thread_count_;
+    LOG(LS_INFO) << "Statistics interval: " << statistics_interval_.count();
+    LOG(LS_INFO) << "Statistics session count: " << statistics_session_count_;
 }
 
 Controller::~Controller() = default;
@@ -132,9 +150,21 @@ bool Controller::start()
     }
 
     sessions_worker_ = std::make_unique<SessionsWorker>(
-        peer_port_, peer_idle_timeout_, shared_pool_->share());
+        peer_port_, peer_idle_timeout_, session_options_, relay_rate_limit_,
+        worker_thread_count_, shared_pool_->share());
     sessions_worker_->start(task_runner_, this);
 
+    // Keys for the whole pool are generated in advance, so that they can be sent to the router
+    // right after connecting.
+    key_factory_->start(max_peer_count_);
+
+    if (statistics_interval_ > std::chrono::seconds(0))
+    {
+        last_statistics_time_ = Session::Clock::now();
+        statistics_timer_.start(statistics_interval_,
+                                std::bind(&Controller::collectStatistics, this));
+    }
+
     connectToRouter();
     return true;
 }
@@ -188,6 +218,7 @@ void Controller::onDisconnected(base::NetworkChannel::ErrorCode error_code)
 
     // Clearing the key pool.
     shared_pool_->clear();
+    pending_key_count_ = 0;
 
     // Retrying a connection at a time interval.
     delayedConnectToRouter();
@@ -237,6 +268,17 @@ void Controller::onPoolKeyExpired(uint32_t /* key_id */)
     sendKeyPool(1);
 }
 
+void Controller::onKeysReady()
+{
+    if (!pending_key_count_)
+        return;
+
+    uint32_t key_count = pending_key_count_;
+    pending_key_count_ = 0;
+
+    sendKeyPool(key_count);
+}
+
 void Controller::connectToRouter()
 {
     LOG(LS_INFO) << "Connecting to router...";
@@ -257,19 +299,28 @@ void Controller::delayedConnectToRouter()
 
 void Controller::sendKeyPool(uint32_t key_count)
 {
+    // Keys are sent only if the connection to the router is established. After connecting, the
+    // whole pool is sent.
+    if (!channel_ || !channel_->isConnected())
+        return;
+
+    // Keys are generated in the background. If there are not enough keys, the rest will be sent
+    // when they are generated.
+    std::vector<SessionKey> keys = key_factory_->takeKeys(key_count);
+    pending_key_count_ += key_count - static_cast<uint32_t>(keys.size());
+
+    if (keys.empty())
+        return;
+
     std::unique_ptr<proto::RelayToRouter> message = std::make_unique<proto::RelayToRouter>();
     proto::RelayKeyPool* relay_key_pool = message->mutable_key_pool();
 
     relay_key_pool->set_peer_host(base::utf8FromUtf16(peer_address_));
     relay_key_pool->set_peer_port(peer_port_);
 
-    // Add the requested number of keys to the pool.
-    for (uint32_t i = 0; i < key_count; ++i)
+    // Add the keys to the pool.
+    for (auto& session_key : keys)
     {
-        SessionKey session_key = SessionKey::create();
-        if (!session_key.isValid())
-            return;
-
         // Add the key to the outgoing message.
         proto::RelayKey* key = relay_key_pool->add_key();
 
@@ -283,7 +334,62 @@ void Controller::sendKeyPool(uint32_t key_count)
     }
 
     // Send a message to the router.
-    channel_->send(base::serialize(*message));
+    channel_->send(*message);
+}
+
+void Controller::collectStatistics()
+{
+    sessions_worker_->collectStatistics(statistics_session_count_,
+        std::bind(&Controller::onStatistics, this, std::placeholders::_1));
+}
+
+void Controller::onStatistics(std::shared_ptr<proto::RelayStat> stat)
+{
+    Session::TimePoint current_time = Session::Clock::now();
+    std::chrono::seconds elapsed =
+        std::chrono::duration_cast<std::chrono::seconds>(current_time - last_statistics_time_);
+
+    if (elapsed.count() > 0 && stat->total_bytes() >= last_total_bytes_)
+        stat->set_speed((stat->total_bytes() - last_total_bytes_) / elapsed.count());
+
+    last_statistics_time_ = current_time;
+    last_total_bytes_ = stat->total_bytes();
+
+    LOG(LS_INFO) << "Statistics (active: " << stat->active_sessions()
+                 << ", pending: " << stat->pending_sessions()
+                 << ", total: " << stat->total_sessions()
+                 << ", bytes: " << stat->total_bytes()
+                 << ", speed: " << stat->speed()
+                 << ", reads: " << stat->read_count()
+                 << ", writes: " << stat->write_count()
+                 << ", write stalls: " << stat->write_stall_count()
+                 << ", throttles: " << stat->throttle_count() << ")";
+
+    // Only the busiest sessions are included (if enabled in the settings). They are sorted by the
+    // throughput in descending order.
+    for (int i = 0; i < stat->session_size(); ++i)
+    {
+        const proto::RelayStat::Session& session = stat->session(i);
+
+        LOG(LS_INFO) << "Session #" << i
+                     << " (duration: " << session.duration()
+                     << ", idle: " << session.idle_time()
+                     << ", bytes: " << session.bytes_first_to_second()
+                     << "/" << session.bytes_second_to_first()
+                     << ", speed: " << session.speed()
+                     << ", reads: " << session.read_count()
+                     << ", writes: " << session.write_count()
+                     << ", write stalls: " << session.write_stall_count()
+                     << ", throttles: " << session.throttle_count() << ")";
+    }
+
+    // The statistics are sent only if the connection to the router is established.
+    if (!channel_ || !channel_->isConnected())
+        return;
+
+    std::unique_ptr<proto::RelayToRouter> message = std::make_unique<proto::RelayToRouter>();
+    message->mutable_relay_stat()->Swap(stat.get());
+    channel_->send(*message);
 }
 
 } // namespace relay
@@ -23,6 +23,7 @@
 #include "base/net/network_channel.h"
 #include "build/build_config.h"
 #include "proto/router_relay.pb.h"
+#include "relay/key_factory.h"
 #include "relay/sessions_worker.h"
 #include "relay/shared_pool.h"
 
@@ -35,7 +36,8 @@ namespace relay {
 class Controller
     : public base::NetworkChannel::Listener,
       public SessionManager::Delegate,
-      public SharedPool::Delegate
+      public SharedPool::Delegate,
+      public KeyFactory::Delegate
 {
 public:
     explicit Controller(std::shared_ptr<base::TaskRunner> task_runner);
@@ -56,10 +58,15 @@ protected:
     // SharedPool::Delegate implementation.
     void onPoolKeyExpired(uint32_t key_id) override;
 
+    // KeyFactory::Delegate implementation.
+    void onKeysReady() override;
+
 private:
     void connectToRouter();
     void delayedConnectToRouter();
     void sendKeyPool(uint32_t key_count);
+    void collectStatistics();
+    void onStatistics(std::shared_ptr<proto::RelayStat> stat);
 
     // Router settings.
     std::u16string router_address_;
@@ -71,12 +78,25 @@ private:
     uint16_t peer_port_ = 0;
     std::chrono::minutes peer_idle_timeout_;
     uint32_t max_peer_count_ = 0;
+    Session::Options session_options_;
+    uint32_t worker_thread_count_ = 0;
+    uint32_t relay_rate_limit_ = 0;
+
+    std::chrono::seconds statistics_interval_;
+    uint32_t statistics_session_count_ = 0;
+    base::WaitableTimer statistics_timer_;
+    Session::TimePoint last_statistics_time_;
+    uint64_t last_total_bytes_ = 0;
 
     std::shared_ptr<base::TaskRunner> task_runner_;
     base::WaitableTimer reconnect_timer_;
     std::unique_ptr<base::NetworkChannel> channel_;
     std::unique_ptr<base::ClientAuthenticator> authenticator_;
     std::unique_ptr<SharedPool> shared_pool_;
+    std::unique_ptr<KeyFactory> key_factory_;
+
+    // Number of keys that must be sent to the router when the key factory generates them.
+    uint32_t pending_key_count_ = 0;
     std::unique_ptr<SessionsWorker> sessions_worker_;
 
     DISALLOW_COPY_AND_ASSIGN(Controller);
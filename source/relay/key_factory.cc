@@ -0,0 +1,153 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "relay/key_factory.h"
+
+#include "base/logging.h"
+#include "base/task_runner.h"
+
+#include <algorithm>
+
+namespace relay {
+
+namespace {
+
+// Number of keys generated at a time. After each batch the caller is notified, so the first keys
+// become available quickly even if a large number of keys is requested.
+const size_t kBatchSize = 64;
+
+} // namespace
+
+KeyFactory::KeyFactory(std::shared_ptr<base::TaskRunner> caller_task_runner, Delegate* delegate)
+    : caller_task_runner_(std::move(caller_task_runner)),
+      delegate_(delegate)
+{
+    DCHECK(caller_task_runner_);
+    DCHECK(delegate_);
+}
+
+KeyFactory::~KeyFactory()
+{
+    thread_.stop();
+}
+
+void KeyFactory::start(size_t reserve_size)
+{
+    LOG(LS_INFO) << "Starting key factory (reserve size: " << reserve_size << ")";
+
+    reserve_size_ = std::max(reserve_size, kBatchSize);
+
+    thread_.start(base::MessageLoop::Type::DEFAULT);
+    self_task_runner_ = thread_.taskRunner();
+    DCHECK(self_task_runner_);
+
+    scheduleRefill();
+}
+
+std::vector<SessionKey> KeyFactory::takeKeys(size_t count)
+{
+    std::vector<SessionKey> keys;
+
+    {
+        std::scoped_lock lock(reserve_lock_);
+
+        size_t available = std::min(count, reserve_.size());
+        keys.reserve(available);
+
+        for (size_t i = 0; i < available; ++i)
+        {
+            keys.emplace_back(std::move(reserve_.front()));
+            reserve_.pop_front();
+        }
+    }
+
+    scheduleRefill();
+    return keys;
+}
+
+void KeyFactory::scheduleRefill()
+{
+    {
+        std::scoped_lock lock(reserve_lock_);
+
+        if (refill_scheduled_ || reserve_.size() >= reserve_size_)
+            return;
+
+        refill_scheduled_ = true;
+    }
+
+    self_task_runner_->postTask(std::bind(&KeyFactory::refill, this));
+}
+
+void KeyFactory::refill()
+{
+    size_t count;
+
+    {
+        std::scoped_lock lock(reserve_lock_);
+
+        if (reserve_.size() >= reserve_size_)
+        {
+            refill_scheduled_ = false;
+            return;
+        }
+
+        count = std::min(reserve_size_ - reserve_.size(), kBatchSize);
+    }
+
+    // Keys are generated without holding the lock.
+    std::vector<SessionKey> keys;
+    keys.reserve(count);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        SessionKey session_key = SessionKey::create();
+        if (!session_key.isValid())
+        {
+            LOG(LS_ERROR) << "Unable to create session key";
+            break;
+        }
+
+        keys.emplace_back(std::move(session_key));
+    }
+
+    {
+        std::scoped_lock lock(reserve_lock_);
+
+        for (auto& key : keys)
+            reserve_.emplace_back(std::move(key));
+
+        // If key generation failed, we do not retry until the next request.
+        if (keys.size() < count)
+            refill_scheduled_ = false;
+    }
+
+    if (!keys.empty())
+        caller_task_runner_->postTask(std::bind(&KeyFactory::notifyKeysReady, this));
+
+    // The next batch is generated in a separate task, so that the thread can be stopped.
+    if (keys.size() == count)
+        self_task_runner_->postTask(std::bind(&KeyFactory::refill, this));
+}
+
+void KeyFactory::notifyKeysReady()
+{
+    delegate_->onKeysReady();
+}
+
+} // namespace relay
@@ -0,0 +1,75 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef RELAY__KEY_FACTORY_H
+#define RELAY__KEY_FACTORY_H
+
+#include "base/threading/thread.h"
+#include "relay/session_key.h"
+
+#include <deque>
+#include <mutex>
+
+namespace relay {
+
+// Generates session keys in batches on a separate thread. Generated keys are kept in a reserve,
+// so that requests are served without key generation on the caller thread.
+class KeyFactory
+{
+public:
+    class Delegate
+    {
+    public:
+        virtual ~Delegate() = default;
+
+        // Called on the caller thread when new keys are added to the reserve.
+        virtual void onKeysReady() = 0;
+    };
+
+    KeyFactory(std::shared_ptr<base::TaskRunner> caller_task_runner, Delegate* delegate);
+    ~KeyFactory();
+
+    // Starts key generation. The factory keeps at least |reserve_size| keys ready.
+    void start(size_t reserve_size);
+
+    // Returns up to |count| keys from the reserve. If the reserve has fewer keys, the remaining
+    // keys are generated in the background and onKeysReady() is called when they are ready.
+    std::vector<SessionKey> takeKeys(size_t count);
+
+private:
+    void scheduleRefill();
+    void refill();
+    void notifyKeysReady();
+
+    std::shared_ptr<base::TaskRunner> caller_task_runner_;
+    Delegate* delegate_;
+
+    base::Thread thread_;
+    std::shared_ptr<base::TaskRunner> self_task_runner_;
+    size_t reserve_size_ = 0;
+
+    std::mutex reserve_lock_;
+    std::deque<SessionKey> reserve_;
+    bool refill_scheduled_ = false;
+
+    DISALLOW_COPY_AND_ASSIGN(KeyFactory);
+};
+
+} // namespace relay
+
+#endif // RELAY__KEY_FACTORY_H
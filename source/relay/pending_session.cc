@@ -35,9 +35,11 @@ constexpr uint32_t kMaxMessageSize = 1 * 1024 * 1024; // 1 MB
 } // namespace
 
 PendingSession::PendingSession(std::shared_ptr<base::TaskRunner> task_runner,
+                               uint64_t id,
                                asio::ip::tcp::socket&& socket,
                                Delegate* delegate)
-    : delegate_(delegate),
+    : id_(id),
+      delegate_(delegate),
       timer_(base::WaitableTimer::Type::SINGLE_SHOT, std::move(task_runner)),
       socket_(std::move(socket))
 {
@@ -53,6 +55,8 @@ void PendingSession::start()
 {
     LOG(LS_INFO) << "Starting pending session";
 
+    start_time_ = Clock::now();
+
     asio::ip::tcp::no_delay option(true);
     asio::error_code error_code;
 
@@ -81,26 +85,14 @@ void PendingSession::stop()
     socket_.close(ignored_code);
 }
 
-void PendingSession::setIdentify(uint32_t key_id, const base::ByteArray& secret)
-{
-    secret_ = secret;
-    key_id_ = key_id;
-}
-
-bool PendingSession::isPeerFor(const PendingSession& other) const
+asio::ip::tcp::socket PendingSession::takeSocket()
 {
-    if (&other == this)
-        return false;
-
-    if (secret_.empty() || other.secret_.empty())
-        return false;
-
-    return key_id_ == other.key_id_ && base::equals(secret_, other.secret_);
+    return std::move(socket_);
 }
 
-asio::ip::tcp::socket PendingSession::takeSocket()
+std::chrono::seconds PendingSession::age(const TimePoint& current_time) const
 {
-    return std::move(socket_);
+    return std::chrono::duration_cast<std::chrono::seconds>(current_time - start_time_);
 }
 
 // static
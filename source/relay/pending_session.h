@@ -50,10 +50,14 @@ public:
     };
 
     PendingSession(std::shared_ptr<base::TaskRunner> task_runner,
+                   uint64_t id,
                    asio::ip::tcp::socket&& socket,
                    Delegate* delegate);
     ~PendingSession();
 
+    using Clock = std::chrono::high_resolution_clock;
+    using TimePoint = std::chrono::time_point<Clock>;
+
     // Starts a session. This starts the timer. If the peer does not send authentication data or if
     // the opposite side peer is not found during this time, then method onPendingSessionFailed()
     // will be called.
@@ -62,31 +66,30 @@ public:
     // Stops a session. No notifications will not come after calling this method.
     void stop();
 
-    // Sets session credentials.
-    void setIdentify(uint32_t key_id, const base::ByteArray& secret);
-
-    // Returns true if the other session is a pair and false otherwise.
-    bool isPeerFor(const PendingSession& other) const;
+    // Returns the identifier of the session. It is unique among all pending sessions of the relay.
+    uint64_t id() const { return id_; }
 
     // Releases a socket from a class.
     asio::ip::tcp::socket takeSocket();
 
+    // Returns the time elapsed since the session was started.
+    std::chrono::seconds age(const TimePoint& current_time) const;
+
 private:
     static void doReadMessage(PendingSession* pending_session);
     void onErrorOccurred(const base::Location& location, const std::error_code& error_code);
     void onMessage();
 
+    const uint64_t id_;
     Delegate* delegate_;
 
     base::WaitableTimer timer_;
     asio::ip::tcp::socket socket_;
+    TimePoint start_time_;
 
     uint32_t buffer_size_ = 0;
     base::ByteArray buffer_;
 
-    base::ByteArray secret_;
-    uint32_t key_id_ = -1;
-
     DISALLOW_COPY_AND_ASSIGN(PendingSession);
 };
 
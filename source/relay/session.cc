@@ -24,18 +24,81 @@
 
 #include <asio/write.hpp>
 
+#include <algorithm>
+
+#if defined(OS_LINUX)
+#include <fcntl.h>
+#include <unistd.h>
+#endif // defined(OS_LINUX)
+
 namespace relay {
 
-Session::Session(std::pair<asio::ip::tcp::socket, asio::ip::tcp::socket>&& sockets)
-    : socket_{ std::move(sockets.first), std::move(sockets.second) }
+namespace {
+
+// The buffer is shrunk after this number of consecutive reads that are less than a quarter of
+// the buffer size.
+const int kShrinkAfterSmallReads = 16;
+
+// Maximum number of reads per one wakeup. After that, other sessions of the shard get a chance to
+// transfer their data.
+const int kMaxReadsPerWakeup = 16;
+
+// Time for which the rate limiter allows to transfer data without delay.
+const std::chrono::milliseconds kRateLimitBurst { 100 };
+
+#if defined(OS_LINUX)
+const int kPipeSize = 256 * 1024; // 256 kB
+#endif // defined(OS_LINUX)
+
+} // namespace
+
+// static
+size_t Session::rateLimitCapacity(uint32_t rate)
 {
-    for (size_t i = 0; i < kNumberOfSides; ++i)
-        std::fill(buffer_[i].begin(), buffer_[i].end(), 0);
+    size_t capacity = static_cast<size_t>(
+        static_cast<uint64_t>(rate) * kRateLimitBurst.count() / 1000);
+
+    // The capacity must allow reads of at least the minimum buffer size.
+    return std::max(capacity, BufferPool::kMinBufferSize);
+}
+
+Session::Session(std::pair<asio::ip::tcp::socket, asio::ip::tcp::socket>&& sockets,
+                 const Options& options,
+                 BufferPool* buffer_pool,
+                 SharedTokenBucket* global_rate_limiter)
+    : socket_{ std::move(sockets.first), std::move(sockets.second) },
+      buffer_pool_(buffer_pool),
+      options_(options),
+      global_rate_limiter_(global_rate_limiter)
+{
+    DCHECK(buffer_pool_);
+
+    if (options_.rate_limit)
+    {
+        rate_limiter_ = std::make_unique<TokenBucket>(
+            options_.rate_limit, rateLimitCapacity(options_.rate_limit));
+    }
+
+    if (rate_limiter_ || global_rate_limiter_)
+    {
+        for (int i = 0; i < kNumberOfSides; ++i)
+        {
+            throttle_timer_[i] =
+                std::make_unique<asio::high_resolution_timer>(socket_[i].get_executor());
+        }
+    }
 }
 
 Session::~Session()
 {
     stop();
+
+    for (int i = 0; i < kNumberOfSides; ++i)
+        releaseBuffer(i);
+
+#if defined(OS_LINUX)
+    closePipes();
+#endif // defined(OS_LINUX)
 }
 
 void Session::start(Delegate* delegate)
@@ -43,10 +106,40 @@ void Session::start(Delegate* delegate)
     LOG(LS_INFO) << "Starting peers session";
 
     start_time_ = Clock::now();
+    last_activity_time_ = start_time_;
     delegate_ = delegate;
 
+    setSocketOptions();
+
+#if defined(OS_LINUX)
+    if (options_.kernel_forwarding)
+    {
+        if (createPipes())
+        {
+            for (int i = 0; i < kNumberOfSides; ++i)
+                Session::doSpliceRead(this, i);
+            return;
+        }
+
+        LOG(LS_WARNING) << "Unable to use kernel forwarding. Data will be copied";
+    }
+#endif // defined(OS_LINUX)
+
+    for (int i = 0; i < kNumberOfSides; ++i)
+    {
+        // Reads are made only after the socket becomes readable, so that the idle session does not
+        // hold buffers.
+        std::error_code error_code;
+        socket_[i].non_blocking(true, error_code);
+        if (error_code)
+        {
+            onErrorOccurred(FROM_HERE, error_code);
+            return;
+        }
+    }
+
     for (int i = 0; i < kNumberOfSides; ++i)
-        Session::doReadSome(this, i);
+        Session::doWaitRead(this, i);
 }
 
 void Session::stop()
@@ -59,6 +152,9 @@ void Session::stop()
     std::error_code ignored_code;
     for (int i = 0; i < kNumberOfSides; ++i)
     {
+        if (throttle_timer_[i])
+            throttle_timer_[i]->cancel();
+
         socket_[i].cancel(ignored_code);
         socket_[i].close(ignored_code);
     }
@@ -69,13 +165,10 @@ void Session::stop()
 
 std::chrono::seconds Session::idleTime(const TimePoint& current_time) const
 {
-    if (start_idle_time_ == TimePoint())
-    {
-        start_idle_time_ = current_time;
+    if (current_time <= last_activity_time_)
         return std::chrono::seconds(0);
-    }
 
-    return std::chrono::duration_cast<std::chrono::seconds>(current_time - start_idle_time_);
+    return std::chrono::duration_cast<std::chrono::seconds>(current_time - last_activity_time_);
 }
 
 std::chrono::seconds Session::duration() const
@@ -85,16 +178,129 @@ std::chrono::seconds Session::duration() const
 
 int64_t Session::bytesTransferred() const
 {
-    return bytes_transferred_;
+    return bytes_transferred_[0] + bytes_transferred_[1];
+}
+
+void Session::statistics(const TimePoint& current_time, proto::RelayStat::Session* stat) const
+{
+    std::chrono::seconds duration =
+        std::chrono::duration_cast<std::chrono::seconds>(current_time - start_time_);
+
+    stat->set_duration(static_cast<uint64_t>(duration.count()));
+    stat->set_idle_time(static_cast<uint64_t>(idleTime(current_time).count()));
+    stat->set_bytes_first_to_second(static_cast<uint64_t>(bytes_transferred_[0]));
+    stat->set_bytes_second_to_first(static_cast<uint64_t>(bytes_transferred_[1]));
+
+    if (duration.count() > 0)
+        stat->set_speed(static_cast<uint64_t>(bytesTransferred() / duration.count()));
+
+    stat->set_read_count(static_cast<uint64_t>(read_count_));
+    stat->set_write_count(static_cast<uint64_t>(write_count_));
+    stat->set_write_stall_count(static_cast<uint64_t>(write_stall_count_));
+    stat->set_throttle_count(static_cast<uint64_t>(throttle_count_));
+}
+
+// static
+void Session::doWaitRead(Session* session, int source)
+{
+    session->socket_[source].async_wait(asio::socket_base::wait_read,
+        [session, source](const std::error_code& error_code)
+    {
+        if (error_code)
+        {
+            if (error_code != asio::error::operation_aborted)
+                session->onErrorOccurred(FROM_HERE, error_code);
+            return;
+        }
+
+        doReadSome(session, source);
+    });
 }
 
 // static
 void Session::doReadSome(Session* session, int source)
 {
-    session->socket_[source].async_read_some(
-        asio::buffer(session->buffer_[source].data(), session->buffer_[source].size()),
-        [session, source](const std::error_code& error_code, size_t bytes_transferred)
+    Buffer& buffer = session->buffer_[source];
+    asio::ip::tcp::socket& source_socket = session->socket_[source];
+    asio::ip::tcp::socket& target_socket =
+        session->socket_[(source + kNumberOfSides - 1) % kNumberOfSides];
+
+    for (int i = 0; i < kMaxReadsPerWakeup; ++i)
+    {
+        std::chrono::milliseconds delay;
+        size_t quota = session->readQuota(buffer.size, &delay);
+        if (!quota)
+        {
+            session->releaseBuffer(source);
+            doThrottle(session, source, delay);
+            return;
+        }
+
+        if (!buffer.data)
+            buffer.data = session->buffer_pool_->take(buffer.size);
+
+        // The socket is in non-blocking mode. If there is no data, the buffer is returned to the
+        // pool and we wait until new data arrives.
+        std::error_code error_code;
+        size_t bytes_read = source_socket.read_some(
+            asio::buffer(buffer.data.get(), quota), error_code);
+        ++session->read_count_;
+
+        if (error_code)
+        {
+            if (error_code == asio::error::would_block)
+            {
+                session->releaseBuffer(source);
+                doWaitRead(session, source);
+                return;
+            }
+
+            session->onErrorOccurred(FROM_HERE, error_code);
+            return;
+        }
+
+        session->bytes_transferred_[source] += bytes_read;
+        session->last_activity_time_ = Clock::now();
+        session->consumeQuota(bytes_read);
+
+        // In most cases the target socket has enough space in the send buffer and the data is
+        // written immediately without waiting.
+        size_t bytes_written = target_socket.write_some(
+            asio::const_buffer(buffer.data.get(), bytes_read), error_code);
+        ++session->write_count_;
+
+        if (error_code && error_code != asio::error::would_block)
+        {
+            session->onErrorOccurred(FROM_HERE, error_code);
+            return;
+        }
+
+        if (bytes_written < bytes_read)
+        {
+            ++session->write_stall_count_;
+            doWrite(session, source, bytes_written, bytes_read);
+            return;
+        }
+
+        session->updateBufferSize(source, bytes_read);
+    }
+
+    // Continue after other sessions of the shard are processed.
+    doWaitRead(session, source);
+}
+
+// static
+void Session::doWrite(Session* session, int source, size_t offset, size_t size)
+{
+    Buffer& buffer = session->buffer_[source];
+
+    asio::async_write(
+        session->socket_[(source + kNumberOfSides - 1) % kNumberOfSides],
+        asio::const_buffer(buffer.data.get() + offset, size - offset),
+        [session, source, size](const std::error_code& error_code, size_t /* bytes_transferred */)
     {
+        ++session->write_count_;
+
         if (error_code)
         {
             if (error_code != asio::error::operation_aborted)
@@ -102,27 +308,313 @@ void Session::doReadSome(Session* session, int source)
         }
         else
         {
-            session->bytes_transferred_ += bytes_transferred;
-            session->start_idle_time_ = TimePoint();
+            session->updateBufferSize(source, size);
+            doReadSome(session, source);
+        }
+    });
+}
+
+void Session::updateBufferSize(int source, size_t bytes_transferred)
+{
+    Buffer& buffer = buffer_[source];
+
+    if (bytes_transferred == buffer.size)
+    {
+        // The whole buffer is filled. Probably more data is available.
+        buffer.small_reads = 0;
+
+        if (buffer.size < BufferPool::kMaxBufferSize)
+        {
+            releaseBuffer(source);
+            buffer.size *= 2;
+        }
+    }
+    else if (bytes_transferred < buffer.size / 4)
+    {
+        if (++buffer.small_reads >= kShrinkAfterSmallReads &&
+            buffer.size > BufferPool::kMinBufferSize)
+        {
+            releaseBuffer(source);
+            buffer.size /= 2;
+            buffer.small_reads = 0;
+        }
+    }
+    else
+    {
+        buffer.small_reads = 0;
+    }
+}
+
+void Session::releaseBuffer(int source)
+{
+    Buffer& buffer = buffer_[source];
+    buffer_pool_->release(buffer.size, std::move(buffer.data));
+}
+
+size_t Session::readQuota(size_t size, std::chrono::milliseconds* delay)
+{
+    if (!rate_limiter_ && !global_rate_limiter_)
+        return size;
+
+    TokenBucket::TimePoint now = TokenBucket::Clock::now();
+    size_t quota = size;
+
+    if (rate_limiter_)
+        quota = std::min(quota, rate_limiter_->available(now));
 
-            asio::async_write(
-                session->socket_[(source + kNumberOfSides - 1) % kNumberOfSides],
-                asio::const_buffer(session->buffer_[source].data(), bytes_transferred),
-                [session, source](const std::error_code& error_code, size_t bytes_transferred)
+    if (global_rate_limiter_)
+        quota = std::min(quota, global_rate_limiter_->available(now));
+
+    // Very small reads increase the number of system calls. We are waiting until at least the
+    // minimum buffer size is available.
+    const size_t threshold = std::min(size, BufferPool::kMinBufferSize);
+    if (quota >= threshold)
+        return quota;
+
+    *delay = std::chrono::milliseconds(0);
+
+    if (rate_limiter_)
+        *delay = std::max(*delay, rate_limiter_->delay(threshold, now));
+
+    if (global_rate_limiter_)
+        *delay = std::max(*delay, global_rate_limiter_->delay(threshold, now));
+
+    // The tokens can become available between the calls. Wait at least a millisecond anyway.
+    *delay = std::max(*delay, std::chrono::milliseconds(1));
+    return 0;
+}
+
+void Session::consumeQuota(size_t bytes)
+{
+    if (rate_limiter_)
+        rate_limiter_->consume(bytes);
+
+    if (global_rate_limiter_)
+        global_rate_limiter_->consume(bytes);
+}
+
+// static
+void Session::doThrottle(Session* session, int source, const std::chrono::milliseconds& delay)
+{
+    ++session->throttle_count_;
+
+    asio::high_resolution_timer* timer = session->throttle_timer_[source].get();
+    DCHECK(timer);
+
+    timer->expires_after(delay);
+    timer->async_wait([session, source](const std::error_code& error_code)
+    {
+        if (error_code)
+        {
+            if (error_code != asio::error::operation_aborted)
+                session->onErrorOccurred(FROM_HERE, error_code);
+            return;
+        }
+
+#if defined(OS_LINUX)
+        if (session->pipe_[source].read_fd != -1)
+        {
+            doSpliceRead(session, source);
+            return;
+        }
+#endif // defined(OS_LINUX)
+
+        doReadSome(session, source);
+    });
+}
+
+void Session::setSocketOptions()
+{
+    for (int i = 0; i < kNumberOfSides; ++i)
+    {
+        std::error_code error_code;
+
+        if (options_.send_buffer_size)
+        {
+            socket_[i].set_option(asio::socket_base::send_buffer_size(
+                static_cast<int>(options_.send_buffer_size)), error_code);
+            if (error_code)
+            {
+                LOG(LS_WARNING) << "Unable to set send buffer size: "
+                                << base::utf16FromLocal8Bit(error_code.message());
+            }
+        }
+
+        if (options_.receive_buffer_size)
+        {
+            socket_[i].set_option(asio::socket_base::receive_buffer_size(
+                static_cast<int>(options_.receive_buffer_size)), error_code);
+            if (error_code)
+            {
+                LOG(LS_WARNING) << "Unable to set receive buffer size: "
+                                << base::utf16FromLocal8Bit(error_code.message());
+            }
+        }
+    }
+}
+
+#if defined(OS_LINUX)
+bool Session::createPipes()
+{
+    for (int i = 0; i < kNumberOfSides; ++i)
+    {
+        int fds[2];
+
+        if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0)
+        {
+            PLOG(LS_WARNING) << "pipe2 failed";
+            closePipes();
+            return false;
+        }
+
+        pipe_[i].read_fd = fds[0];
+        pipe_[i].write_fd = fds[1];
+
+        // Larger pipe allows to move more data per system call. If the size cannot be changed,
+        // the default size is used.
+        if (fcntl(pipe_[i].write_fd, F_SETPIPE_SZ, kPipeSize) < 0)
+        {
+            PLOG(LS_WARNING) << "fcntl(F_SETPIPE_SZ) failed";
+        }
+
+        std::error_code error_code;
+        socket_[i].native_non_blocking(true, error_code);
+        if (error_code)
+        {
+            LOG(LS_WARNING) << "Unable to set non-blocking mode: "
+                            << base::utf16FromLocal8Bit(error_code.message());
+            closePipes();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void Session::closePipes()
+{
+    for (int i = 0; i < kNumberOfSides; ++i)
+    {
+        if (pipe_[i].read_fd != -1)
+        {
+            close(pipe_[i].read_fd);
+            pipe_[i].read_fd = -1;
+        }
+
+        if (pipe_[i].write_fd != -1)
+        {
+            close(pipe_[i].write_fd);
+            pipe_[i].write_fd = -1;
+        }
+
+        pipe_[i].pending = 0;
+    }
+}
+
+// static
+void Session::doSpliceRead(Session* session, int source)
+{
+    session->socket_[source].async_wait(asio::socket_base::wait_read,
+        [session, source](const std::error_code& error_code)
+    {
+        if (error_code)
+        {
+            if (error_code != asio::error::operation_aborted)
+                session->onErrorOccurred(FROM_HERE, error_code);
+            return;
+        }
+
+        Pipe& pipe = session->pipe_[source];
+        DCHECK_EQ(pipe.pending, 0u);
+
+        std::chrono::milliseconds delay;
+        size_t quota = session->readQuota(kPipeSize, &delay);
+        if (!quota)
+        {
+            doThrottle(session, source, delay);
+            return;
+        }
+
+        ssize_t result = splice(session->socket_[source].native_handle(), nullptr,
+                                pipe.write_fd, nullptr,
+                                quota,
+                                SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        ++session->read_count_;
+        if (result < 0)
+        {
+            if (errno == EAGAIN || errno == EINTR)
+            {
+                doSpliceRead(session, source);
+                return;
+            }
+
+            session->onErrorOccurred(FROM_HERE, std::error_code(errno, std::system_category()));
+            return;
+        }
+
+        if (result == 0)
+        {
+            // The peer closed the connection.
+            session->onErrorOccurred(FROM_HERE, asio::error::eof);
+            return;
+        }
+
+        session->bytes_transferred_[source] += result;
+        session->last_activity_time_ = Clock::now();
+        session->consumeQuota(static_cast<size_t>(result));
+
+        pipe.pending = static_cast<size_t>(result);
+        doSpliceWrite(session, source);
+    });
+}
+
+// static
+void Session::doSpliceWrite(Session* session, int source)
+{
+    const int target = (source + kNumberOfSides - 1) % kNumberOfSides;
+    Pipe& pipe = session->pipe_[source];
+
+    while (pipe.pending)
+    {
+        ssize_t result = splice(pipe.read_fd, nullptr,
+                                session->socket_[target].native_handle(), nullptr,
+                                pipe.pending,
+                                SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        ++session->write_count_;
+        if (result < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            if (errno != EAGAIN)
+            {
+                session->onErrorOccurred(FROM_HERE, std::error_code(errno, std::system_category()));
+                return;
+            }
+
+            // The send buffer of the target socket is full. Wait until it becomes writable.
+            ++session->write_stall_count_;
+            session->socket_[target].async_wait(asio::socket_base::wait_write,
+                [session, source](const std::error_code& error_code)
             {
                 if (error_code)
                 {
                     if (error_code != asio::error::operation_aborted)
                         session->onErrorOccurred(FROM_HERE, error_code);
+                    return;
                 }
-                else
-                {
-                    doReadSome(session, source);
-                }
+
+                doSpliceWrite(session, source);
             });
+            return;
         }
-    });
+
+        pipe.pending -= static_cast<size_t>(result);
+    }
+
+    doSpliceRead(session, source);
 }
+#endif // defined(OS_LINUX)
 
 void Session::onErrorOccurred(const base::Location& location, const std::error_code& error_code)
 {
@@ -20,7 +20,12 @@
 #define RELAY__SESSION_H
 
 #include "base/macros_magic.h"
+#include "build/build_config.h"
+#include "proto/router_relay.pb.h"
+#include "relay/buffer_pool.h"
+#include "relay/token_bucket.h"
 
+#include <asio/high_resolution_timer.hpp>
 #include <asio/ip/tcp.hpp>
 
 namespace base {
@@ -32,7 +37,25 @@ namespace relay {
 class Session
 {
 public:
-    explicit Session(std::pair<asio::ip::tcp::socket, asio::ip::tcp::socket>&& sockets);
+    struct Options
+    {
+        // If true, data is transferred using splice() (only supported on Linux).
+        bool kernel_forwarding = false;
+
+        // Sizes of socket send and receive buffers. If 0, the system default is used.
+        uint32_t send_buffer_size = 0;
+        uint32_t receive_buffer_size = 0;
+
+        // Maximum data transfer rate of the session in bytes per second (in both directions).
+        // If 0, the rate is not limited.
+        uint32_t rate_limit = 0;
+    };
+
+    // |global_rate_limiter| limits the total rate of all sessions of the relay. It can be nullptr.
+    Session(std::pair<asio::ip::tcp::socket, asio::ip::tcp::socket>&& sockets,
+            const Options& options,
+            BufferPool* buffer_pool,
+            SharedTokenBucket* global_rate_limiter);
     ~Session();
 
     using Clock = std::chrono::high_resolution_clock;
@@ -49,23 +72,84 @@ public:
     void start(Delegate* delegate);
     void stop();
 
+    // Returns the capacity of the token bucket for the rate limit |rate|.
+    static size_t rateLimitCapacity(uint32_t rate);
+
     std::chrono::seconds idleTime(const TimePoint& current_time) const;
     std::chrono::seconds duration() const;
     int64_t bytesTransferred() const;
 
+    // Fills the session statistics.
+    void statistics(const TimePoint& current_time, proto::RelayStat::Session* stat) const;
+
 private:
+    static void doWaitRead(Session* session, int source);
     static void doReadSome(Session* session, int source);
+    static void doWrite(Session* session, int source, size_t offset, size_t size);
+    void updateBufferSize(int source, size_t bytes_transferred);
+    void releaseBuffer(int source);
+    void setSocketOptions();
+
+    // Returns the number of bytes that can be read now, but not more than |size|. If the rate
+    // limit is reached, returns 0 and |delay| receives the time after which to try again.
+    size_t readQuota(size_t size, std::chrono::milliseconds* delay);
+    void consumeQuota(size_t bytes);
+    static void doThrottle(Session* session, int source, const std::chrono::milliseconds& delay);
     void onErrorOccurred(const base::Location& location, const std::error_code& error_code);
 
+#if defined(OS_LINUX)
+    // Data is moved from the source socket to the pipe and from the pipe to the target socket
+    // using splice() without copying to user space.
+    bool createPipes();
+    void closePipes();
+    static void doSpliceRead(Session* session, int source);
+    static void doSpliceWrite(Session* session, int source);
+#endif // defined(OS_LINUX)
+
     TimePoint start_time_;
-    mutable TimePoint start_idle_time_;
-    int64_t bytes_transferred_ = 0;
+    TimePoint last_activity_time_;
 
     static const int kNumberOfSides = 2;
-    static const int kBufferSize = 8192;
+
+    // Counters of transferred data. Index is the source side.
+    int64_t bytes_transferred_[kNumberOfSides] = { 0, 0 };
+    int64_t read_count_ = 0;
+    int64_t write_count_ = 0;
+    int64_t write_stall_count_ = 0;
+    int64_t throttle_count_ = 0;
 
     asio::ip::tcp::socket socket_[kNumberOfSides];
-    std::array<uint8_t, kBufferSize> buffer_[kNumberOfSides];
+
+    // A buffer is taken from the pool only while data is being transferred. The buffer size
+    // grows if reads fill the whole buffer and shrinks if reads are much smaller than the buffer.
+    struct Buffer
+    {
+        BufferPool::Buffer data;
+        size_t size = BufferPool::kMinBufferSize;
+        int small_reads = 0; // Number of consecutive reads much smaller than the buffer.
+    };
+
+    Buffer buffer_[kNumberOfSides];
+    BufferPool* buffer_pool_;
+
+    const Options options_;
+
+    // Reading is stopped while the rate limit is reached. The data is not buffered, so the peer
+    // slows down due to TCP flow control.
+    std::unique_ptr<TokenBucket> rate_limiter_;
+    SharedTokenBucket* global_rate_limiter_;
+    std::unique_ptr<asio::high_resolution_timer> throttle_timer_[kNumberOfSides];
+
+#if defined(OS_LINUX)
+    struct Pipe
+    {
+        int read_fd = -1;
+        int write_fd = -1;
+        size_t pending = 0; // Number of bytes in the pipe that are not yet sent.
+    };
+
+    Pipe pipe_[kNumberOfSides];
+#endif // defined(OS_LINUX)
 
     Delegate* delegate_ = nullptr;
 
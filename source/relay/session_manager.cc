@@ -26,12 +26,13 @@
 #include "base/peer/host_id.h"
 #include "base/strings/unicode.h"
 
+#include <algorithm>
+#include <thread>
+
 namespace relay {
 
 namespace {
 
-const std::chrono::minutes kIdleTimerInterval { 1 };
-
 // Decrypts an encrypted pair of peer identifiers using key |session_key|.
 base::ByteArray decryptSecret(const proto::PeerToRelay& message, const SharedPool::Key& key)
 {
@@ -68,45 +69,65 @@ base::ByteArray decryptSecret(const proto::PeerToRelay& message, const SharedPoo
     return target;
 }
 
-// Removes a session from the list and returns a pointer to it.
-template<class T>
-std::unique_ptr<T> removeSessionT(std::vector<std::unique_ptr<T>>* session_list, T* session)
+// Returns a key which is equal for both peers of a pair.
+std::string pairingKey(uint32_t key_id, const base::ByteArray& secret)
 {
-    session->stop();
-
-    auto it = session_list->begin();
-    while (it != session_list->end())
-    {
-        if (it->get() == session)
-            break;
-
-        ++it;
-    }
-
-    if (it != session_list->end())
-    {
-        std::unique_ptr<T> result = std::move(*it);
-        session_list->erase(it);
-        return result;
-    }
-
-    return nullptr;
+    std::string key(reinterpret_cast<const char*>(&key_id), sizeof(key_id));
+    key.append(secret.begin(), secret.end());
+    return key;
 }
 
 } // namespace
 
+struct SessionManager::StatisticsRequest
+{
+    std::shared_ptr<proto::RelayStat> stat;
+    size_t remaining_shards;
+    size_t max_sessions;
+    StatisticsCallback callback;
+};
+
 SessionManager::SessionManager(std::shared_ptr<base::TaskRunner> task_runner,
                                uint16_t port,
-                               const std::chrono::minutes& idle_timeout)
+                               const std::chrono::minutes& idle_timeout,
+                               const Session::Options& session_options,
+                               uint32_t relay_rate_limit,
+                               uint32_t thread_count)
     : task_runner_(std::move(task_runner)),
       acceptor_(base::MessageLoop::current()->pumpAsio()->ioContext(),
-                asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port)),
-      idle_timeout_(idle_timeout),
-      idle_timer_(base::MessageLoop::current()->pumpAsio()->ioContext())
+                asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port))
 {
     DCHECK(task_runner_);
 
+    if (!thread_count)
+        thread_count = std::max(std::thread::hardware_concurrency(), 1U);
+
+    if (thread_count > 1 && !SessionShard::canMoveSockets())
+    {
+        // Peers accepted by different shards could not be paired.
+        LOG(LS_WARNING) << "Sockets cannot be moved between threads on this system. "
+                        << "One session shard is used";
+        thread_count = 1;
+    }
+
     LOG(LS_INFO) << "Session manager port: " << port;
+    LOG(LS_INFO) << "Kernel forwarding: "
+                 << (session_options.kernel_forwarding ? "enabled" : "disabled");
+    LOG(LS_INFO) << "Session shards: " << thread_count;
+
+    // The total rate limit is shared by sessions of all shards.
+    std::shared_ptr<SharedTokenBucket> global_rate_limiter;
+    if (relay_rate_limit)
+    {
+        global_rate_limiter = std::make_shared<SharedTokenBucket>(
+            relay_rate_limit, Session::rateLimitCapacity(relay_rate_limit));
+    }
+
+    for (uint32_t i = 0; i < thread_count; ++i)
+    {
+        shards_.emplace_back(std::make_unique<SessionShard>(
+            static_cast<int>(i), idle_timeout, session_options, global_rate_limiter, this));
+    }
 }
 
 SessionManager::~SessionManager()
@@ -114,7 +135,9 @@ SessionManager::~SessionManager()
     std::error_code ignored_code;
     acceptor_.cancel(ignored_code);
     acceptor_.close(ignored_code);
-    idle_timer_.cancel();
+
+    // Shard threads are stopped before the rest of the members are destroyed.
+    shards_.clear();
 }
 
 void SessionManager::start(std::unique_ptr<SharedPool> shared_pool, Delegate* delegate)
@@ -126,92 +149,83 @@ void SessionManager::start(std::unique_ptr<SharedPool> shared_pool, Delegate* de
 
     DCHECK(delegate_ && shared_pool_);
 
-    idle_timer_.expires_after(kIdleTimerInterval);
-    idle_timer_.async_wait(std::bind(&SessionManager::doIdleTimeout, this, std::placeholders::_1));
+    for (auto& shard : shards_)
+        shard->start();
 
     SessionManager::doAccept(this);
 }
 
-void SessionManager::onPendingSessionReady(
-    PendingSession* session, const proto::PeerToRelay& message)
+void SessionManager::collectStatistics(size_t max_sessions, StatisticsCallback callback)
 {
-    LOG(LS_INFO) << "Pending session ready for key_id: " << message.key_id();
+    DCHECK(task_runner_->belongsToCurrentThread());
+    DCHECK(callback);
 
-    // Looking for a key with the specified identifier.
-    std::optional<SharedPool::Key> key = shared_pool_->key(message.key_id(), message.public_key());
-    if (key.has_value())
+    // Pending sessions are counted by the shards that accepted them.
+    std::shared_ptr<proto::RelayStat> stat = std::make_shared<proto::RelayStat>();
+
+    std::shared_ptr<StatisticsRequest> request = std::make_shared<StatisticsRequest>();
+    request->stat = std::move(stat);
+    request->remaining_shards = shards_.size();
+    request->max_sessions = max_sessions;
+    request->callback = std::move(callback);
+
+    for (auto& shard : shards_)
     {
-        // Decrypt the identifiers of peers.
-        base::ByteArray secret = decryptSecret(message, key.value());
-        if (!secret.empty())
+        // Shards call the callback on their own threads. Results are combined on our thread.
+        shard->collectStatistics(max_sessions,
+            [this, request](std::unique_ptr<proto::RelayStat> shard_stat)
         {
-            // Save the identifiers of peers and the identifier of their shared key.
-            session->setIdentify(message.key_id(), secret);
-
-            // Trying to find a peer that wants to be connected.
-            for (auto& other_session : pending_sessions_)
-            {
-                if (session->isPeerFor(*other_session))
-                {
-                    LOG(LS_INFO) << "Both peers are connected with key " << message.key_id();
-
-                    // Delete the key from the pool. It can no longer be used.
-                    shared_pool_->removeKey(message.key_id());
-
-                    // Now the opposite peer is found, start the data transfer between them.
-                    active_sessions_.emplace_back(std::make_unique<Session>(
-                        std::make_pair(session->takeSocket(), other_session->takeSocket())));
-                    active_sessions_.back()->start(this);
-
-                    // Pending sessions are no longer needed, remove them.
-                    removePendingSession(other_session.get());
-                    removePendingSession(session);
-                    return;
-                }
-            }
-
-            LOG(LS_INFO) << "Second peer has not connected yet";
-            return;
-        }
-        else
-        {
-            LOG(LS_WARNING) << "Failed to decrypt shared secret. Connection will be completed";
-        }
-    }
-    else
-    {
-        LOG(LS_WARNING) << "Key with id " << message.key_id() << " NOT found!";
+            task_runner_->postTask(std::bind(&SessionManager::onShardStatistics, this, request,
+                std::shared_ptr<proto::RelayStat>(std::move(shard_stat))));
+        });
     }
+}
 
-    // The key was not found in the pool.
-    removePendingSession(session);
+void SessionManager::onShardPendingSessionReady(SessionShard* shard,
+                                                uint64_t session_id,
+                                                const proto::PeerToRelay& message)
+{
+    // Called on the shard thread. Peers are paired on our thread.
+    task_runner_->postTask(std::bind(
+        &SessionManager::onPendingSessionReady, this, shard, session_id, message));
 }
 
-void SessionManager::onPendingSessionFailed(PendingSession* session)
+void SessionManager::onShardPendingSessionFailed(SessionShard* /* shard */, uint64_t session_id)
 {
-    removePendingSession(session);
+    // Called on the shard thread. The shard has already removed the session.
+    task_runner_->postTask(
+        std::bind(&SessionManager::onPendingSessionFailed, this, session_id));
 }
 
-void SessionManager::onSessionFinished(Session* session)
+void SessionManager::onShardSessionFinished()
 {
-    removeSession(session);
+    // Called on the shard thread. The delegate passes the notification to its own thread.
+    if (delegate_)
+        delegate_->onSessionFinished();
 }
 
 // static
 void SessionManager::doAccept(SessionManager* self)
 {
-    self->acceptor_.async_accept(
-        [self](const std::error_code& error_code, asio::ip::tcp::socket socket)
+    const size_t shard_index = self->next_shard_;
+    self->next_shard_ = (self->next_shard_ + 1) % self->shards_.size();
+
+    // The socket is created in the io_context of the shard, so that all further operations with
+    // it are performed on the shard thread.
+    self->acceptor_.async_accept(self->shards_[shard_index]->ioContext(),
+        [self, shard_index](const std::error_code& error_code, asio::ip::tcp::socket socket)
     {
         if (!error_code)
         {
+            std::error_code ignored_code;
+
             LOG(LS_INFO) << "New accepted connection: " << base::utf16FromLocal8Bit(
-                socket.remote_endpoint().address().to_string());
+                socket.remote_endpoint(ignored_code).address().to_string())
+                         << " (shard #" << shard_index << ")";
 
-            // A new peer is connected. Create and start the pending session.
-            self->pending_sessions_.emplace_back(std::make_unique<PendingSession>(
-                self->task_runner_, std::move(socket), self));
-            self->pending_sessions_.back()->start();
+            // A new peer is connected. The pending session is started on the shard thread.
+            self->shards_[shard_index]->addPendingSession(
+                self->next_session_id_++, std::move(socket));
         }
         else
         {
@@ -227,58 +241,118 @@ void SessionManager::doAccept(SessionManager* self)
     });
 }
 
-// static
-void SessionManager::doIdleTimeout(SessionManager* self, const std::error_code& error_code)
+void SessionManager::onPendingSessionReady(SessionShard* shard,
+                                           uint64_t session_id,
+                                           const proto::PeerToRelay& message)
 {
-    if (error_code == asio::error::operation_aborted)
-        return;
+    LOG(LS_INFO) << "Pending session ready for key_id: " << message.key_id();
 
-    self->doIdleTimeoutImpl(error_code);
-}
+    // Looking for a key with the specified identifier.
+    std::optional<SharedPool::Key> key = shared_pool_->key(message.key_id(), message.public_key());
+    if (!key.has_value())
+    {
+        LOG(LS_WARNING) << "Key with id " << message.key_id() << " NOT found!";
+        shard->removePendingSession(session_id);
+        return;
+    }
 
-void SessionManager::doIdleTimeoutImpl(const std::error_code& error_code)
-{
-    if (!error_code)
+    // Decrypt the identifiers of peers.
+    base::ByteArray secret = decryptSecret(message, key.value());
+    if (secret.empty())
     {
-        auto current_time = Session::Clock::now();
-        auto it = active_sessions_.begin();
-        int count = 0;
+        LOG(LS_WARNING) << "Failed to decrypt shared secret. Connection will be completed";
+        shard->removePendingSession(session_id);
+        return;
+    }
 
-        while (it != active_sessions_.end())
-        {
-            if ((*it)->idleTime(current_time) >= idle_timeout_)
-            {
-                it = active_sessions_.erase(it);
-                ++count;
-            }
-            else
-            {
-                ++it;
-            }
-        }
+    std::string pairing_key = pairingKey(message.key_id(), secret);
 
-        LOG(LS_INFO) << "Sessions ended by timeout: " << count;
-    }
-    else
+    // Trying to find a peer that wants to be connected.
+    auto other = waiting_sessions_.find(pairing_key);
+    if (other == waiting_sessions_.end())
     {
-        LOG(LS_ERROR) << "Error in idle timer: " << base::utf16FromLocal8Bit(error_code.message());
+        waiting_keys_.emplace(session_id, pairing_key);
+        waiting_sessions_.emplace(std::move(pairing_key), WaitingSession{ shard, session_id });
+
+        LOG(LS_INFO) << "Second peer has not connected yet";
+        return;
     }
 
-    idle_timer_.expires_after(kIdleTimerInterval);
-    idle_timer_.async_wait(std::bind(&SessionManager::doIdleTimeout, this, std::placeholders::_1));
+    WaitingSession other_session = other->second;
+
+    waiting_keys_.erase(other_session.session_id);
+    waiting_sessions_.erase(other);
+
+    LOG(LS_INFO) << "Both peers are connected with key " << message.key_id();
+
+    // Delete the key from the pool. It can no longer be used.
+    shared_pool_->removeKey(message.key_id());
+
+    // Now the opposite peer is found, start the data transfer between them.
+    startSession(other_session, WaitingSession{ shard, session_id });
 }
 
-void SessionManager::removePendingSession(PendingSession* session)
+void SessionManager::onPendingSessionFailed(uint64_t session_id)
 {
-    task_runner_->deleteSoon(removeSessionT(&pending_sessions_, session));
+    auto it = waiting_keys_.find(session_id);
+    if (it == waiting_keys_.end())
+        return;
+
+    waiting_sessions_.erase(it->second);
+    waiting_keys_.erase(it);
 }
 
-void SessionManager::removeSession(Session* session)
+void SessionManager::startSession(WaitingSession first, WaitingSession second)
 {
-    task_runner_->deleteSoon(removeSessionT(&active_sessions_, session));
+    if (first.shard == second.shard)
+    {
+        first.shard->startSession(first.session_id, second.session_id);
+        return;
+    }
 
-    if (delegate_)
-        delegate_->onSessionFinished();
+    // The peers were accepted by different shards. The session is started on the less loaded one.
+    if (second.shard->sessionCount() < first.shard->sessionCount())
+        std::swap(first, second);
+
+    second.shard->moveSession(second.session_id, first.shard, first.session_id);
+}
+
+void SessionManager::onShardStatistics(std::shared_ptr<StatisticsRequest> request,
+                                       std::shared_ptr<proto::RelayStat> shard_stat)
+{
+    proto::RelayStat* stat = request->stat.get();
+
+    stat->set_active_sessions(stat->active_sessions() + shard_stat->active_sessions());
+    stat->set_pending_sessions(stat->pending_sessions() + shard_stat->pending_sessions());
+    stat->set_total_sessions(stat->total_sessions() + shard_stat->total_sessions());
+    stat->set_total_bytes(stat->total_bytes() + shard_stat->total_bytes());
+    stat->set_read_count(stat->read_count() + shard_stat->read_count());
+    stat->set_write_count(stat->write_count() + shard_stat->write_count());
+    stat->set_write_stall_count(stat->write_stall_count() + shard_stat->write_stall_count());
+    stat->set_throttle_count(stat->throttle_count() + shard_stat->throttle_count());
+
+    for (int i = 0; i < shard_stat->pending_age_size(); ++i)
+    {
+        if (i < stat->pending_age_size())
+            stat->set_pending_age(i, stat->pending_age(i) + shard_stat->pending_age(i));
+        else
+            stat->add_pending_age(shard_stat->pending_age(i));
+    }
+
+    for (int i = 0; i < shard_stat->session_size(); ++i)
+        SessionShard::addBusiestSession(shard_stat->session(i), request->max_sessions, stat);
+
+    DCHECK_GT(request->remaining_shards, 0u);
+    if (--request->remaining_shards)
+        return;
+
+    std::sort(stat->mutable_session()->pointer_begin(), stat->mutable_session()->pointer_end(),
+              [](const proto::RelayStat::Session* first, const proto::RelayStat::Session* second)
+    {
+        return first->speed() > second->speed();
+    });
+
+    request->callback(std::move(request->stat));
 }
 
 } // namespace relay
@@ -20,11 +20,10 @@
 #define RELAY__SESSION_MANAGER_H
 
 #include "proto/relay_peer.pb.h"
-#include "relay/pending_session.h"
-#include "relay/session.h"
+#include "relay/session_shard.h"
 #include "relay/shared_pool.h"
 
-#include <asio/high_resolution_timer.hpp>
+#include <unordered_map>
 
 namespace base {
 class TaskRunner;
@@ -32,9 +31,11 @@ class TaskRunner;
 
 namespace relay {
 
-class SessionManager
-    : public PendingSession::Delegate,
-      public Session::Delegate
+// Accepts peers and pairs them. The connections are accepted into the io_contexts of the shards in
+// turn and stay there while they are pending. When both peers of a pair are authenticated, the
+// session is started on the shard of the peers. If the peers were accepted by different shards,
+// one of the sockets is moved to the less loaded shard.
+class SessionManager : public SessionShard::Delegate
 {
 public:
     class Delegate
@@ -47,36 +48,65 @@ public:
 
     SessionManager(std::shared_ptr<base::TaskRunner> task_runner,
                    uint16_t port,
-                   const std::chrono::minutes& idle_timeout);
+                   const std::chrono::minutes& idle_timeout,
+                   const Session::Options& session_options,
+                   uint32_t relay_rate_limit,
+                   uint32_t thread_count);
     ~SessionManager();
 
     void start(std::unique_ptr<SharedPool> shared_pool, Delegate* delegate);
 
-protected:
-    // PendingSession::Delegate implementation.
-    void onPendingSessionReady(
-        PendingSession* session, const proto::PeerToRelay& message) override;
-    void onPendingSessionFailed(PendingSession* session) override;
+    using StatisticsCallback = std::function<void(std::shared_ptr<proto::RelayStat> stat)>;
+
+    // Collects statistics of pending sessions and of all shards. The statistics contain no more
+    // than |max_sessions| of the active sessions with the highest throughput. |callback| is called
+    // on the thread of the session manager.
+    void collectStatistics(size_t max_sessions, StatisticsCallback callback);
 
-    // Session::Delegate implementation.
-    void onSessionFinished(Session* session) override;
+protected:
+    // SessionShard::Delegate implementation.
+    void onShardPendingSessionReady(SessionShard* shard,
+                                    uint64_t session_id,
+                                    const proto::PeerToRelay& message) override;
+    void onShardPendingSessionFailed(SessionShard* shard, uint64_t session_id) override;
+    void onShardSessionFinished() override;
 
 private:
+    struct WaitingSession
+    {
+        SessionShard* shard;
+        uint64_t session_id;
+    };
+
     static void doAccept(SessionManager* self);
-    static void doIdleTimeout(SessionManager* self, const std::error_code& error_code);
-    void doIdleTimeoutImpl(const std::error_code& error_code);
 
-    void removePendingSession(PendingSession* sessions);
-    void removeSession(Session* session);
+    void onPendingSessionReady(SessionShard* shard,
+                               uint64_t session_id,
+                               const proto::PeerToRelay& message);
+    void onPendingSessionFailed(uint64_t session_id);
+    void startSession(WaitingSession first, WaitingSession second);
+
+    struct StatisticsRequest;
+    void onShardStatistics(std::shared_ptr<StatisticsRequest> request,
+                           std::shared_ptr<proto::RelayStat> shard_stat);
 
     std::shared_ptr<base::TaskRunner> task_runner_;
 
     asio::ip::tcp::acceptor acceptor_;
-    std::vector<std::unique_ptr<PendingSession>> pending_sessions_;
-    std::vector<std::unique_ptr<Session>> active_sessions_;
 
-    const std::chrono::minutes idle_timeout_;
-    asio::high_resolution_timer idle_timer_;
+    // Pending sessions that have sent their credentials and are waiting for the opposite peer.
+    // The key is equal for both peers of a pair: the key identifier and the decrypted secret.
+    std::unordered_map<std::string, WaitingSession> waiting_sessions_;
+
+    // Keys of |waiting_sessions_| by the identifiers of the sessions.
+    std::unordered_map<uint64_t, std::string> waiting_keys_;
+
+    // Sessions are distributed between shards. Each shard has its own thread.
+    std::vector<std::unique_ptr<SessionShard>> shards_;
+    size_t next_shard_ = 0;
+
+    // Identifier of the next accepted pending session.
+    uint64_t next_session_id_ = 1;
 
     std::unique_ptr<SharedPool> shared_pool_;
     Delegate* delegate_ = nullptr;
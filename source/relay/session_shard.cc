@@ -0,0 +1,463 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "relay/session_shard.h"
+
+#include "base/logging.h"
+#include "base/task_runner.h"
+#include "base/message_loop/message_loop.h"
+#include "base/message_loop/message_pump_asio.h"
+#include "base/strings/unicode.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace relay {
+
+namespace {
+
+const std::chrono::minutes kIdleTimerInterval { 1 };
+
+// Upper bounds of pending session age histogram buckets. The last bucket contains the rest.
+const std::chrono::seconds kPendingAgeBuckets[] =
+{
+    std::chrono::seconds(1),
+    std::chrono::seconds(5),
+    std::chrono::seconds(10),
+    std::chrono::seconds(20)
+};
+
+void addSessionStatistics(const proto::RelayStat::Session& session, proto::RelayStat* stat)
+{
+    stat->set_total_bytes(
+        stat->total_bytes() + session.bytes_first_to_second() + session.bytes_second_to_first());
+    stat->set_read_count(stat->read_count() + session.read_count());
+    stat->set_write_count(stat->write_count() + session.write_count());
+    stat->set_write_stall_count(stat->write_stall_count() + session.write_stall_count());
+    stat->set_throttle_count(stat->throttle_count() + session.throttle_count());
+}
+
+} // namespace
+
+SessionShard::SessionShard(int index,
+                           const std::chrono::minutes& idle_timeout,
+                           const Session::Options& session_options,
+                           std::shared_ptr<SharedTokenBucket> global_rate_limiter,
+                           Delegate* delegate)
+    : index_(index),
+      idle_timeout_(idle_timeout),
+      session_options_(session_options),
+      global_rate_limiter_(std::move(global_rate_limiter)),
+      delegate_(delegate),
+      thread_(std::make_unique<base::Thread>())
+{
+    DCHECK(delegate_);
+
+    // The wheel covers the whole idle timeout. One more slot is needed for the current tick.
+    size_t slot_count = static_cast<size_t>(
+        std::chrono::duration_cast<std::chrono::minutes>(idle_timeout_).count() /
+        kIdleTimerInterval.count()) + 2;
+    idle_wheel_.resize(slot_count);
+}
+
+SessionShard::~SessionShard()
+{
+    thread_->stop();
+}
+
+// static
+bool SessionShard::canMoveSockets()
+{
+#if defined(OS_WIN) && (_WIN32_WINNT < 0x0603)
+    // A socket is associated with the I/O completion port of its io_context. Before Windows 8.1
+    // the association cannot be changed, so basic_socket::release() always fails.
+    return false;
+#else
+    return true;
+#endif
+}
+
+void SessionShard::start()
+{
+    thread_->start(base::MessageLoop::Type::ASIO, this);
+    task_runner_ = thread_->taskRunner();
+    io_context_ = &thread_->messageLoop()->pumpAsio()->ioContext();
+}
+
+void SessionShard::addPendingSession(uint64_t session_id, asio::ip::tcp::socket&& socket)
+{
+    DCHECK(task_runner_);
+
+    // The task must be copyable, but the socket is not.
+    std::shared_ptr<asio::ip::tcp::socket> socket_holder =
+        std::make_shared<asio::ip::tcp::socket>(std::move(socket));
+
+    task_runner_->postTask(
+        std::bind(&SessionShard::addPendingSessionImpl, this, session_id, socket_holder));
+}
+
+void SessionShard::removePendingSession(uint64_t session_id)
+{
+    DCHECK(task_runner_);
+    task_runner_->postTask(std::bind(&SessionShard::removePendingSessionImpl, this, session_id));
+}
+
+void SessionShard::startSession(uint64_t first_id, uint64_t second_id)
+{
+    DCHECK(task_runner_);
+
+    ++session_count_;
+    task_runner_->postTask(
+        std::bind(&SessionShard::startSessionImpl, this, first_id, second_id));
+}
+
+void SessionShard::moveSession(
+    uint64_t session_id, SessionShard* target, uint64_t target_session_id)
+{
+    DCHECK(task_runner_);
+    DCHECK(target && target != this);
+    DCHECK(canMoveSockets());
+
+    // The session is counted by the shard on which it runs.
+    ++target->session_count_;
+    task_runner_->postTask(std::bind(
+        &SessionShard::moveSessionImpl, this, session_id, target, target_session_id));
+}
+
+void SessionShard::collectStatistics(size_t max_sessions, StatisticsCallback callback)
+{
+    DCHECK(task_runner_);
+    DCHECK(callback);
+
+    task_runner_->postTask(std::bind(
+        &SessionShard::collectStatisticsImpl, this, max_sessions, std::move(callback)));
+}
+
+// static
+void SessionShard::addBusiestSession(const proto::RelayStat::Session& session,
+                                     size_t max_sessions,
+                                     proto::RelayStat* stat)
+{
+    if (!max_sessions)
+        return;
+
+    // The sessions are kept in a heap with the slowest session on top.
+    auto faster = [](const proto::RelayStat::Session* first,
+                     const proto::RelayStat::Session* second)
+    {
+        return first->speed() > second->speed();
+    };
+
+    google::protobuf::RepeatedPtrField<proto::RelayStat::Session>* sessions =
+        stat->mutable_session();
+
+    if (static_cast<size_t>(sessions->size()) >= max_sessions)
+    {
+        if (session.speed() <= sessions->Get(0).speed())
+            return;
+
+        std::pop_heap(sessions->pointer_begin(), sessions->pointer_end(), faster);
+        sessions->RemoveLast();
+    }
+
+    sessions->Add()->CopyFrom(session);
+    std::push_heap(sessions->pointer_begin(), sessions->pointer_end(), faster);
+}
+
+void SessionShard::onBeforeThreadRunning()
+{
+    LOG(LS_INFO) << "Session shard #" << index_ << " started";
+
+    idle_timer_ = std::make_unique<asio::high_resolution_timer>(
+        base::MessageLoop::current()->pumpAsio()->ioContext());
+    startIdleTimer();
+}
+
+void SessionShard::onAfterThreadRunning()
+{
+    idle_timer_.reset();
+
+    for (auto& slot : idle_wheel_)
+        slot.clear();
+    sessions_.clear();
+    pending_sessions_.clear();
+
+    LOG(LS_INFO) << "Session shard #" << index_ << " stopped";
+}
+
+void SessionShard::onPendingSessionReady(
+    PendingSession* session, const proto::PeerToRelay& message)
+{
+    // The session waits for the opposite peer. The peer can be accepted by another shard, so the
+    // peers are paired by the sessions manager.
+    delegate_->onShardPendingSessionReady(this, session->id(), message);
+}
+
+void SessionShard::onPendingSessionFailed(PendingSession* session)
+{
+    const uint64_t session_id = session->id();
+
+    removePendingSessionImpl(session_id);
+    delegate_->onShardPendingSessionFailed(this, session_id);
+}
+
+void SessionShard::onSessionFinished(Session* session)
+{
+    removeSession(session, Session::Clock::now());
+    delegate_->onShardSessionFinished();
+}
+
+void SessionShard::addPendingSessionImpl(uint64_t session_id,
+                                         std::shared_ptr<asio::ip::tcp::socket> socket)
+{
+    std::unique_ptr<PendingSession> session = std::make_unique<PendingSession>(
+        task_runner_, session_id, std::move(*socket), this);
+    PendingSession* session_ptr = session.get();
+
+    pending_sessions_.emplace(session_id, std::move(session));
+    session_ptr->start();
+}
+
+void SessionShard::removePendingSessionImpl(uint64_t session_id)
+{
+    auto it = pending_sessions_.find(session_id);
+    if (it == pending_sessions_.end())
+        return;
+
+    it->second->stop();
+
+    task_runner_->deleteSoon(std::move(it->second));
+    pending_sessions_.erase(it);
+}
+
+asio::ip::tcp::socket SessionShard::takePendingSocket(uint64_t session_id)
+{
+    auto it = pending_sessions_.find(session_id);
+    if (it == pending_sessions_.end())
+        return asio::ip::tcp::socket(*io_context_);
+
+    asio::ip::tcp::socket socket = it->second->takeSocket();
+    removePendingSessionImpl(session_id);
+    return socket;
+}
+
+void SessionShard::startSessionImpl(uint64_t first_id, uint64_t second_id)
+{
+    asio::ip::tcp::socket first = takePendingSocket(first_id);
+    asio::ip::tcp::socket second = takePendingSocket(second_id);
+
+    // One of the peers could be disconnected while the peers were paired.
+    if (!first.is_open() || !second.is_open())
+    {
+        LOG(LS_WARNING) << "Peer disconnected before the session started (shard #" << index_ << ")";
+        --session_count_;
+        return;
+    }
+
+    createSession(std::move(first), std::move(second));
+}
+
+void SessionShard::moveSessionImpl(
+    uint64_t session_id, SessionShard* target, uint64_t target_session_id)
+{
+    asio::ip::tcp::socket socket = takePendingSocket(session_id);
+    if (!socket.is_open())
+    {
+        LOG(LS_WARNING) << "Peer disconnected before the session started (shard #" << index_ << ")";
+        --target->session_count_;
+        target->removePendingSession(target_session_id);
+        return;
+    }
+
+    std::error_code error_code;
+
+#if defined(OS_WIN) && (_WIN32_WINNT < 0x0603)
+    NOTREACHED();
+    error_code = asio::error::operation_not_supported;
+#else
+    asio::ip::tcp protocol = socket.local_endpoint(error_code).protocol();
+    if (!error_code)
+    {
+        // The socket has no pending operations anymore. Its native handle is assigned to a new
+        // socket in the io_context of the target shard.
+        NativeHandle handle = socket.release(error_code);
+        if (!error_code)
+        {
+            target->task_runner_->postTask(std::bind(
+                &SessionShard::startMovedSession, target, target_session_id, protocol, handle));
+            return;
+        }
+    }
+#endif
+
+    LOG(LS_ERROR) << "Unable to move socket: " << base::utf16FromLocal8Bit(error_code.message());
+    --target->session_count_;
+    target->removePendingSession(target_session_id);
+}
+
+void SessionShard::startMovedSession(
+    uint64_t session_id, asio::ip::tcp protocol, NativeHandle handle)
+{
+    // The socket is closed when it is destroyed, even if the opposite peer is disconnected.
+    asio::ip::tcp::socket first(*io_context_, protocol, handle);
+    asio::ip::tcp::socket second = takePendingSocket(session_id);
+
+    if (!second.is_open())
+    {
+        LOG(LS_WARNING) << "Peer disconnected before the session started (shard #" << index_ << ")";
+        --session_count_;
+        return;
+    }
+
+    createSession(std::move(first), std::move(second));
+}
+
+void SessionShard::createSession(asio::ip::tcp::socket&& first, asio::ip::tcp::socket&& second)
+{
+    std::unique_ptr<Session> session = std::make_unique<Session>(
+        std::make_pair(std::move(first), std::move(second)),
+        session_options_, &buffer_pool_, global_rate_limiter_.get());
+    Session* session_ptr = session.get();
+
+    sessions_.emplace(session_ptr, SessionEntry{ std::move(session), 0 });
+    session_ptr->start(this);
+
+    // The session could be finished in start().
+    if (sessions_.find(session_ptr) != sessions_.end())
+        scheduleIdleCheck(session_ptr, Session::Clock::now());
+
+    finished_stat_.set_total_sessions(finished_stat_.total_sessions() + 1);
+}
+
+void SessionShard::collectStatisticsImpl(size_t max_sessions, const StatisticsCallback& callback)
+{
+    std::unique_ptr<proto::RelayStat> stat = std::make_unique<proto::RelayStat>(finished_stat_);
+    stat->set_active_sessions(static_cast<uint32_t>(sessions_.size()));
+    stat->set_pending_sessions(static_cast<uint32_t>(pending_sessions_.size()));
+
+    uint32_t pending_age[std::size(kPendingAgeBuckets) + 1] = { 0 };
+    auto pending_time = PendingSession::Clock::now();
+
+    for (const auto& session : pending_sessions_)
+    {
+        std::chrono::seconds age = session.second->age(pending_time);
+        size_t bucket = 0;
+
+        while (bucket < std::size(kPendingAgeBuckets) && age >= kPendingAgeBuckets[bucket])
+            ++bucket;
+
+        ++pending_age[bucket];
+    }
+
+    for (size_t i = 0; i < std::size(pending_age); ++i)
+        stat->add_pending_age(pending_age[i]);
+
+    auto current_time = Session::Clock::now();
+    proto::RelayStat::Session session_stat;
+
+    for (const auto& session : sessions_)
+    {
+        session.second.session->statistics(current_time, &session_stat);
+        addSessionStatistics(session_stat, stat.get());
+        addBusiestSession(session_stat, max_sessions, stat.get());
+    }
+
+    callback(std::move(stat));
+}
+
+void SessionShard::removeSession(Session* session, const Session::TimePoint& current_time)
+{
+    session->stop();
+
+    auto it = sessions_.find(session);
+    if (it == sessions_.end())
+        return;
+
+    proto::RelayStat::Session session_stat;
+    session->statistics(current_time, &session_stat);
+    addSessionStatistics(session_stat, &finished_stat_);
+
+    idle_wheel_[it->second.idle_slot].erase(session);
+
+    task_runner_->deleteSoon(std::move(it->second.session));
+    sessions_.erase(it);
+    --session_count_;
+}
+
+void SessionShard::scheduleIdleCheck(Session* session, const Session::TimePoint& current_time)
+{
+    auto it = sessions_.find(session);
+    DCHECK(it != sessions_.end());
+
+    // Number of ticks until the idle timeout of the session can expire.
+    std::chrono::seconds remaining = idle_timeout_ - session->idleTime(current_time);
+    size_t ticks = static_cast<size_t>(
+        (remaining + kIdleTimerInterval - std::chrono::seconds(1)) / kIdleTimerInterval);
+    ticks = std::clamp(ticks, size_t(1), idle_wheel_.size() - 1);
+
+    size_t slot = (idle_wheel_pos_ + ticks) % idle_wheel_.size();
+    idle_wheel_[slot].emplace(session);
+    it->second.idle_slot = slot;
+}
+
+void SessionShard::doIdleTimeout(const std::error_code& error_code)
+{
+    if (error_code == asio::error::operation_aborted)
+        return;
+
+    if (!error_code)
+    {
+        auto current_time = Session::Clock::now();
+        int count = 0;
+
+        idle_wheel_pos_ = (idle_wheel_pos_ + 1) % idle_wheel_.size();
+
+        std::unordered_set<Session*> slot;
+        slot.swap(idle_wheel_[idle_wheel_pos_]);
+
+        for (Session* session : slot)
+        {
+            if (session->idleTime(current_time) >= idle_timeout_)
+            {
+                removeSession(session, current_time);
+                ++count;
+            }
+            else
+            {
+                scheduleIdleCheck(session, current_time);
+            }
+        }
+
+        LOG(LS_INFO) << "Sessions ended by timeout: " << count << " (shard #" << index_ << ")";
+    }
+    else
+    {
+        LOG(LS_ERROR) << "Error in idle timer: " << base::utf16FromLocal8Bit(error_code.message());
+    }
+
+    startIdleTimer();
+}
+
+void SessionShard::startIdleTimer()
+{
+    idle_timer_->expires_after(kIdleTimerInterval);
+    idle_timer_->async_wait(
+        std::bind(&SessionShard::doIdleTimeout, this, std::placeholders::_1));
+}
+
+} // namespace relay
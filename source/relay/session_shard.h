@@ -0,0 +1,181 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef RELAY__SESSION_SHARD_H
+#define RELAY__SESSION_SHARD_H
+
+#include "base/threading/thread.h"
+#include "relay/pending_session.h"
+#include "relay/session.h"
+
+#include <asio/high_resolution_timer.hpp>
+
+#include <atomic>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace relay {
+
+// Runs sessions on its own thread with its own io_context. New connections are accepted directly
+// into the io_context of a shard, so the sockets of pending sessions and of active sessions are
+// used only on the shard thread. The sessions manager distributes the connections between
+// several shards to use all processor cores and pairs the peers.
+class SessionShard
+    : public base::Thread::Delegate,
+      public PendingSession::Delegate,
+      public Session::Delegate
+{
+public:
+    class Delegate
+    {
+    public:
+        virtual ~Delegate() = default;
+
+        // Called on the shard thread when the pending session |session_id| received the
+        // authentication data of the peer. The session waits for startSession() or moveSession().
+        virtual void onShardPendingSessionReady(SessionShard* shard,
+                                                uint64_t session_id,
+                                                const proto::PeerToRelay& message) = 0;
+
+        // Called on the shard thread when the pending session |session_id| is removed due to an
+        // error or timeout.
+        virtual void onShardPendingSessionFailed(SessionShard* shard, uint64_t session_id) = 0;
+
+        // Called on the shard thread.
+        virtual void onShardSessionFinished() = 0;
+    };
+
+    SessionShard(int index,
+                 const std::chrono::minutes& idle_timeout,
+                 const Session::Options& session_options,
+                 std::shared_ptr<SharedTokenBucket> global_rate_limiter,
+                 Delegate* delegate);
+    ~SessionShard();
+
+    // Returns true if a socket can be moved to another shard. Peers that are accepted by different
+    // shards can be paired only in this case. Moving a socket between I/O completion ports is not
+    // supported before Windows 8.1.
+    static bool canMoveSockets();
+
+    void start();
+
+    // Returns the io_context of the shard thread. Connections for the shard must be accepted into
+    // it. Can be called after start().
+    asio::io_context& ioContext() { return *io_context_; }
+
+    // Starts a pending session for the accepted |socket|. The socket must belong to ioContext().
+    // Can be called from any thread.
+    void addPendingSession(uint64_t session_id, asio::ip::tcp::socket&& socket);
+
+    // Removes the pending session. Can be called from any thread.
+    void removePendingSession(uint64_t session_id);
+
+    // Starts a session for two pending sessions of the shard. If one of them is already removed,
+    // the other one is removed too. Can be called from any thread.
+    void startSession(uint64_t first_id, uint64_t second_id);
+
+    // Moves the socket of the pending session |session_id| to |target| and starts a session for it
+    // and the pending session |target_session_id| of |target|. Can be called from any thread.
+    // Can be used only if canMoveSockets() returns true.
+    void moveSession(uint64_t session_id, SessionShard* target, uint64_t target_session_id);
+
+    // Returns the number of sessions that were started on the shard and not finished yet.
+    size_t sessionCount() const { return session_count_; }
+
+    using StatisticsCallback = std::function<void(std::unique_ptr<proto::RelayStat> stat)>;
+
+    // Collects statistics of the shard. Can be called from any thread. |callback| is called on the
+    // shard thread. See SessionManager::collectStatistics.
+    void collectStatistics(size_t max_sessions, StatisticsCallback callback);
+
+    // Adds |session| to the sessions of |stat| if it is one of the |max_sessions| sessions with
+    // the highest throughput. The sessions of |stat| must be added only by this method.
+    static void addBusiestSession(const proto::RelayStat::Session& session,
+                                  size_t max_sessions,
+                                  proto::RelayStat* stat);
+
+protected:
+    // base::Thread::Delegate implementation.
+    void onBeforeThreadRunning() override;
+    void onAfterThreadRunning() override;
+
+    // PendingSession::Delegate implementation.
+    void onPendingSessionReady(PendingSession* session, const proto::PeerToRelay& message) override;
+    void onPendingSessionFailed(PendingSession* session) override;
+
+    // Session::Delegate implementation.
+    void onSessionFinished(Session* session) override;
+
+private:
+    using NativeHandle = asio::ip::tcp::socket::native_handle_type;
+
+    void addPendingSessionImpl(uint64_t session_id,
+                               std::shared_ptr<asio::ip::tcp::socket> socket);
+    void removePendingSessionImpl(uint64_t session_id);
+    asio::ip::tcp::socket takePendingSocket(uint64_t session_id);
+    void startSessionImpl(uint64_t first_id, uint64_t second_id);
+    void moveSessionImpl(uint64_t session_id, SessionShard* target, uint64_t target_session_id);
+    void startMovedSession(uint64_t session_id, asio::ip::tcp protocol, NativeHandle handle);
+    void createSession(asio::ip::tcp::socket&& first, asio::ip::tcp::socket&& second);
+    void collectStatisticsImpl(size_t max_sessions, const StatisticsCallback& callback);
+    void removeSession(Session* session, const Session::TimePoint& current_time);
+    void scheduleIdleCheck(Session* session, const Session::TimePoint& current_time);
+    void doIdleTimeout(const std::error_code& error_code);
+    void startIdleTimer();
+
+    const int index_;
+    const std::chrono::minutes idle_timeout_;
+    const Session::Options session_options_;
+    std::shared_ptr<SharedTokenBucket> global_rate_limiter_;
+    Delegate* delegate_;
+
+    // Buffers are shared between all sessions of the shard.
+    BufferPool buffer_pool_;
+
+    std::unique_ptr<base::Thread> thread_;
+    std::shared_ptr<base::TaskRunner> task_runner_;
+    asio::io_context* io_context_ = nullptr;
+    std::unique_ptr<asio::high_resolution_timer> idle_timer_;
+
+    std::unordered_map<uint64_t, std::unique_ptr<PendingSession>> pending_sessions_;
+
+    struct SessionEntry
+    {
+        std::unique_ptr<Session> session;
+        size_t idle_slot; // Slot of |idle_wheel_| which contains the session.
+    };
+
+    std::unordered_map<Session*, SessionEntry> sessions_;
+    std::atomic_size_t session_count_ { 0 };
+
+    // Timer wheel for idle timeout checks. Each slot corresponds to one tick of the idle timer.
+    // A session is checked only in the slot where its idle timeout can expire. If the session was
+    // active since that moment, it is moved to a later slot.
+    std::vector<std::unordered_set<Session*>> idle_wheel_;
+    size_t idle_wheel_pos_ = 0;
+
+    // Counters of sessions that have already finished.
+    proto::RelayStat finished_stat_;
+
+    DISALLOW_COPY_AND_ASSIGN(SessionShard);
+};
+
+} // namespace relay
+
+#endif // RELAY__SESSION_SHARD_H
@@ -0,0 +1,323 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "relay/session.h"
+
+#include "base/message_loop/message_loop.h"
+#include "base/message_loop/message_pump_asio.h"
+#include "base/task_runner.h"
+
+#include <asio/read.hpp>
+#include <asio/write.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#if defined(OS_WIN)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include <gtest/gtest.h>
+
+namespace relay {
+
+namespace {
+
+const size_t kChunkSize = 256 * 1024;
+
+class TestDelegate : public Session::Delegate
+{
+public:
+    TestDelegate() = default;
+    ~TestDelegate() override = default;
+
+    bool isFinished() const { return finished_; }
+
+    void onSessionFinished(Session* /* session */) override
+    {
+        finished_ = true;
+        base::MessageLoop::current()->taskRunner()->postQuit();
+    }
+
+private:
+    bool finished_ = false;
+
+    DISALLOW_COPY_AND_ASSIGN(TestDelegate);
+};
+
+// CPU time used by the calling thread.
+std::chrono::microseconds threadCpuTime()
+{
+#if defined(OS_WIN)
+    FILETIME creation_time, exit_time, kernel_time, user_time;
+    if (!GetThreadTimes(GetCurrentThread(), &creation_time, &exit_time, &kernel_time, &user_time))
+        return std::chrono::microseconds::zero();
+
+    auto to_100ns = [](const FILETIME& time)
+    {
+        return (static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+    };
+
+    return std::chrono::microseconds((to_100ns(kernel_time) + to_100ns(user_time)) / 10);
+#else
+    timespec time;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0)
+        return std::chrono::microseconds::zero();
+
+    return std::chrono::microseconds(
+        static_cast<int64_t>(time.tv_sec) * 1000000 + time.tv_nsec / 1000);
+#endif
+}
+
+std::vector<uint8_t> randomData(size_t size)
+{
+    std::mt19937 engine(size);
+    std::vector<uint8_t> data(size);
+
+    for (auto& byte : data)
+        byte = static_cast<uint8_t>(engine());
+
+    return data;
+}
+
+// Peers are connected to the relay through the loopback interface. The peers use blocking sockets
+// in their own threads. The relay session runs in the message loop of the calling thread.
+class Peers
+{
+public:
+    explicit Peers(asio::io_context& relay_io_context)
+        : first_(peer_io_context_),
+          second_(peer_io_context_),
+          relay_first_(relay_io_context),
+          relay_second_(relay_io_context)
+    {
+        asio::ip::tcp::acceptor acceptor(
+            relay_io_context, asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), 0));
+
+        first_.connect(acceptor.local_endpoint());
+        acceptor.accept(relay_first_);
+
+        second_.connect(acceptor.local_endpoint());
+        acceptor.accept(relay_second_);
+    }
+
+    asio::ip::tcp::socket& first() { return first_; }
+    asio::ip::tcp::socket& second() { return second_; }
+
+    std::pair<asio::ip::tcp::socket, asio::ip::tcp::socket> relaySockets()
+    {
+        return std::make_pair(std::move(relay_first_), std::move(relay_second_));
+    }
+
+private:
+    asio::io_context peer_io_context_;
+    asio::ip::tcp::socket first_;
+    asio::ip::tcp::socket second_;
+    asio::ip::tcp::socket relay_first_;
+    asio::ip::tcp::socket relay_second_;
+
+    DISALLOW_COPY_AND_ASSIGN(Peers);
+};
+
+void writeData(asio::ip::tcp::socket* socket, const std::vector<uint8_t>& data)
+{
+    std::error_code error_code;
+    asio::write(*socket, asio::buffer(data), error_code);
+    EXPECT_FALSE(error_code);
+}
+
+void readData(asio::ip::tcp::socket* socket, std::vector<uint8_t>* data)
+{
+    std::error_code error_code;
+    asio::read(*socket, asio::buffer(*data), error_code);
+    EXPECT_FALSE(error_code);
+}
+
+struct BenchmarkResult
+{
+    double gbit_per_second;
+    double cpu_seconds_per_gigabyte;
+};
+
+// Sends |size| bytes from the first peer to the second one through the relay session.
+BenchmarkResult forward(const Session::Options& options, uint64_t size)
+{
+    base::MessageLoop message_loop(base::MessageLoop::Type::ASIO);
+
+    Peers peers(message_loop.pumpAsio()->ioContext());
+
+    BufferPool buffer_pool;
+    TestDelegate delegate;
+    Session session(peers.relaySockets(), options, &buffer_pool, nullptr);
+
+    auto start_time = std::chrono::steady_clock::now();
+    auto start_cpu_time = threadCpuTime();
+
+    std::thread writer([&peers, size]()
+    {
+        std::vector<uint8_t> chunk(kChunkSize, 0x5A);
+        std::error_code error_code;
+
+        for (uint64_t written = 0; written < size && !error_code;)
+        {
+            size_t chunk_size = static_cast<size_t>(std::min<uint64_t>(kChunkSize, size - written));
+            written += asio::write(
+                peers.first(), asio::buffer(chunk.data(), chunk_size), error_code);
+        }
+
+        // The session is finished when the peer disconnects.
+        peers.first().shutdown(asio::socket_base::shutdown_send, error_code);
+    });
+
+    std::thread reader([&peers, size]()
+    {
+        std::vector<uint8_t> chunk(kChunkSize);
+        std::error_code error_code;
+        uint64_t received = 0;
+
+        while (!error_code)
+            received += peers.second().read_some(asio::buffer(chunk), error_code);
+
+        EXPECT_EQ(received, size);
+    });
+
+    session.start(&delegate);
+    message_loop.run();
+
+    auto cpu_time = threadCpuTime() - start_cpu_time;
+
+    writer.join();
+    reader.join();
+
+    auto duration = std::chrono::steady_clock::now() - start_time;
+
+    EXPECT_TRUE(delegate.isFinished());
+    EXPECT_EQ(session.bytesTransferred(), static_cast<int64_t>(size));
+
+    double seconds = std::chrono::duration<double>(duration).count();
+    double gigabytes = static_cast<double>(size) / 1e9;
+
+    BenchmarkResult result;
+    result.gbit_per_second = gigabytes * 8 / seconds;
+    result.cpu_seconds_per_gigabyte =
+        std::chrono::duration<double>(cpu_time).count() / gigabytes;
+    return result;
+}
+
+void forwardInBothDirections(const Session::Options& options)
+{
+    static const size_t kDataSize = 8 * 1024 * 1024 + 123;
+
+    base::MessageLoop message_loop(base::MessageLoop::Type::ASIO);
+
+    Peers peers(message_loop.pumpAsio()->ioContext());
+
+    BufferPool buffer_pool;
+    TestDelegate delegate;
+    Session session(peers.relaySockets(), options, &buffer_pool, nullptr);
+
+    const std::vector<uint8_t> first_data = randomData(kDataSize);
+    const std::vector<uint8_t> second_data = randomData(kDataSize / 2);
+    std::vector<uint8_t> first_received(second_data.size());
+    std::vector<uint8_t> second_received(first_data.size());
+
+    // Each peer writes and reads at the same time, so that neither direction is blocked by a full
+    // receive buffer of the other one.
+    std::thread peer_threads[] =
+    {
+        std::thread(writeData, &peers.first(), std::cref(first_data)),
+        std::thread(writeData, &peers.second(), std::cref(second_data)),
+        std::thread(readData, &peers.first(), &first_received),
+        std::thread(readData, &peers.second(), &second_received)
+    };
+
+    std::thread closer([&]()
+    {
+        for (auto& thread : peer_threads)
+            thread.join();
+
+        // All data is received. The session is finished when a peer disconnects.
+        std::error_code ignored_code;
+        peers.first().shutdown(asio::socket_base::shutdown_send, ignored_code);
+    });
+
+    session.start(&delegate);
+    message_loop.run();
+
+    closer.join();
+
+    EXPECT_TRUE(delegate.isFinished());
+    EXPECT_TRUE(first_received == second_data);
+    EXPECT_TRUE(second_received == first_data);
+    EXPECT_EQ(session.bytesTransferred(),
+              static_cast<int64_t>(first_data.size() + second_data.size()));
+}
+
+} // namespace
+
+TEST(relay_session_test, forward)
+{
+    forwardInBothDirections(Session::Options());
+}
+
+#if defined(OS_LINUX)
+TEST(relay_session_test, forward_kernel)
+{
+    Session::Options options;
+    options.kernel_forwarding = true;
+
+    forwardInBothDirections(options);
+}
+#endif // defined(OS_LINUX)
+
+TEST(relay_session_test, DISABLED_benchmark)
+{
+    static const uint64_t kDataSize = 4ULL * 1024 * 1024 * 1024;
+
+    struct Mode
+    {
+        const char* name;
+        bool kernel_forwarding;
+    };
+
+    static const Mode kModes[] =
+    {
+        { "user space copy", false },
+#if defined(OS_LINUX)
+        { "splice", true },
+#endif // defined(OS_LINUX)
+    };
+
+    for (const auto& mode : kModes)
+    {
+        Session::Options options;
+        options.kernel_forwarding = mode.kernel_forwarding;
+
+        BenchmarkResult result = forward(options, kDataSize);
+
+        std::cout << "Forwarding (" << mode.name << "): " << result.gbit_per_second
+                  << " Gbit/s, relay thread CPU " << result.cpu_seconds_per_gigabyte
+                  << " s per GB" << std::endl;
+    }
+}
+
+} // namespace relay
@@ -19,14 +19,21 @@
 #include "relay/sessions_worker.h"
 
 #include "base/logging.h"
+#include "base/task_runner.h"
 
 namespace relay {
 
 SessionsWorker::SessionsWorker(uint16_t peer_port,
                                const std::chrono::minutes& peer_idle_timeout,
+                               const Session::Options& session_options,
+                               uint32_t relay_rate_limit,
+                               uint32_t worker_thread_count,
                                std::unique_ptr<SharedPool> shared_pool)
     : peer_port_(peer_port),
       peer_idle_timeout_(peer_idle_timeout),
+      session_options_(session_options),
+      relay_rate_limit_(relay_rate_limit),
+      worker_thread_count_(worker_thread_count),
       shared_pool_(std::move(shared_pool)),
       thread_(std::make_unique<base::Thread>())
 {
@@ -50,13 +57,31 @@ void SessionsWorker::start(std::shared_ptr<base::TaskRunner> caller_task_runner,
     thread_->start(base::MessageLoop::Type::ASIO, this);
 }
 
+void SessionsWorker::collectStatistics(
+    size_t max_sessions, SessionManager::StatisticsCallback callback)
+{
+    if (!self_task_runner_->belongsToCurrentThread())
+    {
+        self_task_runner_->postTask(std::bind(
+            &SessionsWorker::collectStatistics, this, max_sessions, std::move(callback)));
+        return;
+    }
+
+    session_manager_->collectStatistics(max_sessions,
+        [this, callback](std::shared_ptr<proto::RelayStat> stat)
+    {
+        caller_task_runner_->postTask(std::bind(callback, std::move(stat)));
+    });
+}
+
 void SessionsWorker::onBeforeThreadRunning()
 {
     self_task_runner_ = thread_->taskRunner();
     DCHECK(self_task_runner_);
 
     session_manager_ = std::make_unique<SessionManager>(
-        self_task_runner_, peer_port_, peer_idle_timeout_);
+        self_task_runner_, peer_port_, peer_idle_timeout_, session_options_,
+        relay_rate_limit_, worker_thread_count_);
     session_manager_->start(std::move(shared_pool_), this);
 }
 
@@ -33,12 +33,19 @@ class SessionsWorker
 public:
     SessionsWorker(uint16_t peer_port,
                    const std::chrono::minutes& peer_idle_timeout,
+                   const Session::Options& session_options,
+                   uint32_t relay_rate_limit,
+                   uint32_t worker_thread_count,
                    std::unique_ptr<SharedPool> shared_pool);
     ~SessionsWorker();
 
     void start(std::shared_ptr<base::TaskRunner> caller_task_runner,
                SessionManager::Delegate* delegate);
 
+    // Collects statistics of the sessions. |callback| is called on the caller thread.
+    // See SessionManager::collectStatistics.
+    void collectStatistics(size_t max_sessions, SessionManager::StatisticsCallback callback);
+
 protected:
     // base::Thread::Delegate implementation.
     void onBeforeThreadRunning() override;
@@ -50,6 +57,9 @@ protected:
 private:
     const uint16_t peer_port_;
     const std::chrono::minutes peer_idle_timeout_;
+    const Session::Options session_options_;
+    const uint32_t relay_rate_limit_;
+    const uint32_t worker_thread_count_;
 
     std::unique_ptr<SharedPool> shared_pool_;
 
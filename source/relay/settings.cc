@@ -54,6 +54,14 @@ void Settings::reset()
     setPeerPort(DEFAULT_RELAY_PEER_TCP_PORT);
     setPeerIdleTimeout(std::chrono::minutes(5));
     setMaxPeerCount(100);
+    setKernelForwardingEnabled(false);
+    setWorkerThreadCount(0);
+    setPeerSendBufferSize(0);
+    setPeerReceiveBufferSize(0);
+    setStatisticsInterval(std::chrono::seconds(60));
+    setStatisticsSessionCount(0);
+    setSessionRateLimit(0);
+    setRelayRateLimit(0);
     setMinLogLevel(1);
 }
 
@@ -132,6 +140,86 @@ uint32_t Settings::maxPeerCount() const
     return impl_.get<uint32_t>("MaxPeerCount", 100);
 }
 
+void Settings::setKernelForwardingEnabled(bool enable)
+{
+    impl_.set<bool>("KernelForwarding", enable);
+}
+
+bool Settings::isKernelForwardingEnabled() const
+{
+    return impl_.get<bool>("KernelForwarding", false);
+}
+
+void Settings::setWorkerThreadCount(uint32_t count)
+{
+    impl_.set<uint32_t>("WorkerThreads", count);
+}
+
+uint32_t Settings::workerThreadCount() const
+{
+    return impl_.get<uint32_t>("WorkerThreads", 0);
+}
+
+void Settings::setPeerSendBufferSize(uint32_t size)
+{
+    impl_.set<uint32_t>("PeerSendBufferSize", size);
+}
+
+uint32_t Settings::peerSendBufferSize() const
+{
+    return impl_.get<uint32_t>("PeerSendBufferSize", 0);
+}
+
+void Settings::setPeerReceiveBufferSize(uint32_t size)
+{
+    impl_.set<uint32_t>("PeerReceiveBufferSize", size);
+}
+
+uint32_t Settings::peerReceiveBufferSize() const
+{
+    return impl_.get<uint32_t>("PeerReceiveBufferSize", 0);
+}
+
+void Settings::setStatisticsInterval(const std::chrono::seconds& interval)
+{
+    impl_.set<int>("StatisticsInterval", static_cast<int>(interval.count()));
+}
+
+std::chrono::seconds Settings::statisticsInterval() const
+{
+    return std::chrono::seconds(impl_.get<int>("StatisticsInterval", 60));
+}
+
+void Settings::setStatisticsSessionCount(uint32_t count)
+{
+    impl_.set<uint32_t>("StatisticsSessionCount", count);
+}
+
+uint32_t Settings::statisticsSessionCount() const
+{
+    return impl_.get<uint32_t>("StatisticsSessionCount", 0);
+}
+
+void Settings::setSessionRateLimit(uint32_t rate)
+{
+    impl_.set<uint32_t>("SessionRateLimit", rate);
+}
+
+uint32_t Settings::sessionRateLimit() const
+{
+    return impl_.get<uint32_t>("SessionRateLimit", 0);
+}
+
+void Settings::setRelayRateLimit(uint32_t rate)
+{
+    impl_.set<uint32_t>("RelayRateLimit", rate);
+}
+
+uint32_t Settings::relayRateLimit() const
+{
+    return impl_.get<uint32_t>("RelayRateLimit", 0);
+}
+
 void Settings::setMinLogLevel(int level)
 {
     impl_.set<int>("MinLogLevel", level);
@@ -57,6 +57,44 @@ public:
     void setMaxPeerCount(uint32_t count);
     uint32_t maxPeerCount() const;
 
+    // If enabled, data between peers is transferred inside the kernel without copying to user
+    // space (only supported on Linux, on other platforms the setting is ignored).
+    void setKernelForwardingEnabled(bool enable);
+    bool isKernelForwardingEnabled() const;
+
+    // Number of threads that transfer data between peers. If 0, the number of threads is equal
+    // to the number of processor cores.
+    void setWorkerThreadCount(uint32_t count);
+    uint32_t workerThreadCount() const;
+
+    // Sizes of socket send and receive buffers for peer connections. If 0, the system default
+    // is used.
+    void setPeerSendBufferSize(uint32_t size);
+    uint32_t peerSendBufferSize() const;
+
+    void setPeerReceiveBufferSize(uint32_t size);
+    uint32_t peerReceiveBufferSize() const;
+
+    // Interval for collecting statistics. Statistics are sent to the router and written to the
+    // log. If 0, statistics are not collected.
+    void setStatisticsInterval(const std::chrono::seconds& interval);
+    std::chrono::seconds statisticsInterval() const;
+
+    // Number of the sessions with the highest throughput whose statistics are sent to the router
+    // and written to the log. If 0, only the statistics of the whole relay are sent.
+    void setStatisticsSessionCount(uint32_t count);
+    uint32_t statisticsSessionCount() const;
+
+    // Maximum data transfer rate of one session in bytes per second. If 0, the rate is not
+    // limited.
+    void setSessionRateLimit(uint32_t rate);
+    uint32_t sessionRateLimit() const;
+
+    // Maximum total data transfer rate of all sessions in bytes per second. If 0, the rate is not
+    // limited.
+    void setRelayRateLimit(uint32_t rate);
+    uint32_t relayRateLimit() const;
+
     void setMinLogLevel(int level);
     int minLogLevel() const;
 
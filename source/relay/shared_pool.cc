@@ -20,7 +20,10 @@
 
 #include "base/logging.h"
 
+#include <array>
+#include <atomic>
 #include <mutex>
+#include <unordered_map>
 
 namespace relay {
 
@@ -39,11 +42,23 @@ public:
     void clear();
 
 private:
+    // Keys are distributed between several stripes by the key identifier, each with its own lock.
+    // The lock is held only to find a key. The session key is derived outside the lock.
+    static const size_t kStripeCount = 16;
+
+    struct Stripe
+    {
+        mutable std::mutex lock;
+        std::unordered_map<uint32_t, std::shared_ptr<const SessionKey>> map;
+    };
+
+    Stripe& stripe(uint32_t key_id) { return stripes_[key_id % kStripeCount]; }
+    const Stripe& stripe(uint32_t key_id) const { return stripes_[key_id % kStripeCount]; }
+
     Delegate* delegate_;
 
-    mutable std::mutex pool_lock_;
-    std::map<uint32_t, SessionKey> map_;
-    uint32_t current_key_id_ = 0;
+    std::array<Stripe, kStripeCount> stripes_;
+    std::atomic_uint32_t current_key_id_ { 0 };
 
     DISALLOW_COPY_AND_ASSIGN(Pool);
 };
@@ -61,10 +76,13 @@ void SharedPool::Pool::dettach()
 
 uint32_t SharedPool::Pool::addKey(SessionKey&& session_key)
 {
-    std::scoped_lock lock(pool_lock_);
-
     uint32_t key_id = current_key_id_++;
-    map_.emplace(key_id, std::move(session_key));
+    Stripe& key_stripe = stripe(key_id);
+
+    {
+        std::scoped_lock lock(key_stripe.lock);
+        key_stripe.map.emplace(key_id, std::make_shared<const SessionKey>(std::move(session_key)));
+    }
 
     LOG(LS_INFO) << "Key with id " << key_id << " added to pool";
     return key_id;
@@ -72,12 +90,13 @@ uint32_t SharedPool::Pool::addKey(SessionKey&& session_key)
 
 bool SharedPool::Pool::removeKey(uint32_t key_id)
 {
-    std::scoped_lock lock(pool_lock_);
+    Stripe& key_stripe = stripe(key_id);
+    std::scoped_lock lock(key_stripe.lock);
 
-    auto result = map_.find(key_id);
-    if (result != map_.end())
+    auto result = key_stripe.map.find(key_id);
+    if (result != key_stripe.map.end())
     {
-        map_.erase(result);
+        key_stripe.map.erase(result);
 
         LOG(LS_INFO) << "Key with id " << key_id << " removed from pool";
         return true;
@@ -100,22 +119,31 @@ void SharedPool::Pool::setKeyExpired(uint32_t key_id)
 std::optional<SharedPool::Key> SharedPool::Pool::key(
     uint32_t key_id, std::string_view peer_public_key) const
 {
-    std::scoped_lock lock(pool_lock_);
+    std::shared_ptr<const SessionKey> session_key;
+
+    {
+        const Stripe& key_stripe = stripe(key_id);
+        std::scoped_lock lock(key_stripe.lock);
 
-    auto result = map_.find(key_id);
-    if (result == map_.end())
-        return std::nullopt;
+        auto result = key_stripe.map.find(key_id);
+        if (result == key_stripe.map.end())
+            return std::nullopt;
 
-    const SessionKey& session_key = result->second;
-    return std::make_pair(session_key.sessionKey(peer_public_key), session_key.iv());
+        session_key = result->second;
+    }
+
+    return std::make_pair(session_key->sessionKey(peer_public_key), session_key->iv());
 }
 
 void SharedPool::Pool::clear()
 {
-    std::scoped_lock lock(pool_lock_);
+    for (auto& key_stripe : stripes_)
+    {
+        std::scoped_lock lock(key_stripe.lock);
+        key_stripe.map.clear();
+    }
 
     LOG(LS_INFO) << "Key pool cleared";
-    map_.clear();
 }
 
 SharedPool::SharedPool(Delegate* delegate)
@@ -0,0 +1,103 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "relay/token_bucket.h"
+
+#include "base/logging.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace relay {
+
+TokenBucket::TokenBucket(uint32_t rate, size_t capacity)
+    : rate_(static_cast<double>(rate)),
+      capacity_(static_cast<double>(capacity)),
+      tokens_(static_cast<double>(capacity)),
+      last_refill_time_(Clock::now())
+{
+    DCHECK_GT(rate, 0u);
+    DCHECK_GT(capacity, 0u);
+}
+
+TokenBucket::~TokenBucket() = default;
+
+size_t TokenBucket::available(const TimePoint& now)
+{
+    refill(now);
+
+    if (tokens_ < 1.0)
+        return 0;
+
+    return static_cast<size_t>(tokens_);
+}
+
+void TokenBucket::consume(size_t bytes)
+{
+    tokens_ -= static_cast<double>(bytes);
+}
+
+std::chrono::milliseconds TokenBucket::delay(size_t bytes, const TimePoint& now)
+{
+    refill(now);
+
+    double missing = static_cast<double>(bytes) - tokens_;
+    if (missing <= 0)
+        return std::chrono::milliseconds(0);
+
+    return std::chrono::milliseconds(static_cast<int64_t>(std::ceil(missing * 1000.0 / rate_)));
+}
+
+void TokenBucket::refill(const TimePoint& now)
+{
+    if (now <= last_refill_time_)
+        return;
+
+    std::chrono::duration<double> elapsed = now - last_refill_time_;
+    last_refill_time_ = now;
+
+    tokens_ = std::min(capacity_, tokens_ + elapsed.count() * rate_);
+}
+
+SharedTokenBucket::SharedTokenBucket(uint32_t rate, size_t capacity)
+    : bucket_(rate, capacity)
+{
+    // Nothing
+}
+
+SharedTokenBucket::~SharedTokenBucket() = default;
+
+size_t SharedTokenBucket::available(const TokenBucket::TimePoint& now)
+{
+    std::scoped_lock lock(lock_);
+    return bucket_.available(now);
+}
+
+void SharedTokenBucket::consume(size_t bytes)
+{
+    std::scoped_lock lock(lock_);
+    bucket_.consume(bytes);
+}
+
+std::chrono::milliseconds SharedTokenBucket::delay(size_t bytes, const TokenBucket::TimePoint& now)
+{
+    std::scoped_lock lock(lock_);
+    return bucket_.delay(bytes, now);
+}
+
+} // namespace relay
@@ -0,0 +1,82 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef RELAY__TOKEN_BUCKET_H
+#define RELAY__TOKEN_BUCKET_H
+
+#include "base/macros_magic.h"
+
+#include <chrono>
+#include <mutex>
+
+namespace relay {
+
+// Limits the data transfer rate. Tokens (bytes) are added to the bucket at a constant rate up to
+// the bucket capacity. The class is not thread safe.
+class TokenBucket
+{
+public:
+    using Clock = std::chrono::high_resolution_clock;
+    using TimePoint = std::chrono::time_point<Clock>;
+
+    // |rate| is in bytes per second. |capacity| is the maximum burst size in bytes.
+    TokenBucket(uint32_t rate, size_t capacity);
+    ~TokenBucket();
+
+    // Returns the number of bytes that can be transferred at the moment |now|.
+    size_t available(const TimePoint& now);
+
+    // Removes |bytes| from the bucket. More bytes than available can be consumed. In this case the
+    // next bytes will become available later.
+    void consume(size_t bytes);
+
+    // Returns the time after which |bytes| will be available.
+    std::chrono::milliseconds delay(size_t bytes, const TimePoint& now);
+
+private:
+    void refill(const TimePoint& now);
+
+    const double rate_;
+    const double capacity_;
+    double tokens_;
+    TimePoint last_refill_time_;
+
+    DISALLOW_COPY_AND_ASSIGN(TokenBucket);
+};
+
+// Same as TokenBucket, but can be used from multiple threads at the same time.
+class SharedTokenBucket
+{
+public:
+    SharedTokenBucket(uint32_t rate, size_t capacity);
+    ~SharedTokenBucket();
+
+    size_t available(const TokenBucket::TimePoint& now);
+    void consume(size_t bytes);
+    std::chrono::milliseconds delay(size_t bytes, const TokenBucket::TimePoint& now);
+
+private:
+    std::mutex lock_;
+    TokenBucket bucket_;
+
+    DISALLOW_COPY_AND_ASSIGN(SharedTokenBucket);
+};
+
+} // namespace relay
+
+#endif // RELAY__TOKEN_BUCKET_H
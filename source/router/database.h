@@ -22,6 +22,8 @@
 #include "base/peer/host_id.h"
 #include "base/peer/user_list.h"
 
+#include <functional>
+
 namespace router {
 
 class Database
@@ -42,7 +44,19 @@ public:
     virtual bool removeUser(int64_t entry_id) = 0;
     virtual base::User findUser(std::u16string_view username) = 0;
     virtual ErrorCode hostId(const base::ByteArray& key_hash, base::HostId* host_id) const = 0;
-    virtual bool addHost(const base::ByteArray& key_hash) = 0;
+
+    // Adds a host with |key_hash|. |callback| is called with the ID of the host after the host is
+    // committed to the database, or with base::kInvalidHostId if it could not be added. The
+    // callback can be called in any thread, including the calling thread before the method
+    // returns.
+    using AddHostCallback = std::function<void(base::HostId host_id)>;
+    virtual void addHost(const base::ByteArray& key_hash, AddHostCallback callback) = 0;
+
+    // Calls |callback| for each host in the database. The enumeration stops if |callback| returns
+    // false.
+    using HostCallback =
+        std::function<bool(const base::ByteArray& key_hash, base::HostId host_id)>;
+    virtual bool hostList(const HostCallback& callback) const = 0;
 };
 
 } // namespace router
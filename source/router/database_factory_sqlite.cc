@@ -22,7 +22,11 @@
 
 namespace router {
 
-DatabaseFactorySqlite::DatabaseFactorySqlite() = default;
+DatabaseFactorySqlite::DatabaseFactorySqlite(std::shared_ptr<base::TaskRunner> task_runner)
+    : task_runner_(std::move(task_runner))
+{
+    // Nothing
+}
 
 DatabaseFactorySqlite::~DatabaseFactorySqlite() = default;
 
@@ -33,7 +37,7 @@ std::unique_ptr<Database> DatabaseFactorySqlite::createDatabase() const
 
 std::unique_ptr<Database> DatabaseFactorySqlite::openDatabase() const
 {
-    return DatabaseSqlite::open();
+    return DatabaseSqlite::open(task_runner_);
 }
 
 } // namespace router
@@ -22,18 +22,26 @@
 #include "base/macros_magic.h"
 #include "router/database_factory.h"
 
+namespace base {
+class TaskRunner;
+} // namespace base
+
 namespace router {
 
 class DatabaseFactorySqlite : public DatabaseFactory
 {
 public:
-    DatabaseFactorySqlite();
+    // If |task_runner| is specified, the opened databases commit added hosts in batches
+    // (see DatabaseSqlite::open).
+    explicit DatabaseFactorySqlite(std::shared_ptr<base::TaskRunner> task_runner = nullptr);
     ~DatabaseFactorySqlite();
 
     std::unique_ptr<Database> createDatabase() const override;
     std::unique_ptr<Database> openDatabase() const override;
 
 private:
+    std::shared_ptr<base::TaskRunner> task_runner_;
+
     DISALLOW_COPY_AND_ASSIGN(DatabaseFactorySqlite);
 };
 
@@ -0,0 +1,195 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "router/database_host_index.h"
+
+#include "base/logging.h"
+
+#include <cstring>
+
+namespace router {
+
+DatabaseHostIndex::DatabaseHostIndex(std::unique_ptr<Database> database, size_t memory_limit)
+    : database_(std::move(database)),
+      memory_limit_(memory_limit)
+{
+    DCHECK(database_);
+}
+
+DatabaseHostIndex::~DatabaseHostIndex()
+{
+    // The database can commit the last hosts when it is closed. Their callbacks use the index.
+    database_.reset();
+}
+
+bool DatabaseHostIndex::load()
+{
+    std::unique_lock lock(lock_);
+
+    hosts_.clear();
+    complete_ = true;
+
+    bool result = database_->hostList([this](const base::ByteArray& key_hash, base::HostId host_id)
+    {
+        // If the memory limit is reached, then there is no point in continuing.
+        return insert(key_hash, host_id);
+    });
+
+    if (!result)
+    {
+        LOG(LS_ERROR) << "Unable to load hosts from the database";
+        hosts_.clear();
+        complete_ = false;
+        return false;
+    }
+
+    LOG(LS_INFO) << "Hosts in the index: " << hosts_.size() << " (complete: " << complete_ << ")";
+    return true;
+}
+
+size_t DatabaseHostIndex::hostCount() const
+{
+    std::shared_lock lock(lock_);
+    return hosts_.size();
+}
+
+bool DatabaseHostIndex::isComplete() const
+{
+    std::shared_lock lock(lock_);
+    return complete_;
+}
+
+std::vector<base::User> DatabaseHostIndex::userList() const
+{
+    return database_->userList();
+}
+
+bool DatabaseHostIndex::addUser(const base::User& user)
+{
+    return database_->addUser(user);
+}
+
+bool DatabaseHostIndex::modifyUser(const base::User& user)
+{
+    return database_->modifyUser(user);
+}
+
+bool DatabaseHostIndex::removeUser(int64_t entry_id)
+{
+    return database_->removeUser(entry_id);
+}
+
+base::User DatabaseHostIndex::findUser(std::u16string_view username)
+{
+    return database_->findUser(username);
+}
+
+Database::ErrorCode DatabaseHostIndex::hostId(
+    const base::ByteArray& key_hash, base::HostId* host_id) const
+{
+    if (key_hash.size() != kKeyHashSize || !host_id)
+        return database_->hostId(key_hash, host_id);
+
+    KeyHash key;
+    memcpy(key.data(), key_hash.data(), key.size());
+
+    {
+        std::shared_lock lock(lock_);
+
+        auto it = hosts_.find(key);
+        if (it != hosts_.end())
+        {
+            *host_id = it->second;
+            return ErrorCode::SUCCESS;
+        }
+
+        if (complete_)
+        {
+            // All hosts are in the index. There is no such host in the database either.
+            *host_id = base::kInvalidHostId;
+            return ErrorCode::NO_HOST_FOUND;
+        }
+    }
+
+    return database_->hostId(key_hash, host_id);
+}
+
+void DatabaseHostIndex::addHost(const base::ByteArray& key_hash, AddHostCallback callback)
+{
+    DCHECK(callback);
+
+    // The host is added to the index only after it is committed to the database. A host that is
+    // rolled back must not remain in the index.
+    database_->addHost(key_hash, [this, key_hash, callback](base::HostId host_id)
+    {
+        if (host_id != base::kInvalidHostId)
+        {
+            std::unique_lock lock(lock_);
+            insert(key_hash, host_id);
+        }
+
+        callback(host_id);
+    });
+}
+
+bool DatabaseHostIndex::hostList(const HostCallback& callback) const
+{
+    return database_->hostList(callback);
+}
+
+size_t DatabaseHostIndex::KeyHashHasher::operator()(const KeyHash& key_hash) const
+{
+    // The key is a cryptographic hash, so any part of it is evenly distributed.
+    size_t result;
+    memcpy(&result, key_hash.data(), sizeof(result));
+    return result;
+}
+
+bool DatabaseHostIndex::insert(const base::ByteArray& key_hash, base::HostId host_id)
+{
+    if (key_hash.size() != kKeyHashSize)
+    {
+        LOG(LS_ERROR) << "Invalid key hash size: " << key_hash.size();
+        complete_ = false;
+        return true;
+    }
+
+    // Approximate memory usage for one host in the index: the key, the value, the pointer to the
+    // next node, the cached hash and the bucket.
+    constexpr size_t kEntrySize = sizeof(KeyHash) + sizeof(base::HostId) + sizeof(void*) * 3;
+
+    if ((hosts_.size() + 1) * kEntrySize > memory_limit_)
+    {
+        if (complete_)
+        {
+            LOG(LS_WARNING) << "Host index memory limit reached (" << hosts_.size()
+                            << " hosts). Other hosts will be looked up in the database";
+        }
+
+        complete_ = false;
+        return false;
+    }
+
+    KeyHash key;
+    memcpy(key.data(), key_hash.data(), key.size());
+
+    hosts_.insert_or_assign(key, host_id);
+    return true;
+}
+
+} // namespace router
@@ -0,0 +1,86 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef ROUTER__DATABASE_HOST_INDEX_H
+#define ROUTER__DATABASE_HOST_INDEX_H
+
+#include "base/macros_magic.h"
+#include "router/database.h"
+
+#include <array>
+#include <shared_mutex>
+#include <unordered_map>
+
+namespace router {
+
+// Keeps the key hashes of the hosts in memory, so that a host ID lookup does not go to the disk.
+// Hosts are written through to the wrapped database. All other calls are forwarded to it as is.
+// If the hosts do not fit into the memory limit, the hosts that are not in the index are looked
+// up in the wrapped database.
+// The class is thread-safe if the wrapped database is thread-safe.
+class DatabaseHostIndex : public Database
+{
+public:
+    DatabaseHostIndex(std::unique_ptr<Database> database, size_t memory_limit);
+    ~DatabaseHostIndex();
+
+    // Loads the hosts from the wrapped database.
+    bool load();
+
+    size_t hostCount() const;
+
+    // Returns true if all hosts of the database are in the index.
+    bool isComplete() const;
+
+    // Database implementation.
+    std::vector<base::User> userList() const override;
+    bool addUser(const base::User& user) override;
+    bool modifyUser(const base::User& user) override;
+    bool removeUser(int64_t entry_id) override;
+    base::User findUser(std::u16string_view username) override;
+    ErrorCode hostId(const base::ByteArray& key_hash, base::HostId* host_id) const override;
+    void addHost(const base::ByteArray& key_hash, AddHostCallback callback) override;
+    bool hostList(const HostCallback& callback) const override;
+
+private:
+    // Size of BLAKE2b-512 hash.
+    static constexpr size_t kKeyHashSize = 64;
+
+    using KeyHash = std::array<uint8_t, kKeyHashSize>;
+
+    struct KeyHashHasher
+    {
+        size_t operator()(const KeyHash& key_hash) const;
+    };
+
+    // Must be called with |lock_| held exclusively.
+    bool insert(const base::ByteArray& key_hash, base::HostId host_id);
+
+    std::unique_ptr<Database> database_;
+    const size_t memory_limit_;
+
+    mutable std::shared_mutex lock_;
+    std::unordered_map<KeyHash, base::HostId, KeyHashHasher> hosts_;
+    bool complete_ = false;
+
+    DISALLOW_COPY_AND_ASSIGN(DatabaseHostIndex);
+};
+
+} // namespace router
+
+#endif // ROUTER__DATABASE_HOST_INDEX_H
@@ -0,0 +1,230 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "router/database_host_index.h"
+
+#include <map>
+
+#include <gtest/gtest.h>
+
+namespace router {
+
+namespace {
+
+const size_t kKeyHashSize = 64;
+const size_t kMemoryLimit = 1024 * 1024;
+
+base::ByteArray keyHash(uint8_t value)
+{
+    return base::ByteArray(kKeyHashSize, value);
+}
+
+// Keeps the hosts in memory. Added hosts are committed or rolled back on request.
+class FakeDatabase : public Database
+{
+public:
+    FakeDatabase() = default;
+    ~FakeDatabase() override = default;
+
+    size_t lookupCount() const { return lookup_count_; }
+    size_t pendingCount() const { return pending_.size(); }
+
+    void addCommittedHost(const base::ByteArray& key_hash)
+    {
+        hosts_.emplace(key_hash, ++last_host_id_);
+    }
+
+    void commit()
+    {
+        for (auto& host : pending_)
+        {
+            base::HostId host_id = ++last_host_id_;
+            hosts_.emplace(host.first, host_id);
+            host.second(host_id);
+        }
+        pending_.clear();
+    }
+
+    void rollback()
+    {
+        for (auto& host : pending_)
+            host.second(base::kInvalidHostId);
+        pending_.clear();
+    }
+
+    // Database implementation.
+    std::vector<base::User> userList() const override { return {}; }
+    bool addUser(const base::User& /* user */) override { return false; }
+    bool modifyUser(const base::User& /* user */) override { return false; }
+    bool removeUser(int64_t /* entry_id */) override { return false; }
+    base::User findUser(std::u16string_view /* username */) override { return base::User(); }
+
+    ErrorCode hostId(const base::ByteArray& key_hash, base::HostId* host_id) const override
+    {
+        ++lookup_count_;
+
+        auto it = hosts_.find(key_hash);
+        if (it == hosts_.end())
+            return ErrorCode::NO_HOST_FOUND;
+
+        *host_id = it->second;
+        return ErrorCode::SUCCESS;
+    }
+
+    void addHost(const base::ByteArray& key_hash, AddHostCallback callback) override
+    {
+        pending_.emplace_back(key_hash, std::move(callback));
+    }
+
+    bool hostList(const HostCallback& callback) const override
+    {
+        for (const auto& host : hosts_)
+        {
+            if (!callback(host.first, host.second))
+                break;
+        }
+        return true;
+    }
+
+private:
+    std::map<base::ByteArray, base::HostId> hosts_;
+    std::vector<std::pair<base::ByteArray, AddHostCallback>> pending_;
+    base::HostId last_host_id_ = 0;
+    mutable size_t lookup_count_ = 0;
+
+    DISALLOW_COPY_AND_ASSIGN(FakeDatabase);
+};
+
+} // namespace
+
+TEST(database_host_index_test, lookup)
+{
+    std::unique_ptr<FakeDatabase> database = std::make_unique<FakeDatabase>();
+    FakeDatabase* fake = database.get();
+
+    for (uint8_t i = 1; i <= 3; ++i)
+        fake->addCommittedHost(keyHash(i));
+
+    DatabaseHostIndex index(std::move(database), kMemoryLimit);
+    ASSERT_TRUE(index.load());
+    EXPECT_EQ(index.hostCount(), 3);
+    EXPECT_TRUE(index.isComplete());
+
+    base::HostId host_id = base::kInvalidHostId;
+    EXPECT_EQ(index.hostId(keyHash(2), &host_id), Database::ErrorCode::SUCCESS);
+    EXPECT_EQ(host_id, 2);
+
+    // All hosts are in the index, so an unknown host is not looked up in the database.
+    EXPECT_EQ(index.hostId(keyHash(4), &host_id), Database::ErrorCode::NO_HOST_FOUND);
+    EXPECT_EQ(host_id, base::kInvalidHostId);
+    EXPECT_EQ(fake->lookupCount(), 0);
+
+    // A key hash of an unexpected size is looked up in the database.
+    EXPECT_EQ(index.hostId(base::ByteArray(16, 1), &host_id), Database::ErrorCode::NO_HOST_FOUND);
+    EXPECT_EQ(fake->lookupCount(), 1);
+}
+
+TEST(database_host_index_test, memory_limit)
+{
+    std::unique_ptr<FakeDatabase> database = std::make_unique<FakeDatabase>();
+    FakeDatabase* fake = database.get();
+
+    for (uint8_t i = 1; i <= 10; ++i)
+        fake->addCommittedHost(keyHash(i));
+
+    // Only a few hosts fit into the limit.
+    DatabaseHostIndex index(std::move(database), 512);
+    ASSERT_TRUE(index.load());
+    EXPECT_LT(index.hostCount(), 10);
+    EXPECT_GT(index.hostCount(), 0);
+    EXPECT_FALSE(index.isComplete());
+
+    // The hosts that are not in the index are looked up in the database.
+    for (uint8_t i = 1; i <= 10; ++i)
+    {
+        base::HostId host_id = base::kInvalidHostId;
+        EXPECT_EQ(index.hostId(keyHash(i), &host_id), Database::ErrorCode::SUCCESS);
+        EXPECT_EQ(host_id, i);
+    }
+
+    EXPECT_EQ(fake->lookupCount(), 10 - index.hostCount());
+
+    base::HostId host_id = base::kInvalidHostId;
+    EXPECT_EQ(index.hostId(keyHash(11), &host_id), Database::ErrorCode::NO_HOST_FOUND);
+}
+
+TEST(database_host_index_test, host_added_after_commit)
+{
+    std::unique_ptr<FakeDatabase> database = std::make_unique<FakeDatabase>();
+    FakeDatabase* fake = database.get();
+
+    DatabaseHostIndex index(std::move(database), kMemoryLimit);
+    ASSERT_TRUE(index.load());
+
+    base::HostId added_host_id = base::kInvalidHostId;
+    bool called = false;
+
+    index.addHost(keyHash(1), [&](base::HostId host_id)
+    {
+        added_host_id = host_id;
+        called = true;
+    });
+
+    EXPECT_FALSE(called);
+    EXPECT_EQ(fake->pendingCount(), 1);
+
+    // The host is not in the index until it is committed.
+    base::HostId host_id = base::kInvalidHostId;
+    EXPECT_EQ(index.hostId(keyHash(1), &host_id), Database::ErrorCode::NO_HOST_FOUND);
+    EXPECT_EQ(index.hostCount(), 0);
+
+    fake->commit();
+    EXPECT_TRUE(called);
+    EXPECT_NE(added_host_id, base::kInvalidHostId);
+    EXPECT_EQ(index.hostCount(), 1);
+
+    EXPECT_EQ(index.hostId(keyHash(1), &host_id), Database::ErrorCode::SUCCESS);
+    EXPECT_EQ(host_id, added_host_id);
+    EXPECT_EQ(fake->lookupCount(), 0);
+}
+
+TEST(database_host_index_test, rolled_back_host_not_in_index)
+{
+    std::unique_ptr<FakeDatabase> database = std::make_unique<FakeDatabase>();
+    FakeDatabase* fake = database.get();
+
+    DatabaseHostIndex index(std::move(database), kMemoryLimit);
+    ASSERT_TRUE(index.load());
+
+    base::HostId added_host_id = 0;
+
+    index.addHost(keyHash(1), [&](base::HostId host_id)
+    {
+        added_host_id = host_id;
+    });
+
+    fake->rollback();
+    EXPECT_EQ(added_host_id, base::kInvalidHostId);
+    EXPECT_EQ(index.hostCount(), 0);
+    EXPECT_TRUE(index.isComplete());
+
+    base::HostId host_id = base::kInvalidHostId;
+    EXPECT_EQ(index.hostId(keyHash(1), &host_id), Database::ErrorCode::NO_HOST_FOUND);
+}
+
+} // namespace router
@@ -19,6 +19,7 @@
 #include "router/database_sqlite.h"
 
 #include "base/logging.h"
+#include "base/task_runner.h"
 #include "base/files/base_paths.h"
 #include "base/strings/unicode.h"
 #include "build/build_config.h"
@@ -29,6 +30,64 @@ namespace router {
 
 namespace {
 
+// Hosts are committed no later than this interval after the first host in a batch.
+constexpr std::chrono::milliseconds kCommitDelay{ 20 };
+
+// Maximum number of hosts in one transaction.
+constexpr size_t kMaxBatchSize = 256;
+
+const char* kQueries[] =
+{
+    // QUERY_USER_LIST
+    "SELECT * FROM users",
+
+    // QUERY_ADD_USER
+    "INSERT INTO users ('id', 'name', 'group', 'salt', 'verifier', 'sessions', 'flags') "
+    "VALUES (NULL, ?, ?, ?, ?, ?, ?)",
+
+    // QUERY_MODIFY_USER
+    "UPDATE users SET ('name', 'group', 'salt', 'verifier', 'sessions', 'flags') = "
+    "(?, ?, ?, ?, ?, ?) WHERE id=?",
+
+    // QUERY_REMOVE_USER
+    "DELETE FROM users WHERE id=?",
+
+    // QUERY_FIND_USER
+    "SELECT * FROM users WHERE name=?",
+
+    // QUERY_HOST_ID
+    "SELECT * FROM hosts WHERE key=?",
+
+    // QUERY_ADD_HOST
+    "INSERT INTO hosts ('id', 'key') VALUES (NULL, ?)",
+
+    // QUERY_HOST_LIST
+    "SELECT id, key FROM hosts"
+};
+
+// Prepares the cached statement for the next execution.
+void resetStatement(sqlite3_stmt* statement)
+{
+    sqlite3_reset(statement);
+    sqlite3_clear_bindings(statement);
+}
+
+bool execute(sqlite3* db, const char* sql)
+{
+    char* error_string = nullptr;
+
+    int error_code = sqlite3_exec(db, sql, nullptr, nullptr, &error_string);
+    if (error_code != SQLITE_OK)
+    {
+        LOG(LS_ERROR) << "sqlite3_exec failed: " << (error_string ? error_string : "")
+                      << " (" << error_code << ")";
+        sqlite3_free(error_string);
+        return false;
+    }
+
+    return true;
+}
+
 const char* columnTypeToString(int type)
 {
     switch (type)
@@ -249,14 +308,30 @@ std::optional<base::User> readUser(sqlite3_stmt* statement)
 
 } // namespace
 
-DatabaseSqlite::DatabaseSqlite(sqlite3* db)
-    : db_(db)
+DatabaseSqlite::DatabaseSqlite(sqlite3* db, std::shared_ptr<base::TaskRunner> task_runner)
+    : db_(db),
+      task_runner_(std::move(task_runner)),
+      self_(std::make_shared<DatabaseSqlite*>(this))
 {
+    static_assert(std::size(kQueries) == QUERY_COUNT);
+
     DCHECK(db_);
+    statements_.fill(nullptr);
 }
 
 DatabaseSqlite::~DatabaseSqlite()
 {
+    DCHECK(!task_runner_ || task_runner_->belongsToCurrentThread());
+
+    *self_ = nullptr;
+    commit();
+
+    for (auto& statement : statements_)
+    {
+        if (statement)
+            sqlite3_finalize(statement);
+    }
+
     sqlite3_close(db_);
 }
 
@@ -336,7 +411,7 @@ std::unique_ptr<DatabaseSqlite> DatabaseSqlite::create()
 }
 
 // static
-std::unique_ptr<DatabaseSqlite> DatabaseSqlite::open()
+std::unique_ptr<DatabaseSqlite> DatabaseSqlite::open(std::shared_ptr<base::TaskRunner> task_runner)
 {
     std::filesystem::path file_path = filePath();
     if (file_path.empty())
@@ -355,10 +430,56 @@ std::unique_ptr<DatabaseSqlite> DatabaseSqlite::open()
     {
         LOG(LS_WARNING) << "sqlite3_open failed: " << sqlite3_errstr(error_code)
                         << " (" << error_code << ")";
+        sqlite3_close(db);
         return nullptr;
     }
 
-    return std::unique_ptr<DatabaseSqlite>(new DatabaseSqlite(db));
+    std::unique_ptr<DatabaseSqlite> database(new DatabaseSqlite(db, std::move(task_runner)));
+
+    // Readers do not block the writer in WAL mode, and with synchronous=NORMAL a commit does not
+    // wait for fsync (the database is still consistent after a crash).
+    if (!execute(db, "PRAGMA journal_mode=WAL;"))
+        LOG(LS_WARNING) << "Unable to enable WAL mode";
+
+    execute(db, "PRAGMA synchronous=NORMAL;");
+    sqlite3_busy_timeout(db, 5000);
+
+    return database;
+}
+
+bool DatabaseSqlite::commit()
+{
+    CommittedHosts committed;
+    std::scoped_lock lock(lock_);
+    return doCommit(&committed);
+}
+
+bool DatabaseSqlite::doCommit(CommittedHosts* committed)
+{
+    DCHECK(committed->hosts.empty());
+
+    if (!in_transaction_)
+        return true;
+
+    in_transaction_ = false;
+    committed->hosts.swap(batch_hosts_);
+    committed->result = execute(db_, "COMMIT;");
+
+    if (!committed->result)
+    {
+        // No host has received the IDs of the batch yet, so the IDs can be reused safely.
+        LOG(LS_ERROR) << "Unable to commit " << committed->hosts.size() << " hosts";
+        execute(db_, "ROLLBACK;");
+        return false;
+    }
+
+    return true;
+}
+
+DatabaseSqlite::CommittedHosts::~CommittedHosts()
+{
+    for (auto& host : hosts)
+        host.callback(result ? host.host_id : base::kInvalidHostId);
 }
 
 // static
@@ -374,22 +495,16 @@ std::filesystem::path DatabaseSqlite::filePath()
 
 std::vector<base::User> DatabaseSqlite::userList() const
 {
-    const char kQuery[] = "SELECT * FROM users";
+    std::scoped_lock lock(lock_);
 
-    sqlite3_stmt* statement;
-    int error_code = sqlite3_prepare(db_, kQuery, std::size(kQuery), &statement, nullptr);
-    if (error_code != SQLITE_OK)
-    {
-        LOG(LS_ERROR) << "sqlite3_prepare failed: " << sqlite3_errstr(error_code)
-                      << " (" << error_code << ")";
+    sqlite3_stmt* statement = this->statement(QUERY_USER_LIST);
+    if (!statement)
         return std::vector<base::User>();
-    }
 
     std::vector<base::User> users;
     for (;;)
     {
-        error_code = sqlite3_step(statement);
-        if (error_code != SQLITE_ROW)
+        if (sqlite3_step(statement) != SQLITE_ROW)
             break;
 
         std::optional<base::User> user = readUser(statement);
@@ -397,7 +512,7 @@ std::vector<base::User> DatabaseSqlite::userList() const
             users.emplace_back(std::move(user.value()));
     }
 
-    sqlite3_finalize(statement);
+    resetStatement(statement);
     return users;
 }
 
@@ -409,18 +524,15 @@ bool DatabaseSqlite::addUser(const base::User& user)
         return false;
     }
 
-    static const char kQuery[] =
-        "INSERT INTO users ('id', 'name', 'group', 'salt', 'verifier', 'sessions', 'flags') "
-        "VALUES (NULL, ?, ?, ?, ?, ?, ?)";
+    CommittedHosts committed;
+    std::scoped_lock lock(lock_);
 
-    sqlite3_stmt* statement = nullptr;
-    int error_code = sqlite3_prepare(db_, kQuery, std::size(kQuery), &statement, nullptr);
-    if (error_code != SQLITE_OK)
-    {
-        LOG(LS_ERROR) << "sqlite3_prepare failed: " << sqlite3_errstr(error_code)
-                      << " (" << error_code << ")";
+    // A user must not be rolled back together with a batch of hosts.
+    doCommit(&committed);
+
+    sqlite3_stmt* statement = this->statement(QUERY_ADD_USER);
+    if (!statement)
         return false;
-    }
 
     std::string username = base::utf8FromUtf16(user.name);
     bool result = false;
@@ -445,7 +557,7 @@ bool DatabaseSqlite::addUser(const base::User& user)
         if (!writeInt(statement, static_cast<int>(user.flags), 6))
             break;
 
-        error_code = sqlite3_step(statement);
+        int error_code = sqlite3_step(statement);
         if (error_code != SQLITE_DONE)
         {
             LOG(LS_ERROR) << "sqlite3_step failed: " << sqlite3_errstr(error_code)
@@ -457,7 +569,7 @@ bool DatabaseSqlite::addUser(const base::User& user)
     }
     while (false);
 
-    sqlite3_finalize(statement);
+    resetStatement(statement);
     return result;
 }
 
@@ -469,18 +581,15 @@ bool DatabaseSqlite::modifyUser(const base::User& user)
         return false;
     }
 
-    static const char kQuery[] =
-        "UPDATE users SET ('name', 'group', 'salt', 'verifier', 'sessions', 'flags') = "
-        "(?, ?, ?, ?, ?, ?) WHERE id=?";
+    CommittedHosts committed;
+    std::scoped_lock lock(lock_);
 
-    sqlite3_stmt* statement = nullptr;
-    int error_code = sqlite3_prepare(db_, kQuery, std::size(kQuery), &statement, nullptr);
-    if (error_code != SQLITE_OK)
-    {
-        LOG(LS_ERROR) << "sqlite3_prepare failed: " << sqlite3_errstr(error_code)
-                      << " (" << error_code << ")";
+    // A user must not be rolled back together with a batch of hosts.
+    doCommit(&committed);
+
+    sqlite3_stmt* statement = this->statement(QUERY_MODIFY_USER);
+    if (!statement)
         return false;
-    }
 
     std::string username = base::utf8FromUtf16(user.name);
     bool result = false;
@@ -508,7 +617,7 @@ bool DatabaseSqlite::modifyUser(const base::User& user)
         if (!writeInt64(statement, user.entry_id, 7))
             break;
 
-        error_code = sqlite3_step(statement);
+        int error_code = sqlite3_step(statement);
         if (error_code != SQLITE_DONE)
         {
             LOG(LS_ERROR) << "sqlite3_step failed: " << sqlite3_errstr(error_code)
@@ -520,21 +629,21 @@ bool DatabaseSqlite::modifyUser(const base::User& user)
     }
     while (false);
 
-    sqlite3_finalize(statement);
+    resetStatement(statement);
     return result;
 }
 
 bool DatabaseSqlite::removeUser(int64_t entry_id)
 {
-    static const char kQuery[] = "DELETE FROM users WHERE id=?";
+    CommittedHosts committed;
+    std::scoped_lock lock(lock_);
 
-    sqlite3_stmt* statement = nullptr;
-    int error_code = sqlite3_prepare(db_, kQuery, std::size(kQuery), &statement, nullptr);
-    if (error_code != SQLITE_OK)
-    {
-        LOG(LS_ERROR) << "sqlite3_prepare failed: " << sqlite3_errstr(error_code);
+    // A user must not be rolled back together with a batch of hosts.
+    doCommit(&committed);
+
+    sqlite3_stmt* statement = this->statement(QUERY_REMOVE_USER);
+    if (!statement)
         return false;
-    }
 
     bool result = false;
 
@@ -543,7 +652,7 @@ bool DatabaseSqlite::removeUser(int64_t entry_id)
         if (!writeInt64(statement, entry_id, 1))
             break;
 
-        error_code = sqlite3_step(statement);
+        int error_code = sqlite3_step(statement);
         if (error_code != SQLITE_DONE)
         {
             LOG(LS_ERROR) << "sqlite3_step failed: " << sqlite3_errstr(error_code)
@@ -555,22 +664,17 @@ bool DatabaseSqlite::removeUser(int64_t entry_id)
     }
     while (false);
 
-    sqlite3_finalize(statement);
+    resetStatement(statement);
     return result;
 }
 
 base::User DatabaseSqlite::findUser(std::u16string_view username)
 {
-    const char kQuery[] = "SELECT * FROM users WHERE name=?";
+    std::scoped_lock lock(lock_);
 
-    sqlite3_stmt* statement = nullptr;
-    int error_code = sqlite3_prepare(db_, kQuery, std::size(kQuery), &statement, nullptr);
-    if (error_code != SQLITE_OK)
-    {
-        LOG(LS_ERROR) << "sqlite3_prepare failed: " << sqlite3_errstr(error_code)
-                      << " (" << error_code << ")";
+    sqlite3_stmt* statement = this->statement(QUERY_FIND_USER);
+    if (!statement)
         return base::User::kInvalidUser;
-    }
 
     std::string username_utf8 = base::utf8FromUtf16(username);
     std::optional<base::User> user;
@@ -587,7 +691,7 @@ base::User DatabaseSqlite::findUser(std::u16string_view username)
     }
     while (false);
 
-    sqlite3_finalize(statement);
+    resetStatement(statement);
     return user.value_or(base::User::kInvalidUser);
 }
 
@@ -608,16 +712,11 @@ Database::ErrorCode DatabaseSqlite::hostId(
 
     *host_id = base::kInvalidHostId;
 
-    const char kQuery[] = "SELECT * FROM hosts WHERE key=?";
+    std::scoped_lock lock(lock_);
 
-    sqlite3_stmt* statement;
-    int error_code = sqlite3_prepare(db_, kQuery, std::size(kQuery), &statement, nullptr);
-    if (error_code != SQLITE_OK)
-    {
-        LOG(LS_ERROR) << "sqlite3_prepare failed: " << sqlite3_errstr(error_code)
-                      << " (" << error_code << ")";
+    sqlite3_stmt* statement = this->statement(QUERY_HOST_ID);
+    if (!statement)
         return ErrorCode::UNKNOWN;
-    }
 
     ErrorCode result = ErrorCode::UNKNOWN;
 
@@ -626,7 +725,7 @@ Database::ErrorCode DatabaseSqlite::hostId(
         if (!writeBlob(statement, key_hash, 1))
             break;
 
-        error_code = sqlite3_step(statement);
+        int error_code = sqlite3_step(statement);
         if (error_code != SQLITE_ROW)
         {
             LOG(LS_ERROR) << "sqlite3_step failed: " << sqlite3_errstr(error_code)
@@ -647,52 +746,176 @@ Database::ErrorCode DatabaseSqlite::hostId(
     }
     while (false);
 
-    sqlite3_finalize(statement);
+    resetStatement(statement);
     return result;
 }
 
-bool DatabaseSqlite::addHost(const base::ByteArray& keyHash)
+void DatabaseSqlite::addHost(const base::ByteArray& key_hash, AddHostCallback callback)
 {
-    if (keyHash.empty())
+    DCHECK(callback);
+
+    if (key_hash.empty())
     {
         LOG(LS_ERROR) << "Invalid parameters";
-        return false;
+        callback(base::kInvalidHostId);
+        return;
     }
 
-    const char kQuery[] = "INSERT INTO hosts ('id', 'key') VALUES (NULL, ?)";
+    CommittedHosts committed;
+    std::unique_lock lock(lock_);
 
-    sqlite3_stmt* statement = nullptr;
-    int error_code = sqlite3_prepare(db_, kQuery, std::size(kQuery), &statement, nullptr);
-    if (error_code != SQLITE_OK)
+    base::HostId host_id = base::kInvalidHostId;
+
+    do
     {
-        LOG(LS_ERROR) << "sqlite3_prepare failed: " << sqlite3_errstr(error_code)
-                      << " (" << error_code << ")";
-        return false;
+        sqlite3_stmt* statement = this->statement(QUERY_ADD_HOST);
+        if (!statement)
+            break;
+
+        // Hosts are often registered in bursts (for example, when a lot of new hosts are deployed
+        // at once). Several writes in one transaction are much cheaper than a transaction for each.
+        if (!beginBatch())
+            break;
+
+        if (writeBlob(statement, key_hash, 1))
+        {
+            int error_code = sqlite3_step(statement);
+            if (error_code == SQLITE_DONE)
+            {
+                host_id = static_cast<base::HostId>(sqlite3_last_insert_rowid(db_));
+            }
+            else
+            {
+                LOG(LS_ERROR) << "sqlite3_step failed: " << sqlite3_errstr(error_code)
+                              << " (" << error_code << ")";
+            }
+        }
+
+        resetStatement(statement);
     }
+    while (false);
 
-    bool result = false;
+    if (host_id == base::kInvalidHostId || !in_transaction_)
+    {
+        // The host is not added or it is already committed.
+        lock.unlock();
+        callback(host_id);
+        return;
+    }
 
-    do
+    // The ID is reported only after the commit. If the commit fails, the ID is given to another
+    // host later.
+    batch_hosts_.push_back(PendingHost{ host_id, std::move(callback) });
+
+    if (batch_hosts_.size() >= kMaxBatchSize)
+        doCommit(&committed);
+}
+
+bool DatabaseSqlite::hostList(const HostCallback& callback) const
+{
+    std::scoped_lock lock(lock_);
+
+    sqlite3_stmt* statement = this->statement(QUERY_HOST_LIST);
+    if (!statement)
+        return false;
+
+    bool result = true;
+
+    for (;;)
     {
-        if (!writeBlob(statement, keyHash, 1))
+        int error_code = sqlite3_step(statement);
+        if (error_code == SQLITE_DONE)
             break;
 
-        error_code = sqlite3_step(statement);
-        if (error_code != SQLITE_DONE)
+        if (error_code != SQLITE_ROW)
         {
             LOG(LS_ERROR) << "sqlite3_step failed: " << sqlite3_errstr(error_code)
                           << " (" << error_code << ")";
+            result = false;
             break;
         }
 
-        result = true;
+        std::optional<int64_t> entry_id = readInteger<int64_t>(statement, 0);
+        if (!entry_id.has_value())
+        {
+            LOG(LS_ERROR) << "Failed to get field 'id'";
+            continue;
+        }
+
+        std::optional<base::ByteArray> key_hash = readBlob(statement, 1);
+        if (!key_hash.has_value())
+        {
+            LOG(LS_ERROR) << "Failed to get field 'key'";
+            continue;
+        }
+
+        if (!callback(key_hash.value(), static_cast<base::HostId>(entry_id.value())))
+            break;
     }
-    while (false);
 
-    sqlite3_finalize(statement);
+    resetStatement(statement);
     return result;
 }
 
+sqlite3_stmt* DatabaseSqlite::statement(Query query) const
+{
+    DCHECK_LT(query, QUERY_COUNT);
+
+    sqlite3_stmt* statement = statements_[query];
+    if (statement)
+        return statement;
+
+    int error_code = sqlite3_prepare_v3(
+        db_, kQueries[query], -1, SQLITE_PREPARE_PERSISTENT, &statement, nullptr);
+    if (error_code != SQLITE_OK)
+    {
+        LOG(LS_ERROR) << "sqlite3_prepare_v3 failed: " << sqlite3_errstr(error_code)
+                      << " (" << error_code << ")";
+        return nullptr;
+    }
+
+    statements_[query] = statement;
+    return statement;
+}
+
+bool DatabaseSqlite::beginBatch()
+{
+    // If batching is disabled, each host is committed immediately.
+    if (!task_runner_ || in_transaction_)
+        return true;
+
+    if (!execute(db_, "BEGIN;"))
+        return false;
+
+    in_transaction_ = true;
+
+    uint64_t batch_id = ++batch_id_;
+
+    task_runner_->postDelayedTask([self = self_, batch_id]()
+    {
+        // The database was closed before the delay expired.
+        if (!*self)
+            return;
+
+        (*self)->commitBatch(batch_id);
+    },
+    kCommitDelay);
+
+    return true;
+}
+
+void DatabaseSqlite::commitBatch(uint64_t batch_id)
+{
+    CommittedHosts committed;
+    std::scoped_lock lock(lock_);
+
+    // The batch could be already committed because it was full.
+    if (batch_id != batch_id_)
+        return;
+
+    doCommit(&committed);
+}
+
 // static
 std::filesystem::path DatabaseSqlite::databaseDirectory()
 {
@@ -22,10 +22,17 @@
 #include "base/macros_magic.h"
 #include "router/database.h"
 
+#include <array>
 #include <filesystem>
+#include <mutex>
+#include <vector>
 
 #include <sqlite3.h>
 
+namespace base {
+class TaskRunner;
+} // namespace base
+
 namespace router {
 
 class DatabaseSqlite : public Database
@@ -34,7 +41,14 @@ public:
     ~DatabaseSqlite();
 
     static std::unique_ptr<DatabaseSqlite> create();
-    static std::unique_ptr<DatabaseSqlite> open();
+
+    // Opens the database. If |task_runner| is specified, then added hosts are committed in
+    // batches: the transaction is opened on the first added host and committed after a short delay
+    // or when the batch is full. The callbacks of addHost() are called after the commit. Otherwise
+    // each host is committed immediately. Users are always written outside of the batches.
+    // If |task_runner| is specified, the database must be destroyed in its thread.
+    static std::unique_ptr<DatabaseSqlite> open(
+        std::shared_ptr<base::TaskRunner> task_runner = nullptr);
     static std::filesystem::path filePath();
 
     // Database implementation.
@@ -44,13 +58,74 @@ public:
     bool removeUser(int64_t entry_id) override;
     base::User findUser(std::u16string_view username) override;
     ErrorCode hostId(const base::ByteArray& key_hash, base::HostId* host_id) const override;
-    bool addHost(const base::ByteArray& key_hash) override;
+    void addHost(const base::ByteArray& key_hash, AddHostCallback callback) override;
+    bool hostList(const HostCallback& callback) const override;
+
+    // Commits the current batch of hosts (if any).
+    // All methods of the class are thread-safe.
+    bool commit();
 
 private:
-    explicit DatabaseSqlite(sqlite3* db);
+    DatabaseSqlite(sqlite3* db, std::shared_ptr<base::TaskRunner> task_runner);
     static std::filesystem::path databaseDirectory();
 
+    enum Query
+    {
+        QUERY_USER_LIST,
+        QUERY_ADD_USER,
+        QUERY_MODIFY_USER,
+        QUERY_REMOVE_USER,
+        QUERY_FIND_USER,
+        QUERY_HOST_ID,
+        QUERY_ADD_HOST,
+        QUERY_HOST_LIST,
+        QUERY_COUNT
+    };
+
+    // Returns the prepared statement for |query|. The statement is prepared on the first call and
+    // cached until the database is closed. After use, the statement must be reset.
+    sqlite3_stmt* statement(Query query) const;
+
+    // A host added in the current batch.
+    struct PendingHost
+    {
+        base::HostId host_id;
+        AddHostCallback callback;
+    };
+
+    // The hosts of a committed batch. Their callbacks are called in the destructor. It must be
+    // declared before the lock of the database, so that the callbacks are called without the lock.
+    class CommittedHosts
+    {
+    public:
+        CommittedHosts() = default;
+        ~CommittedHosts();
+
+        std::vector<PendingHost> hosts;
+        bool result = false;
+
+    private:
+        DISALLOW_COPY_AND_ASSIGN(CommittedHosts);
+    };
+
+    bool beginBatch();
+    void commitBatch(uint64_t batch_id);
+    bool doCommit(CommittedHosts* committed);
+
+    // The connection is shared between the threads of the router.
+    mutable std::mutex lock_;
+
     sqlite3* db_;
+    mutable std::array<sqlite3_stmt*, QUERY_COUNT> statements_;
+
+    std::shared_ptr<base::TaskRunner> task_runner_;
+
+    // Reset to nullptr in the destructor. Delayed commits check it before the call.
+    std::shared_ptr<DatabaseSqlite*> self_;
+
+    bool in_transaction_ = false;
+    std::vector<PendingHost> batch_hosts_;
+    uint64_t batch_id_ = 0;
 
     DISALLOW_COPY_AND_ASSIGN(DatabaseSqlite);
 };
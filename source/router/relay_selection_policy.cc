@@ -0,0 +1,241 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "router/relay_selection_policy.h"
+
+#include "base/logging.h"
+
+#include <unordered_map>
+#include <vector>
+
+namespace router {
+
+namespace {
+
+// Load at which the weight of a relay is halved.
+const double kSessionScale = 100.0;
+const double kSpeedScale = 100.0 * 1024 * 1024 / 8; // 100 Mbit/s.
+const double kRttScale = 50.0; // Milliseconds.
+
+// Keeps the relays in a binary max-heap ordered by score. The position of each relay in the heap
+// is indexed, so the score of any relay can be changed in O(log n).
+class HeapPolicy : public RelaySelectionPolicy
+{
+public:
+    HeapPolicy() = default;
+    ~HeapPolicy() override = default;
+
+    // RelaySelectionPolicy implementation.
+    void updateRelay(Session::SessionId session_id, const RelayState& state) override;
+    void removeRelay(Session::SessionId session_id) override;
+    void clear() override;
+    std::optional<Session::SessionId> selectRelay() const override;
+
+protected:
+    virtual double score(const RelayState& state) const = 0;
+
+private:
+    struct Entry
+    {
+        Session::SessionId session_id;
+        double score;
+    };
+
+    void swapEntries(size_t first, size_t second);
+    void siftUp(size_t index);
+    void siftDown(size_t index);
+
+    std::vector<Entry> heap_;
+    std::unordered_map<Session::SessionId, size_t> index_;
+
+    DISALLOW_COPY_AND_ASSIGN(HeapPolicy);
+};
+
+void HeapPolicy::updateRelay(Session::SessionId session_id, const RelayState& state)
+{
+    double new_score = score(state);
+
+    auto it = index_.find(session_id);
+    if (it == index_.end())
+    {
+        heap_.push_back({ session_id, new_score });
+        index_.emplace(session_id, heap_.size() - 1);
+        siftUp(heap_.size() - 1);
+        return;
+    }
+
+    size_t index = it->second;
+    double old_score = heap_[index].score;
+
+    heap_[index].score = new_score;
+
+    if (new_score > old_score)
+        siftUp(index);
+    else if (new_score < old_score)
+        siftDown(index);
+}
+
+void HeapPolicy::removeRelay(Session::SessionId session_id)
+{
+    auto it = index_.find(session_id);
+    if (it == index_.end())
+        return;
+
+    size_t index = it->second;
+    size_t last = heap_.size() - 1;
+
+    index_.erase(it);
+
+    if (index != last)
+    {
+        heap_[index] = heap_[last];
+        index_[heap_[index].session_id] = index;
+    }
+
+    heap_.pop_back();
+
+    if (index < heap_.size())
+    {
+        siftUp(index);
+        siftDown(index);
+    }
+}
+
+void HeapPolicy::clear()
+{
+    heap_.clear();
+    index_.clear();
+}
+
+std::optional<Session::SessionId> HeapPolicy::selectRelay() const
+{
+    if (heap_.empty())
+        return std::nullopt;
+
+    return heap_.front().session_id;
+}
+
+void HeapPolicy::swapEntries(size_t first, size_t second)
+{
+    std::swap(heap_[first], heap_[second]);
+    index_[heap_[first].session_id] = first;
+    index_[heap_[second].session_id] = second;
+}
+
+void HeapPolicy::siftUp(size_t index)
+{
+    while (index > 0)
+    {
+        size_t parent = (index - 1) / 2;
+        if (heap_[parent].score >= heap_[index].score)
+            break;
+
+        swapEntries(parent, index);
+        index = parent;
+    }
+}
+
+void HeapPolicy::siftDown(size_t index)
+{
+    for (;;)
+    {
+        size_t largest = index;
+        size_t left = index * 2 + 1;
+        size_t right = left + 1;
+
+        if (left < heap_.size() && heap_[left].score > heap_[largest].score)
+            largest = left;
+        if (right < heap_.size() && heap_[right].score > heap_[largest].score)
+            largest = right;
+
+        if (largest == index)
+            break;
+
+        swapEntries(largest, index);
+        index = largest;
+    }
+}
+
+class FreeCapacityPolicy : public HeapPolicy
+{
+public:
+    FreeCapacityPolicy() = default;
+
+protected:
+    double score(const RelayState& state) const override
+    {
+        return static_cast<double>(state.key_count);
+    }
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(FreeCapacityPolicy);
+};
+
+class WeightedPolicy : public HeapPolicy
+{
+public:
+    WeightedPolicy() = default;
+
+protected:
+    double score(const RelayState& state) const override
+    {
+        const RelayLoad& load = state.load;
+
+        double sessions = static_cast<double>(load.active_sessions + load.pending_sessions);
+        double speed = static_cast<double>(load.speed);
+        double rtt = static_cast<double>(load.rtt.count());
+
+        // Each factor is 1 for an idle relay with an unknown RTT and grows with the load.
+        double weight = (1.0 + sessions / kSessionScale) * (1.0 + speed / kSpeedScale) *
+                        (1.0 + rtt / kRttScale);
+
+        return static_cast<double>(state.key_count) / weight;
+    }
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(WeightedPolicy);
+};
+
+} // namespace
+
+// static
+std::unique_ptr<RelaySelectionPolicy> RelaySelectionPolicy::create(Type type)
+{
+    switch (type)
+    {
+        case Type::WEIGHTED:
+            return std::make_unique<WeightedPolicy>();
+
+        default:
+            return std::make_unique<FreeCapacityPolicy>();
+    }
+}
+
+// static
+RelaySelectionPolicy::Type RelaySelectionPolicy::typeFromString(std::string_view name)
+{
+    if (name == "weighted")
+        return Type::WEIGHTED;
+
+    if (name != "capacity")
+        LOG(LS_WARNING) << "Unknown relay selection policy: " << name;
+
+    return Type::FREE_CAPACITY;
+}
+
+} // namespace router
@@ -0,0 +1,78 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef ROUTER__RELAY_SELECTION_POLICY_H
+#define ROUTER__RELAY_SELECTION_POLICY_H
+
+#include "router/session.h"
+
+#include <chrono>
+#include <optional>
+#include <string_view>
+
+namespace router {
+
+// Chooses the relay for a new peer connection from the relays that have keys in the pool.
+// The pool calls the policy under its lock, so implementations do not need to be thread-safe.
+class RelaySelectionPolicy
+{
+public:
+    virtual ~RelaySelectionPolicy() = default;
+
+    enum class Type
+    {
+        // The relay with the most keys in the pool is selected.
+        FREE_CAPACITY,
+
+        // The number of keys is weighted by the load reported by the relay and by the round trip
+        // time to the relay.
+        WEIGHTED
+    };
+
+    // Load reported by the relay in its statistics and the round trip time to the relay.
+    struct RelayLoad
+    {
+        uint32_t active_sessions = 0;
+        uint32_t pending_sessions = 0;
+        uint64_t speed = 0; // Bytes per second.
+        std::chrono::milliseconds rtt { 0 }; // 0 if not measured yet.
+    };
+
+    struct RelayState
+    {
+        size_t key_count = 0;
+        RelayLoad load;
+    };
+
+    static std::unique_ptr<RelaySelectionPolicy> create(Type type);
+
+    // Converts the policy name from the settings. Returns FREE_CAPACITY for unknown names.
+    static Type typeFromString(std::string_view name);
+
+    // Adds a relay or updates the state of an existing one.
+    virtual void updateRelay(Session::SessionId session_id, const RelayState& state) = 0;
+    virtual void removeRelay(Session::SessionId session_id) = 0;
+    virtual void clear() = 0;
+
+    // Returns the relay for the next connection or std::nullopt if there are no relays.
+    virtual std::optional<Session::SessionId> selectRelay() const = 0;
+};
+
+} // namespace router
+
+#endif // ROUTER__RELAY_SELECTION_POLICY_H
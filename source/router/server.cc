@@ -24,51 +24,32 @@
 #include "base/crypto/key_pair.h"
 #include "base/files/base_paths.h"
 #include "base/files/file_util.h"
-#include "base/net/network_channel.h"
 #include "router/database_factory_sqlite.h"
+#include "router/database_host_index.h"
 #include "router/database_sqlite.h"
-#include "router/session_admin.h"
-#include "router/session_client.h"
-#include "router/session_host.h"
-#include "router/session_relay.h"
+#include "router/server_shard.h"
 #include "router/settings.h"
-#include "router/user_list_db.h"
 
-namespace router {
-
-namespace {
-
-const char* sessionTypeToString(proto::RouterSession session_type)
-{
-    switch (session_type)
-    {
-        case proto::ROUTER_SESSION_CLIENT:
-            return "ROUTER_SESSION_CLIENT";
-
-        case proto::ROUTER_SESSION_HOST:
-            return "ROUTER_SESSION_HOST";
-
-        case proto::ROUTER_SESSION_ADMIN:
-            return "ROUTER_SESSION_ADMIN";
-
-        case proto::ROUTER_SESSION_RELAY:
-            return "ROUTER_SESSION_RELAY";
+#include <algorithm>
+#include <optional>
+#include <thread>
 
-        default:
-            return "ROUTER_SESSION_UNKNOWN";
-    }
-}
-
-} // namespace
+namespace router {
 
 Server::Server(std::shared_ptr<base::TaskRunner> task_runner)
     : task_runner_(std::move(task_runner)),
-      database_factory_(std::make_shared<DatabaseFactorySqlite>())
+      database_factory_(std::make_shared<DatabaseFactorySqlite>(task_runner_))
 {
     DCHECK(task_runner_);
 }
 
-Server::~Server() = default;
+Server::~Server()
+{
+    // Stop accepting new connections before the shards are destroyed. The shards remove their
+    // sessions from the directories when they stop.
+    server_.reset();
+    shards_.clear();
+}
 
 bool Server::start()
 {
@@ -84,6 +65,24 @@ bool Server::start()
 
     Settings settings;
 
+    size_t host_index_memory_limit =
+        static_cast<size_t>(settings.hostIndexMemoryLimit()) * 1024 * 1024;
+    if (host_index_memory_limit)
+    {
+        std::unique_ptr<DatabaseHostIndex> host_index =
+            std::make_unique<DatabaseHostIndex>(std::move(database), host_index_memory_limit);
+
+        // If the hosts cannot be loaded, the index still works: all hosts that are not in it are
+        // looked up in the database.
+        host_index->load();
+        database_ = std::move(host_index);
+    }
+    else
+    {
+        LOG(LS_INFO) << "Host index is disabled";
+        database_ = std::move(database);
+    }
+
     base::ByteArray private_key = settings.privateKey();
     if (private_key.empty())
     {
@@ -150,247 +149,217 @@ bool Server::start()
             LOG(LS_INFO) << "#" << (i + 1) << ": " << relay_white_list_[i];
     }
 
-    std::unique_ptr<base::UserListBase> user_list = UserListDb::open(*database_factory_);
+    size_t shard_count = settings.workerThreadCount();
+    if (!shard_count)
+        shard_count = std::max(std::thread::hardware_concurrency(), 1U);
+
+    LOG(LS_INFO) << "Worker threads: " << shard_count;
 
-    authenticator_manager_ =
-        std::make_unique<base::ServerAuthenticatorManager>(task_runner_, this);
-    authenticator_manager_->setPrivateKey(private_key);
-    authenticator_manager_->setUserList(std::move(user_list));
-    authenticator_manager_->setAnonymousAccess(
-        base::ServerAuthenticator::AnonymousAccess::ENABLE,
-        proto::ROUTER_SESSION_HOST | proto::ROUTER_SESSION_RELAY);
+    std::string relay_selection_policy = settings.relaySelectionPolicy();
+    LOG(LS_INFO) << "Relay selection policy: " << relay_selection_policy;
 
-    relay_key_pool_ = std::make_unique<SharedKeyPool>(this);
+    relay_key_pool_ = std::make_unique<SharedKeyPool>(
+        this, RelaySelectionPolicy::create(
+            RelaySelectionPolicy::typeFromString(relay_selection_policy)));
+
+    // The list of shards does not change after this point, so the shards can read it without
+    // locking.
+    for (size_t i = 0; i < shard_count; ++i)
+        shards_.emplace_back(std::make_unique<ServerShard>(i, private_key, this));
 
     server_ = std::make_unique<base::NetworkServer>();
-    server_->start(port, this);
+
+    for (const auto& shard : shards_)
+    {
+        shard->start();
+        server_->addWorker(shard->thread(), shard.get());
+    }
+
+    server_->start(port, shards_.front().get());
 
     LOG(LS_INFO) << "Server started";
     return true;
 }
 
-std::unique_ptr<proto::SessionList> Server::sessionList() const
+std::unique_ptr<SharedKeyPool> Server::shareRelayKeyPool()
 {
-    std::unique_ptr<proto::SessionList> result = std::make_unique<proto::SessionList>();
+    return relay_key_pool_->share();
+}
 
-    for (const auto& session : sessions_)
-    {
-        proto::Session* item = result->add_session();
+size_t Server::relayKeyCount(Session::SessionId session_id) const
+{
+    return relay_key_pool_->countForRelay(session_id);
+}
 
-        item->set_session_id(session->sessionId());
-        item->set_session_type(session->sessionType());
-        item->set_timepoint(session->startTime());
-        item->set_ip_address(session->address());
-        item->mutable_version()->CopyFrom(session->version().toProto());
-        item->set_os_name(session->osName());
-        item->set_computer_name(session->computerName());
+bool Server::isAddressAllowed(proto::RouterSession session_type,
+                              const std::u16string& address) const
+{
+    const std::vector<std::u16string>* white_list;
 
-        switch (session->sessionType())
-        {
-            case proto::ROUTER_SESSION_HOST:
-            {
-                proto::HostSessionData session_data;
+    switch (session_type)
+    {
+        case proto::ROUTER_SESSION_CLIENT:
+            white_list = &client_white_list_;
+            break;
 
-                for (const auto& host_id : static_cast<SessionHost*>(session.get())->hostIdList())
-                    session_data.add_host_id(host_id);
+        case proto::ROUTER_SESSION_HOST:
+            white_list = &host_white_list_;
+            break;
 
-                item->set_session_data(session_data.SerializeAsString());
-            }
+        case proto::ROUTER_SESSION_ADMIN:
+            white_list = &admin_white_list_;
             break;
 
-            case proto::ROUTER_SESSION_RELAY:
-            {
-                proto::RelaySessionData session_data;
-                session_data.set_pool_size(relay_key_pool_->countForRelay(session->sessionId()));
-                item->set_session_data(session_data.SerializeAsString());
-            }
+        case proto::ROUTER_SESSION_RELAY:
+            white_list = &relay_white_list_;
             break;
 
-            default:
-                break;
-        }
+        default:
+            return false;
     }
 
-    result->set_error_code(proto::SessionList::SUCCESS);
-    return result;
+    return white_list->empty() || base::contains(*white_list, address);
 }
 
-bool Server::stopSession(Session::SessionId session_id)
+void Server::addSession(Session::SessionId session_id, ServerShard* shard)
 {
-    for (auto it = sessions_.begin(); it != sessions_.end(); ++it)
-    {
-        if (it->get()->sessionId() == session_id)
-        {
-            sessions_.erase(it);
-            return true;
-        }
-    }
-
-    return false;
+    std::scoped_lock lock(sessions_lock_);
+    sessions_[session_id] = shard;
 }
 
-void Server::onHostSessionWithId(SessionHost* session)
+void Server::removeSession(Session::SessionId session_id)
 {
-    for (auto it = sessions_.begin(); it != sessions_.end();)
-    {
-        if (it->get()->sessionType() == proto::ROUTER_SESSION_HOST)
-        {
-            SessionHost* other_session = reinterpret_cast<SessionHost*>(it->get());
-            if (other_session != session)
-            {
-                for (const auto& host_id : session->hostIdList())
-                {
-                    if (other_session->hasHostId(host_id))
-                    {
-                        LOG(LS_INFO) << "Detected previous connection with ID " << host_id;
-
-                        it = sessions_.erase(it);
-                        continue;
-                    }
-                }
-            }
-        }
-
-        ++it;
-    }
+    std::scoped_lock lock(sessions_lock_);
+    sessions_.erase(session_id);
 }
 
-SessionHost* Server::hostSessionById(base::HostId host_id)
+bool Server::stopSession(Session::SessionId session_id)
 {
-    for (auto it = sessions_.begin(); it != sessions_.end(); ++it)
-    {
-        Session* entry = it->get();
-
-        if (entry->sessionType() == proto::ROUTER_SESSION_HOST &&
-            static_cast<SessionHost*>(entry)->hasHostId(host_id))
-        {
-            return static_cast<SessionHost*>(entry);
-        }
-    }
+    ServerShard* shard = sessionShard(session_id);
+    if (!shard)
+        return false;
 
-    return nullptr;
+    shard->postStopSession(session_id);
+    return true;
 }
 
-Session* Server::sessionById(Session::SessionId session_id)
+void Server::addHost(base::HostId host_id, Session::SessionId session_id, ServerShard* shard)
 {
-    for (auto& session : sessions_)
+    HostStripe& stripe = hostStripe(host_id);
+    std::optional<HostEntry> previous;
+
     {
-        if (session->sessionId() == session_id)
-            return session.get();
+        std::scoped_lock lock(stripe.lock);
+
+        HostEntry& entry = stripe.hosts[host_id];
+        if (entry.shard && entry.session_id != session_id)
+            previous = entry;
+
+        entry.session_id = session_id;
+        entry.shard = shard;
     }
 
-    return nullptr;
+    if (previous.has_value())
+    {
+        LOG(LS_INFO) << "Detected previous connection with ID " << host_id;
+        previous->shard->postStopSession(previous->session_id);
+    }
 }
 
-void Server::onNewConnection(std::unique_ptr<base::NetworkChannel> channel)
+void Server::removeHost(base::HostId host_id, Session::SessionId session_id)
 {
-    LOG(LS_INFO) << "New connection: " << channel->peerAddress();
+    HostStripe& stripe = hostStripe(host_id);
+    std::scoped_lock lock(stripe.lock);
 
-    channel->setOwnKeepAlive(true);
-    channel->setNoDelay(true);
+    auto it = stripe.hosts.find(host_id);
 
-    if (authenticator_manager_)
-        authenticator_manager_->addNewChannel(std::move(channel));
+    // The host ID could be taken by another session.
+    if (it != stripe.hosts.end() && it->second.session_id == session_id)
+        stripe.hosts.erase(it);
 }
 
-void Server::onPoolKeyUsed(Session::SessionId session_id, uint32_t key_id)
+bool Server::hasHost(base::HostId host_id) const
 {
-    for (const auto& session : sessions_)
-    {
-        SessionRelay* relay_session = static_cast<SessionRelay*>(session.get());
-        if (relay_session->sessionId() == session_id)
-            relay_session->sendKeyUsed(key_id);
-    }
+    const HostStripe& stripe = hostStripe(host_id);
+    std::scoped_lock lock(stripe.lock);
+    return stripe.hosts.find(host_id) != stripe.hosts.end();
 }
 
-void Server::onNewSession(base::ServerAuthenticatorManager::SessionInfo&& session_info)
+bool Server::sendConnectionOffer(std::shared_ptr<PendingOffer> pending_offer)
 {
-    std::u16string address = session_info.channel->peerAddress();
-    proto::RouterSession session_type =
-        static_cast<proto::RouterSession>(session_info.session_type);
+    ServerShard* shard = nullptr;
 
-    LOG(LS_INFO) << "New session: " << sessionTypeToString(session_type) << " (" << address << ")";
-
-    std::unique_ptr<Session> session;
-
-    switch (session_info.session_type)
     {
-        case proto::ROUTER_SESSION_CLIENT:
-        {
-            if (!client_white_list_.empty() && !base::contains(client_white_list_, address))
-                break;
+        const HostStripe& stripe = hostStripe(pending_offer->host_id);
+        std::scoped_lock lock(stripe.lock);
 
-            session = std::make_unique<SessionClient>();
-        }
-        break;
+        auto it = stripe.hosts.find(pending_offer->host_id);
+        if (it == stripe.hosts.end())
+            return false;
 
-        case proto::ROUTER_SESSION_HOST:
-        {
-            if (!host_white_list_.empty() && !base::contains(host_white_list_, address))
-                break;
+        shard = it->second.shard;
+    }
 
-            session = std::make_unique<SessionHost>();
-        }
-        break;
+    shard->postConnectionOffer(std::move(pending_offer));
+    return true;
+}
 
-        case proto::ROUTER_SESSION_ADMIN:
-        {
-            if (!admin_white_list_.empty() && !base::contains(admin_white_list_, address))
-                break;
+void Server::collectSessionList(Session::SessionId requester_id, ServerShard* requester_shard)
+{
+    struct Request
+    {
+        std::mutex lock;
+        size_t remaining;
+        std::shared_ptr<proto::SessionList> session_list;
+    };
 
-            session = std::make_unique<SessionAdmin>();
-        }
-        break;
+    std::shared_ptr<Request> request = std::make_shared<Request>();
+    request->remaining = shards_.size();
+    request->session_list = std::make_shared<proto::SessionList>();
 
-        case proto::ROUTER_SESSION_RELAY:
+    for (const auto& shard : shards_)
+    {
+        shard->collectSessionList(
+            [request, requester_id, requester_shard](const proto::SessionList& session_list)
         {
-            if (!relay_white_list_.empty() && !base::contains(relay_white_list_, address))
-                break;
+            std::scoped_lock lock(request->lock);
 
-            session = std::make_unique<SessionRelay>();
-        }
-        break;
+            request->session_list->MergeFrom(session_list);
+            if (--request->remaining)
+                return;
 
-        default:
-        {
-            LOG(LS_ERROR) << "Unsupported session type: "
-                          << static_cast<int>(session_info.session_type);
-        }
-        break;
+            request->session_list->set_error_code(proto::SessionList::SUCCESS);
+            requester_shard->postSessionList(requester_id, request->session_list);
+        });
     }
+}
 
-    if (!session)
-    {
-        LOG(LS_ERROR) << "Connection rejected for '" << address << "'";
-        return;
-    }
+void Server::onPoolKeyUsed(Session::SessionId session_id, uint32_t key_id)
+{
+    ServerShard* shard = sessionShard(session_id);
+    if (shard)
+        shard->postKeyUsed(session_id, key_id);
+}
 
-    session->setChannel(std::move(session_info.channel));
-    session->setDatabaseFactory(database_factory_);
-    session->setServer(this);
-    session->setRelayKeyPool(relay_key_pool_->share());
-    session->setVersion(session_info.version);
-    session->setOsName(session_info.os_name);
-    session->setComputerName(session_info.computer_name);
+Server::HostStripe& Server::hostStripe(base::HostId host_id)
+{
+    return host_stripes_[host_id % kHostStripeCount];
+}
 
-    sessions_.emplace_back(std::move(session));
-    sessions_.back()->start(this);
+const Server::HostStripe& Server::hostStripe(base::HostId host_id) const
+{
+    return host_stripes_[host_id % kHostStripeCount];
 }
 
-void Server::onSessionFinished(Session::SessionId session_id, proto::RouterSession /* session_type */)
+ServerShard* Server::sessionShard(Session::SessionId session_id) const
 {
-    for (auto it = sessions_.begin(); it != sessions_.end(); ++it)
-    {
-        if (it->get()->sessionId() == session_id)
-        {
-            // Session will be destroyed after completion of the current call.
-            task_runner_->deleteSoon(std::move(*it));
+    std::scoped_lock lock(sessions_lock_);
 
-            // Delete a session from the list.
-            sessions_.erase(it);
-            break;
-        }
-    }
+    auto it = sessions_.find(session_id);
+    if (it == sessions_.end())
+        return nullptr;
+
+    return it->second;
 }
 
 } // namespace router
@@ -21,23 +21,32 @@
 
 #include "base/net/network_server.h"
 #include "base/peer/host_id.h"
-#include "base/peer/server_authenticator_manager.h"
 #include "build/build_config.h"
 #include "proto/router_admin.pb.h"
+#include "proto/router_peer.pb.h"
 #include "router/session.h"
 #include "router/shared_key_pool.h"
 
+#include <array>
+#include <mutex>
+#include <unordered_map>
+
+namespace base {
+class TaskRunner;
+} // namespace base
+
 namespace router {
 
+class Database;
 class DatabaseFactory;
-class SessionHost;
-class SessionRelay;
-
-class Server
-    : public base::NetworkServer::Delegate,
-      public SharedKeyPool::Delegate,
-      public base::ServerAuthenticatorManager::Delegate,
-      public Session::Delegate
+class ServerShard;
+struct PendingOffer;
+
+// The connections are served by several shards, each with its own thread. A connection is
+// assigned to a shard when it is accepted and stays there until it is closed. The server keeps
+// the state shared between the shards: the directory of sessions and host IDs, the relay key pool
+// and the database. Methods called by the shards are thread-safe.
+class Server : public SharedKeyPool::Delegate
 {
 public:
     explicit Server(std::shared_ptr<base::TaskRunner> task_runner);
@@ -45,40 +54,75 @@ public:
 
     bool start();
 
-    std::unique_ptr<proto::SessionList> sessionList() const;
+    std::shared_ptr<Database> database() const { return database_; }
+    std::unique_ptr<SharedKeyPool> shareRelayKeyPool();
+    size_t relayKeyCount(Session::SessionId session_id) const;
+
+    bool isAddressAllowed(proto::RouterSession session_type, const std::u16string& address) const;
+
+    void addSession(Session::SessionId session_id, ServerShard* shard);
+    void removeSession(Session::SessionId session_id);
+
+    // Stops a session in the shard that owns it. Returns false if the session is not found.
     bool stopSession(Session::SessionId session_id);
-    void onHostSessionWithId(SessionHost* session);
 
-    SessionHost* hostSessionById(base::HostId host_id);
-    Session* sessionById(Session::SessionId session_id);
+    // Assigns |host_id| to a host session. If the ID belongs to another session, that session is
+    // stopped.
+    void addHost(base::HostId host_id, Session::SessionId session_id, ServerShard* shard);
+    void removeHost(base::HostId host_id, Session::SessionId session_id);
+    bool hasHost(base::HostId host_id) const;
 
-protected:
-    // base::NetworkServer::Delegate implementation.
-    void onNewConnection(std::unique_ptr<base::NetworkChannel> channel) override;
+    // Delivers an offer to the shard of the host. Returns false if the host is not found.
+    bool sendConnectionOffer(std::shared_ptr<PendingOffer> pending_offer);
 
+    // Collects sessions from all shards. The list is sent to the admin session |requester_id| of
+    // |requester_shard|.
+    void collectSessionList(Session::SessionId requester_id, ServerShard* requester_shard);
+
+protected:
     // SharedKeyPool::Delegate implementation.
     void onPoolKeyUsed(Session::SessionId session_id, uint32_t key_id) override;
 
-    // base::ServerAuthenticatorManager::Delegate implementation.
-    void onNewSession(base::ServerAuthenticatorManager::SessionInfo&& session_info) override;
-
-    // Session::Delegate implementation.
-    void onSessionFinished(Session::SessionId session_id,
-                           proto::RouterSession session_type) override;
-
 private:
+    struct HostEntry
+    {
+        Session::SessionId session_id = 0;
+        ServerShard* shard = nullptr;
+    };
+
+    // Host IDs are looked up on every connection request. The directory is split into stripes
+    // with separate locks so that the shards rarely wait for each other.
+    struct HostStripe
+    {
+        mutable std::mutex lock;
+        std::unordered_map<base::HostId, HostEntry> hosts;
+    };
+
+    static const size_t kHostStripeCount = 16;
+
+    HostStripe& hostStripe(base::HostId host_id);
+    const HostStripe& hostStripe(base::HostId host_id) const;
+    ServerShard* sessionShard(Session::SessionId session_id) const;
+
     std::shared_ptr<base::TaskRunner> task_runner_;
     std::shared_ptr<DatabaseFactory> database_factory_;
-    std::unique_ptr<base::NetworkServer> server_;
-    std::unique_ptr<base::ServerAuthenticatorManager> authenticator_manager_;
+
+    // The database connection shared by all sessions.
+    std::shared_ptr<Database> database_;
     std::unique_ptr<SharedKeyPool> relay_key_pool_;
-    std::vector<std::unique_ptr<Session>> sessions_;
 
     std::vector<std::u16string> client_white_list_;
     std::vector<std::u16string> host_white_list_;
     std::vector<std::u16string> admin_white_list_;
     std::vector<std::u16string> relay_white_list_;
 
+    mutable std::mutex sessions_lock_;
+    std::unordered_map<Session::SessionId, ServerShard*> sessions_;
+    std::array<HostStripe, kHostStripeCount> host_stripes_;
+
+    std::vector<std::unique_ptr<ServerShard>> shards_;
+    std::unique_ptr<base::NetworkServer> server_;
+
     DISALLOW_COPY_AND_ASSIGN(Server);
 };
 
@@ -0,0 +1,455 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "router/server_shard.h"
+
+#include "base/logging.h"
+#include "base/task_runner.h"
+#include "base/message_loop/message_loop.h"
+#include "base/net/network_channel.h"
+#include "router/database_factory_sqlite.h"
+#include "router/server.h"
+#include "router/session_admin.h"
+#include "router/session_client.h"
+#include "router/session_host.h"
+#include "router/session_relay.h"
+#include "router/user_list_db.h"
+
+namespace router {
+
+namespace {
+
+// SRP calculations take tens of milliseconds. They are done in a separate thread so that they
+// do not delay the sessions of the shard.
+const size_t kAuthenticationThreadsPerShard = 1;
+
+const char* sessionTypeToString(proto::RouterSession session_type)
+{
+    switch (session_type)
+    {
+        case proto::ROUTER_SESSION_CLIENT:
+            return "ROUTER_SESSION_CLIENT";
+
+        case proto::ROUTER_SESSION_HOST:
+            return "ROUTER_SESSION_HOST";
+
+        case proto::ROUTER_SESSION_ADMIN:
+            return "ROUTER_SESSION_ADMIN";
+
+        case proto::ROUTER_SESSION_RELAY:
+            return "ROUTER_SESSION_RELAY";
+
+        default:
+            return "ROUTER_SESSION_UNKNOWN";
+    }
+}
+
+} // namespace
+
+ServerShard::ServerShard(size_t index, const base::ByteArray& private_key, Server* server)
+    : index_(index),
+      private_key_(private_key),
+      server_(server),
+      thread_(std::make_unique<base::Thread>())
+{
+    DCHECK(server_);
+}
+
+ServerShard::~ServerShard()
+{
+    thread_->stop();
+}
+
+void ServerShard::start()
+{
+    thread_->start(base::MessageLoop::Type::ASIO, this);
+    task_runner_ = thread_->taskRunner();
+}
+
+void ServerShard::requestSessionList(Session::SessionId requester_id)
+{
+    DCHECK(task_runner_->belongsToCurrentThread());
+    server_->collectSessionList(requester_id, this);
+}
+
+bool ServerShard::stopSession(Session::SessionId session_id)
+{
+    DCHECK(task_runner_->belongsToCurrentThread());
+
+    std::unique_ptr<Session> session = removeSession(session_id);
+    if (session)
+    {
+        task_runner_->deleteSoon(std::move(session));
+        return true;
+    }
+
+    // The session can belong to another shard.
+    return server_->stopSession(session_id);
+}
+
+void ServerShard::onHostSessionWithId(SessionHost* session, base::HostId host_id)
+{
+    DCHECK(task_runner_->belongsToCurrentThread());
+
+    sessions_.addHostId(session, host_id);
+
+    // The previous session with this ID (if any) is stopped by the server.
+    server_->addHost(host_id, session->sessionId(), this);
+}
+
+void ServerShard::onHostIdReset(SessionHost* session, base::HostId host_id)
+{
+    DCHECK(task_runner_->belongsToCurrentThread());
+
+    sessions_.removeHostId(session, host_id);
+    server_->removeHost(host_id, session->sessionId());
+}
+
+void ServerShard::onHostAdded(
+    Session::SessionId session_id, const std::string& key, base::HostId host_id)
+{
+    DCHECK(task_runner_->belongsToCurrentThread());
+
+    Session* session = sessions_.find(session_id);
+    if (!session || session->sessionType() != proto::ROUTER_SESSION_HOST)
+    {
+        // The host has disconnected. It will request a new ID the next time.
+        return;
+    }
+
+    static_cast<SessionHost*>(session)->onHostAdded(key, host_id);
+}
+
+bool ServerShard::hasHost(base::HostId host_id) const
+{
+    DCHECK(task_runner_->belongsToCurrentThread());
+
+    if (sessions_.findHost(host_id))
+        return true;
+
+    return server_->hasHost(host_id);
+}
+
+void ServerShard::sendConnectionOffer(std::shared_ptr<PendingOffer> pending_offer)
+{
+    DCHECK(task_runner_->belongsToCurrentThread());
+
+    if (sessions_.findHost(pending_offer->host_id))
+    {
+        sendConnectionOfferImpl(std::move(pending_offer));
+        return;
+    }
+
+    if (!server_->sendConnectionOffer(pending_offer))
+        connectionOfferResult(std::move(pending_offer), false);
+}
+
+void ServerShard::collectSessionList(SessionListCallback callback)
+{
+    DCHECK(task_runner_);
+    DCHECK(callback);
+
+    task_runner_->postTask([this, callback = std::move(callback)]()
+    {
+        proto::SessionList list;
+        addSessionList(&list);
+        callback(list);
+    });
+}
+
+void ServerShard::postSessionList(Session::SessionId requester_id,
+                                  std::shared_ptr<proto::SessionList> session_list)
+{
+    DCHECK(task_runner_);
+
+    task_runner_->postTask([this, requester_id, session_list = std::move(session_list)]()
+    {
+        sendSessionList(requester_id, *session_list);
+    });
+}
+
+void ServerShard::postStopSession(Session::SessionId session_id)
+{
+    DCHECK(task_runner_);
+
+    task_runner_->postTask([this, session_id]()
+    {
+        std::unique_ptr<Session> session = removeSession(session_id);
+        if (session)
+            task_runner_->deleteSoon(std::move(session));
+    });
+}
+
+void ServerShard::postConnectionOffer(std::shared_ptr<PendingOffer> pending_offer)
+{
+    DCHECK(task_runner_);
+    task_runner_->postTask(
+        std::bind(&ServerShard::sendConnectionOfferImpl, this, std::move(pending_offer)));
+}
+
+void ServerShard::postConnectionOfferResult(std::shared_ptr<PendingOffer> pending_offer,
+                                            bool delivered)
+{
+    DCHECK(task_runner_);
+    task_runner_->postTask(std::bind(
+        &ServerShard::connectionOfferResult, this, std::move(pending_offer), delivered));
+}
+
+void ServerShard::postKeyUsed(Session::SessionId session_id, uint32_t key_id)
+{
+    DCHECK(task_runner_);
+    task_runner_->postTask(std::bind(&ServerShard::sendKeyUsed, this, session_id, key_id));
+}
+
+void ServerShard::onBeforeThreadRunning()
+{
+    LOG(LS_INFO) << "Server shard #" << index_ << " started";
+
+    DatabaseFactorySqlite database_factory;
+
+    authenticator_manager_ = std::make_unique<base::ServerAuthenticatorManager>(
+        base::MessageLoop::current()->taskRunner(), this);
+    authenticator_manager_->setPrivateKey(private_key_);
+    authenticator_manager_->setUserList(UserListDb::open(database_factory));
+    authenticator_manager_->setAnonymousAccess(
+        base::ServerAuthenticator::AnonymousAccess::ENABLE,
+        proto::ROUTER_SESSION_HOST | proto::ROUTER_SESSION_RELAY);
+    authenticator_manager_->setWorkerThreadCount(kAuthenticationThreadsPerShard);
+}
+
+void ServerShard::onAfterThreadRunning()
+{
+    authenticator_manager_.reset();
+
+    // The sessions must be destroyed in the thread in which they were created.
+    std::vector<Session::SessionId> session_ids;
+    for (const auto& session : sessions_.sessions())
+        session_ids.emplace_back(session.first);
+
+    for (const auto& session_id : session_ids)
+        removeSession(session_id);
+
+    LOG(LS_INFO) << "Server shard #" << index_ << " stopped";
+}
+
+void ServerShard::onNewConnection(std::unique_ptr<base::NetworkChannel> channel)
+{
+    LOG(LS_INFO) << "New connection: " << channel->peerAddress() << " (shard #" << index_ << ")";
+
+    channel->setOwnKeepAlive(true);
+    channel->setNoDelay(true);
+
+    if (authenticator_manager_)
+        authenticator_manager_->addNewChannel(std::move(channel));
+}
+
+void ServerShard::onNewSession(base::ServerAuthenticatorManager::SessionInfo&& session_info)
+{
+    std::u16string address = session_info.channel->peerAddress();
+    proto::RouterSession session_type =
+        static_cast<proto::RouterSession>(session_info.session_type);
+
+    LOG(LS_INFO) << "New session: " << sessionTypeToString(session_type) << " (" << address << ")";
+
+    std::unique_ptr<Session> session;
+
+    if (server_->isAddressAllowed(session_type, address))
+    {
+        switch (session_type)
+        {
+            case proto::ROUTER_SESSION_CLIENT:
+                session = std::make_unique<SessionClient>();
+                break;
+
+            case proto::ROUTER_SESSION_HOST:
+                session = std::make_unique<SessionHost>();
+                break;
+
+            case proto::ROUTER_SESSION_ADMIN:
+                session = std::make_unique<SessionAdmin>();
+                break;
+
+            case proto::ROUTER_SESSION_RELAY:
+                session = std::make_unique<SessionRelay>();
+                break;
+
+            default:
+            {
+                LOG(LS_ERROR) << "Unsupported session type: "
+                              << static_cast<int>(session_info.session_type);
+            }
+            break;
+        }
+    }
+
+    if (!session)
+    {
+        LOG(LS_ERROR) << "Connection rejected for '" << address << "'";
+        return;
+    }
+
+    session->setChannel(std::move(session_info.channel));
+    session->setDatabase(server_->database());
+    session->setShard(this);
+    session->setRelayKeyPool(server_->shareRelayKeyPool());
+    session->setVersion(session_info.version);
+    session->setOsName(session_info.os_name);
+    session->setComputerName(session_info.computer_name);
+
+    Session* added_session = sessions_.add(std::move(session));
+    server_->addSession(added_session->sessionId(), this);
+    added_session->start(this);
+
+    LOG(LS_INFO) << "Sessions of this type in shard #" << index_ << ": "
+                 << sessions_.sessionsByType(session_type).size()
+                 << " (total: " << sessions_.count() << ")";
+}
+
+void ServerShard::onSessionFinished(Session::SessionId session_id,
+                                    proto::RouterSession /* session_type */)
+{
+    // Delete a session from the list.
+    std::unique_ptr<Session> session = removeSession(session_id);
+
+    // Session will be destroyed after completion of the current call.
+    if (session)
+        task_runner_->deleteSoon(std::move(session));
+}
+
+void ServerShard::addSessionList(proto::SessionList* list) const
+{
+    for (const auto& entry : sessions_.sessions())
+    {
+        const Session* session = entry.second.get();
+        proto::Session* item = list->add_session();
+
+        item->set_session_id(session->sessionId());
+        item->set_session_type(session->sessionType());
+        item->set_timepoint(session->startTime());
+        item->set_ip_address(session->address());
+        item->mutable_version()->CopyFrom(session->version().toProto());
+        item->set_os_name(session->osName());
+        item->set_computer_name(session->computerName());
+
+        switch (session->sessionType())
+        {
+            case proto::ROUTER_SESSION_HOST:
+            {
+                proto::HostSessionData session_data;
+
+                for (const auto& host_id : static_cast<const SessionHost*>(session)->hostIdList())
+                    session_data.add_host_id(host_id);
+
+                item->set_session_data(session_data.SerializeAsString());
+            }
+            break;
+
+            case proto::ROUTER_SESSION_RELAY:
+            {
+                proto::RelaySessionData session_data;
+                session_data.set_pool_size(server_->relayKeyCount(session->sessionId()));
+
+                const proto::RelayStat* relay_stat =
+                    static_cast<const SessionRelay*>(session)->relayStat();
+                if (relay_stat)
+                    session_data.mutable_relay_stat()->CopyFrom(*relay_stat);
+                item->set_session_data(session_data.SerializeAsString());
+            }
+            break;
+
+            default:
+                break;
+        }
+    }
+}
+
+void ServerShard::sendSessionList(Session::SessionId requester_id,
+                                  const proto::SessionList& session_list)
+{
+    Session* session = sessions_.find(requester_id);
+    if (!session || session->sessionType() != proto::ROUTER_SESSION_ADMIN)
+        return;
+
+    static_cast<SessionAdmin*>(session)->sendSessionList(session_list);
+}
+
+void ServerShard::sendConnectionOfferImpl(std::shared_ptr<PendingOffer> pending_offer)
+{
+    bool delivered = false;
+
+    SessionHost* host = sessions_.findHost(pending_offer->host_id);
+    if (!host)
+    {
+        LOG(LS_WARNING) << "Host with id " << pending_offer->host_id << " NOT found in shard #"
+                        << index_;
+    }
+    else
+    {
+        host->sendConnectionOffer(pending_offer->offer);
+        delivered = true;
+    }
+
+    ServerShard* client_shard = pending_offer->client_shard;
+    if (client_shard == this)
+        connectionOfferResult(std::move(pending_offer), delivered);
+    else
+        client_shard->postConnectionOfferResult(std::move(pending_offer), delivered);
+}
+
+void ServerShard::connectionOfferResult(std::shared_ptr<PendingOffer> pending_offer,
+                                        bool delivered)
+{
+    // The key is returned to the pool even if the client has already disconnected.
+    if (delivered)
+        pending_offer->key_pool->useCredentials(pending_offer->credentials);
+    else
+        pending_offer->key_pool->returnCredentials(std::move(pending_offer->credentials));
+
+    Session* session = sessions_.find(pending_offer->client_id);
+    if (!session || session->sessionType() != proto::ROUTER_SESSION_CLIENT)
+        return;
+
+    static_cast<SessionClient*>(session)->onConnectionOfferResult(*pending_offer, delivered);
+}
+
+void ServerShard::sendKeyUsed(Session::SessionId session_id, uint32_t key_id)
+{
+    Session* session = sessions_.find(session_id);
+    if (!session || session->sessionType() != proto::ROUTER_SESSION_RELAY)
+        return;
+
+    static_cast<SessionRelay*>(session)->sendKeyUsed(key_id);
+}
+
+std::unique_ptr<Session> ServerShard::removeSession(Session::SessionId session_id)
+{
+    std::unique_ptr<Session> session = sessions_.remove(session_id);
+    if (!session)
+        return nullptr;
+
+    if (session->sessionType() == proto::ROUTER_SESSION_HOST)
+    {
+        for (const auto& host_id : static_cast<SessionHost*>(session.get())->hostIdList())
+            server_->removeHost(host_id, session_id);
+    }
+
+    server_->removeSession(session_id);
+    return session;
+}
+
+} // namespace router
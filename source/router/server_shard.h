@@ -0,0 +1,152 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef ROUTER__SERVER_SHARD_H
+#define ROUTER__SERVER_SHARD_H
+
+#include "base/net/network_server.h"
+#include "base/peer/host_id.h"
+#include "base/peer/server_authenticator_manager.h"
+#include "base/threading/thread.h"
+#include "proto/router_admin.pb.h"
+#include "proto/router_peer.pb.h"
+#include "router/session.h"
+#include "router/session_registry.h"
+#include "router/shared_key_pool.h"
+
+namespace router {
+
+class Server;
+class ServerShard;
+class SessionHost;
+
+// A connection offer from a client to a host that can be connected to any shard. The client
+// receives its offer only after the offer is delivered to the host. Until then the relay key is
+// neither used nor returned to the pool.
+struct PendingOffer
+{
+    base::HostId host_id = base::kInvalidHostId;
+
+    // The shard and the session of the client.
+    ServerShard* client_shard = nullptr;
+    Session::SessionId client_id = 0;
+
+    std::unique_ptr<SharedKeyPool> key_pool;
+    SharedKeyPool::Credentials credentials;
+
+    // The offer for the host.
+    proto::ConnectionOffer offer;
+};
+
+// Serves a part of the router connections on its own thread: authenticates them and owns the
+// sessions created for them. The server distributes new connections between several shards to
+// use all processor cores. The state shared by all shards (host IDs, relay keys, the database)
+// is kept by the server.
+class ServerShard
+    : public base::Thread::Delegate,
+      public base::NetworkServer::Delegate,
+      public base::ServerAuthenticatorManager::Delegate,
+      public Session::Delegate
+{
+public:
+    ServerShard(size_t index, const base::ByteArray& private_key, Server* server);
+    ~ServerShard();
+
+    void start();
+
+    size_t index() const { return index_; }
+    base::Thread* thread() const { return thread_.get(); }
+    std::shared_ptr<base::TaskRunner> taskRunner() const { return task_runner_; }
+
+    // The methods below are called by the sessions of the shard in the thread of the shard.
+
+    // Requests the list of sessions of all shards. The list is sent to the admin session
+    // |requester_id| when it is collected.
+    void requestSessionList(Session::SessionId requester_id);
+
+    // Stops the session with |session_id| in any shard. Returns false if there is no such session.
+    bool stopSession(Session::SessionId session_id);
+
+    void onHostSessionWithId(SessionHost* session, base::HostId host_id);
+    void onHostIdReset(SessionHost* session, base::HostId host_id);
+
+    // Returns true if a host with |host_id| is connected to any shard.
+    bool hasHost(base::HostId host_id) const;
+
+    // Sends a connection offer to the host in any shard. The result is passed to the client
+    // session of this shard with SessionClient::onConnectionOfferResult().
+    void sendConnectionOffer(std::shared_ptr<PendingOffer> pending_offer);
+
+    // Called when the host requested by the host session |session_id| is committed to the
+    // database. The task is posted to the shard by the session itself because the shard can be
+    // destroyed before the database calls it.
+    void onHostAdded(Session::SessionId session_id, const std::string& key, base::HostId host_id);
+
+    // The methods below are called by the server. They can be called from any thread, the work is
+    // done in the thread of the shard.
+
+    // Adds the sessions of the shard to |list| and calls |callback| in the thread of the shard.
+    using SessionListCallback = std::function<void(const proto::SessionList& list)>;
+    void collectSessionList(SessionListCallback callback);
+
+    void postSessionList(Session::SessionId requester_id,
+                         std::shared_ptr<proto::SessionList> session_list);
+    void postStopSession(Session::SessionId session_id);
+    void postConnectionOffer(std::shared_ptr<PendingOffer> pending_offer);
+    void postConnectionOfferResult(std::shared_ptr<PendingOffer> pending_offer, bool delivered);
+    void postKeyUsed(Session::SessionId session_id, uint32_t key_id);
+
+protected:
+    // base::Thread::Delegate implementation.
+    void onBeforeThreadRunning() override;
+    void onAfterThreadRunning() override;
+
+    // base::NetworkServer::Delegate implementation.
+    void onNewConnection(std::unique_ptr<base::NetworkChannel> channel) override;
+
+    // base::ServerAuthenticatorManager::Delegate implementation.
+    void onNewSession(base::ServerAuthenticatorManager::SessionInfo&& session_info) override;
+
+    // Session::Delegate implementation.
+    void onSessionFinished(Session::SessionId session_id,
+                           proto::RouterSession session_type) override;
+
+private:
+    void addSessionList(proto::SessionList* list) const;
+    void sendSessionList(Session::SessionId requester_id, const proto::SessionList& session_list);
+    void sendConnectionOfferImpl(std::shared_ptr<PendingOffer> pending_offer);
+    void connectionOfferResult(std::shared_ptr<PendingOffer> pending_offer, bool delivered);
+    void sendKeyUsed(Session::SessionId session_id, uint32_t key_id);
+    std::unique_ptr<Session> removeSession(Session::SessionId session_id);
+
+    const size_t index_;
+    const base::ByteArray private_key_;
+    Server* server_;
+
+    std::unique_ptr<base::Thread> thread_;
+    std::shared_ptr<base::TaskRunner> task_runner_;
+
+    std::unique_ptr<base::ServerAuthenticatorManager> authenticator_manager_;
+    SessionRegistry sessions_;
+
+    DISALLOW_COPY_AND_ASSIGN(ServerShard);
+};
+
+} // namespace router
+
+#endif // ROUTER__SERVER_SHARD_H
@@ -22,16 +22,17 @@
 #include "base/net/network_channel.h"
 #include "base/strings/unicode.h"
 #include "router/database.h"
-#include "router/database_factory.h"
 #include "router/shared_key_pool.h"
 
+#include <atomic>
+
 namespace router {
 
 Session::SessionId createSessionId()
 {
-    static Session::SessionId last_session_id = 0;
-    ++last_session_id;
-    return last_session_id;
+    // Sessions are created in different threads.
+    static std::atomic<Session::SessionId> last_session_id = 0;
+    return ++last_session_id;
 }
 
 Session::Session(proto::RouterSession session_type)
@@ -53,14 +54,14 @@ void Session::setRelayKeyPool(std::unique_ptr<SharedKeyPool> relay_key_pool)
     relay_key_pool_ = std::move(relay_key_pool);
 }
 
-void Session::setDatabaseFactory(std::shared_ptr<DatabaseFactory> database_factory)
+void Session::setDatabase(std::shared_ptr<Database> database)
 {
-    database_factory_ = std::move(database_factory);
+    database_ = std::move(database);
 }
 
-void Session::setServer(Server* server)
+void Session::setShard(ServerShard* shard)
 {
-    server_ = server;
+    shard_ = shard;
 }
 
 void Session::start(Delegate* delegate)
@@ -77,15 +78,15 @@ void Session::start(Delegate* delegate)
         return;
     }
 
-    if (!database_factory_)
+    if (!database_)
     {
-        LOG(LS_FATAL) << "Invalid database factory";
+        LOG(LS_FATAL) << "Invalid database";
         return;
     }
 
-    if (!server_)
+    if (!shard_)
     {
-        LOG(LS_FATAL) << "Invalid server";
+        LOG(LS_FATAL) << "Invalid shard";
         return;
     }
 
@@ -103,11 +104,6 @@ void Session::start(Delegate* delegate)
     onSessionReady();
 }
 
-std::unique_ptr<Database> Session::openDatabase() const
-{
-    return database_factory_->openDatabase();
-}
-
 void Session::setVersion(const base::Version& version)
 {
     version_ = version;
@@ -140,7 +136,15 @@ std::chrono::seconds Session::duration() const
 void Session::sendMessage(const google::protobuf::MessageLite& message)
 {
     if (channel_)
-        channel_->send(base::serialize(message));
+        channel_->send(message);
+}
+
+std::chrono::milliseconds Session::roundTripTime() const
+{
+    if (!channel_)
+        return std::chrono::milliseconds(0);
+
+    return channel_->roundTripTime();
 }
 
 void Session::onConnected()
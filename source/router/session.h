@@ -26,8 +26,7 @@
 namespace router {
 
 class Database;
-class DatabaseFactory;
-class Server;
+class ServerShard;
 class SharedKeyPool;
 
 class Session : public base::NetworkChannel::Listener
@@ -49,8 +48,8 @@ public:
 
     void setChannel(std::unique_ptr<base::NetworkChannel> channel);
     void setRelayKeyPool(std::unique_ptr<SharedKeyPool> relay_key_pool);
-    void setDatabaseFactory(std::shared_ptr<DatabaseFactory> database_factory);
-    void setServer(Server* server);
+    void setDatabase(std::shared_ptr<Database> database);
+    void setShard(ServerShard* shard);
 
     void start(Delegate* delegate);
 
@@ -71,7 +70,8 @@ public:
 
 protected:
     void sendMessage(const google::protobuf::MessageLite& message);
-    std::unique_ptr<Database> openDatabase() const;
+    std::chrono::milliseconds roundTripTime() const;
+    Database& database() { return *database_; }
 
     virtual void onSessionReady() = 0;
 
@@ -82,8 +82,9 @@ protected:
     SharedKeyPool& relayKeyPool() { return *relay_key_pool_; }
     const SharedKeyPool& relayKeyPool() const { return *relay_key_pool_; }
 
-    Server& server() { return *server_; }
-    const Server& server() const { return *server_; }
+    // The shard that owns the session. Sessions of other shards are available only through it.
+    ServerShard& shard() { return *shard_; }
+    const ServerShard& shard() const { return *shard_; }
 
 private:
     const proto::RouterSession session_type_;
@@ -91,9 +92,9 @@ private:
     time_t start_time_ = 0;
 
     std::unique_ptr<base::NetworkChannel> channel_;
-    std::shared_ptr<DatabaseFactory> database_factory_;
+    std::shared_ptr<Database> database_;
     std::unique_ptr<SharedKeyPool> relay_key_pool_;
-    Server* server_ = nullptr;
+    ServerShard* shard_ = nullptr;
 
     std::string address_;
     std::string username_;
@@ -23,7 +23,7 @@
 #include "base/net/network_channel.h"
 #include "base/peer/user.h"
 #include "router/database.h"
-#include "router/server.h"
+#include "router/server_shard.h"
 
 namespace router {
 
@@ -79,17 +79,10 @@ void SessionAdmin::onMessageWritten(size_t /* pending */)
 
 void SessionAdmin::doUserListRequest()
 {
-    std::unique_ptr<Database> database = openDatabase();
-    if (!database)
-    {
-        LOG(LS_ERROR) << "Failed to connect to database";
-        return;
-    }
-
     std::unique_ptr<proto::RouterToAdmin> message = std::make_unique<proto::RouterToAdmin>();
     proto::UserList* list = message->mutable_user_list();
 
-    std::vector<base::User> users = database->userList();
+    std::vector<base::User> users = database().userList();
     for (const auto& user : users)
         list->add_user()->CopyFrom(user.serialize());
 
@@ -124,17 +117,20 @@ void SessionAdmin::doUserRequest(const proto::UserRequest& request)
     sendMessage(*message);
 }
 
-void SessionAdmin::doSessionListRequest(const proto::SessionListRequest& /* request */)
+void SessionAdmin::sendSessionList(const proto::SessionList& session_list)
 {
     std::unique_ptr<proto::RouterToAdmin> message = std::make_unique<proto::RouterToAdmin>();
-
-    message->set_allocated_session_list(server().sessionList().release());
-    if (!message->has_session_list())
-        message->mutable_session_list()->set_error_code(proto::SessionList::UNKNOWN_ERROR);
-
+    message->mutable_session_list()->CopyFrom(session_list);
     sendMessage(*message);
 }
 
+void SessionAdmin::doSessionListRequest(const proto::SessionListRequest& /* request */)
+{
+    // The sessions are distributed between the shards. The list is sent in sendSessionList()
+    // when all shards have added their sessions.
+    shard().requestSessionList(sessionId());
+}
+
 void SessionAdmin::doSessionRequest(const proto::SessionRequest& request)
 {
     std::unique_ptr<proto::RouterToAdmin> message = std::make_unique<proto::RouterToAdmin>();
@@ -145,7 +141,7 @@ void SessionAdmin::doSessionRequest(const proto::SessionRequest& request)
     {
         Session::SessionId session_id = request.session_id();
 
-        if (!server().stopSession(session_id))
+        if (!shard().stopSession(session_id))
         {
             LOG(LS_WARNING) << "Session not found: " << session_id;
             session_result->set_error_code(proto::SessionResult::INVALID_SESSION_ID);
@@ -182,14 +178,7 @@ proto::UserResult::ErrorCode SessionAdmin::addUser(const proto::User& user)
         return proto::UserResult::INVALID_DATA;
     }
 
-    std::unique_ptr<Database> database = openDatabase();
-    if (!database)
-    {
-        LOG(LS_ERROR) << "Failed to connect to database";
-        return proto::UserResult::INTERNAL_ERROR;
-    }
-
-    if (!database->addUser(new_user))
+    if (!database().addUser(new_user))
         return proto::UserResult::INTERNAL_ERROR;
 
     return proto::UserResult::SUCCESS;
@@ -218,14 +207,7 @@ proto::UserResult::ErrorCode SessionAdmin::modifyUser(const proto::User& user)
         return proto::UserResult::INVALID_DATA;
     }
 
-    std::unique_ptr<Database> database = openDatabase();
-    if (!database)
-    {
-        LOG(LS_ERROR) << "Failed to connect to database";
-        return proto::UserResult::INTERNAL_ERROR;
-    }
-
-    if (!database->modifyUser(new_user))
+    if (!database().modifyUser(new_user))
         return proto::UserResult::INTERNAL_ERROR;
 
     return proto::UserResult::SUCCESS;
@@ -233,18 +215,11 @@ proto::UserResult::ErrorCode SessionAdmin::modifyUser(const proto::User& user)
 
 proto::UserResult::ErrorCode SessionAdmin::deleteUser(const proto::User& user)
 {
-    std::unique_ptr<Database> database = openDatabase();
-    if (!database)
-    {
-        LOG(LS_ERROR) << "Failed to connect to database";
-        return proto::UserResult::INTERNAL_ERROR;
-    }
-
     uint64_t entry_id = user.entry_id();
 
     LOG(LS_INFO) << "User remove request: " << entry_id;
 
-    if (!database->removeUser(entry_id))
+    if (!database().removeUser(entry_id))
         return proto::UserResult::INTERNAL_ERROR;
 
     return proto::UserResult::SUCCESS;
@@ -32,6 +32,8 @@ public:
     SessionAdmin();
     ~SessionAdmin();
 
+    void sendSessionList(const proto::SessionList& session_list);
+
 protected:
     // Session implementation.
     void onSessionReady() override;
@@ -21,9 +21,8 @@
 #include "base/logging.h"
 #include "base/crypto/random.h"
 #include "base/strings/unicode.h"
-#include "router/server.h"
-#include "router/session_host.h"
-#include "router/session_relay.h"
+#include "router/server_shard.h"
+#include "router/shared_key_pool.h"
 
 namespace router {
 
@@ -64,68 +63,81 @@ void SessionClient::onMessageWritten(size_t /* pending */)
     // Nothing
 }
 
-void SessionClient::readConnectionRequest(const proto::ConnectionRequest& request)
+void SessionClient::onConnectionOfferResult(const PendingOffer& pending_offer, bool delivered)
 {
-    LOG(LS_INFO) << "New connection request (host_id: " << request.host_id() << ")";
+    if (!delivered)
+    {
+        LOG(LS_WARNING) << "Host with id " << pending_offer.host_id << " disconnected";
+        sendConnectionOffer(proto::ConnectionOffer::PEER_NOT_FOUND);
+        return;
+    }
 
     std::unique_ptr<proto::RouterToPeer> message = std::make_unique<proto::RouterToPeer>();
     proto::ConnectionOffer* offer = message->mutable_connection_offer();
 
-    SessionHost* host = server().hostSessionById(request.host_id());
-    if (!host)
+    offer->CopyFrom(pending_offer.offer);
+    offer->set_peer_role(proto::ConnectionOffer::CLIENT);
+
+    LOG(LS_INFO) << "Sending connection offer to client";
+    sendMessage(*message);
+}
+
+void SessionClient::readConnectionRequest(const proto::ConnectionRequest& request)
+{
+    LOG(LS_INFO) << "New connection request (host_id: " << request.host_id() << ")";
+
+    if (!shard().hasHost(request.host_id()))
     {
         LOG(LS_WARNING) << "Host with id " << request.host_id() << " NOT found!";
-        offer->set_error_code(proto::ConnectionOffer::PEER_NOT_FOUND);
+        sendConnectionOffer(proto::ConnectionOffer::PEER_NOT_FOUND);
+        return;
     }
-    else
+
+    LOG(LS_INFO) << "Host with id " << request.host_id() << " found";
+
+    std::optional<SharedKeyPool::Credentials> credentials = relayKeyPool().takeCredentials();
+    if (!credentials.has_value())
     {
-        LOG(LS_INFO) << "Host with id " << request.host_id() << " found";
-
-        std::optional<SharedKeyPool::Credentials> credentials = relayKeyPool().takeCredentials();
-        if (!credentials.has_value())
-        {
-            LOG(LS_WARNING) << "Empty key pool";
-            offer->set_error_code(proto::ConnectionOffer::KEY_POOL_EMPTY);
-        }
-        else
-        {
-            SessionRelay* relay = static_cast<SessionRelay*>(
-                server().sessionById(credentials->session_id));
-            if (!relay)
-            {
-                LOG(LS_ERROR) << "No relay with session id " << credentials->session_id;
-                offer->set_error_code(proto::ConnectionOffer::KEY_POOL_EMPTY);
-            }
-            else
-            {
-                const std::optional<SessionRelay::PeerData>& peer_data = relay->peerData();
-                if (!peer_data.has_value())
-                {
-                    LOG(LS_ERROR) << "No peer data for relay with session id "
-                                  << credentials->session_id;
-                    offer->set_error_code(proto::ConnectionOffer::KEY_POOL_EMPTY);
-                }
-                else
-                {
-                    offer->set_error_code(proto::ConnectionOffer::SUCCESS);
-
-                    proto::RelayCredentials* offer_credentials = offer->mutable_relay();
-
-                    offer_credentials->set_host(relay->peerData()->first);
-                    offer_credentials->set_port(relay->peerData()->second);
-                    offer_credentials->mutable_key()->Swap(&credentials->key);
-                    offer_credentials->set_secret(base::Random::string(16));
-
-                    LOG(LS_INFO) << "Sending connection offer to host";
-                    offer->set_peer_role(proto::ConnectionOffer::HOST);
-                    host->sendConnectionOffer(*offer);
-                }
-            }
-        }
+        LOG(LS_WARNING) << "Empty key pool";
+        sendConnectionOffer(proto::ConnectionOffer::KEY_POOL_EMPTY);
+        return;
     }
 
-    LOG(LS_INFO) << "Sending connection offer to client";
+    std::shared_ptr<PendingOffer> pending_offer = std::make_shared<PendingOffer>();
+    pending_offer->host_id = request.host_id();
+    pending_offer->client_shard = &shard();
+    pending_offer->client_id = sessionId();
+    pending_offer->key_pool = relayKeyPool().share();
+
+    proto::ConnectionOffer* offer = &pending_offer->offer;
+    offer->set_error_code(proto::ConnectionOffer::SUCCESS);
+    offer->set_peer_role(proto::ConnectionOffer::HOST);
+
+    proto::RelayCredentials* offer_credentials = offer->mutable_relay();
+
+    offer_credentials->set_host(credentials->peer_data.first);
+    offer_credentials->set_port(credentials->peer_data.second);
+    offer_credentials->mutable_key()->CopyFrom(credentials->key);
+    offer_credentials->set_secret(base::Random::string(16));
+
+    // The key is returned to the pool if the offer can not be delivered.
+    pending_offer->credentials = std::move(*credentials);
+
+    // The host can be connected to another shard. In this case the offer is delivered to it
+    // asynchronously and the client receives its offer after that.
+    LOG(LS_INFO) << "Sending connection offer to host";
+    shard().sendConnectionOffer(std::move(pending_offer));
+}
+
+void SessionClient::sendConnectionOffer(proto::ConnectionOffer::ErrorCode error_code)
+{
+    std::unique_ptr<proto::RouterToPeer> message = std::make_unique<proto::RouterToPeer>();
+    proto::ConnectionOffer* offer = message->mutable_connection_offer();
+
+    offer->set_error_code(error_code);
     offer->set_peer_role(proto::ConnectionOffer::CLIENT);
+
+    LOG(LS_INFO) << "Sending connection offer to client";
     sendMessage(*message);
 }
 
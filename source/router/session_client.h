@@ -26,6 +26,7 @@ namespace router {
 
 class ServerProxy;
 class SharedKeyPool;
+struct PendingOffer;
 
 class SessionClient : public Session
 {
@@ -33,6 +34,9 @@ public:
     SessionClient();
     ~SessionClient();
 
+    // Sends the offer to the client after the offer has been delivered to the host (or not).
+    void onConnectionOfferResult(const PendingOffer& pending_offer, bool delivered);
+
 protected:
     // Session implementation.
     void onSessionReady() override;
@@ -43,6 +47,7 @@ protected:
 
 private:
     void readConnectionRequest(const proto::ConnectionRequest& request);
+    void sendConnectionOffer(proto::ConnectionOffer::ErrorCode error_code);
 
     DISALLOW_COPY_AND_ASSIGN(SessionClient);
 };
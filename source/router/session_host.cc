@@ -24,7 +24,7 @@
 #include "base/crypto/random.h"
 #include "base/net/network_channel.h"
 #include "router/database.h"
-#include "router/server.h"
+#include "router/server_shard.h"
 
 namespace router {
 
@@ -54,6 +54,23 @@ void SessionHost::sendConnectionOffer(const proto::ConnectionOffer& offer)
     sendMessage(*message);
 }
 
+void SessionHost::onHostAdded(const std::string& key, base::HostId host_id)
+{
+    if (host_id == base::kInvalidHostId)
+    {
+        LOG(LS_ERROR) << "Unable to add host";
+        return;
+    }
+
+    std::unique_ptr<proto::RouterToPeer> message = std::make_unique<proto::RouterToPeer>();
+    proto::HostIdResponse* host_id_response = message->mutable_host_id_response();
+
+    host_id_response->set_key(key);
+    assignHostId(host_id, host_id_response);
+
+    sendMessage(*message);
+}
+
 void SessionHost::onSessionReady()
 {
     // Nothing
@@ -89,60 +106,51 @@ void SessionHost::onMessageWritten(size_t /* pending */)
 
 void SessionHost::readHostIdRequest(const proto::HostIdRequest& host_id_request)
 {
-    std::unique_ptr<Database> database = openDatabase();
-    if (!database)
-    {
-        LOG(LS_ERROR) << "Failed to connect to database";
-        return;
-    }
-
-    std::unique_ptr<proto::RouterToPeer> message = std::make_unique<proto::RouterToPeer>();
-    proto::HostIdResponse* host_id_response = message->mutable_host_id_response();
-    base::ByteArray key_hash;
-
     if (host_id_request.type() == proto::HostIdRequest::NEW_ID)
     {
         // Generate new key.
         std::string key = base::Random::string(kHostKeySize);
 
         // Calculate hash for key.
-        key_hash = base::GenericHash::hash(base::GenericHash::Type::BLAKE2b512, key);
+        base::ByteArray key_hash =
+            base::GenericHash::hash(base::GenericHash::Type::BLAKE2b512, key);
 
-        if (!database->addHost(key_hash))
-        {
-            LOG(LS_ERROR) << "Unable to add host";
-            return;
-        }
+        // The key and the ID are sent to the host only after they are committed to the database.
+        // Otherwise, after a failure the ID could be given to another host.
+        std::shared_ptr<base::TaskRunner> task_runner = shard().taskRunner();
+        ServerShard* shard = &this->shard();
+        SessionId session_id = sessionId();
 
-        host_id_response->set_key(std::move(key));
-    }
-    else if (host_id_request.type() == proto::HostIdRequest::EXISTING_ID)
-    {
-        // Using existing key.
-        key_hash = base::GenericHash::hash(
-            base::GenericHash::Type::BLAKE2b512, host_id_request.key());
+        database().addHost(key_hash, [task_runner, shard, session_id, key](base::HostId host_id)
+        {
+            // If the shard is already stopped, then the task is discarded.
+            task_runner->postTask(
+                std::bind(&ServerShard::onHostAdded, shard, session_id, key, host_id));
+        });
+        return;
     }
-    else
+
+    if (host_id_request.type() != proto::HostIdRequest::EXISTING_ID)
     {
         LOG(LS_ERROR) << "Unknown request type: " << host_id_request.type();
         return;
     }
 
+    // Using existing key.
+    base::ByteArray key_hash = base::GenericHash::hash(
+        base::GenericHash::Type::BLAKE2b512, host_id_request.key());
+
+    std::unique_ptr<proto::RouterToPeer> message = std::make_unique<proto::RouterToPeer>();
+    proto::HostIdResponse* host_id_response = message->mutable_host_id_response();
     base::HostId host_id = base::kInvalidHostId;
 
-    switch (database->hostId(key_hash, &host_id))
+    switch (database().hostId(key_hash, &host_id))
     {
         case Database::ErrorCode::SUCCESS:
         {
             if (host_id != base::kInvalidHostId)
             {
-                host_id_response->set_error_code(proto::HostIdResponse::SUCCESS);
-                host_id_response->set_host_id(host_id);
-
-                host_id_list_.emplace_back(host_id);
-
-                // Notify the server that the ID has been assigned.
-                server().onHostSessionWithId(this);
+                assignHostId(host_id, host_id_response);
             }
             else
             {
@@ -164,6 +172,17 @@ void SessionHost::readHostIdRequest(const proto::HostIdRequest& host_id_request)
     sendMessage(*message);
 }
 
+void SessionHost::assignHostId(base::HostId host_id, proto::HostIdResponse* host_id_response)
+{
+    host_id_response->set_error_code(proto::HostIdResponse::SUCCESS);
+    host_id_response->set_host_id(host_id);
+
+    host_id_list_.emplace_back(host_id);
+
+    // Notify the shard that the ID has been assigned.
+    shard().onHostSessionWithId(this, host_id);
+}
+
 void SessionHost::readResetHostId(const proto::ResetHostId& reset_host_id)
 {
     base::HostId host_id = reset_host_id.host_id();
@@ -185,6 +204,8 @@ void SessionHost::readResetHostId(const proto::ResetHostId& reset_host_id)
         {
             LOG(LS_INFO) << "Host ID " << host_id << " remove from list";
             host_id_list_.erase(it);
+
+            shard().onHostIdReset(this, host_id);
             return;
         }
     }
@@ -40,6 +40,9 @@ public:
 
     void sendConnectionOffer(const proto::ConnectionOffer& offer);
 
+    // Sends |key| and |host_id| to the host after the new host is committed to the database.
+    void onHostAdded(const std::string& key, base::HostId host_id);
+
 protected:
     // Session implementation.
     void onSessionReady() override;
@@ -51,6 +54,7 @@ protected:
 private:
     void readHostIdRequest(const proto::HostIdRequest& host_id_request);
     void readResetHostId(const proto::ResetHostId& reset_host_id);
+    void assignHostId(base::HostId host_id, proto::HostIdResponse* host_id_response);
 
     HostIdList host_id_list_;
 
@@ -0,0 +1,118 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "router/session_registry.h"
+
+#include "base/logging.h"
+#include "router/session_host.h"
+
+namespace router {
+
+SessionRegistry::SessionRegistry() = default;
+
+SessionRegistry::~SessionRegistry() = default;
+
+Session* SessionRegistry::add(std::unique_ptr<Session> session)
+{
+    DCHECK(session);
+
+    Session* result = session.get();
+
+    types_[result->sessionType()].emplace(result);
+    sessions_.emplace(result->sessionId(), std::move(session));
+
+    if (result->sessionType() == proto::ROUTER_SESSION_HOST)
+    {
+        SessionHost* host_session = static_cast<SessionHost*>(result);
+
+        for (const auto& host_id : host_session->hostIdList())
+            addHostId(host_session, host_id);
+    }
+
+    return result;
+}
+
+std::unique_ptr<Session> SessionRegistry::remove(Session::SessionId session_id)
+{
+    auto it = sessions_.find(session_id);
+    if (it == sessions_.end())
+        return nullptr;
+
+    std::unique_ptr<Session> session = std::move(it->second);
+    sessions_.erase(it);
+
+    auto type = types_.find(session->sessionType());
+    if (type != types_.end())
+        type->second.erase(session.get());
+
+    if (session->sessionType() == proto::ROUTER_SESSION_HOST)
+    {
+        SessionHost* host_session = static_cast<SessionHost*>(session.get());
+
+        for (const auto& host_id : host_session->hostIdList())
+            removeHostId(host_session, host_id);
+    }
+
+    return session;
+}
+
+void SessionRegistry::addHostId(SessionHost* session, base::HostId host_id)
+{
+    hosts_[host_id] = session;
+}
+
+void SessionRegistry::removeHostId(SessionHost* session, base::HostId host_id)
+{
+    auto it = hosts_.find(host_id);
+
+    // The host ID could be taken by another session.
+    if (it != hosts_.end() && it->second == session)
+        hosts_.erase(it);
+}
+
+Session* SessionRegistry::find(Session::SessionId session_id) const
+{
+    auto it = sessions_.find(session_id);
+    if (it == sessions_.end())
+        return nullptr;
+
+    return it->second.get();
+}
+
+SessionHost* SessionRegistry::findHost(base::HostId host_id) const
+{
+    auto it = hosts_.find(host_id);
+    if (it == hosts_.end())
+        return nullptr;
+
+    return it->second;
+}
+
+const SessionRegistry::SessionSet& SessionRegistry::sessionsByType(
+    proto::RouterSession session_type) const
+{
+    static const SessionSet kEmptySet;
+
+    auto it = types_.find(session_type);
+    if (it == types_.end())
+        return kEmptySet;
+
+    return it->second;
+}
+
+} // namespace router
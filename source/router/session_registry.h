@@ -0,0 +1,73 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef ROUTER__SESSION_REGISTRY_H
+#define ROUTER__SESSION_REGISTRY_H
+
+#include "base/peer/host_id.h"
+#include "router/session.h"
+
+#include <unordered_map>
+#include <unordered_set>
+
+namespace router {
+
+class SessionHost;
+
+// Owns the router sessions and keeps indexes for fast lookup by session ID, host ID and session
+// type.
+class SessionRegistry
+{
+public:
+    SessionRegistry();
+    ~SessionRegistry();
+
+    using SessionSet = std::unordered_set<Session*>;
+    using SessionMap = std::unordered_map<Session::SessionId, std::unique_ptr<Session>>;
+
+    // Adds a session to the registry and returns a pointer to it.
+    Session* add(std::unique_ptr<Session> session);
+
+    // Removes a session from the registry and all indexes. Returns nullptr if the session is not
+    // found.
+    std::unique_ptr<Session> remove(Session::SessionId session_id);
+
+    // Adds or removes a host ID to the index of a host session.
+    void addHostId(SessionHost* session, base::HostId host_id);
+    void removeHostId(SessionHost* session, base::HostId host_id);
+
+    Session* find(Session::SessionId session_id) const;
+    SessionHost* findHost(base::HostId host_id) const;
+
+    // Returns all sessions of type |session_type|.
+    const SessionSet& sessionsByType(proto::RouterSession session_type) const;
+
+    const SessionMap& sessions() const { return sessions_; }
+    size_t count() const { return sessions_.size(); }
+
+private:
+    SessionMap sessions_;
+    std::unordered_map<base::HostId, SessionHost*> hosts_;
+    std::unordered_map<int, SessionSet> types_;
+
+    DISALLOW_COPY_AND_ASSIGN(SessionRegistry);
+};
+
+} // namespace router
+
+#endif // ROUTER__SESSION_REGISTRY_H
@@ -60,6 +60,10 @@ void SessionRelay::onMessageReceived(const base::ByteArray& buffer)
     {
         readKeyPool(message->key_pool());
     }
+    else if (message->has_relay_stat())
+    {
+        readRelayStat(message->relay_stat());
+    }
     else
     {
         LOG(LS_WARNING) << "Unhandled message from relay server";
@@ -81,7 +85,26 @@ void SessionRelay::readKeyPool(const proto::RelayKeyPool& key_pool)
         key_pool.peer_host(), static_cast<uint16_t>(key_pool.peer_port())));
 
     for (int i = 0; i < key_pool.key_size(); ++i)
-        pool.addKey(sessionId(), key_pool.key(i));
+        pool.addKey(sessionId(), *peer_data_, key_pool.key(i));
+}
+
+void SessionRelay::readRelayStat(const proto::RelayStat& relay_stat)
+{
+    LOG(LS_INFO) << "Received relay statistics (active sessions: " << relay_stat.active_sessions()
+                 << ", pending sessions: " << relay_stat.pending_sessions() << ")";
+
+    if (!relay_stat_)
+        relay_stat_ = std::make_unique<proto::RelayStat>();
+
+    relay_stat_->CopyFrom(relay_stat);
+
+    SharedKeyPool::RelayLoad load;
+    load.active_sessions = relay_stat.active_sessions();
+    load.pending_sessions = relay_stat.pending_sessions();
+    load.speed = relay_stat.speed();
+    load.rtt = roundTripTime();
+
+    relayKeyPool().setRelayLoad(sessionId(), load);
 }
 
 } // namespace router
@@ -31,9 +31,12 @@ public:
     SessionRelay();
     ~SessionRelay();
 
-    using PeerData = std::pair<std::string, uint16_t>;
+    using PeerData = SharedKeyPool::PeerData;
 
     const std::optional<PeerData>& peerData() const { return peer_data_; }
+
+    // Returns the last statistics received from the relay or nullptr if not received yet.
+    const proto::RelayStat* relayStat() const { return relay_stat_.get(); }
     void sendKeyUsed(uint32_t key_id);
 
 protected:
@@ -46,8 +49,10 @@ protected:
 
 private:
     void readKeyPool(const proto::RelayKeyPool& key_pool);
+    void readRelayStat(const proto::RelayStat& relay_stat);
 
     std::optional<PeerData> peer_data_;
+    std::unique_ptr<proto::RelayStat> relay_stat_;
 
     DISALLOW_COPY_AND_ASSIGN(SessionRelay);
 };
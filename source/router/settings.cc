@@ -52,6 +52,9 @@ void Settings::reset()
     setPort(DEFAULT_ROUTER_TCP_PORT);
     setPrivateKey(base::ByteArray());
     setMinLogLevel(1);
+    setHostIndexMemoryLimit(64);
+    setWorkerThreadCount(0);
+    setRelaySelectionPolicy("capacity");
     setClientWhiteList(WhiteList());
     setHostWhiteList(WhiteList());
     setAdminWhiteList(WhiteList());
@@ -93,6 +96,36 @@ int Settings::minLogLevel() const
     return impl_.get<int>("MinLogLevel", 1);
 }
 
+void Settings::setHostIndexMemoryLimit(uint32_t megabytes)
+{
+    impl_.set<uint32_t>("HostIndexMemoryLimit", megabytes);
+}
+
+uint32_t Settings::hostIndexMemoryLimit() const
+{
+    return impl_.get<uint32_t>("HostIndexMemoryLimit", 64);
+}
+
+void Settings::setWorkerThreadCount(uint32_t count)
+{
+    impl_.set<uint32_t>("WorkerThreads", count);
+}
+
+uint32_t Settings::workerThreadCount() const
+{
+    return impl_.get<uint32_t>("WorkerThreads", 0);
+}
+
+void Settings::setRelaySelectionPolicy(const std::string& policy)
+{
+    impl_.set<std::string>("RelaySelectionPolicy", policy);
+}
+
+std::string Settings::relaySelectionPolicy() const
+{
+    return impl_.get<std::string>("RelaySelectionPolicy", "capacity");
+}
+
 void Settings::setClientWhiteList(const std::vector<std::u16string>& list)
 {
     setWhiteList("ClientWhiteList", list);
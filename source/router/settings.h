@@ -43,6 +43,20 @@ public:
     void setMinLogLevel(int level);
     int minLogLevel() const;
 
+    // Memory limit (in megabytes) for the in-memory index of host keys. If the limit is exceeded,
+    // the hosts that did not fit are looked up in the database. 0 disables the index.
+    void setHostIndexMemoryLimit(uint32_t megabytes);
+    uint32_t hostIndexMemoryLimit() const;
+
+    // Number of threads serving the connections. 0 means the number of processor threads.
+    void setWorkerThreadCount(uint32_t count);
+    uint32_t workerThreadCount() const;
+
+    // Policy of relay selection for peer connections: "capacity" selects the relay with the most
+    // keys, "weighted" also takes into account the load of the relays and the round trip time.
+    void setRelaySelectionPolicy(const std::string& policy);
+    std::string relaySelectionPolicy() const;
+
     using WhiteList = std::vector<std::u16string>;
 
     void setClientWhiteList(const WhiteList& list);
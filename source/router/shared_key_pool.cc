@@ -20,20 +20,26 @@
 
 #include "base/logging.h"
 
-#include <map>
+#include <mutex>
+#include <unordered_map>
 
 namespace router {
 
 class SharedKeyPool::Impl
 {
 public:
-    explicit Impl(Delegate* delegate);
+    Impl(Delegate* delegate, std::unique_ptr<RelaySelectionPolicy> policy);
     ~Impl() = default;
 
     void dettach();
 
-    void addKey(Session::SessionId session_id, const proto::RelayKey& key);
+    void addKey(Session::SessionId session_id,
+                const PeerData& peer_data,
+                const proto::RelayKey& key);
+    void setRelayLoad(Session::SessionId session_id, const RelayLoad& load);
     std::optional<Credentials> takeCredentials();
+    void useCredentials(const Credentials& credentials);
+    void returnCredentials(Credentials credentials);
     void removeKeysForRelay(Session::SessionId session_id);
     void clear();
     size_t countForRelay(Session::SessionId session_id) const;
@@ -43,128 +49,212 @@ public:
 private:
     using Keys = std::vector<proto::RelayKey>;
 
-    std::map<Session::SessionId, Keys> pool_;
+    struct Relay
+    {
+        PeerData peer_data;
+        Keys keys;
+        RelayLoad load;
+    };
+
+    void updatePolicy(Session::SessionId session_id, const Relay& relay);
+
+    mutable std::mutex lock_;
+
+    // A relay stays in the map without keys to keep its load. Only relays with keys are passed to
+    // the policy.
+    std::unordered_map<Session::SessionId, Relay> pool_;
+    std::unique_ptr<RelaySelectionPolicy> policy_;
+    size_t key_count_ = 0;
     Delegate* delegate_;
 
     DISALLOW_COPY_AND_ASSIGN(Impl);
 };
 
-SharedKeyPool::Impl::Impl(Delegate* delegate)
-    : delegate_(delegate)
+SharedKeyPool::Impl::Impl(Delegate* delegate, std::unique_ptr<RelaySelectionPolicy> policy)
+    : policy_(std::move(policy)),
+      delegate_(delegate)
 {
     DCHECK(delegate_);
+
+    if (!policy_)
+        policy_ = RelaySelectionPolicy::create(RelaySelectionPolicy::Type::FREE_CAPACITY);
 }
 
 void SharedKeyPool::Impl::dettach()
 {
+    std::scoped_lock lock(lock_);
     delegate_ = nullptr;
 }
 
-void SharedKeyPool::Impl::addKey(Session::SessionId session_id, const proto::RelayKey& key)
+void SharedKeyPool::Impl::addKey(Session::SessionId session_id,
+                                 const PeerData& peer_data,
+                                 const proto::RelayKey& key)
 {
+    std::scoped_lock lock(lock_);
+
     auto relay = pool_.find(session_id);
     if (relay == pool_.end())
     {
         LOG(LS_INFO) << "Host not found in pool. It will be added";
-        relay = pool_.emplace(session_id, Keys()).first;
+        relay = pool_.emplace(session_id, Relay()).first;
     }
 
     LOG(LS_INFO) << "Added key with id " << key.key_id() << " for host '" << session_id << "'";
-    relay->second.emplace_back(std::move(key));
+    relay->second.peer_data = peer_data;
+    relay->second.keys.emplace_back(key);
+    ++key_count_;
+
+    updatePolicy(session_id, relay->second);
 }
 
-std::optional<SharedKeyPool::Credentials> SharedKeyPool::Impl::takeCredentials()
+void SharedKeyPool::Impl::setRelayLoad(Session::SessionId session_id, const RelayLoad& load)
 {
-    if (pool_.empty())
-    {
-        LOG(LS_WARNING) << "Empty key pool";
-        return std::nullopt;
-    }
+    std::scoped_lock lock(lock_);
 
-    auto preffered_relay = pool_.end();
-    size_t max_count = 0;
+    Relay& relay = pool_[session_id];
+    relay.load = load;
 
-    for (auto it = pool_.begin(); it != pool_.end(); ++it)
-    {
-        size_t count = it->second.size();
-        if (count > max_count)
-        {
-            preffered_relay = it;
-            max_count = count;
-        }
-    }
+    if (!relay.keys.empty())
+        updatePolicy(session_id, relay);
+}
 
-    if (preffered_relay == pool_.end())
+std::optional<SharedKeyPool::Credentials> SharedKeyPool::Impl::takeCredentials()
+{
+    std::scoped_lock lock(lock_);
+
+    std::optional<Session::SessionId> preffered_relay = policy_->selectRelay();
+    if (!preffered_relay.has_value())
     {
         LOG(LS_WARNING) << "Empty key pool";
         return std::nullopt;
     }
 
-    LOG(LS_INFO) << "Preffered relay: " << preffered_relay->first;
+    LOG(LS_INFO) << "Preffered relay: " << *preffered_relay;
 
-    if (preffered_relay->second.empty())
+    auto relay = pool_.find(*preffered_relay);
+    if (relay == pool_.end() || relay->second.keys.empty())
     {
         LOG(LS_ERROR) << "Empty key pool for relay";
+        policy_->removeRelay(*preffered_relay);
         return std::nullopt;
     }
 
+    Keys& keys = relay->second.keys;
+
     Credentials credentials;
-    credentials.session_id = preffered_relay->first;
-    credentials.key = std::move(preffered_relay->second.back());
+    credentials.session_id = relay->first;
+    credentials.peer_data = relay->second.peer_data;
+    credentials.key = std::move(keys.back());
 
     // Removing the key from the pool.
-    preffered_relay->second.pop_back();
+    keys.pop_back();
+    --key_count_;
+
+    if (keys.empty())
+        LOG(LS_INFO) << "Last key in the pool for relay. The relay will not be selected";
+
+    updatePolicy(relay->first, relay->second);
+    return credentials;
+}
+
+void SharedKeyPool::Impl::useCredentials(const Credentials& credentials)
+{
+    Delegate* delegate;
 
-    if (preffered_relay->second.empty())
     {
-        LOG(LS_INFO) << "Last key in the pool for relay. The relay will be removed from the pool";
-        pool_.erase(preffered_relay->first);
+        std::scoped_lock lock(lock_);
+        delegate = delegate_;
     }
 
-    if (delegate_)
-        delegate_->onPoolKeyUsed(credentials.session_id, credentials.key.key_id());
+    // The delegate is called without the lock, because it can call the pool methods.
+    if (delegate)
+        delegate->onPoolKeyUsed(credentials.session_id, credentials.key.key_id());
+}
 
-    return credentials;
+void SharedKeyPool::Impl::returnCredentials(Credentials credentials)
+{
+    std::scoped_lock lock(lock_);
+
+    auto relay = pool_.find(credentials.session_id);
+    if (relay == pool_.end())
+    {
+        LOG(LS_INFO) << "Relay '" << credentials.session_id << "' not found. Key with id "
+                     << credentials.key.key_id() << " dropped";
+        return;
+    }
+
+    LOG(LS_INFO) << "Key with id " << credentials.key.key_id() << " returned to the pool";
+    relay->second.keys.emplace_back(std::move(credentials.key));
+    ++key_count_;
+
+    updatePolicy(relay->first, relay->second);
 }
 
 void SharedKeyPool::Impl::removeKeysForRelay(Session::SessionId session_id)
 {
+    std::scoped_lock lock(lock_);
+
     LOG(LS_INFO) << "All keys for relay '" << session_id << "' removed";
-    pool_.erase(session_id);
+
+    auto relay = pool_.find(session_id);
+    if (relay == pool_.end())
+        return;
+
+    key_count_ -= relay->second.keys.size();
+    pool_.erase(relay);
+    policy_->removeRelay(session_id);
 }
 
 void SharedKeyPool::Impl::clear()
 {
+    std::scoped_lock lock(lock_);
+
     LOG(LS_INFO) << "Key pool cleared";
     pool_.clear();
+    policy_->clear();
+    key_count_ = 0;
 }
 
 size_t SharedKeyPool::Impl::countForRelay(Session::SessionId session_id) const
 {
+    std::scoped_lock lock(lock_);
+
     auto result = pool_.find(session_id);
     if (result == pool_.end())
         return 0;
 
-    return result->second.size();
+    return result->second.keys.size();
 }
 
 size_t SharedKeyPool::Impl::count() const
 {
-    size_t result = 0;
-
-    for (const auto& relay : pool_)
-        result += relay.second.size();
-
-    return result;
+    std::scoped_lock lock(lock_);
+    return key_count_;
 }
 
 bool SharedKeyPool::Impl::isEmpty() const
 {
-    return pool_.empty();
+    std::scoped_lock lock(lock_);
+    return key_count_ == 0;
 }
 
-SharedKeyPool::SharedKeyPool(Delegate* delegate)
-    : impl_(std::make_shared<Impl>(delegate)),
+void SharedKeyPool::Impl::updatePolicy(Session::SessionId session_id, const Relay& relay)
+{
+    if (relay.keys.empty())
+    {
+        policy_->removeRelay(session_id);
+        return;
+    }
+
+    RelaySelectionPolicy::RelayState state;
+    state.key_count = relay.keys.size();
+    state.load = relay.load;
+
+    policy_->updateRelay(session_id, state);
+}
+
+SharedKeyPool::SharedKeyPool(Delegate* delegate, std::unique_ptr<RelaySelectionPolicy> policy)
+    : impl_(std::make_shared<Impl>(delegate, std::move(policy))),
       is_primary_(true)
 {
     // Nothing
@@ -188,9 +278,16 @@ std::unique_ptr<SharedKeyPool> SharedKeyPool::share()
     return std::unique_ptr<SharedKeyPool>(new SharedKeyPool(impl_));
 }
 
-void SharedKeyPool::addKey(Session::SessionId session_id, const proto::RelayKey& key)
+void SharedKeyPool::addKey(Session::SessionId session_id,
+                           const PeerData& peer_data,
+                           const proto::RelayKey& key)
+{
+    impl_->addKey(session_id, peer_data, key);
+}
+
+void SharedKeyPool::setRelayLoad(Session::SessionId session_id, const RelayLoad& load)
 {
-    impl_->addKey(session_id, key);
+    impl_->setRelayLoad(session_id, load);
 }
 
 std::optional<SharedKeyPool::Credentials> SharedKeyPool::takeCredentials()
@@ -198,6 +295,16 @@ std::optional<SharedKeyPool::Credentials> SharedKeyPool::takeCredentials()
     return impl_->takeCredentials();
 }
 
+void SharedKeyPool::useCredentials(const Credentials& credentials)
+{
+    impl_->useCredentials(credentials);
+}
+
+void SharedKeyPool::returnCredentials(Credentials credentials)
+{
+    impl_->returnCredentials(std::move(credentials));
+}
+
 void SharedKeyPool::removeKeysForRelay(Session::SessionId session_id)
 {
     impl_->removeKeysForRelay(session_id);
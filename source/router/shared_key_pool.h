@@ -21,6 +21,7 @@
 
 #include "base/macros_magic.h"
 #include "proto/router_common.pb.h"
+#include "router/relay_selection_policy.h"
 #include "router/session.h"
 
 #include <cstdint>
@@ -29,6 +30,7 @@
 
 namespace router {
 
+// The pool is shared between the threads of the router. All methods are thread-safe.
 class SharedKeyPool
 {
 public:
@@ -40,19 +42,42 @@ public:
         virtual void onPoolKeyUsed(Session::SessionId session_id, uint32_t key_id) = 0;
     };
 
-    explicit SharedKeyPool(Delegate* delegate);
+    // If |policy| is not specified, the relay with the most keys is selected.
+    explicit SharedKeyPool(Delegate* delegate,
+                           std::unique_ptr<RelaySelectionPolicy> policy = nullptr);
     ~SharedKeyPool();
 
     std::unique_ptr<SharedKeyPool> share();
 
+    // Address and port of the relay for peers.
+    using PeerData = std::pair<std::string, uint16_t>;
+
     struct Credentials
     {
         Session::SessionId session_id;
+        PeerData peer_data;
         proto::RelayKey key;
     };
 
-    void addKey(Session::SessionId session_id, const proto::RelayKey& key);
+    void addKey(Session::SessionId session_id,
+                const PeerData& peer_data,
+                const proto::RelayKey& key);
+
+    using RelayLoad = RelaySelectionPolicy::RelayLoad;
+
+    // Updates the load of the relay. The load is used by the relay selection policy.
+    void setRelayLoad(Session::SessionId session_id, const RelayLoad& load);
+
+    // Takes a key of the relay selected by the policy. The key must be either used or returned.
     std::optional<Credentials> takeCredentials();
+
+    // Notifies the relay that the key of |credentials| is given to the peers.
+    void useCredentials(const Credentials& credentials);
+
+    // Returns the key of |credentials| to the pool if the peers have not received it. If the relay
+    // is already removed, the key is dropped.
+    void returnCredentials(Credentials credentials);
+
     void removeKeysForRelay(Session::SessionId session_id);
     void clear();
     size_t countForRelay(Session::SessionId session_id) const;
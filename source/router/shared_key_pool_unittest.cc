@@ -0,0 +1,121 @@
+//
+// Aspia Project
+// Copyright (C) 2020 Dmitry Chapyshev <dmitry@aspia.ru>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "router/shared_key_pool.h"
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace router {
+
+namespace {
+
+const Session::SessionId kRelayId = 1;
+
+class TestDelegate : public SharedKeyPool::Delegate
+{
+public:
+    TestDelegate() = default;
+    ~TestDelegate() override = default;
+
+    const std::vector<uint32_t>& usedKeys() const { return used_keys_; }
+
+    void onPoolKeyUsed(Session::SessionId session_id, uint32_t key_id) override
+    {
+        EXPECT_EQ(session_id, kRelayId);
+        used_keys_.emplace_back(key_id);
+    }
+
+private:
+    std::vector<uint32_t> used_keys_;
+
+    DISALLOW_COPY_AND_ASSIGN(TestDelegate);
+};
+
+proto::RelayKey relayKey(uint32_t key_id)
+{
+    proto::RelayKey key;
+    key.set_key_id(key_id);
+    return key;
+}
+
+} // namespace
+
+TEST(shared_key_pool_test, use_credentials)
+{
+    TestDelegate delegate;
+    SharedKeyPool pool(&delegate);
+
+    pool.addKey(kRelayId, SharedKeyPool::PeerData("127.0.0.1", 8000), relayKey(10));
+    EXPECT_EQ(pool.count(), 1);
+
+    std::optional<SharedKeyPool::Credentials> credentials = pool.takeCredentials();
+    ASSERT_TRUE(credentials.has_value());
+    EXPECT_EQ(credentials->session_id, kRelayId);
+    EXPECT_EQ(credentials->key.key_id(), 10);
+    EXPECT_TRUE(pool.isEmpty());
+
+    // The relay is notified only when the key is given to the peers.
+    EXPECT_TRUE(delegate.usedKeys().empty());
+
+    pool.useCredentials(*credentials);
+    ASSERT_EQ(delegate.usedKeys().size(), 1);
+    EXPECT_EQ(delegate.usedKeys().front(), 10);
+    EXPECT_TRUE(pool.isEmpty());
+}
+
+TEST(shared_key_pool_test, return_credentials)
+{
+    TestDelegate delegate;
+    SharedKeyPool pool(&delegate);
+
+    pool.addKey(kRelayId, SharedKeyPool::PeerData("127.0.0.1", 8000), relayKey(10));
+
+    std::optional<SharedKeyPool::Credentials> credentials = pool.takeCredentials();
+    ASSERT_TRUE(credentials.has_value());
+    EXPECT_FALSE(pool.takeCredentials().has_value());
+
+    pool.returnCredentials(std::move(*credentials));
+    EXPECT_EQ(pool.countForRelay(kRelayId), 1);
+    EXPECT_TRUE(delegate.usedKeys().empty());
+
+    // The returned key can be taken again.
+    credentials = pool.takeCredentials();
+    ASSERT_TRUE(credentials.has_value());
+    EXPECT_EQ(credentials->key.key_id(), 10);
+}
+
+TEST(shared_key_pool_test, return_credentials_of_removed_relay)
+{
+    TestDelegate delegate;
+    SharedKeyPool pool(&delegate);
+
+    pool.addKey(kRelayId, SharedKeyPool::PeerData("127.0.0.1", 8000), relayKey(10));
+
+    std::optional<SharedKeyPool::Credentials> credentials = pool.takeCredentials();
+    ASSERT_TRUE(credentials.has_value());
+
+    // The key of a disconnected relay is dropped.
+    pool.removeKeysForRelay(kRelayId);
+    pool.returnCredentials(std::move(*credentials));
+    EXPECT_TRUE(pool.isEmpty());
+    EXPECT_FALSE(pool.takeCredentials().has_value());
+}
+
+} // namespace router